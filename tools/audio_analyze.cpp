@@ -0,0 +1,259 @@
+/*
+ * Runs the sound reactive analysis (wled00/audio_analysis.h) on a WAV file on the host.
+ * Prints one CSV line per FFT frame with volume, AGC, peaks, beat tracking and the 16 result bands
+ * to stdout and the analysis time per frame to stderr. Useful for checking changes of the AGC or
+ * the band mapping against recordings, and for comparing the cost of window and hop sizes.
+ *
+ * Build:  g++ -O2 -std=c++11 -o audio_analyze tools/audio_analyze.cpp
+ * Usage:  ./audio_analyze [options] file.wav > frames.csv
+ *         ./audio_analyze [options] --tone HZ [--amp A] [--amp2 A] > frames.csv
+ *   --fft N          FFT size, power of 2 (512)
+ *   --hop N          new samples per FFT (256)
+ *   --rate N         sample rate of the analysis, the file is resampled to it (10240)
+ *   --analog         scale samples like the 10 bit analog input instead of the I2S microphone
+ *   --squelch N      soundSquelch (10)
+ *   --gain N         sampleGain (1)
+ *   --bands N        soundBands (8-64, default 0 = off)
+ *   --loop N         emulated loop() period in ms for getSample()/agcAvg() (2)
+ *   --peak-bin N     binNum of the legacy peak detection (64)
+ *   --peak-vol N     maxVol of the legacy peak detection (64)
+ *   --tone HZ        analyze a 10 s sine instead of a file, 16 bit amplitude --amp (4000),
+ *                    changing to --amp2 after 5 s (same)
+ *   --expect-agc MIN MAX   exit with 2 unless the mean sampleAgc of the last 2 s of the input and the
+ *                    mean of the 2 s before the amplitude change (if any) are within MIN-MAX
+ *
+ * Only 16 bit PCM WAV files are supported, multiple channels are mixed down.
+ *
+ * AGC regression check, a steady tone settles at targetAgc (60), also after a level step down or up:
+ *   ./audio_analyze --tone 440 --amp 4000 --expect-agc 50 70 > /dev/null
+ *   ./audio_analyze --tone 440 --amp 8000 --amp2 1000 --expect-agc 50 70 > /dev/null
+ *   ./audio_analyze --tone 440 --amp 1000 --amp2 8000 --expect-agc 50 70 > /dev/null
+ *   ./audio_analyze --analog --tone 440 --amp 4000 --expect-agc 50 70 > /dev/null
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+
+#include "../wled00/audio_analysis.h"
+
+// WAV file resampled to the analysis rate and scaled like the firmware inputs
+class WavSource : public AudioSource {
+  public:
+  bool load(const char* path, uint32_t rate, bool analog) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    std::vector<uint8_t> file;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) file.insert(file.end(), buf, buf + n);
+    fclose(f);
+
+    if (file.size() < 12 || memcmp(&file[0], "RIFF", 4) || memcmp(&file[8], "WAVE", 4)) return false;
+    uint16_t channels = 0, bits = 0, format = 0;
+    uint32_t fileRate = 0;
+    const uint8_t* data = nullptr;
+    uint32_t dataLen = 0;
+    for (size_t pos = 12; pos + 8 <= file.size(); ) {
+      uint32_t len = get32(&file[pos + 4]);
+      if (pos + 8 + len > file.size()) len = file.size() - pos - 8;
+      if (!memcmp(&file[pos], "fmt ", 4) && len >= 16) {
+        format   = get16(&file[pos + 8]);
+        channels = get16(&file[pos + 10]);
+        fileRate = get32(&file[pos + 12]);
+        bits     = get16(&file[pos + 22]);
+      } else if (!memcmp(&file[pos], "data", 4)) {
+        data = &file[pos + 8];
+        dataLen = len;
+      }
+      pos += 8 + len + (len & 1);
+    }
+    if (format != 1 || bits != 16 || channels == 0 || fileRate == 0 || !data) {
+      fprintf(stderr, "only 16 bit PCM WAV files are supported\n");
+      return false;
+    }
+
+    std::vector<float> mono(dataLen / (2 * channels));
+    for (size_t i = 0; i < mono.size(); i++) {
+      float sum = 0;
+      for (uint16_t c = 0; c < channels; c++) sum += (int16_t)get16(data + 2 * (i * channels + c));
+      mono[i] = sum / channels;
+    }
+
+    // linear resampling, then the same scaling as the firmware inputs
+    size_t count = (size_t)((double)mono.size() * rate / fileRate);
+    _samples.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      double t = (double)i * fileRate / rate;
+      size_t k = (size_t)t;
+      float frac = t - k;
+      float v = (k + 1 < mono.size()) ? mono[k] + frac * (mono[k + 1] - mono[k]) : mono[k];
+      _samples[i] = scale(v, analog);
+    }
+    _pos = 0;
+    return true;
+  }
+
+  // seconds of a sine at the analysis rate, amplitude amp for the first half and amp2 for the second
+  void tone(uint32_t rate, float hz, float amp, float amp2, float seconds, bool analog) {
+    _samples.resize((size_t)(seconds * rate));
+    for (size_t i = 0; i < _samples.size(); i++) {
+      float a = (i < _samples.size() / 2) ? amp : amp2;
+      _samples[i] = scale(a * sinf(2.0f * (float)M_PI * hz * i / rate), analog);
+    }
+    _pos = 0;
+  }
+
+  uint16_t read(float* dst, uint16_t count) override {
+    if (_pos >= _samples.size()) return 0;
+    if (count > _samples.size() - _pos) count = _samples.size() - _pos;
+    memcpy(dst, &_samples[_pos], sizeof(float) * count);
+    _pos += count;
+    return count;
+  }
+
+  // raw sample at index (for the emulated loop)
+  inline float at(size_t i) { return (i < _samples.size()) ? _samples[i] : 0; }
+  inline size_t position() { return _pos; }
+  inline size_t length() { return _samples.size(); }
+
+  private:
+  std::vector<float> _samples;
+  size_t _pos = 0;
+
+  static float scale(float v, bool analog) { return analog ? 512.0f + v / 64.0f : fabsf(v); } // 10 bit ADC around mid scale, or abs(i2s >> 16)
+  static uint16_t get16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+  static uint32_t get32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+};
+
+// the analysis clock: time of the newest sample read
+static WavSource wav;
+static uint32_t rate = 10240;
+static uint32_t wavClock() {
+  return (uint64_t)wav.position() * 1000 / rate;
+}
+
+// sampleAgc averaged over a time window
+struct AgcWindow {
+  uint32_t from, to;
+  double sum = 0;
+  uint32_t n = 0;
+  AgcWindow(uint32_t from, uint32_t to) : from(from), to(to) {}
+  void add(uint32_t ms, int agc) { if (ms >= from && ms < to) { sum += agc; n++; } }
+  double mean() const { return n ? sum / n : -1; }
+};
+
+int main(int argc, char** argv) {
+  uint32_t fftSize = 512, hop = 256, loopMs = 2, peakBin = 64, peakVol = 64;
+  bool analog = false;
+  AudioConfig cfg;
+  const char* path = nullptr;
+  float toneHz = 0, amp = 4000, amp2 = -1;
+  int agcMin = -1, agcMax = -1;
+
+  for (int i = 1; i < argc; i++) {
+    const char* a = argv[i];
+    bool hasValue = (i + 1 < argc);
+    if      (!strcmp(a, "--fft")      && hasValue) fftSize = atoi(argv[++i]);
+    else if (!strcmp(a, "--hop")      && hasValue) hop = atoi(argv[++i]);
+    else if (!strcmp(a, "--rate")     && hasValue) rate = atoi(argv[++i]);
+    else if (!strcmp(a, "--squelch")  && hasValue) cfg.squelch = atoi(argv[++i]);
+    else if (!strcmp(a, "--gain")     && hasValue) cfg.gain = atoi(argv[++i]);
+    else if (!strcmp(a, "--bands")    && hasValue) cfg.bands = atoi(argv[++i]);
+    else if (!strcmp(a, "--loop")     && hasValue) loopMs = atoi(argv[++i]);
+    else if (!strcmp(a, "--peak-bin") && hasValue) peakBin = atoi(argv[++i]);
+    else if (!strcmp(a, "--peak-vol") && hasValue) peakVol = atoi(argv[++i]);
+    else if (!strcmp(a, "--tone")     && hasValue) toneHz = atof(argv[++i]);
+    else if (!strcmp(a, "--amp")      && hasValue) amp = atof(argv[++i]);
+    else if (!strcmp(a, "--amp2")     && hasValue) amp2 = atof(argv[++i]);
+    else if (!strcmp(a, "--expect-agc") && i + 2 < argc) { agcMin = atoi(argv[++i]); agcMax = atoi(argv[++i]); }
+    else if (!strcmp(a, "--analog")) analog = true;
+    else if (a[0] != '-') path = a;
+    else {
+      fprintf(stderr, "unknown option %s\n", a);
+      return 1;
+    }
+  }
+  if ((!path && toneHz <= 0) || loopMs == 0 || peakBin >= AUDIO_FRAME_BINS || rate == 0) {
+    fprintf(stderr, "usage: %s [--fft N] [--hop N] [--rate N] [--analog] [--squelch N] [--gain N] [--bands N] [--loop ms] [--peak-bin N] [--peak-vol N] [--expect-agc MIN MAX] file.wav | --tone HZ [--amp A] [--amp2 A]\n", argv[0]);
+    return 1;
+  }
+
+  if (toneHz > 0) {
+    wav.tone(rate, toneHz, amp, amp2 < 0 ? amp : amp2, 10, analog);
+  } else if (!wav.load(path, rate, analog)) {
+    fprintf(stderr, "cannot read %s\n", path);
+    return 1;
+  }
+  uint32_t lengthMs = (uint64_t)wav.length() * 1000 / rate;
+  AgcWindow settled(lengthMs > 2000 ? lengthMs - 2000 : 0, lengthMs);      // end of the input
+  AgcWindow beforeStep(lengthMs / 2 > 2000 ? lengthMs / 2 - 2000 : 0, lengthMs / 2); // before --amp2
+  AudioAnalyzer analyzer;
+  if (!analyzer.begin(rate, fftSize, hop)) {
+    fprintf(stderr, "invalid FFT size %u / hop %u\n", fftSize, hop);
+    return 1;
+  }
+
+  AudioFrame frame;
+  memset(&frame, 0, sizeof(frame));
+  AudioVolume volume;
+  uint32_t frames = 0, peaks = 0;
+  double totalUs = 0, maxUs = 0;
+  uint32_t nextLoop = 0, lastPeak = 0, lastBeats = 0;
+
+  printf("frame,ms,sample,sampleAvg,sampleAgc,peak,majorPeak,magnitude,bpm,beatPhase,beat");
+  for (int i = 0; i < 16; i++) printf(",r%d", i);
+  printf("\n");
+
+  for (;;) {
+    auto start = std::chrono::steady_clock::now();
+    if (!analyzer.process(wav, &frame, cfg, wavClock)) break;
+    uint32_t ms = frame.time;
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    totalUs += us;
+    if (us > maxUs) maxUs = us;
+    frames++;
+
+    // loop() as it would have run while these samples came in: volume on the newest raw sample
+    for (; nextLoop < ms; nextLoop += loopMs) {
+      volume.update((int)wav.at((uint64_t)nextLoop * rate / 1000), cfg);
+      volume.agc(cfg);
+    }
+
+    // legacy peak detection of getSample() (100 ms holdoff)
+    bool peak = (frame.fftBin[peakBin] > peakVol && ms > lastPeak + 100);
+    if (peak) { lastPeak = ms; peaks++; }
+    bool beat = (frame.beatCount != lastBeats);
+    lastBeats = frame.beatCount;
+
+    printf("%u,%u,%d,%.2f,%d,%d,%.1f,%.0f,%.1f,%.2f,%d", frames, ms, volume.sample, volume.sampleAvg, volume.sampleAgc,
+           peak, frame.majorPeak, frame.magnitude, frame.beatBpm, frame.beatPhase, beat);
+    settled.add(ms, volume.sampleAgc);
+    beforeStep.add(ms, volume.sampleAgc);
+    for (int i = 0; i < 16; i++) printf(",%d", frame.fftResult[i]);
+    printf("\n");
+  }
+
+  if (frames) {
+    double audioMs = (double)frames * hop * 1000 / rate;
+    fprintf(stderr, "fft %u hop %u rate %u: %u frames, %u legacy peaks, %u beats, %.0f bpm\n",
+            fftSize, hop, rate, frames, peaks, frame.beatCount, frame.beatBpm);
+    fprintf(stderr, "analysis %.1f us/frame avg, %.1f us max, %.3f%% of real time (host)\n",
+            totalUs / frames, maxUs, 100.0 * totalUs / 1000.0 / audioMs);
+  }
+
+  if (agcMin >= 0) {
+    bool step = (toneHz > 0 && amp2 >= 0);
+    bool ok = settled.mean() >= agcMin && settled.mean() <= agcMax;
+    if (step) ok = ok && beforeStep.mean() >= agcMin && beforeStep.mean() <= agcMax;
+    fprintf(stderr, "sampleAgc mean %.1f at the end", settled.mean());
+    if (step) fprintf(stderr, ", %.1f before the step", beforeStep.mean());
+    fprintf(stderr, ", expected %d-%d: %s\n", agcMin, agcMax, ok ? "ok" : "FAILED");
+    if (!ok) return 2;
+  }
+  return 0;
+}
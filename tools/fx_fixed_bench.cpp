@@ -0,0 +1,97 @@
+/*
+ * Compares the float and the fixed point (WLED_FX_FIXED_POINT) variants of the effects in FX.cpp
+ * that still have both, and times them. Since the particle effects moved to the fixed point
+ * particle engine (see tools/particle_bench.cpp for their comparison with the old float code)
+ * this is the 2D Julia set. Both variants are built from wled00/fx_julia.h, which mode_2DJulia()
+ * runs, writing the palette index instead of the pixel color, so the difference is shown in palette
+ * steps (0-255). Every combination of frame time, intensity and zoom below is rendered by both variants.
+ * Exits with 2 if the difference exceeds the limits below. Points close to the set escape after a
+ * different number of iterations with a few bits less precision, so single pixels at the edge of the
+ * set can be far off; the limits bound how many and how much on average.
+ *
+ * Build:  g++ -O2 -std=c++11 -o fx_fixed_bench tools/fx_fixed_bench.cpp
+ * Usage:  ./fx_fixed_bench [width] [height] [rounds]      (32, 32, 200)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+
+#include "../wled00/fx_julia.h"
+
+// limits of the fixed point variant, measured 4.8-5.0%, 1.50-1.56, 0.46-0.48% and 140-192 at 16x16 to 64x32
+#define MAX_DIFFER_PCT      6.0     // pixels with a different palette index
+#define MAX_MEAN_DIFF       2.0     // palette steps, over all pixels
+#define MAX_INOUT_PCT       1.0     // pixels inside the set in one variant only
+#define MAX_DIFF_OUTSIDE    208     // palette steps, pixels both variants draw outside of the set
+
+static volatile int sink;
+
+// palette index of a pixel, 0 for points inside the set (drawn black)
+static inline uint8_t juliaIndex(int iter, int maxIterations) {
+  return (iter == maxIterations) ? 0 : iter*255/maxIterations;
+}
+
+static void renderFloat(const JuliaView& v, int w, int h, uint8_t* out) {
+  juliaFloat(v, w, h, [&](int i, int j, int iter) { out[j*w + i] = juliaIndex(iter, v.maxIterations); });
+}
+
+static void renderFixed(const JuliaView& v, int w, int h, uint8_t* out) {
+  juliaFixed(v, w, h, [&](int i, int j, int iter) { out[j*w + i] = juliaIndex(iter, v.maxIterations); });
+}
+
+int main(int argc, char** argv) {
+  int w      = argc > 1 ? atoi(argv[1]) : 32;
+  int h      = argc > 2 ? atoi(argv[2]) : 32;
+  int rounds = argc > 3 ? atoi(argv[3]) : 200;
+  if (w < 1 || h < 1 || rounds < 1) return 1;
+
+  std::vector<uint8_t> fl(w*h), fx(w*h);
+  const uint8_t intensities[] = {24, 64, 128, 255};
+  const float zooms[] = {1.0f, 0.5f, 0.1f, 0.01f};
+
+  uint64_t pixels = 0, differ = 0, diffSum = 0, inside = 0;
+  int maxDiff = 0, maxDiffOutside = 0;      // all pixels, pixels both variants draw outside of the set
+  for (uint32_t ms = 0; ms < 5000; ms += 250) {
+    for (uint8_t in : intensities) {
+      for (float z : zooms) {
+        JuliaView v = juliaView(ms, in, 0, 0, z);
+        renderFloat(v, w, h, fl.data());
+        renderFixed(v, w, h, fx.data());
+        for (int p = 0; p < w*h; p++) {
+          int d = abs((int)fl[p] - (int)fx[p]);
+          if (d) differ++;
+          if ((fl[p] == 0) != (fx[p] == 0)) inside++;
+          else if (fl[p] && d > maxDiffOutside) maxDiffOutside = d;
+          diffSum += d;
+          if (d > maxDiff) maxDiff = d;
+        }
+        pixels += w*h;
+      }
+    }
+  }
+
+  printf("%dx%d, %llu pixels compared\n", w, h, (unsigned long long)pixels);
+  printf("%-10s %10s %12s %12s %14s %16s\n", "effect", "differ", "mean diff", "max diff", "in/out of set", "max diff outside");
+  double differPct = 100.0 * differ / pixels, meanDiff = (double)diffSum / pixels, inoutPct = 100.0 * inside / pixels;
+  printf("%-10s %9.2f%% %12.3f %12d %13.3f%% %16d\n", "2D Julia", differPct, meanDiff, maxDiff, inoutPct, maxDiffOutside);
+  printf("%-10s %9.2f%% %12.3f %12s %13.3f%% %16d\n", "limit", MAX_DIFFER_PCT, MAX_MEAN_DIFF, "", MAX_INOUT_PCT, MAX_DIFF_OUTSIDE);
+  bool ok = differPct <= MAX_DIFFER_PCT && meanDiff <= MAX_MEAN_DIFF && inoutPct <= MAX_INOUT_PCT && maxDiffOutside <= MAX_DIFF_OUTSIDE;
+  printf("%s\n", ok ? "within the limits" : "FAILED: outside of the limits");
+
+  // timing at the default intensity, one frame per round
+  JuliaView v = juliaView(1000, 24, 0, 0, 1.0f);
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) renderFloat(v, w, h, fl.data());
+  auto t1 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) renderFixed(v, w, h, fx.data());
+  auto t2 = std::chrono::steady_clock::now();
+  double tFl = std::chrono::duration<double, std::micro>(t1 - t0).count() / rounds;
+  double tFx = std::chrono::duration<double, std::micro>(t2 - t1).count() / rounds;
+  printf("\nfloat %8.1f us/frame, fixed %8.1f us/frame (host with FPU, the ESP8266 has none)\n", tFl, tFx);
+  sink = fl[0] + fx[0];
+  return ok ? 0 : 2;
+}
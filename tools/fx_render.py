@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+
+# Renders effects on a WLED device with a fixed clock and random seed and stores the frames, or compares
+# them against frames stored before. The device renders into /render.bin (see handleRender() in led.cpp),
+# so two renders of the same firmware and settings give the same pixels, and a firmware change that
+# alters the output of an effect shows up as a difference.
+#
+#   ./fx_render.py http://wled.local --out golden              render all effects into golden/
+#   ./fx_render.py http://wled.local --check golden            render again and compare
+#   ./fx_render.py http://wled.local --modes 9,66 --pal 6 --sx 200 --frames 50 --out tmp
+#   ./fx_render.py http://wled.local --seg '{"start":0,"stop":16,"startY":0,"stopY":16,"col":[[255,0,0]],"c1":64}' --out 2d
+#
+# The segments of the device are used as they are, only segment 0 is set: fx/pal/sx/ix and the segment
+# object given with --seg (JSON or @file, e.g. bounds, colors, options, custom sliders, same keys as the
+# JSON API). Frames rendered with --seg are stored with a hash of it in the name. Sound reactive effects
+# depend on the audio data of the device, keep it silent (or sync off) when recording them.
+# A missing stored render fails the check unless --allow-missing is given.
+
+import requests
+import argparse
+import json
+import struct
+import zlib
+import time
+import os
+import sys
+
+HEADER = struct.Struct("<4sBBHHHHI")
+
+
+class Render:
+    def __init__(self, data):
+        magic, version, bpp, self.pixels, self.frames, self.frameMs, self.seed, self.id = HEADER.unpack_from(data)
+        if magic != b"WFRM" or version != 1 or bpp != 4:
+            raise ValueError("not a render file")
+        self.data = data
+        self.frameSize = self.pixels * 4
+
+    def frame(self, f):
+        start = HEADER.size + f * self.frameSize
+        return struct.unpack_from("<{0}I".format(self.pixels), self.data, start)
+
+    def compare(self, other):
+        """Returns None if equal, else (frame, differing pixels, first pixel, expected, got)"""
+        if (self.pixels, self.frames, self.frameMs, self.seed) != (other.pixels, other.frames, other.frameMs, other.seed):
+            return (-1, 0, 0, 0, 0)
+        for f in range(self.frames):
+            a, b = self.frame(f), other.frame(f)
+            if a != b:
+                diff = [i for i in range(self.pixels) if a[i] != b[i]]
+                return (f, len(diff), diff[0], a[diff[0]], b[diff[0]])
+        return None
+
+
+def segment(args):
+    """Segment object of --seg, with fx/pal/sx/ix of the command line taking precedence"""
+    seg = {}
+    if args.seg:
+        text = args.seg
+        if text.startswith("@"):
+            with open(text[1:]) as f:
+                text = f.read()
+        seg = json.loads(text)
+        if not isinstance(seg, dict):
+            raise ValueError("--seg must be a JSON object")
+    for key, default in (("pal", 0), ("sx", 128), ("ix", 128)):
+        if getattr(args, key) is not None:
+            seg[key] = getattr(args, key)
+        else:
+            seg.setdefault(key, default)
+    seg.pop("fx", None)
+    seg["id"] = 0
+    return seg
+
+
+def render(host, mode, args, renderId):
+    seg = dict(args.segment, fx=mode)
+    state = {"seg": [seg], "render": {"n": args.frames, "dt": args.dt, "seed": args.seed, "id": renderId}}
+    requests.post("{0}/json/state".format(host), json=state).raise_for_status()
+
+    deadline = time.time() + args.timeout
+    while time.time() < deadline:
+        time.sleep(0.2)
+        r = requests.get("{0}/render.bin".format(host))
+        if r.status_code != 200 or len(r.content) < HEADER.size:
+            continue
+        result = Render(r.content)
+        if result.id != renderId:
+            continue
+        if result.frames == 0:
+            raise RuntimeError("render of mode {0} refused, file system full or not writable for {1} frames".format(mode, args.frames))
+        if len(r.content) == HEADER.size + result.frames * result.frameSize:
+            return result
+    raise TimeoutError("no render of mode {0}".format(mode))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Reproducible effect rendering on a WLED device")
+    parser.add_argument("host", help="device URL, e.g. http://wled.local")
+    group = parser.add_mutually_exclusive_group(required=True)
+    group.add_argument("--out", help="directory to store the frames in")
+    group.add_argument("--check", help="directory with stored frames to compare against")
+    parser.add_argument("--modes", help="comma separated effect ids (all)")
+    parser.add_argument("--seg", help="segment 0 as JSON object, or @file with it")
+    parser.add_argument("--pal", type=int, help="palette (0)")
+    parser.add_argument("--sx", type=int, help="effect speed (128)")
+    parser.add_argument("--ix", type=int, help="effect intensity (128)")
+    parser.add_argument("--frames", type=int, default=100, help="frames per effect, at most 600 (100)")
+    parser.add_argument("--dt", type=int, default=24, help="ms per frame (24)")
+    parser.add_argument("--seed", type=int, default=1, help="random seed (1)")
+    parser.add_argument("--timeout", type=float, default=20, help="seconds to wait for a render (20)")
+    parser.add_argument("--allow-missing", action="store_true", help="skip effects without stored frames in --check")
+    args = parser.parse_args()
+    host = args.host.rstrip("/")
+    args.segment = segment(args)
+    suffix = ""
+    if args.seg:
+        canonical = json.dumps(args.segment, sort_keys=True, separators=(",", ":"))
+        suffix = "_seg{0:08x}".format(zlib.crc32(canonical.encode()))
+
+    if args.modes:
+        modes = [int(m) for m in args.modes.split(",")]
+    else:
+        effects = requests.get("{0}/json/effects".format(host))
+        effects.raise_for_status()
+        modes = list(range(len(effects.json())))
+
+    if args.out:
+        os.makedirs(args.out, exist_ok=True)
+    failed = 0
+    missing = 0
+    baseId = int(time.time()) & 0xFFFF0000
+    for n, mode in enumerate(modes):
+        seg = args.segment
+        name = "fx{0:03d}_pal{1}_sx{2}_ix{3}{4}.bin".format(mode, seg["pal"], seg["sx"], seg["ix"], suffix)
+        result = render(host, mode, args, baseId + n)
+        if args.out:
+            with open(os.path.join(args.out, name), "wb") as f:
+                f.write(result.data)
+            print("{0}: {1} frames of {2} pixels".format(name, result.frames, result.pixels))
+            continue
+
+        path = os.path.join(args.check, name)
+        if not os.path.exists(path):
+            print("{0}: no stored frames".format(name))
+            if args.allow_missing:
+                missing += 1
+            else:
+                failed += 1
+            continue
+        with open(path, "rb") as f:
+            stored = Render(f.read())
+        diff = stored.compare(result)
+        if diff is None:
+            print("{0}: ok".format(name))
+        elif diff[0] < 0:
+            print("{0}: different length, frame time or seed".format(name))
+            failed += 1
+        else:
+            print("{0}: frame {1} differs in {2} pixels, pixel {3} is {5:08x} instead of {4:08x}".format(name, *diff))
+            failed += 1
+
+    if args.check:
+        print("{0} of {1} effects differ or have no stored frames, {2} skipped".format(failed, len(modes), missing))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,47 @@
+#!/usr/bin/env python3
+
+# Converts a WLED ledmap.json into the binary ledmap.bin, which the device loads without parsing (see
+# WS2812FX::deserializeMap() in FX_fcn.cpp), or a ledmap.bin back into JSON. Upload the result with the
+# edit page, as /ledmap.bin or /ledmap<n>.bin for map n. A .bin is used in place of the .json of the same map.
+#
+#   ./ledmap_bin.py ledmap.json ledmap.bin
+#   ./ledmap_bin.py ledmap2.bin ledmap2.json
+
+import json
+import struct
+import sys
+
+HEADER = struct.Struct("<4sHH")
+
+
+def main():
+    if len(sys.argv) != 3:
+        print("usage: {0} <in.json|in.bin> <out.bin|out.json>".format(sys.argv[0]))
+        return 1
+    src, dst = sys.argv[1], sys.argv[2]
+
+    if src.endswith(".json"):
+        with open(src) as f:
+            entries = json.load(f)["map"]
+        if len(entries) > 0xFFFF:
+            print("map has more than 65535 entries")
+            return 1
+        with open(dst, "wb") as f:
+            f.write(HEADER.pack(b"WMAP", len(entries), 0))
+            f.write(struct.pack("<{0}H".format(len(entries)), *[e & 0xFFFF for e in entries]))
+    else:
+        with open(src, "rb") as f:
+            data = f.read()
+        magic, count, _ = HEADER.unpack_from(data)
+        if magic != b"WMAP" or len(data) < HEADER.size + 2 * count:
+            print("not a ledmap.bin")
+            return 1
+        entries = struct.unpack_from("<{0}H".format(count), data, HEADER.size)
+        with open(dst, "w") as f:
+            json.dump({"map": list(entries)}, f, separators=(",", ":"))
+    print("{0} entries".format(len(entries)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
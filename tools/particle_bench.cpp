@@ -0,0 +1,389 @@
+/*
+ * Benchmarks the particle engine (wled00/particles.h) on the host: particles updated per ms for
+ * 1D and 2D systems with gravity, drag and the floor flags, and the cost of spawning and killing.
+ * Also checks that a particle launched with sqrt(2*g*h) peaks at h.
+ *
+ * Before that, the motion of the particle effects is compared with the float code they used before
+ * the engine: the same launches are run through both, frame by frame at FRAMETIME (42 fps), and
+ * the difference of the drawn pixel is printed per effect. Only the physics is compared, colors and
+ * random launches are left out.
+ *
+ * Build:  g++ -O2 -std=c++11 -o particle_bench tools/particle_bench.cpp
+ * Usage:  ./particle_bench [steps]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+
+#include "../wled00/particles.h"
+
+static volatile int32_t sink;
+
+// fills the system and runs steps updates, respawning what dies, returns particle updates per ms
+static double bench(uint16_t n, bool is2D, uint8_t flags, uint32_t steps) {
+  std::vector<uint8_t> data(ParticleSystem::dataSize(n, is2D));
+  ParticleSystem ps;
+  ps.begin(data.data(), n, is2D, 0, true);
+  ps.gravityX = is2D ? 0 : -300;
+  ps.gravityY = -300;
+  ps.drag = 64;                                   // 1/1024
+  ps.flags = flags;
+  ps.width = 64 * PS_ONE;
+  ps.height = 64 * PS_ONE;
+
+  srand(1);
+  uint64_t updates = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t s = 0; s < steps; s++) {
+    while (!ps.full()) {
+      int32_t v = (rand() & 0xFFFF) - 0x8000;
+      if (is2D) ps.spawn2D(32 * PS_ONE, 32 * PS_ONE, v, abs(v), 200 + (rand() & 255), 255, s);
+      else      ps.spawn(32 * PS_ONE, v, 200 + (rand() & 255), 255, s);
+    }
+    updates += ps.count();
+    ps.update();
+  }
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  sink = ps.x[0];
+  return updates / ms;
+}
+
+/*
+ * previous float code of the effects against the engine
+ */
+
+static const uint32_t FRAME_MS = 1000/42;        // FRAMETIME
+
+// integer square root, as in FX.cpp
+static uint32_t fx_sqrt(uint64_t x) {
+  uint64_t r = 0, bit = (uint64_t)1 << 62;
+  while (bit > x) bit >>= 2;
+  while (bit) {
+    if (x >= r + bit) {
+      x -= r + bit;
+      r = (r >> 1) + bit;
+    } else {
+      r >>= 1;
+    }
+    bit >>= 2;
+  }
+  return r;
+}
+
+// drawn pixel per frame of the old and the new code, -1 if nothing is drawn
+struct Track {
+  std::vector<int> oldPx, newPx;
+  void add(int o, int n) { oldPx.push_back(o); newPx.push_back(n); }
+};
+
+// frames drawn by both and the pixel distance there, frames drawn by only one of them
+struct Diff {
+  int frames = 0, only = 0, maxDiff = 0;
+  double sum = 0;
+  void add(const Track& t) {
+    size_t n = t.oldPx.size() > t.newPx.size() ? t.oldPx.size() : t.newPx.size();
+    for (size_t i = 0; i < n; i++) {
+      int o = i < t.oldPx.size() ? t.oldPx[i] : -1;
+      int p = i < t.newPx.size() ? t.newPx[i] : -1;
+      if (o < 0 && p < 0) continue;
+      if (o < 0 || p < 0) { only++; continue; }
+      int d = abs(o - p);
+      if (d > maxDiff) maxDiff = d;
+      sum += d;
+      frames++;
+    }
+  }
+  void print(const char* effect, const char* what) {
+    printf("%-16s %-34s %8d %10.3f %8d %9.2f%%\n", effect, what, frames, frames ? sum / frames : 0.0, maxDiff,
+      frames + only ? 100.0 * only / (frames + only) : 0.0);
+  }
+};
+
+// popcorn kernels for every peak height at SEGLEN len and speed
+static void comparePopcorn(uint16_t len, uint8_t speed, Diff& d) {
+  float gravity = (-0.0001 - (speed/200000.0)) * len;
+  int32_t g = -(((int64_t)len * PS_ONE) * (20 + speed) / 200000);
+  for (uint16_t r = 0; r < 128; r++) {
+    uint16_t peakHeight = ((128 + r) * (len - 1)) >> 8;
+    float pos = 0.01f, vel = sqrt(-2.0 * gravity * peakHeight);
+    uint8_t data[64];
+    ParticleSystem ps;
+    ps.begin(data, 1, false, 0, true);
+    ps.gravityX = g;
+    ps.flags = PS_KILL_BELOW;
+    ps.spawn(PS_ONE / 100, fx_sqrt(((uint64_t)2 * -g * peakHeight) << 16));
+    Track t;
+    while (pos >= 0.0f || ps.count()) {
+      int o = -1, n = -1;
+      if (pos >= 0.0f) {
+        pos += vel; vel += gravity;
+        if (pos >= 0.0f && (uint16_t)pos < len) o = (uint16_t)pos;
+      }
+      ps.update();
+      if (ps.count() && ParticleSystem::pixel(ps.x[0]) < len) n = ParticleSystem::pixel(ps.x[0]);
+      t.add(o, n);
+    }
+    d.add(t);
+  }
+}
+
+// fireworks flare up to the explosion, then sparks from -0.9 to 1.1 of the spark speed
+static void compareFireworks(uint16_t len, uint8_t speed, Diff& flareDiff, Diff& sparkDiff) {
+  float gravity = (-0.0004 - (speed/800000.0)) * len;
+  int32_t g = -(((int64_t)len * PS_ONE) * (320 + speed) / 800000);
+  for (uint16_t r = 0; r < 180; r++) {
+    uint16_t peakHeight = ((75 + r) * (len - 1)) >> 8;
+    float pos = 0, vel = sqrt(-2.0 * gravity * peakHeight);
+    uint8_t data[64];
+    ParticleSystem ps;
+    ps.begin(data, 1, false, 0, true);
+    ps.gravityX = g;
+    ps.spawn(0, fx_sqrt(((uint64_t)2 * -g * peakHeight) << 16));
+    Track t;
+    bool oldUp = true, newUp = true;
+    while (oldUp || newUp) {
+      int o = -1, n = -1;
+      if (oldUp && vel > 12 * gravity) {
+        o = int(pos);
+        pos += vel;
+        if (pos < 0) pos = 0;
+        if (pos > len - 1) pos = len - 1;
+        vel += gravity;
+      } else oldUp = false;
+      if (newUp && ps.vx[0] > 12 * g) {
+        n = ParticleSystem::pixel(ps.x[0]);
+        ps.move(0);
+        if (ps.x[0] < 0) ps.x[0] = 0;
+        if (ps.x[0] > (int32_t)(len - 1) << 16) ps.x[0] = (int32_t)(len - 1) << 16;
+      } else newUp = false;
+      t.add(o, n);
+    }
+    flareDiff.add(t);
+
+    // sparks from where the old flare exploded, so only the spark motion is compared
+    for (uint16_t sv = 0; sv <= 20000; sv += 1000) {
+      float spos = pos;
+      float svel = (float(sv) / 10000.0 - 0.9) * pos/len * -gravity * 50;
+      float dyingGravity = gravity/2;
+      int32_t flarePos = pos * PS_ONE;
+      int32_t v = (int32_t)(sv * (uint32_t)PS_ONE / 10000) - 58982;
+      v = (int64_t)v * flarePos / ((int32_t)len << 16);
+      v = ((int64_t)v * (-g * 50)) >> 16;
+      ParticleSystem sp;
+      sp.begin(data, 1, false, 0, true);
+      sp.flags = PS_KILL_BELOW;
+      sp.spawn(flarePos, v);
+      int32_t dg = g/2;
+      Track st;
+      for (int col = 345; col > 4; col -= 4) {
+        int o = -1, n = -1;
+        spos += svel; svel += dyingGravity;
+        if (spos > 0 && spos < len) o = int(spos);
+        sp.gravityX = dg;
+        sp.update();
+        if (sp.count() && sp.x[0] > 0 && ParticleSystem::pixel(sp.x[0]) < len) n = ParticleSystem::pixel(sp.x[0]);
+        dyingGravity *= .99;
+        dg -= dg / 100;
+        st.add(o, n);
+      }
+      sparkDiff.add(st);
+    }
+  }
+}
+
+// a drop falling from the end of the segment, its bounce and the fall back to 0
+static void compareDrip(uint16_t len, uint8_t speed, Diff& d) {
+  float gravity = (-0.0005 - (speed/50000.0)) * len;
+  float pos = len - 1, vel = 0;
+  uint8_t data[64];
+  ParticleSystem ps;
+  ps.begin(data, 1, false, 0, true);
+  ps.gravityX = -(((int64_t)len * PS_ONE) * (25 + speed) / 50000);
+  ps.spawn((int32_t)(len - 1) << 16, 0);
+  uint8_t oldState = 2, newState = 2;
+  Track t;
+  while (oldState || newState) {
+    int o = -1, n = -1;
+    if (oldState) {
+      if (pos > 0) {
+        pos += vel;
+        if (pos < 0) pos = 0;
+        vel += gravity;
+        o = (uint16_t)pos;
+      } else if (oldState > 2) oldState = 0;
+      else { vel = -vel/4; pos += vel; oldState = 5; }
+    }
+    if (newState) {
+      if (ps.x[0] > 0) {
+        ps.move(0);
+        if (ps.x[0] < 0) ps.x[0] = 0;
+        n = ParticleSystem::pixel(ps.x[0]);
+      } else if (newState > 2) newState = 0;
+      else { ps.vx[0] = -ps.vx[0]/4; ps.x[0] += ps.vx[0]; newState = 5; }
+    }
+    t.add(o, n);
+  }
+  d.add(t);
+}
+
+// bouncing balls: closed form trajectories restarted at every bounce against the integrated engine
+static void compareBalls(uint16_t len, uint8_t speed, uint32_t ms, Diff& d) {
+  const uint8_t numBalls = 8;                     // intensity 128
+  const uint16_t div = (255-speed)*8/256 +1;
+  float gravity = -9.81, impactVelocityStart = sqrt(-2 * gravity);
+  unsigned long lastBounceTime[numBalls];
+  float impactVelocity[numBalls];
+  uint8_t data[256];
+  ParticleSystem ps;
+  ps.begin(data, numBalls, false, 0, true);
+  ps.gravityX = -642908;
+  for (uint8_t i = 0; i < numBalls; i++) {
+    lastBounceTime[i] = 0; impactVelocity[i] = 0;
+    ps.spawn(0, 290289);
+  }
+  std::vector<Track> t(numBalls);
+  uint32_t prev = 0;
+  for (uint32_t time = 0; time <= ms; time += FRAME_MS) {
+    for (uint8_t i = 0; i < numBalls; i++) {
+      float timeSinceLastBounce = (time - lastBounceTime[i])/div;
+      float height = 0.5 * gravity * pow(timeSinceLastBounce/1000, 2.0) + impactVelocity[i] * timeSinceLastBounce/1000;
+      if (height < 0) {
+        height = 0;
+        float dampening = 0.90 - float(i)/pow(numBalls,2);
+        impactVelocity[i] = dampening * impactVelocity[i];
+        lastBounceTime[i] = time;
+        if (impactVelocity[i] < 0.015) impactVelocity[i] = impactVelocityStart;
+      }
+      t[i].oldPx.push_back(round(height * (len - 1)));
+    }
+    uint32_t dt = time - prev;
+    if (dt > 100) dt = 100;
+    prev = time;
+    ps.update((dt << 16) / (1000 * div));
+    for (uint8_t i = 0; i < numBalls; i++) {
+      if (ps.x[i] < 0) {
+        int64_t v2 = (int64_t)ps.vx[i] * ps.vx[i] - 2 * (int64_t)ps.gravityX * ps.x[i];
+        int32_t impactVelocity = (v2 > 0) ? fx_sqrt(v2) : 0;
+        ps.x[i] = 0;
+        int32_t dampening = 58982 - (i * PS_ONE) / (numBalls * numBalls);
+        ps.vx[i] = ((int64_t)dampening * impactVelocity) >> 16;
+        if (ps.vx[i] < 983) ps.vx[i] = 290289;
+      }
+      t[i].newPx.push_back(((uint64_t)ps.x[i] * (len - 1) + PS_ONE/2) >> 16);
+    }
+  }
+  for (uint8_t i = 0; i < numBalls; i++) d.add(t[i]);
+}
+
+// starburst fragments, velocity per second with 3x drag per second
+static void compareStarburst(Diff& d) {
+  const uint16_t start = 100;
+  for (uint16_t r = 0; r < 256; r += 15) {
+    for (uint16_t m = 15; m < 256; m += 30) {
+      for (int var = 1; var <= 5; var++) {
+        float vel = 375.0f * (float)r/255.0 * (float)m/255.0;
+        float frag = start;
+        uint8_t data[64];
+        ParticleSystem ps;
+        ps.begin(data, 1, false, 0, true);
+        ps.drag = 3 * PS_ONE;
+        int32_t v = (int64_t)(375 * PS_ONE) * r * m / (255 * 255);
+        ps.spawn((int32_t)start << 16, v * var / 3);
+        Track t;
+        for (uint32_t age = 0; age <= 1750; age += FRAME_MS) {
+          float dt = FRAME_MS/1000.0;
+          frag += vel * dt * (float)var/3.0;
+          vel -= 3*vel*dt;
+          ps.update(((uint32_t)FRAME_MS << 16) / 1000);
+          t.add((int)frag, ParticleSystem::pixel(ps.x[0]));
+        }
+        d.add(t);
+      }
+    }
+  }
+}
+
+// ripples only use the particle age, the drawn states must be the same
+static void compareRipple(Diff& d) {
+  for (uint16_t speed = 0; speed < 256; speed++) {
+    uint8_t rippledecay = (speed >> 4) +1;
+    Track t;
+    uint16_t state = 1;
+    while (state) {
+      t.oldPx.push_back(state);
+      state += rippledecay;
+      if (state > 254) state = 0;
+    }
+    uint8_t data[64];
+    ParticleSystem ps;
+    ps.begin(data, 1, false, 0, true);
+    ps.spawn(0, 0, 253 / rippledecay + 1);
+    while (ps.count()) {
+      t.newPx.push_back(1 + ps.age[0] * rippledecay);
+      ps.update();
+    }
+    d.add(t);
+  }
+}
+
+static void compareEffects() {
+  printf("%-16s %-34s %8s %10s %8s %10s\n", "effect", "compared", "frames", "mean px", "max px", "one only");
+  const uint16_t lens[] = {30, 150, 600};
+  for (uint16_t len : lens) {
+    char what[40];
+    Diff pop, flare, spark, drip, balls, ballsLong;
+    for (uint16_t speed = 0; speed < 256; speed += 64) {
+      comparePopcorn(len, speed, pop);
+      compareFireworks(len, speed, flare, spark);
+      compareDrip(len, speed, drip);
+      compareBalls(len, speed, 5000, balls);
+      compareBalls(len, speed, 60000, ballsLong);
+    }
+    snprintf(what, sizeof(what), "%u px, kernels", len);           pop.print("Popcorn", what);
+    snprintf(what, sizeof(what), "%u px, flare", len);             flare.print("Fireworks 1D", what);
+    snprintf(what, sizeof(what), "%u px, sparks", len);            spark.print("Fireworks 1D", what);
+    snprintf(what, sizeof(what), "%u px, fall and bounce", len);   drip.print("Drip", what);
+    snprintf(what, sizeof(what), "%u px, 8 balls, first 5 s", len); balls.print("Bouncing Balls", what);
+    snprintf(what, sizeof(what), "%u px, 8 balls, 60 s", len);     ballsLong.print("Bouncing Balls", what);
+  }
+  Diff star, ripple;
+  compareStarburst(star);
+  compareRipple(ripple);
+  star.print("Starburst", "fragments, 1.75 s");
+  ripple.print("Ripple", "wave states, all speeds");
+  printf("(mean/max px: distance of the pixel both draw, one only: frames only one of them draws a pixel)\n\n");
+}
+
+int main(int argc, char** argv) {
+  uint32_t steps = (argc > 1) ? atoi(argv[1]) : 2000;
+
+  compareEffects();
+
+  // launch height check, like popcorn and fireworks do it
+  {
+    uint8_t data[64];
+    ParticleSystem ps;
+    ps.begin(data, 1, false, 0, true);
+    ps.gravityX = -2000;
+    int32_t h = 100 * PS_ONE;
+    ps.spawn(0, (int32_t)sqrt(2.0 * 2000 * (double)h));
+    int32_t peak = 0;
+    while (ps.vx[0] > ps.gravityX) { ps.update(); if (ps.x[0] > peak) peak = ps.x[0]; }
+    printf("peak %.3f for height 100\n", peak / 65536.0);
+  }
+
+  printf("%-6s %-22s %12s\n", "n", "system", "particles/ms");
+  const uint16_t sizes[] = {1000, 2000, 4000};
+  for (uint16_t n : sizes) {
+    printf("%-6u %-22s %12.0f\n", n, "1D",               bench(n, false, 0, steps));
+    printf("%-6u %-22s %12.0f\n", n, "1D kill below",    bench(n, false, PS_KILL_BELOW, steps));
+    printf("%-6u %-22s %12.0f\n", n, "1D floor bounce",  bench(n, false, PS_FLOOR_BOUNCE, steps));
+    printf("%-6u %-22s %12.0f\n", n, "2D",               bench(n, true, 0, steps));
+    printf("%-6u %-22s %12.0f\n", n, "2D kill outside",  bench(n, true, PS_KILL_OUTSIDE, steps));
+  }
+  return 0;
+}
@@ -0,0 +1,232 @@
+/*
+ * Microbenchmark of the packed pixel kernels (wled00/pixel_kernels.h) against the per channel
+ * code they replace in FX_fcn.cpp (color_blend(), fade_out(), fade2black(), blur()).
+ * The reference functions below do the same math on a plain buffer, so only the arithmetic is
+ * compared, not getPixelColor()/setPixelColor(). Every kernel is also checked against its
+ * reference on random colors first.
+ *
+ * Build:  g++ -O2 -std=c++11 -o pixel_bench tools/pixel_bench.cpp
+ *         (add -DPIXEL_KERNELS_NARROW to force the 32 bit path on a 64 bit host)
+ * Usage:  ./pixel_bench [pixels] [rounds]      (1500, 2000)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <chrono>
+
+#include "../wled00/pixel_kernels.h"
+
+/*
+ * per channel code as it was in FX_fcn.cpp
+ */
+
+static uint32_t ref_blend(uint32_t color1, uint32_t color2, uint8_t blend) {
+  if (blend == 0)   return color1;
+  if (blend == 255) return color2;
+  uint32_t w1 = (color1 >> 24) & 0xFF, r1 = (color1 >> 16) & 0xFF, g1 = (color1 >> 8) & 0xFF, b1 = color1 & 0xFF;
+  uint32_t w2 = (color2 >> 24) & 0xFF, r2 = (color2 >> 16) & 0xFF, g2 = (color2 >> 8) & 0xFF, b2 = color2 & 0xFF;
+  uint32_t w3 = ((w2 * blend) + (w1 * (255 - blend))) >> 8;
+  uint32_t r3 = ((r2 * blend) + (r1 * (255 - blend))) >> 8;
+  uint32_t g3 = ((g2 * blend) + (g1 * (255 - blend))) >> 8;
+  uint32_t b3 = ((b2 * blend) + (b1 * (255 - blend))) >> 8;
+  return ((w3 << 24) | (r3 << 16) | (g3 << 8) | (b3));
+}
+
+static uint32_t ref_fade_out(uint32_t color, uint32_t target, float mappedRate) {
+  int w1 = (color >> 24) & 0xff, r1 = (color >> 16) & 0xff, g1 = (color >> 8) & 0xff, b1 = color & 0xff;
+  int w2 = (target >> 24) & 0xff, r2 = (target >> 16) & 0xff, g2 = (target >> 8) & 0xff, b2 = target & 0xff;
+  int wdelta = (w2 - w1) / mappedRate;
+  int rdelta = (r2 - r1) / mappedRate;
+  int gdelta = (g2 - g1) / mappedRate;
+  int bdelta = (b2 - b1) / mappedRate;
+  wdelta += (w2 == w1) ? 0 : (w2 > w1) ? 1 : -1;
+  rdelta += (r2 == r1) ? 0 : (r2 > r1) ? 1 : -1;
+  gdelta += (g2 == g1) ? 0 : (g2 > g1) ? 1 : -1;
+  bdelta += (b2 == b1) ? 0 : (b2 > b1) ? 1 : -1;
+  return ((uint32_t)(uint8_t)(w1 + wdelta) << 24) | ((uint32_t)(uint8_t)(r1 + rdelta) << 16) |
+         ((uint32_t)(uint8_t)(g1 + gdelta) << 8) | (uint8_t)(b1 + bdelta);
+}
+
+static uint32_t ref_scale(uint32_t color, float mappedRate) {
+  int w = ((color >> 24) & 0xff) * mappedRate, r = ((color >> 16) & 0xff) * mappedRate;
+  int g = ((color >> 8) & 0xff) * mappedRate,  b = (color & 0xff) * mappedRate;
+  return ((uint32_t)w << 24) | ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+}
+
+static inline uint8_t qadd8(uint8_t a, uint8_t b) { unsigned t = a + b; return t > 255 ? 255 : t; }
+static inline uint8_t nscale8(uint8_t c, uint8_t s) { return ((uint16_t)c * (1 + s)) >> 8; }
+
+static void ref_blur(uint32_t* px, uint16_t n, uint8_t blur_amount) {
+  uint8_t keep = 255 - blur_amount, seep = blur_amount >> 1;
+  uint8_t carry[4] = {0};
+  for (uint16_t i = 0; i < n; i++) {
+    uint8_t cur[4], part[4];
+    for (int k = 0; k < 4; k++) {
+      uint8_t c = px[i] >> (8 * k);
+      part[k] = nscale8(c, seep);
+      cur[k] = qadd8(nscale8(c, keep), carry[k]);
+      carry[k] = part[k];
+    }
+    if (i > 0) {
+      uint32_t p = 0;
+      for (int k = 0; k < 4; k++) p |= (uint32_t)qadd8(px[i - 1] >> (8 * k), part[k]) << (8 * k);
+      px[i - 1] = p;
+    }
+    px[i] = cur[0] | (cur[1] << 8) | (cur[2] << 16) | ((uint32_t)cur[3] << 24);
+  }
+}
+
+/*
+ * checks
+ */
+
+static uint32_t rnd() { return ((uint32_t)rand() << 16) ^ (uint32_t)rand(); }
+
+static int channelDiff(uint32_t a, uint32_t b) {
+  int m = 0;
+  for (int k = 0; k < 32; k += 8) {
+    int d = abs((int)((a >> k) & 0xFF) - (int)((b >> k) & 0xFF));
+    if (d > m) m = d;
+  }
+  return m;
+}
+
+static bool check() {
+  bool ok = true;
+  int blendDiff = 0, fadeDiff = 0, fadeStuck = 0, addDiff = 0, scaleDiff = 0;
+  for (int i = 0; i < 200000; i++) {
+    uint32_t a = rnd(), b = rnd();
+    uint8_t x = rnd();
+    uint8_t bl = 1 + x % 254;                          // color_blend() returns the colors for 0 and 255 itself
+    int d = channelDiff(pixel_blend(a, b, bl), ref_blend(a, b, bl));
+    if (d > blendDiff) blendDiff = d;
+
+    uint8_t rate = (255 - x) >> 1;
+    float mappedRate = float(rate) + 1.1;
+    uint16_t amount = 256 / mappedRate;
+    uint32_t f = pixel_fade_toward(a, b, amount);
+    d = channelDiff(f, ref_fade_out(a, b, mappedRate));
+    if (d > fadeDiff) fadeDiff = d;
+    for (int k = 0; k < 32; k += 8) {                 // has to move every channel that is not there yet
+      if (((a >> k) & 0xFF) != ((b >> k) & 0xFF) && ((a >> k) & 0xFF) == ((f >> k) & 0xFF)) fadeStuck++;
+    }
+
+    uint32_t s = 0;
+    for (int k = 0; k < 32; k += 8) s |= (uint32_t)qadd8(a >> k, b >> k) << k;
+    d = channelDiff(pixel_add(a, b), s);
+    if (d > addDiff) addDiff = d;
+
+    s = 0;
+    for (int k = 0; k < 32; k += 8) s |= (uint32_t)nscale8(a >> k, x) << k;
+    d = channelDiff(pixel_scale(a, x), s);
+    if (d > scaleDiff) scaleDiff = d;
+  }
+
+  std::vector<uint32_t> p1(257), p2;
+  for (auto& c : p1) c = rnd();
+  p2 = p1;
+  ref_blur(p1.data(), p1.size(), 172);
+  pixels_blur(p2.data(), p2.size(), 172);
+  int blurDiff = 0;
+  for (size_t i = 0; i < p1.size(); i++) { int d = channelDiff(p1[i], p2[i]); if (d > blurDiff) blurDiff = d; }
+
+  // wide and narrow buffer paths have to agree with the single pixel versions
+  std::vector<uint32_t> q(101);
+  for (auto& c : q) c = rnd();
+  p2 = q;
+  pixels_fade_toward(p2.data(), p2.size(), 0x10203040, 77);
+  int bufDiff = 0;
+  for (size_t i = 0; i < q.size(); i++) bufDiff += (p2[i] != pixel_fade_toward(q[i], 0x10203040, 77));
+
+  printf("max channel difference to the per channel code: blend %d, add %d, scale %d, blur %d, fade %d (%d channels stuck)%s\n",
+         blendDiff, addDiff, scaleDiff, blurDiff, fadeDiff, fadeStuck, bufDiff ? ", BUFFER MISMATCH" : "");
+  ok = (blendDiff == 0 && addDiff == 0 && scaleDiff == 0 && blurDiff == 0 && fadeStuck == 0 && bufDiff == 0 && fadeDiff <= 2);
+  return ok;
+}
+
+/*
+ * timing
+ */
+
+template <typename F> static double bench(const char* name, std::vector<uint32_t>& px, int rounds, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) f(px.data(), (uint16_t)px.size(), (uint8_t)r);
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  ns /= (double)rounds * px.size();
+  uint32_t sum = 0;                                   // keep the results alive
+  for (uint32_t c : px) sum += c;
+  printf("  %-28s %6.2f ns/pixel  (%08x)\n", name, ns, sum);
+  return ns;
+}
+
+int main(int argc, char** argv) {
+  int n = (argc > 1) ? atoi(argv[1]) : 1500;
+  int rounds = (argc > 2) ? atoi(argv[2]) : 2000;
+  if (n < 1 || n > 65535 || rounds < 1) {
+    fprintf(stderr, "usage: %s [pixels] [rounds]\n", argv[0]);
+    return 1;
+  }
+
+  bool ok = check();
+  #ifdef PIXEL_KERNELS_WIDE
+  printf("%d pixels, %d rounds, 64 bit buffer path\n", n, rounds);
+  #else
+  printf("%d pixels, %d rounds, 32 bit buffer path\n", n, rounds);
+  #endif
+
+  std::vector<uint32_t> px(n);
+  auto fillRandom = [&]() { srand(1); for (auto& c : px) c = rnd(); };
+  const uint32_t target = 0x00102030;
+
+  fillRandom();
+  double a = bench("blend, per channel", px, rounds, [&](uint32_t* p, uint16_t len, uint8_t r) {
+    for (uint16_t i = 0; i < len; i++) p[i] = ref_blend(p[i], target, r | 1);
+  });
+  fillRandom();
+  double b = bench("blend, packed", px, rounds, [&](uint32_t* p, uint16_t len, uint8_t r) {
+    pixels_blend(p, len, target, r | 1);
+  });
+  printf("  speedup %.1fx\n", a / b);
+
+  fillRandom();
+  a = bench("fade_out, per channel", px, rounds, [&](uint32_t* p, uint16_t len, uint8_t r) {
+    float mappedRate = float((255 - r) >> 1) + 1.1;
+    for (uint16_t i = 0; i < len; i++) p[i] = ref_fade_out(p[i], target, mappedRate);
+  });
+  fillRandom();
+  b = bench("fade_out, packed", px, rounds, [&](uint32_t* p, uint16_t len, uint8_t r) {
+    pixels_fade_toward(p, len, target, 256 / (float((255 - r) >> 1) + 1.1));
+  });
+  printf("  speedup %.1fx\n", a / b);
+
+  fillRandom();
+  a = bench("fade2black, per channel", px, rounds, [&](uint32_t* p, uint16_t len, uint8_t r) {
+    float mappedRate = (r % 100 + 1) / 100.0f;
+    for (uint16_t i = 0; i < len; i++) p[i] = ref_scale(p[i] | 0x01010101, mappedRate);
+  });
+  fillRandom();
+  b = bench("fade2black, packed", px, rounds, [&](uint32_t* p, uint16_t len, uint8_t r) {
+    uint8_t s = (r % 100 + 1) * 256 / 100 - 1;
+    pixels_add(p, len, 0x01010101);
+    pixels_scale(p, len, s);
+  });
+  printf("  speedup %.1fx\n", a / b);
+
+  fillRandom();
+  a = bench("blur, per channel", px, rounds, [&](uint32_t* p, uint16_t len, uint8_t r) { ref_blur(p, len, r); });
+  fillRandom();
+  b = bench("blur, packed", px, rounds, [&](uint32_t* p, uint16_t len, uint8_t r) { pixels_blur(p, len, r); });
+  printf("  speedup %.1fx\n", a / b);
+
+  if (n >= 64) {
+    uint16_t w = 32, h = n / 32;
+    std::vector<uint32_t> m(w * h);
+    fillRandom();
+    for (size_t i = 0; i < m.size(); i++) m[i] = px[i];
+    bench("blur2d 32 x n/32, packed", m, rounds, [&](uint32_t* p, uint16_t, uint8_t r) { pixels_blur2d(p, w, h, r); });
+  }
+
+  return ok ? 0 : 1;
+}
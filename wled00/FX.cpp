@@ -25,6 +25,8 @@
 */
 
 #include "FX.h"
+#include "particles.h"
+#include "fx_julia.h"
 
 #define IBN 5100
 #define PALETTE_SOLID_WRAP (paletteBlend == 1 || paletteBlend == 3)
@@ -1140,7 +1142,7 @@ uint16_t WS2812FX::mode_fireworks() {
 
   for(uint16_t i=0; i<MAX(1, SEGLEN/20); i++) {
     if(random8(129 - (SEGMENT.intensity >> 1)) == 0) {
-      uint16_t index = random(SEGLEN);
+      uint16_t index = random16(SEGLEN);
       setPixelColor(index, color_from_palette(random8(), false, false, 0));
       SEGENV.aux1 = SEGENV.aux0;
       SEGENV.aux0 = index;
@@ -1504,7 +1506,7 @@ uint16_t WS2812FX::mode_multi_comet(void)
       }
       comets[i]++;
     } else {
-      if(!random(SEGLEN)) {
+      if(!random16(SEGLEN)) {
         comets[i] = 0;
       }
     }
@@ -1634,10 +1636,10 @@ uint16_t WS2812FX::mode_lightning(void)
     }
     SEGENV.aux1--;
 
-    SEGENV.step = millis();
+    SEGENV.step = fxMillis();
     //return random8(4, 10); // each flash only lasts one frame/every 24ms... originally 4-10 milliseconds
   } else {
-    if (millis() - SEGENV.step > SEGENV.aux0) {
+    if (fxMillis() - SEGENV.step > SEGENV.aux0) {
       SEGENV.aux1--;
       if (SEGENV.aux1 < 2) SEGENV.aux1 = 0;
 
@@ -1645,7 +1647,7 @@ uint16_t WS2812FX::mode_lightning(void)
       if (SEGENV.aux1 == 2) {
         SEGENV.aux0 = (random8(255 - SEGMENT.speed) * 100); // delay between strikes
       }
-      SEGENV.step = millis();
+      SEGENV.step = fxMillis();
     }
   }
   return FRAMETIME;
@@ -1856,12 +1858,15 @@ uint16_t WS2812FX::mode_colorwaves()
 }
 
 
-// colored stripes pulsing at a defined Beats-Per-Minute (BPM)
+// colored stripes pulsing at a defined Beats-Per-Minute (BPM), or at the tempo of the music if one was detected
 uint16_t WS2812FX::mode_bpm()
 {
+  extern float beatBpm;
+  extern uint8_t beatPhase;
+
   CRGB fastled_col;
   uint32_t stp = (now / 20) & 0xFF;
-  uint8_t beat = beatsin8(SEGMENT.speed, 64, 255);
+  uint8_t beat = (beatBpm > 0) ? map8(sin8(beatPhase + 64), 64, 255) : beatsin8(SEGMENT.speed, 64, 255);
   for (uint16_t i = 0; i < SEGLEN; i++) {
     fastled_col = ColorFromPalette(currentPalette, stp + (i * 2), beat - stp + (i * 10));
     setPixelColor(i, fastled_col.red, fastled_col.green, fastled_col.blue);
@@ -2174,11 +2179,12 @@ uint16_t WS2812FX::ripple_base(bool rainbow)
 {
   uint16_t maxRipples = 1 + (SEGLEN >> 2);
   if (maxRipples > 100) maxRipples = 100;
-  uint16_t dataSize = sizeof(ripple) * maxRipples;
 
-  if (!SEGENV.allocateData(dataSize)) return mode_static(); //allocation failed
+  if (!SEGENV.allocateData(ParticleSystem::dataSize(maxRipples))) return mode_static(); //allocation failed
 
-  Ripple* ripples = reinterpret_cast<Ripple*>(SEGENV.data);
+  // a ripple is a particle that does not move, its age gives the wave state
+  ParticleSystem ripples;
+  ripples.begin(SEGENV.data, maxRipples);
 
   // ranbow background or chosen background, all very dim.
   if (rainbow) {
@@ -2200,45 +2206,43 @@ uint16_t WS2812FX::ripple_base(bool rainbow)
   }
 
   //draw wave
-  for (uint16_t i = 0; i < maxRipples; i++)
+  uint8_t rippledecay = (SEGMENT.speed >> 4) +1; //faster decay if faster propagation
+  for (uint16_t i = 0; i < ripples.count(); i++)
   {
-    uint16_t ripplestate = ripples[i].state;
-    if (ripplestate)
+    uint16_t ripplestate = 1 + ripples.age[i] * rippledecay;
+    if (ripplestate > 254) continue; //speed was lowered, dies with the next update
+    uint16_t rippleorigin = ParticleSystem::pixel(ripples.x[i]);
+    uint32_t col = color_from_palette(ripples.value[i], false, false, 255);
+    uint16_t propagation = ((ripplestate/rippledecay -1) * SEGMENT.speed);
+    int16_t propI = propagation >> 8;
+    uint8_t propF = propagation & 0xFF;
+    int16_t left = rippleorigin - propI -1;
+    uint8_t amp = (ripplestate < 17) ? triwave8((ripplestate-1)*8) : map(ripplestate,17,255,255,2);
+
+    for (int16_t v = left; v < left +4; v++)
     {
-      uint8_t rippledecay = (SEGMENT.speed >> 4) +1; //faster decay if faster propagation
-      uint16_t rippleorigin = ripples[i].pos;
-      uint32_t col = color_from_palette(ripples[i].color, false, false, 255);
-      uint16_t propagation = ((ripplestate/rippledecay -1) * SEGMENT.speed);
-      int16_t propI = propagation >> 8;
-      uint8_t propF = propagation & 0xFF;
-      int16_t left = rippleorigin - propI -1;
-      uint8_t amp = (ripplestate < 17) ? triwave8((ripplestate-1)*8) : map(ripplestate,17,255,255,2);
-
-      for (int16_t v = left; v < left +4; v++)
+      uint8_t mag = scale8(cubicwave8((propF>>2)+(v-left)*64), amp);
+      if (v < SEGLEN && v >= 0)
       {
-        uint8_t mag = scale8(cubicwave8((propF>>2)+(v-left)*64), amp);
-        if (v < SEGLEN && v >= 0)
-        {
-          setPixelColor(v, color_blend(getPixelColor(v), col, mag));
-        }
-        int16_t w = left + propI*2 + 3 -(v-left);
-        if (w < SEGLEN && w >= 0)
-        {
-          setPixelColor(w, color_blend(getPixelColor(w), col, mag));
-        }
+        setPixelColor(v, color_blend(getPixelColor(v), col, mag));
       }
-      ripplestate += rippledecay;
-      ripples[i].state = (ripplestate > 254) ? 0 : ripplestate;
-    } else //randomly create new wave
-    {
-      if (random16(IBN + 10000) <= SEGMENT.intensity)
+      int16_t w = left + propI*2 + 3 -(v-left);
+      if (w < SEGLEN && w >= 0)
       {
-        ripples[i].state = 1;
-        ripples[i].pos = random16(SEGLEN);
-        ripples[i].color = random8(); //color
+        setPixelColor(w, color_blend(getPixelColor(w), col, mag));
       }
     }
   }
+  ripples.update(); //ripples die when the state would pass 254
+
+  //randomly create new waves
+  for (uint16_t i = ripples.count(); i < maxRipples; i++)
+  {
+    if (random16(IBN + 10000) <= SEGMENT.intensity)
+    {
+      ripples.spawn((int32_t)random16(SEGLEN) << 16, 0, 253 / rippledecay + 1, random8());
+    }
+  }
   return FRAMETIME;
 }
 
@@ -2540,56 +2544,81 @@ uint16_t WS2812FX::mode_spots_fade()
 }
 
 
-//each needs 12 bytes
-//Spark type is used for popcorn and 1D fireworks
-typedef struct Ball {
-  unsigned long lastBounceTime;
-  float impactVelocity;
-  float height;
-} ball;
+/*
+ * Fixed point helpers for the particle effects below. Positions, heights and velocities are 16.16 fixed point.
+ */
+#define FX_ONE PS_ONE
+
+// integer square root
+static uint32_t fx_sqrt(uint64_t x) {
+  uint64_t r = 0, bit = (uint64_t)1 << 62;
+  while (bit > x) bit >>= 2;
+  while (bit) {
+    if (x >= r + bit) {
+      x -= r + bit;
+      r = (r >> 1) + bit;
+    } else {
+      r >>= 1;
+    }
+    bit >>= 2;
+  }
+  return r;
+}
+
+// integer part, rounded towards 0 like a float to int conversion
+static inline int fx_int(int32_t v) {
+  return (v < 0) ? -(-v >> 16) : (v >> 16);
+}
 
 /*
 *  Bouncing Balls Effect
+*  Heights are in segment lengths, velocities per second, every frame moves the balls by the time passed.
 */
 uint16_t WS2812FX::mode_bouncing_balls(void) {
   //allocate segment data
   uint16_t maxNumBalls = 16;
-  uint16_t dataSize = sizeof(ball) * maxNumBalls;
-  if (!SEGENV.allocateData(dataSize)) return mode_static(); //allocation failed
+  if (!SEGENV.allocateData(ParticleSystem::dataSize(maxNumBalls))) return mode_static(); //allocation failed
 
-  Ball* balls = reinterpret_cast<Ball*>(SEGENV.data);
+  ParticleSystem balls;
+  balls.begin(SEGENV.data, maxNumBalls);
+  balls.gravityX = -642908;                     // -9.81, standard value of gravity
+  const int32_t impactVelocityStart = 290289;   // sqrt(-2 * gravity)
 
   // number of balls based on intensity setting to max of 7 (cycles colors)
   // non-chosen color is a random color
-  uint8_t numBalls = int(((SEGMENT.intensity * (maxNumBalls - 0.8f)) / 255) + 1);
-
-  float gravity                           = -9.81; // standard value of gravity
-  float impactVelocityStart               = sqrt( -2 * gravity);
+  uint8_t numBalls = (SEGMENT.intensity * 76) / 1275 + 1;  // intensity * (maxNumBalls - 0.8) / 255 + 1
 
-  unsigned long time = millis();
+  uint32_t time = fxMillis();
 
   if (SEGENV.call == 0) {
-    for (uint8_t i = 0; i < maxNumBalls; i++) balls[i].lastBounceTime = time;
+    balls.clear();
+    for (uint8_t i = 0; i < maxNumBalls; i++) balls.spawn(0, impactVelocityStart);
+    SEGENV.step = time;
   }
 
+  uint32_t dt = time - SEGENV.step;
+  if (dt > 100) dt = 100;                       // no jumps after a stall
+  SEGENV.step = time;
+  balls.update((dt << 16) / (1000 * ((255-SEGMENT.speed)*8/256 +1)));
+
   bool hasCol2 = SEGCOLOR(2);
   fill(hasCol2 ? BLACK : SEGCOLOR(1));
 
-  for (uint8_t i = 0; i < numBalls; i++) {
-    float timeSinceLastBounce = (time - balls[i].lastBounceTime)/((255-SEGMENT.speed)*8/256 +1);
-    balls[i].height = 0.5 * gravity * pow(timeSinceLastBounce/1000 , 2.0) + balls[i].impactVelocity * timeSinceLastBounce/1000;
-
-    if (balls[i].height < 0) { //start bounce
-      balls[i].height = 0;
+  for (uint8_t i = 0; i < balls.count(); i++) {
+    if (balls.x[i] < 0) { //start bounce
+      // speed at the floor, not at the overshoot below it (v^2 = vx^2 - 2*g*x), so balls don't gain height
+      int64_t v2 = (int64_t)balls.vx[i] * balls.vx[i] - 2 * (int64_t)balls.gravityX * balls.x[i];
+      int32_t impactVelocity = (v2 > 0) ? fx_sqrt(v2) : 0;
+      balls.x[i] = 0;
       //damping for better effect using multiple balls
-      float dampening = 0.90 - float(i)/pow(numBalls,2);
-      balls[i].impactVelocity = dampening * balls[i].impactVelocity;
-      balls[i].lastBounceTime = time;
+      int32_t dampening = 58982 - (i * FX_ONE) / (numBalls * numBalls);  // 0.90 - i/numBalls^2
+      balls.vx[i] = ((int64_t)dampening * impactVelocity) >> 16;
 
-      if (balls[i].impactVelocity < 0.015) {
-        balls[i].impactVelocity = impactVelocityStart;
+      if (balls.vx[i] < 983) {                  // 0.015
+        balls.vx[i] = impactVelocityStart;
       }
     }
+    if (i >= numBalls) continue;
 
     uint32_t color = SEGCOLOR(0);
     if (SEGMENT.palette) {
@@ -2598,7 +2627,7 @@ uint16_t WS2812FX::mode_bouncing_balls(void) {
       color = SEGCOLOR(i % NUM_COLORS);
     }
 
-    uint16_t pos = round(balls[i].height * (SEGLEN - 1));
+    uint16_t pos = ((uint64_t)balls.x[i] * (SEGLEN - 1) + FX_ONE/2) >> 16;
     setPixelColor(pos, color);
   }
 
@@ -2670,15 +2699,6 @@ uint16_t WS2812FX::mode_glitter()
 
 
 
-//each needs 12 bytes
-//Spark type is used for popcorn, 1D fireworks, and drip
-typedef struct Spark {
-  float pos;
-  float vel;
-  uint16_t col;
-  uint8_t colIndex;
-} spark;
-
 /*
 *  POPCORN
 *  modified from https://github.com/kitesurfer1404/WS2812FX/blob/master/src/custom/Popcorn.h
@@ -2686,13 +2706,12 @@ typedef struct Spark {
 uint16_t WS2812FX::mode_popcorn(void) {
   //allocate segment data
   uint16_t maxNumPopcorn = 24;
-  uint16_t dataSize = sizeof(spark) * maxNumPopcorn;
-  if (!SEGENV.allocateData(dataSize)) return mode_static(); //allocation failed
-
-  Spark* popcorn = reinterpret_cast<Spark*>(SEGENV.data);
+  if (!SEGENV.allocateData(ParticleSystem::dataSize(maxNumPopcorn))) return mode_static(); //allocation failed
 
-  float gravity = -0.0001 - (SEGMENT.speed/200000.0); // m/s/s
-  gravity *= SEGLEN;
+  ParticleSystem popcorn;
+  popcorn.begin(SEGENV.data, maxNumPopcorn);
+  popcorn.gravityX = -(((int64_t)SEGLEN * FX_ONE) * (20 + SEGMENT.speed) / 200000); // (-0.0001 - speed/200000) * SEGLEN
+  popcorn.flags = PS_KILL_BELOW;
 
   bool hasCol2 = SEGCOLOR(2);
   fill(hasCol2 ? BLACK : SEGCOLOR(1));
@@ -2700,34 +2719,32 @@ uint16_t WS2812FX::mode_popcorn(void) {
   uint8_t numPopcorn = SEGMENT.intensity*maxNumPopcorn/255;
   if (numPopcorn == 0) numPopcorn = 1;
 
-  for(uint8_t i = 0; i < numPopcorn; i++) {
-    bool isActive = popcorn[i].pos >= 0.0f;
+  popcorn.update(); //kernels falling back below 0 are done
+  for (uint16_t i = 0; i < popcorn.count(); i++) {
+    uint8_t colIndex = popcorn.tag[i];
+    uint32_t col = color_wheel(colIndex);
+    if (!SEGMENT.palette && colIndex < NUM_COLORS) col = SEGCOLOR(colIndex);
 
-    if (isActive) { // if kernel is active, update its position
-      popcorn[i].pos += popcorn[i].vel;
-      popcorn[i].vel += gravity;
-      uint32_t col = color_wheel(popcorn[i].colIndex);
-      if (!SEGMENT.palette && popcorn[i].colIndex < NUM_COLORS) col = SEGCOLOR(popcorn[i].colIndex);
-
-      uint16_t ledIndex = popcorn[i].pos;
-      if (ledIndex < SEGLEN) setPixelColor(ledIndex, col);
-    } else { // if kernel is inactive, randomly pop it
-      if (random8() < 2) { // POP!!!
-        popcorn[i].pos = 0.01f;
+    int16_t ledIndex = ParticleSystem::pixel(popcorn.x[i]);
+    if (ledIndex < SEGLEN) setPixelColor(ledIndex, col);
+  }
 
-        uint16_t peakHeight = 128 + random8(128); //0-255
-        peakHeight = (peakHeight * (SEGLEN -1)) >> 8;
-        popcorn[i].vel = sqrt(-2.0 * gravity * peakHeight);
+  // randomly pop the inactive kernels
+  for (uint8_t i = popcorn.count(); i < numPopcorn; i++) {
+    if (random8() < 2) { // POP!!!
+      uint16_t peakHeight = 128 + random8(128); //0-255
+      peakHeight = (peakHeight * (SEGLEN -1)) >> 8;
+      int32_t vel = fx_sqrt(((uint64_t)2 * -popcorn.gravityX * peakHeight) << 16);
 
-        if (SEGMENT.palette)
-        {
-          popcorn[i].colIndex = random8();
-        } else {
-          byte col = random8(0, NUM_COLORS);
-          if (!hasCol2 || !SEGCOLOR(col)) col = 0;
-          popcorn[i].colIndex = col;
-        }
+      uint8_t colIndex;
+      if (SEGMENT.palette)
+      {
+        colIndex = random8();
+      } else {
+        colIndex = random8(0, NUM_COLORS);
+        if (!hasCol2 || !SEGCOLOR(colIndex)) colIndex = 0;
       }
+      popcorn.spawn(FX_ONE / 100, vel, 0, 0, colIndex);
     }
   }
 
@@ -2833,30 +2850,39 @@ uint16_t WS2812FX::mode_candle_multi()
 */
 #define STARBURST_MAX_FRAG 12
 
-//each needs 64 byte
+//each star needs 12 bytes, its fragments are particles tagged with the star index
 typedef struct particle {
-  CRGB     color;
   uint32_t birth  =0;
-  uint32_t last   =0;
-  float    vel    =0;
-  uint16_t pos    =-1;
-  float    fragment[STARBURST_MAX_FRAG];
+  uint16_t pos    =0;
+  CRGB     color;
 } star;
 
 uint16_t WS2812FX::mode_starburst(void) {
   uint8_t numStars = 1 + (SEGLEN >> 3);
   if (numStars > 15) numStars = 15;
-  uint16_t dataSize = sizeof(star) * numStars;
+  uint16_t numFragments = numStars * STARBURST_MAX_FRAG;
+  uint16_t dataSize = ParticleSystem::dataSize(numFragments, false, sizeof(star) * numStars);
 
   if (!SEGENV.allocateData(dataSize)) return mode_static(); //allocation failed
 
-  uint32_t it = millis();
+  uint32_t it = fxMillis();
 
-  star* stars = reinterpret_cast<star*>(SEGENV.data);
+  ParticleSystem fragments;
+  fragments.begin(SEGENV.data, numFragments, false, sizeof(star) * numStars);
+  star* stars = reinterpret_cast<star*>(fragments.extra);
 
-  float          maxSpeed                = 375.0f;  // Max velocity
-  float          particleIgnition        = 250.0f;  // How long to "flash"
-  float          particleFadeTime        = 1500.0f; // Fade out time
+  const int32_t  maxSpeed                = 375 * FX_ONE;  // Max velocity, pixels per second
+  const uint16_t particleIgnition        = 250;           // How long to "flash"
+  const uint16_t particleFadeTime        = 1500;          // Fade out time
+
+  // all fragments travel right, will be mirrored on other side. Steps are seconds and the
+  // fragments lose 3 times their velocity per second
+  if (SEGENV.call == 0) SEGENV.step = it;
+  uint32_t dt = it - SEGENV.step;               // ms
+  if (dt > 100) dt = 100;                       // no jumps after a stall
+  SEGENV.step = it;
+  fragments.drag = 3 * FX_ONE;
+  fragments.update((dt << 16) / 1000);
 
   for (int j = 0; j < numStars; j++)
   {
@@ -2865,85 +2891,80 @@ uint16_t WS2812FX::mode_starburst(void) {
     {
       // Pick a random color and location.
       uint16_t startPos = random16(SEGLEN-1);
-      float multiplier = (float)(random8())/255.0 * 1.0;
+      uint8_t multiplier = random8();
 
       stars[j].color = col_to_crgb(color_wheel(random8()));
       stars[j].pos = startPos;
-      stars[j].vel = maxSpeed * (float)(random8())/255.0 * multiplier;
       stars[j].birth = it;
-      stars[j].last = it;
+      int32_t vel = (int64_t)maxSpeed * random8() * multiplier / (255 * 255);
       // more fragments means larger burst effect
       int num = random8(3,6 + (SEGMENT.intensity >> 5));
 
-      for (int i=0; i < STARBURST_MAX_FRAG; i++) {
-        if (i < num) stars[j].fragment[i] = startPos;
-        else stars[j].fragment[i] = -1;
+      for (int i=0; i < num; i++) {
+        int var = i >> 1;
+        fragments.spawn((int32_t)startPos << 16, vel * var / 3, 0, 0, j);
       }
     }
   }
 
   fill(SEGCOLOR(1));
 
+  CRGB    colors[15];
+  int32_t sizes[15];
   for (int j=0; j<numStars; j++)
   {
-    if (stars[j].birth != 0) {
-      float dt = (it-stars[j].last)/1000.0;
-
-      for (int i=0; i < STARBURST_MAX_FRAG; i++) {
-        int var = i >> 1;
-
-        if (stars[j].fragment[i] > 0) {
-          //all fragments travel right, will be mirrored on other side
-          stars[j].fragment[i] += stars[j].vel * dt * (float)var/3.0;
-        }
-      }
-      stars[j].last = it;
-      stars[j].vel -= 3*stars[j].vel*dt;
-    }
-
     CRGB c = stars[j].color;
 
     // If the star is brand new, it flashes white briefly.
     // Otherwise it just fades over time.
-    float fade = 0.0f;
-    float age = it-stars[j].birth;
+    int32_t fade = 0;                           // 16.16
+    uint32_t age = it-stars[j].birth;
 
-    if (age < particleIgnition) {
-      c = col_to_crgb(color_blend(WHITE, crgb_to_col(c), 254.5f*((age / particleIgnition))));
+    if (stars[j].birth == 0) {
+      fade = FX_ONE;                            // no star, has no fragments
+    } else if (age < particleIgnition) {
+      c = col_to_crgb(color_blend(WHITE, crgb_to_col(c), age * 509 / (2 * particleIgnition)));   // 254.5 * age / particleIgnition
     } else {
       // Figure out how much to fade and shrink the star based on
       // its age relative to its lifetime
       if (age > particleIgnition + particleFadeTime) {
-        fade = 1.0f;                  // Black hole, all faded out
+        fade = FX_ONE;                // Black hole, all faded out
         stars[j].birth = 0;
         c = col_to_crgb(SEGCOLOR(1));
       } else {
         age -= particleIgnition;
-        fade = (age / particleFadeTime);  // Fading star
-        byte f = 254.5f*fade;
+        fade = (age << 16) / particleFadeTime;  // Fading star
+        byte f = age * 509 / (2 * particleFadeTime);
         c = col_to_crgb(color_blend(crgb_to_col(c), SEGCOLOR(1), f));
       }
     }
-
-    float particleSize = (1.0 - fade) * 2;
-
-    for (uint8_t index=0; index < STARBURST_MAX_FRAG*2; index++) {
-      bool mirrored = index & 0x1;
-      uint8_t i = index >> 1;
-      if (stars[j].fragment[i] > 0) {
-        float loc = stars[j].fragment[i];
-        if (mirrored) loc -= (loc-stars[j].pos)*2;
-        int start = loc - particleSize;
-        int end = loc + particleSize;
-        if (start < 0) start = 0;
-        if (start == end) end++;
-        if (end > SEGLEN) end = SEGLEN;
-        for (int p = start; p < end; p++) {
-          setPixelColor(p, c.r, c.g, c.b);
-        }
+    colors[j] = c;
+    sizes[j] = (FX_ONE - fade) * 2;
+  }
+
+  for (uint16_t k = 0; k < fragments.count(); k++) {
+    uint8_t j = fragments.tag[k];
+    CRGB c = colors[j];
+    for (uint8_t mirrored = 0; mirrored < 2; mirrored++) {
+      int32_t loc = fragments.x[k];
+      if (loc <= 0) break;
+      if (mirrored) loc -= (loc-((int32_t)stars[j].pos << 16))*2;
+      int start = fx_int(loc - sizes[j]);
+      int end = fx_int(loc + sizes[j]);
+      if (start < 0) start = 0;
+      if (start == end) end++;
+      if (end > SEGLEN) end = SEGLEN;
+      for (int p = start; p < end; p++) {
+        setPixelColor(p, c.r, c.g, c.b);
       }
     }
   }
+
+  // the fragments of burnt out stars are gone
+  for (uint16_t k = 0; k < fragments.count(); ) {
+    if (stars[fragments.tag[k]].birth == 0) fragments.kill(k);
+    else k++;
+  }
   return FRAMETIME;
 }
 
@@ -2958,8 +2979,7 @@ uint16_t WS2812FX::mode_exploding_fireworks(void)
   //allocate segment data
   uint16_t numSparks = 2 + (SEGLEN >> 1);
   if (numSparks > 80) numSparks = 80;
-  uint16_t dataSize = sizeof(spark) * numSparks;
-  if (!SEGENV.allocateData(dataSize)) return mode_static(); //allocation failed
+  if (!SEGENV.allocateData(ParticleSystem::dataSize(numSparks, false, sizeof(int32_t)))) return mode_static(); //allocation failed
 
   fill(BLACK);
 
@@ -2967,32 +2987,33 @@ uint16_t WS2812FX::mode_exploding_fireworks(void)
   //have fireworks start in either direction based on intensity
   SEGMENT.setOption(SEG_OPTION_REVERSED, SEGENV.step);
 
-  Spark* sparks = reinterpret_cast<Spark*>(SEGENV.data);
-  Spark* flare = sparks; //first spark is flare data
+  // the flare is particle 0 while it is launched, then the sparks replace it
+  ParticleSystem sparks;
+  sparks.begin(SEGENV.data, numSparks, false, sizeof(int32_t));
+  int32_t* dying_gravity = reinterpret_cast<int32_t*>(sparks.extra);
 
-  float gravity = -0.0004 - (SEGMENT.speed/800000.0); // m/s/s
-  gravity *= SEGLEN;
+  int32_t gravity = -(((int64_t)SEGLEN * FX_ONE) * (320 + SEGMENT.speed) / 800000); // (-0.0004 - speed/800000) * SEGLEN
 
   if (SEGENV.aux0 < 2) { //FLARE
     if (SEGENV.aux0 == 0) { //init flare
-      flare->pos = 0;
       uint16_t peakHeight = 75 + random8(180); //0-255
       peakHeight = (peakHeight * (SEGLEN -1)) >> 8;
-      flare->vel = sqrt(-2.0 * gravity * peakHeight);
-      flare->col = 255; //brightness
+      sparks.clear();
+      sparks.spawn(0, fx_sqrt(((uint64_t)2 * -gravity * peakHeight) << 16), 0, 255); //value is the brightness
 
       SEGENV.aux0 = 1;
     }
 
     // launch
-    if (flare->vel > 12 * gravity) {
+    if (sparks.vx[0] > 12 * gravity) {
       // flare
-      setPixelColor(int(flare->pos),flare->col,flare->col,flare->col);
+      uint8_t bri = sparks.value[0];
+      setPixelColor(ParticleSystem::pixel(sparks.x[0]), bri, bri, bri);
 
-      flare->pos += flare->vel;
-      flare->pos = constrain(flare->pos, 0, SEGLEN-1);
-      flare->vel += gravity;
-      flare->col -= 2;
+      sparks.gravityX = gravity;
+      sparks.move(0);
+      sparks.x[0] = constrain(sparks.x[0], 0, (int32_t)(SEGLEN-1) << 16);
+      sparks.value[0] -= 2;
     } else {
       SEGENV.aux0 = 2;  // ready to explode
     }
@@ -3003,35 +3024,36 @@ uint16_t WS2812FX::mode_exploding_fireworks(void)
      * Explosion happens where the flare ended.
      * Size is proportional to the height.
      */
-    int nSparks = flare->pos;
-    nSparks = constrain(nSparks, 0, numSparks);
-    static float dying_gravity;
-
     // initialize sparks
     if (SEGENV.aux0 == 2) {
+      int32_t flarePos = sparks.x[0];
+      int nSparks = flarePos >> 16;
+      nSparks = constrain(nSparks, 0, numSparks);
+
+      sparks.clear();
       for (int i = 1; i < nSparks; i++) {
-        sparks[i].pos = flare->pos;
-        sparks[i].vel = (float(random16(0, 20000)) / 10000.0) - 0.9; // from -0.9 to 1.1
-        sparks[i].col = 345;//abs(sparks[i].vel * 750.0); // set colors before scaling velocity to keep them bright
-        //sparks[i].col = constrain(sparks[i].col, 0, 345);
-        sparks[i].colIndex = random8();
-        sparks[i].vel *= flare->pos/SEGLEN; // proportional to height
-        sparks[i].vel *= -gravity *50;
+        int32_t vel = (int32_t)(random16(0, 20000) * (uint32_t)FX_ONE / 10000) - 58982; // from -0.9 to 1.1
+        vel = (int64_t)vel * flarePos / ((int32_t)SEGLEN << 16); // proportional to height
+        vel = ((int64_t)vel * (-gravity * 50)) >> 16;
+        sparks.spawn(flarePos, vel, 0, 345, random8()); //value is the heat, tag the color
       }
-      //sparks[1].col = 345; // this will be our known spark
-      dying_gravity = gravity/2;
+      *dying_gravity = gravity/2;
       SEGENV.aux0 = 3;
     }
 
-    if (sparks[1].col > 4) {//&& sparks[1].pos > 0) { // as long as our known spark is lit, work with all the sparks
-      for (int i = 1; i < nSparks; i++) {
-        sparks[i].pos += sparks[i].vel;
-        sparks[i].vel += dying_gravity;
-        if (sparks[i].col > 3) sparks[i].col -= 4;
+    // all sparks cool down alike, so any spark tells if they are still lit
+    if (sparks.count() && sparks.value[0] > 4) {
+      sparks.gravityX = *dying_gravity;
+      sparks.flags = PS_KILL_BELOW;
+      sparks.update();
+
+      for (uint16_t i = 0; i < sparks.count(); i++) {
+        if (sparks.value[i] > 3) sparks.value[i] -= 4;
 
-        if (sparks[i].pos > 0 && sparks[i].pos < SEGLEN) {
-          uint16_t prog = sparks[i].col;
-          uint32_t spColor = (SEGMENT.palette) ? color_wheel(sparks[i].colIndex) : SEGCOLOR(0);
+        int16_t pos = ParticleSystem::pixel(sparks.x[i]);
+        if (sparks.x[i] > 0 && pos < SEGLEN) {
+          uint16_t prog = sparks.value[i];
+          uint32_t spColor = (SEGMENT.palette) ? color_wheel(sparks.tag[i]) : SEGCOLOR(0);
           CRGB c = CRGB::Black; //HeatColor(sparks[i].col);
           if (prog > 300) { //fade from white to spark color
             c = col_to_crgb(color_blend(spColor, WHITE, (prog - 300)*5));
@@ -3041,10 +3063,10 @@ uint16_t WS2812FX::mode_exploding_fireworks(void)
             c.g = qsub8(c.g, cooling);
             c.b = qsub8(c.b, cooling * 2);
           }
-          setPixelColor(int(sparks[i].pos), c.red, c.green, c.blue);
+          setPixelColor(pos, c.red, c.green, c.blue);
         }
       }
-      dying_gravity *= .99; // as sparks burn out they fall slower
+      *dying_gravity -= *dying_gravity / 100; // as sparks burn out they fall slower
     } else {
       SEGENV.aux0 = 6 + random8(10); //wait for this many frames
     }
@@ -3069,67 +3091,68 @@ uint16_t WS2812FX::mode_exploding_fireworks(void)
 uint16_t WS2812FX::mode_drip(void)
 {
   //allocate segment data
-  uint16_t numDrops = 4;
-  uint16_t dataSize = sizeof(spark) * numDrops;
-  if (!SEGENV.allocateData(dataSize)) return mode_static(); //allocation failed
+  uint16_t maxNumDrops = 4;
+  if (!SEGENV.allocateData(ParticleSystem::dataSize(maxNumDrops))) return mode_static(); //allocation failed
 
   fill(SEGCOLOR(1));
 
-  Spark* drops = reinterpret_cast<Spark*>(SEGENV.data);
+  // drops keep their index, value is the brightness and tag the drop state
+  // (0 init, 1 forming, 2 falling, 5 bouncing)
+  ParticleSystem drops;
+  drops.begin(SEGENV.data, maxNumDrops);
+  while (!drops.full()) drops.spawn(0, 0);
 
-  numDrops = 1 + (SEGMENT.intensity >> 6);
+  uint8_t numDrops = 1 + (SEGMENT.intensity >> 6);
 
-  float gravity = -0.0005 - (SEGMENT.speed/50000.0);
-  gravity *= SEGLEN;
+  drops.gravityX = -(((int64_t)SEGLEN * FX_ONE) * (25 + SEGMENT.speed) / 50000); // (-0.0005 - speed/50000) * SEGLEN
   int sourcedrop = 12;
 
   for (uint8_t j=0;j<numDrops;j++) {
-    if (drops[j].colIndex == 0) { //init
-      drops[j].pos = SEGLEN-1;    // start at end
-      drops[j].vel = 0;           // speed
-      drops[j].col = sourcedrop;  // brightness
-      drops[j].colIndex = 1;      // drop state (0 init, 1 forming, 2 falling, 5 bouncing)
+    if (drops.tag[j] == 0) { //init
+      drops.x[j] = (int32_t)(SEGLEN-1) << 16;  // start at end
+      drops.vx[j] = 0;            // speed
+      drops.value[j] = sourcedrop;// brightness
+      drops.tag[j] = 1;           // forming
     }
 
     setPixelColor(SEGLEN-1,color_blend(BLACK,SEGCOLOR(0), sourcedrop));// water source
-    if (drops[j].colIndex==1) {
-      if (drops[j].col>255) drops[j].col=255;
-      setPixelColor(uint16_t(drops[j].pos),color_blend(BLACK,SEGCOLOR(0),drops[j].col));
+    if (drops.tag[j]==1) {
+      if (drops.value[j]>255) drops.value[j]=255;
+      setPixelColor(ParticleSystem::pixel(drops.x[j]),color_blend(BLACK,SEGCOLOR(0),drops.value[j]));
 
-      drops[j].col += map(SEGMENT.speed, 0, 255, 1, 6); // swelling
+      drops.value[j] += map(SEGMENT.speed, 0, 255, 1, 6); // swelling
 
-      if (random8() < drops[j].col/10) {               // random drop
-        drops[j].colIndex=2;               //fall
-        drops[j].col=255;
+      if (random8() < drops.value[j]/10) {     // random drop
+        drops.tag[j]=2;                       //fall
+        drops.value[j]=255;
       }
     }
-    if (drops[j].colIndex > 1) {           // falling
-      if (drops[j].pos > 0) {              // fall until end of segment
-        drops[j].pos += drops[j].vel;
-        if (drops[j].pos < 0) drops[j].pos = 0;
-        drops[j].vel += gravity;
+    if (drops.tag[j] > 1) {                   // falling
+      if (drops.x[j] > 0) {                   // fall until end of segment
+        drops.move(j);
+        if (drops.x[j] < 0) drops.x[j] = 0;
 
-        for (uint16_t i=1;i<7-drops[j].colIndex;i++) { // some minor math so we don't expand bouncing droplets
-          uint16_t pos = constrain(uint16_t(drops[j].pos) +i, 0, SEGLEN-1); //this is BAD, returns a pos >= SEGLEN occasionally
-          setPixelColor(pos,color_blend(BLACK,SEGCOLOR(0),drops[j].col/i)); //spread pixel with fade while falling
+        for (uint16_t i=1;i<7-drops.tag[j];i++) { // some minor math so we don't expand bouncing droplets
+          uint16_t pos = constrain(ParticleSystem::pixel(drops.x[j]) +i, 0, SEGLEN-1);
+          setPixelColor(pos,color_blend(BLACK,SEGCOLOR(0),drops.value[j]/i)); //spread pixel with fade while falling
         }
 
-        if (drops[j].colIndex > 2) {       // during bounce, some water is on the floor
-          setPixelColor(0,color_blend(SEGCOLOR(0),BLACK,drops[j].col));
+        if (drops.tag[j] > 2) {               // during bounce, some water is on the floor
+          setPixelColor(0,color_blend(SEGCOLOR(0),BLACK,drops.value[j]));
         }
-      } else {                             // we hit bottom
-        if (drops[j].colIndex > 2) {       // already hit once, so back to forming
-          drops[j].colIndex = 0;
-          drops[j].col = sourcedrop;
+      } else {                                // we hit bottom
+        if (drops.tag[j] > 2) {               // already hit once, so back to forming
+          drops.tag[j] = 0;
+          drops.value[j] = sourcedrop;
 
         } else {
 
-          if (drops[j].colIndex==2) {      // init bounce
-            drops[j].vel = -drops[j].vel/4;// reverse velocity with damping
-            drops[j].pos += drops[j].vel;
+          if (drops.tag[j]==2) {              // init bounce
+            drops.vx[j] = -drops.vx[j]/4;     // reverse velocity with damping
+            drops.x[j] += drops.vx[j];
           }
-          drops[j].col = sourcedrop*2;
-          drops[j].colIndex = 5;           // bouncing
+          drops.value[j] = sourcedrop*2;
+          drops.tag[j] = 5;                   // bouncing
         }
       }
     }
@@ -3267,7 +3290,7 @@ uint16_t WS2812FX::mode_heartbeat(void) {
   bri_lower = bri_lower * 2042 / (2048 + SEGMENT.intensity);
   SEGENV.aux1 = bri_lower;
 
-  unsigned long beatTimer = millis() - SEGENV.step;
+  unsigned long beatTimer = fxMillis() - SEGENV.step;
   if((beatTimer > secondBeat) && !SEGENV.aux0) { // time for the second beat?
     SEGENV.aux1 = UINT16_MAX; //full bri
     SEGENV.aux0 = 1;
@@ -3275,7 +3298,7 @@ uint16_t WS2812FX::mode_heartbeat(void) {
   if(beatTimer > msPerBeat) { // time to reset the beat timer?
     SEGENV.aux1 = UINT16_MAX; //full bri
     SEGENV.aux0 = 0;
-    SEGENV.step = millis();
+    SEGENV.step = fxMillis();
   }
 
   for (uint16_t i = 0; i < SEGLEN; i++) {
@@ -3425,14 +3448,14 @@ uint16_t WS2812FX::mode_sunrise() {
   //speed 60 - 120 : sunset time in minutes - 60;
   //speed above: "breathing" rise and set
   if (SEGENV.call == 0 || SEGMENT.speed != SEGENV.aux0) {
-	  SEGENV.step = millis(); //save starting time, millis() because now can change from sync
+	  SEGENV.step = fxMillis(); //save starting time, fxMillis() because now can change from sync
     SEGENV.aux0 = SEGMENT.speed;
   }
 
   fill(0);
   uint16_t stage = 0xFFFF;
 
-  uint32_t s10SinceStart = (millis() - SEGENV.step) /100; //tenths of seconds
+  uint32_t s10SinceStart = (fxMillis() - SEGENV.step) /100; //tenths of seconds
 
   if (SEGMENT.speed > 120) { //quick sunrise and sunset
 	  uint16_t counter = (now >> 1) * (((SEGMENT.speed -120) >> 1) +1);
@@ -3473,21 +3496,21 @@ uint16_t WS2812FX::mode_sunrise() {
  */
 uint16_t WS2812FX::phased_base(uint8_t moder) {                  // We're making sine waves here. By Andrew Tuline.
 
+  if (!SEGENV.allocateData(sizeof(float))) return mode_static(); //allocation failed
+  float* phase = reinterpret_cast<float*>(SEGENV.data);         // Phase change value gets calculated, starts at 0.
+
   uint8_t allfreq = 16;                                          // Base frequency.
-  //float* phasePtr = reinterpret_cast<float*>(SEGENV.step);     // Phase change value gets calculated.
-  static float phase = 0;//phasePtr[0];
   uint8_t cutOff = (255-SEGMENT.intensity);                      // You can change the number of pixels.  AKA INTENSITY (was 192).
   uint8_t modVal = 5;//SEGMENT.fft1/8+1;                         // You can change the modulus. AKA FFT1 (was 5).
 
   uint8_t index = now/64;                                        // Set color rotation speed
-  phase += SEGMENT.speed/32.0;                                   // You can change the speed of the wave. AKA SPEED (was .4)
-  //phasePtr[0] = phase;
+  *phase += SEGMENT.speed/32.0;                                  // You can change the speed of the wave. AKA SPEED (was .4)
 
   for (int i = 0; i < SEGLEN; i++) {
     if (moder == 1) modVal = (inoise8(i*10 + i*10) /16);         // Let's randomize our mod length with some Perlin noise.
     uint16_t val = (i+1) * allfreq;                              // This sets the frequency of the waves. The +1 makes sure that leds[0] is used.
     if (modVal == 0) modVal = 1;
-    val += phase * (i % modVal +1) /2;                           // This sets the varying phase change of the waves. By Andrew Tuline.
+    val += *phase * (i % modVal +1) /2;                           // This sets the varying phase change of the waves. By Andrew Tuline.
     uint8_t b = cubicwave8(val);                                 // Now we make an 8 bit sinewave.
     b = (b > cutOff) ? (b - cutOff) : 0;                         // A ternary operator to cutoff the light.
     setPixelColor(i, color_blend(SEGCOLOR(1), color_from_palette(index, false, false, 0), b));
@@ -3533,9 +3556,9 @@ uint16_t WS2812FX::mode_noisepal(void) {                      // Slow noise pale
   CRGBPalette16* palettes = reinterpret_cast<CRGBPalette16*>(SEGENV.data);
 
   uint16_t changePaletteMs = 4000 + SEGMENT.speed *10;        //between 4 - 6.5sec
-  if (millis() - SEGENV.step > changePaletteMs)
+  if (fxMillis() - SEGENV.step > changePaletteMs)
   {
-    SEGENV.step = millis();
+    SEGENV.step = fxMillis();
 
     uint8_t baseI = random8();
     palettes[1] = CRGBPalette16(CHSV(baseI+random8(64), 255, random8(128,255)), CHSV(baseI+128, 255, random8(128,255)), CHSV(baseI+random8(92), 192, random8(128,255)), CHSV(baseI+random8(92), 255, random8(128,255)));
@@ -3676,7 +3699,7 @@ uint16_t WS2812FX::mode_dancing_shadows(void)
 
   fill(BLACK);
 
-  unsigned long time = millis();
+  unsigned long time = fxMillis();
   bool respawn = false;
 
   for (uint8_t i = 0; i < numSpotlights; i++) {
@@ -3862,8 +3885,8 @@ uint16_t WS2812FX::mode_tv_simulator(void) {
   }
 
     // create a new sceene
-    if (((millis() - tvSimulator->sceeneStart) >= tvSimulator->sceeneDuration) || SEGENV.aux1 == 0) {
-      tvSimulator->sceeneStart    = millis();                                               // remember the start of the new sceene
+    if (((fxMillis() - tvSimulator->sceeneStart) >= tvSimulator->sceeneDuration) || SEGENV.aux1 == 0) {
+      tvSimulator->sceeneStart    = fxMillis();                                               // remember the start of the new sceene
       tvSimulator->sceeneDuration = random16(60* 250* colorSpeed, 60* 750 * colorSpeed);    // duration of a "movie sceene" which has similar colors (5 to 15 minutes with max speed slider)
       tvSimulator->sceeneColorHue = random16(   0, 768);                                    // random start color-tone for the sceene
       tvSimulator->sceeneColorSat = random8 ( 100, 130 + colorIntensity);                   // random start color-saturation for the sceene
@@ -3914,11 +3937,11 @@ uint16_t WS2812FX::mode_tv_simulator(void) {
     tvSimulator->fadeTime  = random16(0, tvSimulator->totalTime);   // Pixel-to-pixel transition time
     if (random8(10) < 3) tvSimulator->fadeTime = 0;                 // Force scene cut 30% of time
 
-    tvSimulator->startTime = millis();
+    tvSimulator->startTime = fxMillis();
   } // end of initialization
 
   // how much time is elapsed ?
-  tvSimulator->elapsed = millis() - tvSimulator->startTime;
+  tvSimulator->elapsed = fxMillis() - tvSimulator->startTime;
 
   // fade from prev volor to next color
   if (tvSimulator->elapsed < tvSimulator->fadeTime) {
@@ -3970,15 +3993,15 @@ class AuroraWave {
 
   public:
     void init(uint32_t segment_length, CRGB color) {
-      ttl = random(500, 1501);
+      ttl = random16(500, 1501);
       basecolor = color;
-      basealpha = random(60, 101) / (float)100;
+      basealpha = random16(60, 101) / (float)100;
       age = 0;
-      width = random(segment_length / 20, segment_length / W_WIDTH_FACTOR); //half of width to make math easier
+      width = random16(segment_length / 20, segment_length / W_WIDTH_FACTOR); //half of width to make math easier
       if (!width) width = 1;
-      center = random(101) / (float)100 * segment_length;
-      goingleft = random(0, 2) == 0;
-      speed_factor = (random(10, 31) / (float)100 * W_MAX_SPEED / 255);
+      center = random16(101) / (float)100 * segment_length;
+      goingleft = random16(0, 2) == 0;
+      speed_factor = (random16(10, 31) / (float)100 * W_MAX_SPEED / 255);
       alive = true;
     }
 
@@ -4060,7 +4083,7 @@ uint16_t WS2812FX::mode_aurora(void) {
     waves = reinterpret_cast<AuroraWave*>(SEGENV.data);
 
     for(int i = 0; i < SEGENV.aux1; i++) {
-      waves[i].init(SEGLEN, col_to_crgb(color_from_palette(random8(), false, false, random(0, 3))));
+      waves[i].init(SEGLEN, col_to_crgb(color_from_palette(random8(), false, false, random16(0, 3))));
     }
   } else {
     waves = reinterpret_cast<AuroraWave*>(SEGENV.data);
@@ -4072,7 +4095,7 @@ uint16_t WS2812FX::mode_aurora(void) {
 
     if(!(waves[i].stillAlive())) {
       //If a wave dies, reinitialize it starts over.
-      waves[i].init(SEGLEN, col_to_crgb(color_from_palette(random8(), false, false, random(0, 3))));
+      waves[i].init(SEGLEN, col_to_crgb(color_from_palette(random8(), false, false, random16(0, 3))));
     }
   }
 
@@ -4106,9 +4129,9 @@ uint16_t WS2812FX::mode_aurora(void) {
 //    Start of Audio Reactive fork     //
 /////////////////////////////////////////
 
-// FastLED array, so we can refer to leds[i] instead of the lossy getPixel() and setPixel()
-uint32_t ledData[MAX_LEDS];                     // See const.h for a value of 1500.
-uint32_t dataStore[4096];                       // we are declaring a storage area or 64 x 64 (4096) words.
+// Effects that need a FastLED array, so we can refer to leds[i] instead of the lossy getPixel() and setPixel(),
+// keep it in their segment data (SEGENV.allocateData(sizeof(CRGB) * SEGLEN)), so it only takes memory
+// while such an effect runs and segments running it at the same time don't overwrite each other.
 
 
 // Sound reactive external variables
@@ -4126,9 +4149,19 @@ extern uint8_t binNum;
 // FFT based variables
 extern double FFT_MajorPeak;
 extern double FFT_Magnitude;
-extern double fftBin[];                         // raw FFT data
+extern float fftBin[];                          // raw FFT data, samples/2 (256) bins
 extern int fftResult[];                         // summary of bins array. 16 summary bins.
 extern float fftAvg[];
+extern uint32_t audioFrameSeq;                  // changes whenever new audio data arrived
+extern uint8_t fftBandResult[];                 // fftBandCount logarithmic bands, configurable 8-64
+extern uint8_t fftBandCount;                    // 0 if only the 16 fftResult[] bands are available
+extern float beatBpm;                           // detected tempo, 0 if there is none
+extern uint8_t beatPhase;                       // 0-255 within the current beat, 0 on the beat
+extern uint16_t beatCount;                      // increases with every beat
+
+// Number of bands the GEQ style effects can show and the value (0-254) of one of them
+static inline uint8_t geqBandCount() { return fftBandCount ? fftBandCount : 16; }
+static inline int geqBand(uint8_t band) { return fftBandCount ? fftBandResult[band] : fftResult[band]; }
 
 
 ///////////////////////////////////////
@@ -4162,7 +4195,7 @@ uint16_t WS2812FX::mode_perlinmove(void) {
 
   fade_out(255-SEGMENT.fft1);
   for (int i=0; i<SEGMENT.intensity/16+1; i++) {
-    uint16_t locn = inoise16(millis()*128/(260-SEGMENT.speed)+i*15000, millis()*128/(260-SEGMENT.speed));   // Get a new pixel location from moving noise.
+    uint16_t locn = inoise16(fxMillis()*128/(260-SEGMENT.speed)+i*15000, fxMillis()*128/(260-SEGMENT.speed));   // Get a new pixel location from moving noise.
     uint16_t pixloc = map(locn,50*256,192*256,0,SEGLEN)%(SEGLEN);                       // Map that to the length of the strand, and ensure we don't go over.
     setPixelColor(pixloc, color_blend(SEGCOLOR(1), color_from_palette(pixloc%255, false, PALETTE_SOLID_WRAP, 0), 255));
   }
@@ -4191,17 +4224,11 @@ typedef struct Julia {              // We can't use the 'static' keyword for per
 
 uint16_t WS2812FX::mode_2DJulia(void) {                           // An animated Julia set by Andrew Tuline
 
-  if (matrixWidth * matrixHeight > SEGLEN || matrixWidth < 4 || matrixHeight < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // No, we're not going to overrun the segment.
-
-  // UNUSED VARIABLE WARNING
-  // CRGB *leds = (CRGB*) ledData;
+  if (SEGWIDTH < 4 || SEGHEIGHT < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // Segment geometry is too small for a 2D effect.
 
   if (!SEGENV.allocateData(sizeof(julia))) return mode_static();  // We use this method for allocating memory for static variables.
   Julia* julias = reinterpret_cast<Julia*>(SEGENV.data);          // Because 'static' doesn't work with SEGMENTS.
 
-  float reAl;
-  float imAg;
-
   if (SEGENV.call == 0) {           // Reset the center if we've just re-started this animation.
     julias->xcen = 0.;
     julias->ycen = 0.;
@@ -4219,79 +4246,25 @@ uint16_t WS2812FX::mode_2DJulia(void) {                           // An animated
   if (julias->xymag < 0.01) julias->xymag = 0.01;
   if (julias->xymag > 1.0) julias->xymag = 1.0;
 
-  float xmin = julias->xcen - julias->xymag;
-  float xmax = julias->xcen + julias->xymag;
-  float ymin = julias->ycen - julias->xymag;
-  float ymax = julias->ycen + julias->xymag;
-
-// Whole set should be within -1.2,1.2 to -.8 to 1.
-  xmin = constrain(xmin,-1.2,1.2);
-  xmax = constrain(xmax,-1.2,1.2);
-  ymin = constrain(ymin,-.8,1.0);
-  ymax = constrain(ymax,-.8,1.0);
-
-  float dx;                       // Delta x is mapped to the matrix size.
-  float dy;                       // Delta y is mapped to the matrix size.
-
-  int maxIterations = 15;         // How many iterations per pixel before we give up. Make it 8 bits to match our range of colours.
-  float maxCalc = 16.0;           // How big is each calculation allowed to be before we give up.
-
-  maxIterations = SEGMENT.intensity/2;
-
-
-// Resize section on the fly for some animaton.
-  reAl = -0.94299;                // PixelBlaze example
-  imAg = 0.3162;
-
-  reAl += sin((float)millis()/305.)/20.;
-  imAg += sin((float)millis()/405.)/20.;
-
-//  Serial.print(reAl,4); Serial.print("\t"); Serial.print(imAg,4); Serial.println(" ");
-
-  dx = (xmax - xmin) / (matrixWidth);     // Scale the delta x and y values to our matrix size.
-  dy = (ymax - ymin) / (matrixHeight);
+  // Resize section on the fly for some animaton, the iteration is in fx_julia.h
+  JuliaView view = juliaView(fxMillis(), SEGMENT.intensity, julias->xcen, julias->ycen, julias->xymag);
+  int maxIterations = view.maxIterations;
 
-  // Start y
-  float y = ymin;
-  for (int j = 0; j < matrixHeight; j++) {
-
-    // Start x
-    float x = xmin;
-    for (int i = 0; i < matrixWidth; i++) {
-
-      // Now we test, as we iterate z = z^2 + c does z tend towards infinity?
-      float a = x;
-      float b = y;
-      int iter = 0;
-
-      while (iter < maxIterations) {    // Here we determine whether or not we're out of bounds.
-        float aa = a * a;
-        float bb = b * b;
-        float len = aa + bb;
-        if (len > maxCalc) {            // |z| = sqrt(a^2+b^2) OR z^2 = a^2+b^2 to save on having to perform a square root.
-          break;  // Bail
-        }
-
-       // This operation corresponds to z -> z^2+c where z=a+ib c=(x,y). Remember to use 'foil'.
-        b = 2*a*b + imAg;
-        a = aa - bb + reAl;
-        iter++;
-      } // while
-
-      // We color each pixel based on how long it takes to get to infinity, or black if it never gets there.
-      if (iter == maxIterations) {
-//        leds[XY(i,j)] = CRGB::Black;            // Calculation kept on going, so it was within the set.
-        setPixelColor(XY(i,j),0);
-      } else {
-//        leds[XY(i,j)] = CHSV(iter*255/maxIterations,255,255);   // Near the edge of the set.
-        setPixelColor(XY(i,j), color_blend(SEGCOLOR(1), color_from_palette(iter*255/maxIterations, false, PALETTE_SOLID_WRAP, 0), 255));
-      }
-      x += dx;
+  // We color each pixel based on how long it takes to get to infinity, or black if it never gets there.
+  auto pixel = [this, maxIterations](int i, int j, int iter) {
+    if (iter == maxIterations) {
+      setPixelColor(XY(i,j),0);     // Calculation kept on going, so it was within the set.
+    } else {
+      setPixelColor(XY(i,j), color_blend(SEGCOLOR(1), color_from_palette(iter*255/maxIterations, false, PALETTE_SOLID_WRAP, 0), 255));
     }
-    y += dy;
-  }
+  };
+#ifdef WLED_FX_FIXED_POINT
+  juliaFixed(view, SEGWIDTH, SEGHEIGHT, pixel);
+#else
+  juliaFloat(view, SEGWIDTH, SEGHEIGHT, pixel);
+#endif
 
-//  blur2d( leds, matrixWidth, matrixHeight, 64);
+//  blur2d( leds, SEGWIDTH, SEGHEIGHT, 64);
 
 //  setPixels(leds);       // Use this ONLY if we're going to display via leds[x] method.
   return FRAMETIME;
@@ -4313,7 +4286,7 @@ uint16_t WS2812FX::mode_pixels(void) {                    // Pixels. By Andrew T
   fade_out(SEGMENT.speed);
 
   for (int i=0; i <SEGMENT.intensity/16; i++) {
-    uint16_t segLoc = random(SEGLEN);                     // 16 bit for larger strands of LED's.
+    uint16_t segLoc = random16(SEGLEN);                     // 16 bit for larger strands of LED's.
     setPixelColor(segLoc, color_blend(SEGCOLOR(1), color_from_palette(myVals[i%32]+i*4, false, PALETTE_SOLID_WRAP, 0), sampleAgc));
   }
 
@@ -4327,14 +4300,15 @@ uint16_t WS2812FX::mode_pixels(void) {                    // Pixels. By Andrew T
 
 uint16_t WS2812FX::mode_pixelwave(void) {                 // Pixelwave. By Andrew Tuline.
 
-  CRGB *leds = (CRGB*) ledData;
+  if (!SEGENV.allocateData(sizeof(CRGB) * SEGLEN)) return mode_static(); //allocation failed
+  CRGB *leds = reinterpret_cast<CRGB*>(SEGENV.data);
   if (SEGENV.call == 0) fill_solid(leds,SEGLEN, 0);
   uint8_t secondHand = micros()/(256-SEGMENT.speed)/500+1 % 16;
 
   if(SEGENV.aux0 != secondHand) {
     SEGENV.aux0 = secondHand;
     int pixBri = sample * SEGMENT.intensity / 64;
-    leds[SEGLEN/2] = color_blend(SEGCOLOR(1), color_from_palette(millis(), false, PALETTE_SOLID_WRAP, 0), pixBri);
+    leds[SEGLEN/2] = color_blend(SEGCOLOR(1), color_from_palette(fxMillis(), false, PALETTE_SOLID_WRAP, 0), pixBri);
 
     for (int i=SEGLEN-1; i>SEGLEN/2; i--) {               // Move to the right.
       leds[i] = leds[i-1];
@@ -4357,7 +4331,7 @@ uint16_t WS2812FX::mode_juggles(void) {                   // Juggles. By Andrew
 
   fade_out(224);
   for (int i=0; i<SEGMENT.intensity/32+1; i++) {
-          setPixelColor(beatsin16(SEGMENT.speed/4+i*2,0,SEGLEN-1), color_blend(SEGCOLOR(1), color_from_palette(millis()/4+i*2, false, PALETTE_SOLID_WRAP, 0), sampleAgc));
+          setPixelColor(beatsin16(SEGMENT.speed/4+i*2,0,SEGLEN-1), color_blend(SEGCOLOR(1), color_from_palette(fxMillis()/4+i*2, false, PALETTE_SOLID_WRAP, 0), sampleAgc));
   }
 
   return FRAMETIME;
@@ -4369,14 +4343,15 @@ uint16_t WS2812FX::mode_juggles(void) {                   // Juggles. By Andrew
 //////////////////////
 
 uint16_t WS2812FX::mode_matripix(void) {                  // Matripix. By Andrew Tuline.
-  CRGB *leds = (CRGB*) ledData;
+  if (!SEGENV.allocateData(sizeof(CRGB) * SEGLEN)) return mode_static(); //allocation failed
+  CRGB *leds = reinterpret_cast<CRGB*>(SEGENV.data);
   if (SEGENV.call == 0) fill_solid(leds,SEGLEN, 0);
 
   uint8_t secondHand = micros()/(256-SEGMENT.speed)/500 % 16;
   if(SEGENV.aux0 != secondHand) {
     SEGENV.aux0 = secondHand;
     int pixBri = sample * SEGMENT.intensity / 64;
-    leds[SEGLEN-1] = color_blend(SEGCOLOR(1), color_from_palette(millis(), false, PALETTE_SOLID_WRAP, 0), pixBri);
+    leds[SEGLEN-1] = color_blend(SEGCOLOR(1), color_from_palette(fxMillis(), false, PALETTE_SOLID_WRAP, 0), pixBri);
     for (int i=0; i<SEGLEN-1; i++) leds[i] = leds[i+1];
   }
 
@@ -4410,7 +4385,7 @@ uint16_t WS2812FX::mode_gravimeter(void) {                // Gravmeter. By Andre
   uint8_t gravity = 8 - SEGMENT.speed/32;
 
   for (int i=0; i<tempsamp; i++) {
-    uint8_t index = inoise8(i*segmentSampleAvg+millis(), 5000+i*segmentSampleAvg);
+    uint8_t index = inoise8(i*segmentSampleAvg+fxMillis(), 5000+i*segmentSampleAvg);
     setPixelColor(i, color_blend(SEGCOLOR(1), color_from_palette(index, false, PALETTE_SOLID_WRAP, 0), segmentSampleAvg*8));
   }
 
@@ -4420,7 +4395,7 @@ uint16_t WS2812FX::mode_gravimeter(void) {                // Gravmeter. By Andre
     gravcen->topLED--;
 
   if (gravcen->topLED > 0) {
-    setPixelColor(gravcen->topLED, color_blend(SEGCOLOR(1), color_from_palette(millis(), false, PALETTE_SOLID_WRAP, 0), 255));
+    setPixelColor(gravcen->topLED, color_blend(SEGCOLOR(1), color_from_palette(fxMillis(), false, PALETTE_SOLID_WRAP, 0), 255));
   }
   gravcen->gravityCounter = (gravcen->gravityCounter + 1) % gravity;
 
@@ -4446,7 +4421,7 @@ uint16_t WS2812FX::mode_gravcenter(void) {                // Gravcenter. By Andr
   uint8_t gravity = 8 - SEGMENT.speed/32;
 
   for (int i=0; i<tempsamp; i++) {
-    uint8_t index = inoise8(i*segmentSampleAvg+millis(), 5000+i*segmentSampleAvg);
+    uint8_t index = inoise8(i*segmentSampleAvg+fxMillis(), 5000+i*segmentSampleAvg);
     setPixelColor(i+SEGLEN/2, color_blend(SEGCOLOR(1), color_from_palette(index, false, PALETTE_SOLID_WRAP, 0), segmentSampleAvg*8));
     setPixelColor(SEGLEN/2-i-1, color_blend(SEGCOLOR(1), color_from_palette(index, false, PALETTE_SOLID_WRAP, 0), segmentSampleAvg*8));
   }
@@ -4457,8 +4432,8 @@ uint16_t WS2812FX::mode_gravcenter(void) {                // Gravcenter. By Andr
     gravcen->topLED--;
 
   if (gravcen->topLED >= 0) {
-    setPixelColor(gravcen->topLED+SEGLEN/2, color_blend(SEGCOLOR(1), color_from_palette(millis(), false, PALETTE_SOLID_WRAP, 0), 255));
-    setPixelColor(SEGLEN/2-1-gravcen->topLED, color_blend(SEGCOLOR(1), color_from_palette(millis(), false, PALETTE_SOLID_WRAP, 0), 255));
+    setPixelColor(gravcen->topLED+SEGLEN/2, color_blend(SEGCOLOR(1), color_from_palette(fxMillis(), false, PALETTE_SOLID_WRAP, 0), 255));
+    setPixelColor(SEGLEN/2-1-gravcen->topLED, color_blend(SEGCOLOR(1), color_from_palette(fxMillis(), false, PALETTE_SOLID_WRAP, 0), 255));
   }
   gravcen->gravityCounter = (gravcen->gravityCounter + 1) % gravity;
 
@@ -4485,7 +4460,7 @@ uint16_t WS2812FX::mode_gravcentric(void) {               // Gravcenter. By Andr
   uint8_t gravity = 8 - SEGMENT.speed/32;
 
   for (int i=0; i<tempsamp; i++) {
-    uint8_t index = segmentSampleAvg*24+millis()/200;
+    uint8_t index = segmentSampleAvg*24+fxMillis()/200;
     setPixelColor(i+SEGLEN/2, color_blend(SEGCOLOR(0), color_from_palette(index, false, PALETTE_SOLID_WRAP, 0), 255));
     setPixelColor(SEGLEN/2-1-i, color_blend(SEGCOLOR(0), color_from_palette(index, false, PALETTE_SOLID_WRAP, 0), 255));
   }
@@ -4541,22 +4516,19 @@ uint16_t WS2812FX::mode_midnoise(void) {                  // Midnoise. By Andrew
 // I am the god of hellfire. . . Volume (only) reactive fire routine. Oh, look how short this is.
 uint16_t WS2812FX::mode_noisefire(void) {                 // Noisefire. By Andrew Tuline.
 
-  CRGB *leds = (CRGB*) ledData;
-
   currentPalette = CRGBPalette16(CHSV(0,255,2), CHSV(0,255,4), CHSV(0,255,8), CHSV(0, 255, 8),  // Fire palette definition. Lower value = darker.
                                  CHSV(0, 255, 16), CRGB::Red, CRGB::Red, CRGB::Red,
                                  CRGB::DarkOrange,CRGB::DarkOrange, CRGB::Orange, CRGB::Orange,
                                  CRGB::Yellow, CRGB::Orange, CRGB::Yellow, CRGB::Yellow);
 
   for (int i = 0; i < SEGLEN; i++) {
-    uint16_t index = inoise8(i*SEGMENT.speed/64,millis()*SEGMENT.speed/64*SEGLEN/255);  // X location is constant, but we move along the Y at the rate of millis(). By Andrew Tuline.
+    uint16_t index = inoise8(i*SEGMENT.speed/64,fxMillis()*SEGMENT.speed/64*SEGLEN/255);  // X location is constant, but we move along the Y at the rate of millis(). By Andrew Tuline.
     index = (255 - i*256/SEGLEN) * index/(256-SEGMENT.intensity);                       // Now we need to scale index so that it gets blacker as we get close to one of the ends.
                                                                                         // This is a simple y=mx+b equation that's been scaled. index/128 is another scaling.
     CRGB color = ColorFromPalette(currentPalette, index, sampleAvg*2, LINEARBLEND);     // Use the my own palette.
-    leds[i] = color;
+    setPixelColor(i, color.red, color.green, color.blue);
   }
 
-  setPixels(leds);
   return FRAMETIME;
 } // mode_noisefire()
 
@@ -4636,7 +4608,7 @@ uint16_t WS2812FX::mode_puddles(void) {                   // Puddles. By Andrew
 
   uint16_t size = 0;
   uint8_t fadeVal = map(SEGMENT.speed,0,255, 224, 255);
-  uint16_t pos = random(SEGLEN);                          // Set a random starting position.
+  uint16_t pos = random16(SEGLEN);                          // Set a random starting position.
 
   fade_out(fadeVal);
 
@@ -4646,7 +4618,7 @@ uint16_t WS2812FX::mode_puddles(void) {                   // Puddles. By Andrew
   }
 
   for(int i=0; i<size; i++) {                             // Flash the LED's.
-    setPixelColor(pos+i, color_blend(SEGCOLOR(1), color_from_palette(millis(), false, PALETTE_SOLID_WRAP, 0), 255));
+    setPixelColor(pos+i, color_blend(SEGCOLOR(1), color_from_palette(fxMillis(), false, PALETTE_SOLID_WRAP, 0), 255));
   }
 
   return FRAMETIME;
@@ -4662,7 +4634,7 @@ uint16_t WS2812FX::mode_puddlepeak(void) {                // Puddlepeak. By Andr
 
   uint16_t size = 0;
   uint8_t fadeVal = map(SEGMENT.speed,0,255, 224, 255);
-  uint16_t pos = random(SEGLEN);                          // Set a random starting position.
+  uint16_t pos = random16(SEGLEN);                          // Set a random starting position.
 
   binNum = SEGMENT.fft2;                               // Select a bin.
   maxVol = SEGMENT.fft3/2;                             // Our volume comparator.
@@ -4676,7 +4648,7 @@ uint16_t WS2812FX::mode_puddlepeak(void) {                // Puddlepeak. By Andr
   }
 
   for(int i=0; i<size; i++) {                             // Flash the LED's.
-    setPixelColor(pos+i, color_blend(SEGCOLOR(1), color_from_palette(millis(), false, PALETTE_SOLID_WRAP, 0), 255));
+    setPixelColor(pos+i, color_blend(SEGCOLOR(1), color_from_palette(fxMillis(), false, PALETTE_SOLID_WRAP, 0), 255));
 
   }
 
@@ -4779,12 +4751,24 @@ double mapf(double x, double in_min, double in_max, double out_min, double out_m
 uint16_t WS2812FX::mode_binmap(void) {                    // Binmap. Scale raw fftBin[] values to SEGLEN. Shows just how noisy those bins are.
 
   #define FIRSTBIN 3                            // The first 3 bins are garbage.
-  #define LASTBIN 255                           // Don't use the highest bins, as they're (almost) a mirror of the first 256.
+  #define LASTBIN 252                           // Don't use the highest bins, FIRSTBIN+LASTBIN must stay below the 256 available bins.
 
   float maxVal = 512;                           // Kind of a guess as to the maximum output value per combined logarithmic bins.
 
+  if (!SEGENV.allocateData(SEGLEN)) return mode_static(); //allocation failed
+  uint8_t *brights = SEGENV.data;
+
+  // the bins only change with a new audio frame, keep the brightness per pixel until then
+  bool newFrame = (SEGENV.call == 0 || SEGENV.step != audioFrameSeq);
+  SEGENV.step = audioFrameSeq;
+
   for (int i=0; i<SEGLEN; i++) {
 
+    if (!newFrame) {
+      setPixelColor(i, color_blend(SEGCOLOR(1), color_from_palette(i*8+fxMillis()/50, false, PALETTE_SOLID_WRAP, 0), brights[i]));
+      continue;
+    }
+
     uint16_t startBin = FIRSTBIN+i*LASTBIN/SEGLEN;        // This is the START bin for this particular pixel.
     uint16_t   endBin = FIRSTBIN+(i+1)*LASTBIN/SEGLEN;    // This is the END bin for this particular pixel.
 
@@ -4802,8 +4786,9 @@ uint16_t WS2812FX::mode_binmap(void) {                    // Binmap. Scale raw f
     if (sumBin > maxVal) sumBin = maxVal;                 // Make sure our bin isn't higher than the max . . which we capped earlier.
 
     uint8_t bright = constrain(mapf(sumBin, 0, maxVal, 0, 255),0,255);  // Map the brightness in relation to maxVal and crunch to 8 bits.
+    brights[i] = bright;
 
-    setPixelColor(i, color_blend(SEGCOLOR(1), color_from_palette(i*8+millis()/50, false, PALETTE_SOLID_WRAP, 0), bright));  // 'i' is just an index in the palette. The FFT value, bright, is the intensity.
+    setPixelColor(i, color_blend(SEGCOLOR(1), color_from_palette(i*8+fxMillis()/50, false, PALETTE_SOLID_WRAP, 0), bright));  // 'i' is just an index in the palette. The FFT value, bright, is the intensity.
 
   } // for i
 
@@ -4817,14 +4802,15 @@ uint16_t WS2812FX::mode_binmap(void) {                    // Binmap. Scale raw f
 
 uint16_t WS2812FX::mode_blurz(void) {                    // Blurz. By Andrew Tuline.
 
-  CRGB *leds = (CRGB*) ledData;
+  if (!SEGENV.allocateData(sizeof(CRGB) * SEGLEN)) return mode_static(); //allocation failed
+  CRGB *leds = reinterpret_cast<CRGB*>(SEGENV.data);
   if (SEGENV.call == 0) {fill_solid(leds,SEGLEN, 0); SEGENV.aux0 = 0; }
 
   uint8_t blurAmt = SEGMENT.intensity;
 
   fade_out(SEGMENT.speed);
 
-  uint16_t segLoc = random(SEGLEN);
+  uint16_t segLoc = random16(SEGLEN);
   leds[segLoc] = color_blend(SEGCOLOR(1), color_from_palette(fftResult[SEGENV.aux0]*240/(SEGLEN-1), false, PALETTE_SOLID_WRAP, 0), fftResult[SEGENV.aux0]);
   SEGENV.aux0++;
   SEGENV.aux0 = SEGENV.aux0 % 16;
@@ -4864,13 +4850,14 @@ uint16_t WS2812FX::mode_freqmap(void) {                   // Map FFT_MajorPeak t
 
 uint16_t WS2812FX::mode_freqmatrix(void) {                // Freqmatrix. By Andreas Pleschung.
 
-   uint8_t secondHand = micros()/(256-SEGMENT.speed)/500 % 16;
+  if (!SEGENV.allocateData(sizeof(uint32_t) * (SEGLEN + 1))) return mode_static(); //allocation failed, HSV per pixel and one for the shift
+  uint32_t *leds = reinterpret_cast<uint32_t*>(SEGENV.data);
+
+  uint8_t secondHand = micros()/(256-SEGMENT.speed)/500 % 16;
 
   if(SEGENV.aux0 != secondHand) {
     SEGENV.aux0 = secondHand;
 
-    uint32_t *leds = ledData;
-
     double sensitivity = mapf(SEGMENT.fft3, 1, 255, 1, 10);
     int pixVal = sampleAgc * SEGMENT.intensity / 256 * sensitivity;
     if (pixVal > 255) pixVal = 255;
@@ -4969,14 +4956,15 @@ uint16_t WS2812FX::mode_freqwave(void) {                  // Freqwave. By Andrea
 // As a compromise between speed and accuracy we are currently sampling with 10240Hz, from which we can then determine with a 512bin FFT our max frequency is 5120Hz.
 // Depending on the music stream you have you might find it useful to change the frequency mapping.
 
+  if (!SEGENV.allocateData(sizeof(uint32_t) * (SEGLEN + 1))) return mode_static(); //allocation failed, HSV per pixel and one for the shift
+  uint32_t *leds = reinterpret_cast<uint32_t*>(SEGENV.data);
+
   uint8_t secondHand = micros()/(256-SEGMENT.speed)/500 % 16;
 
 //  uint8_t secondHand = millis()/(256-SEGMENT.speed) % 10;
   if(SEGENV.aux0 != secondHand) {
     SEGENV.aux0 = secondHand;
 
-    uint32_t* leds = ledData;
-
     //uint8_t fade = SEGMENT.fft3;
     //uint8_t fadeval;
 
@@ -5081,7 +5069,7 @@ uint16_t WS2812FX::mode_noisemove(void) {                 // Noisemove.    By: A
   uint8_t numBins = map(SEGMENT.intensity,0,255,0,16);    // Map slider to fftResult bins.
 
   for (int i=0; i<numBins; i++) {                         // How many active bins are we using.
-    uint16_t locn = inoise16(millis()*SEGMENT.speed+i*50000, millis()*SEGMENT.speed);   // Get a new pixel location from moving noise.
+    uint16_t locn = inoise16(fxMillis()*SEGMENT.speed+i*50000, fxMillis()*SEGMENT.speed);   // Get a new pixel location from moving noise.
 
     locn = map(locn,7500,58000,0,SEGLEN-1);               // Map that to the length of the strand, and ensure we don't go over.
     locn = locn % (SEGLEN - 1);                           // Just to be bloody sure.
@@ -5102,7 +5090,8 @@ uint16_t WS2812FX::mode_noisemove(void) {                 // Noisemove.    By: A
 
 uint16_t WS2812FX::mode_waterfall(void) {                   // Waterfall. By: Andrew Tuline
 
-  CRGB *leds = (CRGB*) ledData;
+  if (!SEGENV.allocateData(sizeof(CRGB) * SEGLEN)) return mode_static(); //allocation failed
+  CRGB *leds = reinterpret_cast<CRGB*>(SEGENV.data);
   if (SEGENV.call == 0) fill_solid(leds,SEGLEN, 0);
 
   binNum = SEGMENT.fft2;                               // Select a bin.
@@ -5135,7 +5124,8 @@ uint16_t WS2812FX::mode_waterfall(void) {                   // Waterfall. By: An
 uint16_t WS2812FX::mode_DJLight(void) {                   // Written by ??? Adapted by Will Tatam.
   int NUM_LEDS = SEGLEN;                                  // aka SEGLEN
   int mid = NUM_LEDS / 2;
-  CRGB *leds = (CRGB* )ledData;
+  if (!SEGENV.allocateData(sizeof(CRGB) * SEGLEN)) return mode_static(); //allocation failed
+  CRGB *leds = reinterpret_cast<CRGB*>(SEGENV.data);
 
   uint8_t secondHand = micros()/(256-SEGMENT.speed)/500+1 % 64;
 
@@ -5171,30 +5161,31 @@ uint16_t WS2812FX::mode_DJLight(void) {                   // Written by ??? Adap
 
 uint16_t WS2812FX::mode_2DGEQ(void) {                     // By Will Tatam.
 
-  if (matrixWidth * matrixHeight > SEGLEN || matrixWidth < 4 || matrixHeight < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // No, we're not going to overrun the segment.
+  if (SEGWIDTH < 4 || SEGHEIGHT < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // Segment geometry is too small for a 2D effect.
 
   fade_out(224);                                          // Just in case something doesn't get faded.
 
-  CRGB *leds = (CRGB*) ledData;
+  if (!SEGENV.allocateData(sizeof(CRGB) * SEGLEN)) return mode_static(); //allocation failed
+  CRGB *leds = reinterpret_cast<CRGB*>(SEGENV.data);
   fadeToBlackBy(leds, SEGLEN, SEGMENT.speed);
 
-  int NUMB_BANDS = map(SEGMENT.fft3, 0, 255, 1, 16);
-  int barWidth = (matrixWidth / NUMB_BANDS);
+  int NUMB_BANDS = map(SEGMENT.fft3, 0, 255, 1, geqBandCount());
+  int barWidth = (SEGWIDTH / NUMB_BANDS);
   int bandInc = 1;
   if(barWidth == 0) {
     // Matrix narrower than fft bands
     barWidth = 1;
-    bandInc = (NUMB_BANDS / matrixWidth);
+    bandInc = (NUMB_BANDS / SEGWIDTH);
   }
 
   int b = 0;
   for (int band = 0; band < NUMB_BANDS; band += bandInc) {
-    int count = map(fftResult[band], 0, 255, 0, matrixHeight);
+    int count = map(geqBand(band), 0, 255, 0, SEGHEIGHT);
     for (int w = 0; w < barWidth; w++) {
       int xpos = (barWidth * b) + w;
-      for (int i = 0; i <=  matrixHeight; i++) {
+      for (int i = 0; i <=  SEGHEIGHT; i++) {
         if (i < count) {
-        leds[XY(xpos, i)] = color_blend(SEGCOLOR(1), color_from_palette((band * 35), false, PALETTE_SOLID_WRAP, 0), 255);
+        leds[XY(xpos, i)] = color_blend(SEGCOLOR(1), color_from_palette((band * 35 * 16 / geqBandCount()), false, PALETTE_SOLID_WRAP, 0), 255);
         }
       }
     }
@@ -5212,17 +5203,18 @@ uint16_t WS2812FX::mode_2DGEQ(void) {                     // By Will Tatam.
 
 uint16_t WS2812FX::mode_2DFunkyPlank(void) {              // Written by ??? Adapted by Will Tatam.
 
-  if (matrixWidth * matrixHeight > SEGLEN || matrixWidth < 4 || matrixHeight < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // No, we're not going to overrun the segment.
+  if (SEGWIDTH < 4 || SEGHEIGHT < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // Segment geometry is too small for a 2D effect.
 
-  CRGB *leds = (CRGB*) ledData;
+  if (!SEGENV.allocateData(sizeof(CRGB) * SEGLEN)) return mode_static(); //allocation failed
+  CRGB *leds = reinterpret_cast<CRGB*>(SEGENV.data);
 
-  int NUMB_BANDS = map(SEGMENT.fft3, 0, 255, 1, 16);
-  int barWidth = (matrixWidth / NUMB_BANDS);
+  int NUMB_BANDS = map(SEGMENT.fft3, 0, 255, 1, geqBandCount());
+  int barWidth = (SEGWIDTH / NUMB_BANDS);
   int bandInc = 1;
   if(barWidth == 0) {
     // Matrix narrower than fft bands
     barWidth = 1;
-    bandInc = (NUMB_BANDS / matrixWidth);
+    bandInc = (NUMB_BANDS / SEGWIDTH);
   }
 
   uint8_t secondHand = micros()/(256-SEGMENT.speed)/500+1 % 64;
@@ -5233,8 +5225,8 @@ uint16_t WS2812FX::mode_2DFunkyPlank(void) {              // Written by ??? Adap
     // display values of
     int b = 0;
     for (int band = 0; band < NUMB_BANDS; band += bandInc) {
-      int hue = fftResult[band];
-      int v = map(fftResult[band], 0, 255, 10, 255);
+      int hue = geqBand(band);
+      int v = map(geqBand(band), 0, 255, 10, 255);
 //     if(hue > 0) Serial.printf("Band: %u Value: %u\n", band, hue);
      for (int w = 0; w < barWidth; w++) {
          int xpos = (barWidth * b) + w;
@@ -5244,8 +5236,8 @@ uint16_t WS2812FX::mode_2DFunkyPlank(void) {              // Written by ??? Adap
     }
 
     // Update the display:
-    for (int i = (matrixHeight - 1); i > 0; i--) {
-      for (int j = (matrixWidth - 1); j >= 0; j--) {
+    for (int i = (SEGHEIGHT - 1); i > 0; i--) {
+      for (int j = (SEGWIDTH - 1); j >= 0; j--) {
         int src = XY(j, (i - 1));
         int dst = XY(j, i);
         leds[dst] = leds[src];
@@ -5265,30 +5257,31 @@ uint16_t WS2812FX::mode_2DFunkyPlank(void) {              // Written by ??? Adap
 
 uint16_t WS2812FX::mode_2DCenterBars(void) {              // Written by Scott Marley Adapted by  Spiro-C..
 
-  if (matrixWidth * matrixHeight > SEGLEN || matrixWidth < 4 || matrixHeight < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // No, we're not going to overrun the segment.
+  if (SEGWIDTH < 4 || SEGHEIGHT < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // Segment geometry is too small for a 2D effect.
 
-  CRGB *leds = (CRGB*) ledData;
+  if (!SEGENV.allocateData(sizeof(CRGB) * SEGLEN)) return mode_static(); //allocation failed
+  CRGB *leds = reinterpret_cast<CRGB*>(SEGENV.data);
   fadeToBlackBy(leds, SEGLEN, SEGMENT.speed);
 
-  int NUMB_BANDS = map(SEGMENT.fft3, 0, 255, 1, 16);
-  int barWidth = (matrixWidth / NUMB_BANDS);
+  int NUMB_BANDS = map(SEGMENT.fft3, 0, 255, 1, geqBandCount());
+  int barWidth = (SEGWIDTH / NUMB_BANDS);
   int bandInc = 1;
   if(barWidth == 0) {
     // Matrix narrower than fft bands
     barWidth = 1;
-    bandInc = (NUMB_BANDS / matrixWidth);
+    bandInc = (NUMB_BANDS / SEGWIDTH);
   }
 
   int b = 0;
   for (int band = 0; band < NUMB_BANDS; band += bandInc) {
-    int hight = map(fftResult[band], 0, 255, 0, matrixHeight);
+    int hight = map(geqBand(band), 0, 255, 0, SEGHEIGHT);
     if (hight % 2 == 0) hight--;
-    int yStart = ((matrixHeight - hight) / 2 );
+    int yStart = ((SEGHEIGHT - hight) / 2 );
     for (int w = 0; w < barWidth; w++) {
       int x = (barWidth * b) + w;
       for (int y = yStart; y <= (yStart + hight); y++) {
 //        leds[XY(x, y)] = CHSV((band * 35), 255, 255);
-         leds[XY(x, y)] = color_blend(SEGCOLOR(1), color_from_palette((band * 35), false, PALETTE_SOLID_WRAP, 0), 255);
+         leds[XY(x, y)] = color_blend(SEGCOLOR(1), color_from_palette((band * 35 * 16 / geqBandCount()), false, PALETTE_SOLID_WRAP, 0), 255);
       }
     }
     b++;
@@ -5302,19 +5295,8 @@ uint16_t WS2812FX::mode_2DCenterBars(void) {              // Written by Scott Ma
 //     START of 2D NON-REACTIVE ROUTINES    //
 //////////////////////////////////////////////
 
-static uint16_t x = 0;
-static uint16_t y = 0;
-static uint16_t z = 0;
-static int speed2D = 20;
-
 // uint8_t colorLoop = 1;
 
-// Scale determines how far apart the pixels in our noise matrix are.  Try
-// changing these values around to see how it affects the motion of the display.  The
-// higher the value of scale, the more "zoomed out" the noise iwll be.  A value
-// of 1 will be so zoomed in, you'll mostly see solid colors.
-static int scale_2d = 30; // scale is set dynamically once we've started up
-
 // blur1d: one-dimensional blur filter. Spreads light to 2 line neighbors.
 // blur2d: two-dimensional blur filter. Spreads light to 8 XY neighbors.
 //
@@ -5345,30 +5327,42 @@ void WS2812FX::blur1d( CRGB* leds, uint16_t numLeds, fract8 blur_amount)
     }
 }
 
-void WS2812FX::blur2d( CRGB* leds, uint8_t width, uint8_t height, fract8 blur_amount)
+void WS2812FX::blur2d( CRGB* leds, uint16_t width, uint16_t height, fract8 blur_amount)
 {
     blurRows(leds, width, height, blur_amount);
     blurColumns(leds, width, height, blur_amount);
 }
 
 // blurRows: perform a blur1d on every row of a rectangular matrix
-void WS2812FX::blurRows( CRGB* leds, uint8_t width, uint8_t height, fract8 blur_amount)
+void WS2812FX::blurRows( CRGB* leds, uint16_t width, uint16_t height, fract8 blur_amount)
 {
-    for( uint8_t row = 0; row < height; row++) {
-        CRGB* rowbase = leds + (row * width);
-        blur1d( rowbase, width, blur_amount);
+    // rows are not necessarily contiguous (serpentine, rotation, panels), so go through XY()
+    uint8_t keep = 255 - blur_amount;
+    uint8_t seep = blur_amount >> 1;
+    for( uint16_t row = 0; row < height; row++) {
+        CRGB carryover = CRGB::Black;
+        for( uint16_t i = 0; i < width; i++) {
+            CRGB cur = leds[XY(i,row)];
+            CRGB part = cur;
+            part.nscale8( seep);
+            cur.nscale8( keep);
+            cur += carryover;
+            if( i) leds[XY(i-1,row)] += part;
+            leds[XY(i,row)] = cur;
+            carryover = part;
+        }
     }
 }
 
 // blurColumns: perform a blur1d on each column of a rectangular matrix
-void WS2812FX::blurColumns(CRGB* leds, uint8_t width, uint8_t height, fract8 blur_amount)
+void WS2812FX::blurColumns(CRGB* leds, uint16_t width, uint16_t height, fract8 blur_amount)
 {
     // blur columns
     uint8_t keep = 255 - blur_amount;
     uint8_t seep = blur_amount >> 1;
-    for( uint8_t col = 0; col < width; col++) {
+    for( uint16_t col = 0; col < width; col++) {
         CRGB carryover = CRGB::Black;
-        for( uint8_t i = 0; i < height; i++) {
+        for( uint16_t i = 0; i < height; i++) {
             CRGB cur = leds[XY(col,i)];
             CRGB part = cur;
             part.nscale8( seep);
@@ -5418,14 +5412,15 @@ void WS2812FX::blurColumns(CRGB* leds, uint8_t width, uint8_t height, fract8 blu
 
 
 // This function will return the right 'led index number' for
-// a given set of X and Y coordinates on your matrix.
-// IT DOES NOT CHECK THE COORDINATE BOUNDARIES.
-// That's up to you.  Don't pass it bogus values.
+// a given set of X and Y coordinates in the current segment.
+// The layout is the segment's own geometry ("mx" in the JSON API), or the
+// global matrix settings if it has none. Coordinates outside of the
+// segment's SEGWIDTH x SEGHEIGHT are clamped to its edges.
 //
 // Use the "XY" function like this:
 //
-//    for( uint8_t x = 0; x < matrixWidth; x++) {
-//      for( uint8_t y = 0; y < matrixHeight; y++) {
+//    for( uint16_t x = 0; x < SEGWIDTH; x++) {
+//      for( uint16_t y = 0; y < SEGHEIGHT; y++) {
 //
 //        // Here's the x, y to 'led index' in action:
 //        leds[ XY( x, y) ] = CHSV( random8(), 255, 255);
@@ -5436,24 +5431,13 @@ void WS2812FX::blurColumns(CRGB* leds, uint8_t width, uint8_t height, fract8 blu
 //
 uint16_t WS2812FX::XY( int x, int y) {
 
-uint16_t i = 0;
-
-if( matrixSerpentine == false) {
-  i = (y * matrixWidth) + x;
-}
+if (x >= SEGWIDTH)  x = SEGWIDTH - 1;
+if (y >= SEGHEIGHT) y = SEGHEIGHT - 1;
+if (x < 0 || y < 0) return 0;
 
-if( matrixSerpentine == true) {
-  if( y & 0x01) {
-    // Odd rows run backwards
-    uint8_t reverseX = (matrixWidth - 1) - x;
-    i = (y * matrixWidth) + reverseX;
-  } else {
-    // Even rows run forwards
-    i = (y * matrixWidth) + x;
-  }
-}
-
-return i;
+if (!SEGENV.xyMap && !SEGENV.xyNoMap) buildXYMap();
+if (SEGENV.xyMap) return SEGENV.xyMap[y * SEGWIDTH + x];
+return mapXY(x, y);
 } // XY()
 
 
@@ -5467,21 +5451,27 @@ return i;
 
 uint16_t WS2812FX::mode_2Dplasma(void) {                  // By Andreas Pleschutznig. A work in progress.
 
-  if (matrixWidth * matrixHeight > SEGLEN || matrixWidth < 4 || matrixHeight < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // No, we're not going to overrun the segment.
+  if (SEGWIDTH < 4 || SEGHEIGHT < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // Segment geometry is too small for a 2D effect.
+
+  if (!SEGENV.allocateData(sizeof(uint16_t) * 3 + (uint32_t)SEGWIDTH * SEGHEIGHT)) return mode_static(); //allocation failed
+  uint16_t *pos = reinterpret_cast<uint16_t*>(SEGENV.data);   // x, y, z of the noise, start at 0
+  uint8_t *noise = SEGENV.data + sizeof(uint16_t) * 3;     // 2D noise, one byte per cell, row by row
+  uint16_t &x = pos[0], &y = pos[1], &z = pos[2];
 
-  static uint8_t ihue=0;
   // uint8_t index;   // COMMENTED OUT - UNUSED VARIABLE COMPILER WARNINGS
   // uint8_t bri;     // COMMENTED OUT - UNUSED VARIABLE COMPILER WARNINGS
-  static unsigned long prevMillis;
-  unsigned long curMillis = millis();
+  unsigned long curMillis = fxMillis();
+
+  if ((curMillis - SEGENV.step) >= ((256-SEGMENT.speed) >>2)) {
+    SEGENV.step = curMillis;                              // time of the last update
+    int speed2D = SEGMENT.speed;
 
-  if ((curMillis - prevMillis) >= ((256-SEGMENT.speed) >>2)) {
-    prevMillis = curMillis;
-    speed2D = SEGMENT.speed;
-    scale_2d = SEGMENT.fft2;
+    // Scale determines how far apart the pixels in our noise matrix are.  Try
+    // changing these values around to see how it affects the motion of the display.  The
+    // higher the value of scale, the more "zoomed out" the noise iwll be.  A value
+    // of 1 will be so zoomed in, you'll mostly see solid colors.
+    int scale_2d = SEGMENT.fft2;
 
-    uint32_t *noise = ledData;                            // we use the set aside storage array for FFT routines to store temporary 2D data
-    uint8_t MAX_DIMENSION = ((matrixWidth>matrixHeight) ? matrixWidth : matrixHeight);
 
     // If we're runing at a low "speed", some 8-bit artifacts become visible
     // from frame-to-frame.  In order to reduce this, we can do some fast data-smoothing.
@@ -5492,9 +5482,9 @@ uint16_t WS2812FX::mode_2Dplasma(void) {                  // By Andreas Pleschut
       dataSmoothing = 200 - (speed2D * 4);
       }
 
-    for(int i = 0; i < MAX_DIMENSION; i++) {
+    for(int i = 0; i < SEGWIDTH; i++) {
       int ioffset = scale_2d * i;
-      for(int j = 0; j < MAX_DIMENSION; j++) {
+      for(int j = 0; j < SEGHEIGHT; j++) {
         int joffset = scale_2d * j;
 
         uint8_t data = inoise8(x + ioffset,y + joffset,z);
@@ -5506,12 +5496,12 @@ uint16_t WS2812FX::mode_2Dplasma(void) {                  // By Andreas Pleschut
         data = qadd8(data,scale8(data,39));
 
         if( dataSmoothing ) {
-          uint8_t olddata = noise[i * matrixWidth + j];
+          uint8_t olddata = noise[j * SEGWIDTH + i];
           uint8_t newdata = scale8( olddata, dataSmoothing) + scale8( data, 256 - dataSmoothing);
           data = newdata;
         }
 
-        noise[i * matrixWidth + j] = data;
+        noise[j * SEGWIDTH + i] = data;
       }
     }
 
@@ -5523,18 +5513,18 @@ uint16_t WS2812FX::mode_2Dplasma(void) {                  // By Andreas Pleschut
 
  // ---
 
-  for(int i = 0; i < matrixWidth; i++) {
-    for(int j = 0; j < matrixHeight; j++) {
+  for(int i = 0; i < SEGWIDTH; i++) {
+    for(int j = 0; j < SEGHEIGHT; j++) {
       // We use the value at the (i,j) coordinate in the noise
       // array for our brightness, and the flipped value from (j,i)
-      // for our pixel's index into the color palette.
+      // for our pixel's index into the color palette (wrapped if the segment is not square).
 
-      uint8_t index = noise[j * matrixWidth + i];
-      uint8_t bri =   noise[i * matrixWidth + j];
+      uint8_t index = noise[(i % SEGHEIGHT) * SEGWIDTH + (j % SEGWIDTH)];
+      uint8_t bri =   noise[j * SEGWIDTH + i];
 
       // if this palette is a 'loop', add a slowly-changing base value
       if (SEGMENT.fft1 > 128) {
-        index += ihue;
+        index += SEGENV.aux0;                             // hue
       }
 
       // brighten up, as the color palette itself often contains the
@@ -5549,7 +5539,7 @@ uint16_t WS2812FX::mode_2Dplasma(void) {                  // By Andreas Pleschut
       setPixelColor(XY(i, j), color.red, color.green, color.blue);
       }
     }
-  ihue+=1;
+  SEGENV.aux0 = (SEGENV.aux0 + 1) & 0xFF;
   }
 
   return FRAMETIME;
@@ -5562,9 +5552,10 @@ uint16_t WS2812FX::mode_2Dplasma(void) {                  // By Andreas Pleschut
 
 uint16_t WS2812FX::mode_2Dfirenoise(void) {               // firenoise2d. By Andrew Tuline. Yet another short routine.
 
-  if (matrixWidth * matrixHeight > SEGLEN || matrixWidth < 4 || matrixHeight < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // No, we're not going to overrun the segment.
+  if (SEGWIDTH < 4 || SEGHEIGHT < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // Segment geometry is too small for a 2D effect.
 
-  CRGB *leds = (CRGB *)ledData;
+  if (!SEGENV.allocateData(sizeof(CRGB) * SEGLEN)) return mode_static(); //allocation failed
+  CRGB *leds = reinterpret_cast<CRGB*>(SEGENV.data);
 
   uint32_t xscale = 600;                                  // How far apart they are
   uint32_t yscale = 1000;                                 // How fast they move
@@ -5575,15 +5566,15 @@ uint16_t WS2812FX::mode_2Dfirenoise(void) {               // firenoise2d. By And
                                    CRGB::DarkOrange,CRGB::DarkOrange, CRGB::Orange, CRGB::Orange,
                                    CRGB::Yellow, CRGB::Orange, CRGB::Yellow, CRGB::Yellow);
   //int a = millis();   // COMMENTED OUT - UNUSED VARIABLE COMPILER WARNINGS
-  for (int j=0; j < matrixWidth; j++) {
-    for (int i=0; i < matrixHeight; i++) {
+  for (int j=0; j < SEGWIDTH; j++) {
+    for (int i=0; i < SEGHEIGHT; i++) {
 
       // This perlin fire is by Andrew Tuline
-      indexx = inoise8(i*xscale+millis()/4,j*yscale*matrixWidth/255);                                             // We're moving along our Perlin map.
-      leds[XY(i,j)] = ColorFromPalette(currentPalette, min(i*(indexx)>>4, 255), i*255/matrixWidth, LINEARBLEND);  // With that value, look up the 8 bit colour palette value and assign it to the current LED.
+      indexx = inoise8(i*xscale+fxMillis()/4,j*yscale*SEGWIDTH/255);                                             // We're moving along our Perlin map.
+      leds[XY(i,j)] = ColorFromPalette(currentPalette, min(i*(indexx)>>4, 255), i*255/SEGWIDTH, LINEARBLEND);  // With that value, look up the 8 bit colour palette value and assign it to the current LED.
 
 // This perlin fire is my /u/ldirko
-//      leds[XY(i,j)] = ColorFromPalette (currentPalette, qsub8(inoise8 (i * 60 , j * 60+ a , a /3), abs8(j - (matrixHeight-1)) * 255 / (matrixHeight-1)), 255);
+//      leds[XY(i,j)] = ColorFromPalette (currentPalette, qsub8(inoise8 (i * 60 , j * 60+ a , a /3), abs8(j - (SEGHEIGHT-1)) * 255 / (SEGHEIGHT-1)), 255);
 
     } // for i
   } // for j
@@ -5604,25 +5595,26 @@ uint16_t WS2812FX::mode_2Dsquaredswirl(void) {            // By: Mark Kriegsman.
                                                           // Modifed by: Andrew Tuline
                                                           // fft3 affects the blur amount.
 
-  if (matrixWidth * matrixHeight > SEGLEN || matrixWidth < 4 || matrixHeight < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // No, we're not going to overrun the segment.
+  if (SEGWIDTH < 4 || SEGHEIGHT < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // Segment geometry is too small for a 2D effect.
 
-  CRGB *leds = (CRGB *)ledData;
+  if (!SEGENV.allocateData(sizeof(CRGB) * SEGLEN)) return mode_static(); //allocation failed
+  CRGB *leds = reinterpret_cast<CRGB*>(SEGENV.data);
   const uint8_t kBorderWidth = 2;
 
   fadeToBlackBy(leds, SEGLEN, 24);
   // uint8_t blurAmount = dim8_raw( beatsin8(20,64,128) );  //3,64,192
   uint8_t blurAmount = SEGMENT.fft3;
-  blur2d(leds, matrixWidth, matrixHeight, blurAmount);
+  blur2d(leds, SEGWIDTH, SEGHEIGHT, blurAmount);
 
   // Use two out-of-sync sine waves
-  uint8_t  i = beatsin8(19, kBorderWidth, matrixWidth-kBorderWidth);
-  uint8_t  j = beatsin8(22, kBorderWidth, matrixWidth-kBorderWidth);
-  uint8_t  k = beatsin8(17, kBorderWidth, matrixWidth-kBorderWidth);
-  uint8_t  m = beatsin8(18, kBorderWidth, matrixHeight-kBorderWidth);
-  uint8_t  n = beatsin8(15, kBorderWidth, matrixHeight-kBorderWidth);
-  uint8_t  p = beatsin8(20, kBorderWidth, matrixHeight-kBorderWidth);
+  uint8_t  i = beatsin8(19, kBorderWidth, SEGWIDTH-kBorderWidth);
+  uint8_t  j = beatsin8(22, kBorderWidth, SEGWIDTH-kBorderWidth);
+  uint8_t  k = beatsin8(17, kBorderWidth, SEGWIDTH-kBorderWidth);
+  uint8_t  m = beatsin8(18, kBorderWidth, SEGHEIGHT-kBorderWidth);
+  uint8_t  n = beatsin8(15, kBorderWidth, SEGHEIGHT-kBorderWidth);
+  uint8_t  p = beatsin8(20, kBorderWidth, SEGHEIGHT-kBorderWidth);
 
-  uint16_t ms = millis();
+  uint16_t ms = fxMillis();
 
   leds[XY( i, m)] += ColorFromPalette(currentPalette, ms/29, 255, LINEARBLEND);
   leds[XY( j, n)] += ColorFromPalette(currentPalette, ms/41, 255, LINEARBLEND);
@@ -5642,44 +5634,43 @@ uint16_t WS2812FX::mode_2Dsquaredswirl(void) {            // By: Mark Kriegsman.
 
 uint16_t WS2812FX::mode_2Dfire2012(void) {                // Fire2012 by Mark Kriegsman. Converted to WLED by Andrew Tuline.
 
-  if (matrixWidth * matrixHeight > SEGLEN || matrixWidth < 4 || matrixHeight < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // No, we're not going to overrun the segment.
+  if (SEGWIDTH < 4 || SEGHEIGHT < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // Segment geometry is too small for a 2D effect.
 
-  CRGB *leds = (CRGB *)ledData;
-  //static byte *heat = (byte *)dataStore;    // COMMENTED OUT - UNUSED VARIABLE COMPILER WARNINGS
+  if (!SEGENV.allocateData(sizeof(CRGB) * SEGLEN + SEGWIDTH * SEGHEIGHT)) return mode_static(); //allocation failed
+  CRGB *leds = reinterpret_cast<CRGB*>(SEGENV.data);
+  byte *heat = SEGENV.data + sizeof(CRGB) * SEGLEN;     // one heat cell per pixel, column by column
 
   const uint8_t COOLING = 50;
   const uint8_t SPARKING = 50;
 
   CRGBPalette16 currentPalette  = CRGBPalette16( CRGB::Black, CRGB::Red, CRGB::Orange, CRGB::Yellow);
 
-  static unsigned long prevMillis;
-  unsigned long curMillis = millis();
+  unsigned long curMillis = fxMillis();
 
-  if ((curMillis - prevMillis) >= ((256-SEGMENT.speed) >>2)) {
-    prevMillis = curMillis;
-    static byte *heat = (byte *)dataStore;
+  if ((curMillis - SEGENV.step) >= ((256-SEGMENT.speed) >>2)) {
+    SEGENV.step = curMillis;                              // time of the last update
 
-    for (int mw = 0; mw < matrixWidth; mw++) {            // Move along the width of the flame
+    for (int mw = 0; mw < SEGWIDTH; mw++) {            // Move along the width of the flame
 
       // Step 1.  Cool down every cell a little
-      for (int mh = 0; mh < matrixHeight; mh++) {
-        heat[mw*matrixWidth+mh] = qsub8( heat[mw*matrixWidth+mh],  random16(0, ((COOLING * 10) / matrixHeight) + 2));
+      for (int mh = 0; mh < SEGHEIGHT; mh++) {
+        heat[mw*SEGHEIGHT+mh] = qsub8( heat[mw*SEGHEIGHT+mh],  random16(0, ((COOLING * 10) / SEGHEIGHT) + 2));
       }
 
       // Step 2.  Heat from each cell drifts 'up' and diffuses a little
-      for (int mh = matrixHeight - 1; mh >= 2; mh--) {
-        heat[mw*matrixWidth+mh] = (heat[mw*matrixWidth+mh - 1] + heat[mw*matrixWidth+mh - 2] + heat[mw*matrixWidth+mh - 2] ) / 3;
+      for (int mh = SEGHEIGHT - 1; mh >= 2; mh--) {
+        heat[mw*SEGHEIGHT+mh] = (heat[mw*SEGHEIGHT+mh - 1] + heat[mw*SEGHEIGHT+mh - 2] + heat[mw*SEGHEIGHT+mh - 2] ) / 3;
       }
 
       // Step 3.  Randomly ignite new 'sparks' of heat near the bottom
       if (random8(0,255) < SPARKING ) {
         int mh = random8(3);
-        heat[mw*matrixWidth+mh] = qadd8( heat[mw*matrixWidth+mh], random8(160,255) );
+        heat[mw*SEGHEIGHT+mh] = qadd8( heat[mw*SEGHEIGHT+mh], random8(160,255) );
       }
 
       // Step 4.  Map from heat cells to LED colors
-      for (int mh = 0; mh < matrixHeight; mh++) {
-        byte colorindex = scale8( heat[mw*matrixWidth+mh], 240);
+      for (int mh = 0; mh < SEGHEIGHT; mh++) {
+        byte colorindex = scale8( heat[mw*SEGHEIGHT+mh], 240);
         leds[XY(mw,mh)] = ColorFromPalette(currentPalette, colorindex, 255);
       } // for mh
     } // for mw
@@ -5700,24 +5691,24 @@ uint16_t WS2812FX::mode_2Dfire2012(void) {                // Fire2012 by Mark Kr
 
 uint16_t WS2812FX::mode_2Ddna(void) {         // dna originally by by ldirko at https://pastebin.com/pCkkkzcs. Updated by Preyy. WLED version by Andrew Tuline.
 
-  if (matrixWidth * matrixHeight > SEGLEN || matrixWidth < 4 || matrixHeight < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // No, we're not going to overrun the segment.
+  if (SEGWIDTH < 4 || SEGHEIGHT < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // Segment geometry is too small for a 2D effect.
 
-  CRGB *leds = (CRGB *)ledData;
+  if (!SEGENV.allocateData(sizeof(CRGB) * SEGLEN)) return mode_static(); //allocation failed
+  CRGB *leds = reinterpret_cast<CRGB*>(SEGENV.data);
 
   fadeToBlackBy(leds, SEGLEN, 64);
 
-  static unsigned long prevMillis;
-  unsigned long curMillis = millis();
+  unsigned long curMillis = fxMillis();
 
-  if ((curMillis - prevMillis) >= ((256-SEGMENT.speed) >>3)) {
-    prevMillis = curMillis;
+  if ((curMillis - SEGENV.step) >= ((256-SEGMENT.speed) >>3)) {
+    SEGENV.step = curMillis;                              // time of the last update
 
-  for(int i = 0; i < matrixHeight; i++) {
-      leds[XY(beatsin8(10, 0, matrixWidth-1, 0, i*4), i)] = ColorFromPalette(currentPalette, i*5+millis()/17, beatsin8(5, 55, 255, 0, i*10), LINEARBLEND);
-      leds[XY(beatsin8(10, 0, matrixWidth-1, 0, i*4+128), i)] = ColorFromPalette(currentPalette,i*5+128+millis()/17, beatsin8(5, 55, 255, 0, i*10+128), LINEARBLEND);        // 180 degrees (128) out of phase
+  for(int i = 0; i < SEGHEIGHT; i++) {
+      leds[XY(beatsin8(10, 0, SEGWIDTH-1, 0, i*4), i)] = ColorFromPalette(currentPalette, i*5+fxMillis()/17, beatsin8(5, 55, 255, 0, i*10), LINEARBLEND);
+      leds[XY(beatsin8(10, 0, SEGWIDTH-1, 0, i*4+128), i)] = ColorFromPalette(currentPalette,i*5+128+fxMillis()/17, beatsin8(5, 55, 255, 0, i*10+128), LINEARBLEND);        // 180 degrees (128) out of phase
   }
 
-  blur2d(leds, matrixWidth, matrixHeight, 2);
+  blur2d(leds, SEGWIDTH, SEGHEIGHT, 2);
 
    for (int i=0; i<SEGLEN; i++) {
       setPixelColor(i, leds[i].red, leds[i].green, leds[i].blue);
@@ -5735,33 +5726,33 @@ uint16_t WS2812FX::mode_2Ddna(void) {         // dna originally by by ldirko at
 
 uint16_t WS2812FX::mode_2Dmatrix(void) {                  // Matrix2D. By Jeremy Williams. Adapted by Andrew Tuline.
 
-  if (matrixWidth * matrixHeight > SEGLEN || matrixWidth < 4 || matrixHeight < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // No, we're not going to overrun the segment.
+  if (SEGWIDTH < 4 || SEGHEIGHT < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // Segment geometry is too small for a 2D effect.
 
-  CRGB *leds = (CRGB* )ledData;
+  if (!SEGENV.allocateData(sizeof(CRGB) * SEGLEN)) return mode_static(); //allocation failed
+  CRGB *leds = reinterpret_cast<CRGB*>(SEGENV.data);
 
-  static unsigned long prevMillis;
-  unsigned long curMillis = millis();
+  unsigned long curMillis = fxMillis();
 
   if (SEGENV.call == 0) fill_solid(leds,SEGLEN, 0);
 
-  if ((curMillis - prevMillis) >= ((256-SEGMENT.speed) >>2)) {
-    prevMillis = curMillis;
+  if ((curMillis - SEGENV.step) >= ((256-SEGMENT.speed) >>2)) {
+    SEGENV.step = curMillis;                              // time of the last update
 
     if (SEGMENT.fft3 < 128) {									            // check for orientation, slider in first quarter, default orientation
-    	for (int16_t row=matrixHeight-1; row>=0; row--) {
-    		for (int16_t col=0; col<matrixWidth; col++) {
+    	for (int16_t row=SEGHEIGHT-1; row>=0; row--) {
+    		for (int16_t col=0; col<SEGWIDTH; col++) {
     			if (leds[XY(col, row)] == CRGB(175,255,175)) {
     				leds[XY(col, row)] = CRGB(27,130,39);         // create trail
-    				if (row < matrixHeight-1) leds[XY(col, row+1)] = CRGB(175,255,175);
+    				if (row < SEGHEIGHT-1) leds[XY(col, row+1)] = CRGB(175,255,175);
     			}
     		}
     	}
     } else if (SEGMENT.fft3 >= 128)   {	                  // second quadrant
-    	for (int16_t row=matrixHeight-1; row>=0; row--) {
-    	    		for (int16_t col=matrixWidth-1; col >= 0; col--) {
+    	for (int16_t row=SEGHEIGHT-1; row>=0; row--) {
+    	    		for (int16_t col=SEGWIDTH-1; col >= 0; col--) {
     	    			if (leds[XY(col, row)] == CRGB(175,255,175)) {
     	    				leds[XY(col, row)] = CRGB(27,130,39);   // create trail
-    	    				if (row < matrixHeight-1) leds[XY(col+1, row)] = CRGB(175,255,175);
+    	    				if (row < SEGHEIGHT-1) leds[XY(col+1, row)] = CRGB(175,255,175);
     	    			}
     	    		}
     	    	}
@@ -5784,12 +5775,12 @@ uint16_t WS2812FX::mode_2Dmatrix(void) {                  // Matrix2D. By Jeremy
     // spawn new falling code
     if (SEGMENT.fft3 < 128) {
     	if (random8(3) == 0 || emptyScreen) {               // lower number == more frequent spawns
-    	  uint8_t spawnX = random8(matrixWidth);
+    	  uint8_t spawnX = random8(SEGWIDTH);
       	  leds[XY(spawnX, 0)] = CRGB(175,255,175 );
     	}
     } else if (SEGMENT.fft3 >= 128) {
     	if (random8(3) == 0 || emptyScreen) {               // lower number == more frequent spawns
-    	  uint8_t spawnX = random8(matrixHeight);
+    	  uint8_t spawnX = random8(SEGHEIGHT);
     	  leds[XY(0, spawnX)] = CRGB(175,255,175 );
     	  }
     }
@@ -5809,25 +5800,26 @@ uint16_t WS2812FX::mode_2Dmatrix(void) {                  // Matrix2D. By Jeremy
 
 uint16_t WS2812FX::mode_2Dmeatballs(void) {   // Metaballs by Stefan Petrick. Cannot have one of the dimensions be 2 or less. Adapted by Andrew Tuline.
 
-  if (matrixWidth * matrixHeight > SEGLEN || matrixWidth < 4 || matrixHeight < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // No, we're not going to overrun the segment.
+  if (SEGWIDTH < 4 || SEGHEIGHT < 4) {return blink(CRGB::Red, CRGB::Black, false, false);}    // Segment geometry is too small for a 2D effect.
 
-  CRGB *leds = (CRGB* )ledData;
+  if (!SEGENV.allocateData(sizeof(CRGB) * SEGLEN)) return mode_static(); //allocation failed
+  CRGB *leds = reinterpret_cast<CRGB*>(SEGENV.data);
 
   float speed = 1;
 
   // get some 2 random moving points
-  uint8_t x2 = inoise8(millis() * speed, 25355, 685 ) / 16;
-  uint8_t y2 = inoise8(millis() * speed, 355, 11685 ) / 16;
+  uint8_t x2 = inoise8(fxMillis() * speed, 25355, 685 ) / 16;
+  uint8_t y2 = inoise8(fxMillis() * speed, 355, 11685 ) / 16;
 
-  uint8_t x3 = inoise8(millis() * speed, 55355, 6685 ) / 16;
-  uint8_t y3 = inoise8(millis() * speed, 25355, 22685 ) / 16;
+  uint8_t x3 = inoise8(fxMillis() * speed, 55355, 6685 ) / 16;
+  uint8_t y3 = inoise8(fxMillis() * speed, 25355, 22685 ) / 16;
 
   // and one Lissajou function
   uint8_t x1 = beatsin8(23 * speed, 0, 15);
   uint8_t y1 = beatsin8(28 * speed, 0, 15);
 
-  for (uint8_t y = 0; y < matrixHeight; y++) {
-    for (uint8_t x = 0; x < matrixWidth; x++) {
+  for (uint16_t y = 0; y < SEGHEIGHT; y++) {
+    for (uint16_t x = 0; x < SEGWIDTH; x++) {
 
       // calculate distances of the 3 points from actual pixel
       // and add them together with weightening
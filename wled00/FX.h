@@ -55,6 +55,13 @@
 #define WLED_FPS         42
 #define FRAMETIME        (1000/WLED_FPS)
 
+/* The 2D Julia set has a fixed point version for chips without FPU. Used by default on ESP8266, define
+  WLED_FX_FLOAT to use the float version there or WLED_FX_FIXED_POINT to use the fixed point version on
+  ESP32 as well. The particle effects (particles.h) always use fixed point. */
+#if defined(ESP8266) && !defined(WLED_FX_FLOAT) && !defined(WLED_FX_FIXED_POINT)
+  #define WLED_FX_FIXED_POINT
+#endif
+
 /* each segment uses 52 bytes of SRAM memory, so if you're application fails because of
   insufficient memory, decreasing MAX_NUM_SEGMENTS may help */
 #ifdef ESP8266
@@ -62,13 +69,13 @@
   /* How many color transitions can run at once */
   #define MAX_NUM_TRANSITIONS  8
   /* How much data bytes all segments combined may allocate */
-  #define MAX_SEGMENT_DATA  2048
+  #define MAX_SEGMENT_DATA  4096
 #else
 #ifndef MAX_NUM_SEGMENTS
   #define MAX_NUM_SEGMENTS    16
 #endif
   #define MAX_NUM_TRANSITIONS 16
-  #define MAX_SEGMENT_DATA  8192
+  #define MAX_SEGMENT_DATA  32768   // includes the pixel buffers of the audio reactive and 2D effects
 #endif
 
 #define LED_SKIP_AMOUNT  1
@@ -79,9 +86,12 @@
 #define SEGCOLOR(x)      _colors_t[x]
 #define SEGENV           _segment_runtimes[_segment_index]
 #define SEGLEN           _virtualSegmentLength
+#define SEGWIDTH         _segmentWidth
+#define SEGHEIGHT        _segmentHeight
 #define SEGACT           SEGMENT.stop
 #define SPEED_FORMULA_L  5U + (50U*(255U - SEGMENT.speed))/SEGLEN
-#define RESET_RUNTIME    memset(_segment_runtimes, 0, sizeof(_segment_runtimes))
+#define RESET_RUNTIME    for (uint8_t i = 0; i < MAX_NUM_SEGMENTS; i++) { _segment_runtimes[i].deallocateData(); _segment_runtimes[i].freeXYMap(); } \
+                         memset(_segment_runtimes, 0, sizeof(_segment_runtimes))
 
 // some common colors
 #define RED        (uint32_t)0xFF0000
@@ -116,6 +126,14 @@
 #define IS_REVERSE      ((SEGMENT.options & REVERSE     ) == REVERSE     )
 #define IS_SELECTED     ((SEGMENT.options & SELECTED    ) == SELECTED    )
 
+// 2D geometry
+// bits 2-3: rotation in steps of 90 degrees clockwise
+// bit    1: transpose (swap x and y before rotating)
+// bit    0: serpentine, every other row runs backwards
+#define SEG_2D_SERPENTINE (uint8_t)0x01
+#define SEG_2D_TRANSPOSE  (uint8_t)0x02
+#define SEG_2D_ROTATION   (uint8_t)0x0C
+
 #define MODE_COUNT                     154
 
 #define FX_MODE_STATIC                   0
@@ -280,6 +298,9 @@ class WS2812FX {
   // pre show callback
   typedef void (*show_callback) (void);
 
+  // effect clock, replaces millis() for reproducible rendering
+  typedef uint32_t (*clock_callback) (void);
+
   static WS2812FX* instance;
 
   // segment parameters
@@ -299,6 +320,9 @@ class WS2812FX {
       uint8_t grouping, spacing;
       uint8_t opacity;
       uint32_t colors[NUM_COLORS];
+      uint16_t width, height;            // 2D size of the matrix the segment is wired as, 0 = use the global matrix settings
+      uint8_t geometry;                  // SEG_2D_* bits
+      uint8_t panelWidth, panelHeight;   // the matrix is tiled from identical panels of this size, row by row (0 = a single panel)
       bool setColor(uint8_t slot, uint32_t c, uint8_t segn) { //returns true if changed
         if (slot >= NUM_COLORS || segn >= MAX_NUM_SEGMENTS) return false;
         if (c == colors[slot]) return false;
@@ -377,6 +401,8 @@ class WS2812FX {
         if (fft2 != b.fft2)           d |= SEG_DIFFERS_FX;
         if (fft3 != b.fft3)           d |= SEG_DIFFERS_FX;
         if (palette != b.palette)     d |= SEG_DIFFERS_FX;
+        if (width != b.width || height != b.height || geometry != b.geometry ||
+            panelWidth != b.panelWidth || panelHeight != b.panelHeight) d |= SEG_DIFFERS_GSO;
 
         if ((options & 0b00101111) != (b.options & 0b00101111)) d |= SEG_DIFFERS_OPT;
         for (uint8_t i = 0; i < NUM_COLORS; i++)
@@ -396,7 +422,26 @@ class WS2812FX {
       uint16_t aux0;
       uint16_t aux1;
       byte* data = nullptr;
-      bool allocateData(uint16_t len){
+      uint16_t* xyMap = nullptr;         // logical x,y to segment pixel, built on the first XY() call
+      uint64_t xyKey = 0;                // geometry xyMap is for
+      bool xyNoMap = false;              // building the map failed, XY() calculates instead
+      bool allocateXYMap(uint32_t n) {
+        uint32_t len = n * sizeof(uint16_t);
+        if (WS2812FX::instance->_usedSegmentData + len > MAX_SEGMENT_DATA) return false; //shares the effect data budget
+        xyMap = (uint16_t*) malloc(len);
+        if (!xyMap) return false;
+        WS2812FX::instance->_usedSegmentData += len;
+        _xyMapLen = len;
+        return true;
+      }
+      void freeXYMap() {
+        free(xyMap);
+        xyMap = nullptr;
+        xyNoMap = false;
+        WS2812FX::instance->_usedSegmentData -= _xyMapLen;
+        _xyMapLen = 0;
+      }
+      bool allocateData(uint32_t len){ //32 bit so sizes like width*height can't wrap before the check
         if (data && _dataLen == len) return true; //already allocated
         deallocateData();
         if (WS2812FX::instance->_usedSegmentData + len > MAX_SEGMENT_DATA) return false; //not enough memory
@@ -425,6 +470,7 @@ class WS2812FX {
         if (_requiresReset) {
           next_time = 0; step = 0; call = 0; aux0 = 0; aux1 = 0;
           deallocateData();
+          freeXYMap();
           _requiresReset = false;
         }
       }
@@ -437,6 +483,7 @@ class WS2812FX {
       void reset() { _requiresReset = true; }
       private:
         uint16_t _dataLen = 0;
+        uint16_t _xyMapLen = 0;
         bool _requiresReset = false;
     } segment_runtime;
 
@@ -486,14 +533,14 @@ class WS2812FX {
           if (prevSeg < MAX_NUM_SEGMENTS) instance->_segments[prevSeg].setOption(SEG_OPTION_TRANSITIONAL, false);
         }
         t.transitionDur = dur;
-        t.transitionStart = millis();
+        t.transitionStart = instance->fxMillis();
         t.segment = s;
         instance->_segments[segn].setOption(SEG_OPTION_TRANSITIONAL, true);
         //refresh immediately, required for Solid mode
         if (instance->_segment_runtimes[segn].next_time > t.transitionStart + 22) instance->_segment_runtimes[segn].next_time = t.transitionStart;
       }
       uint16_t progress(bool allowEnd = false) { //transition progression between 0-65535
-        uint32_t timeNow = millis();
+        uint32_t timeNow = instance->fxMillis();
         if (timeNow - transitionStart > transitionDur) {
           if (allowEnd) {
             uint8_t segn = segment & 0x3F;
@@ -698,6 +745,11 @@ class WS2812FX {
       setBrightness(uint8_t b),
       setRange(uint16_t i, uint16_t i2, uint32_t col),
       setShowCallback(show_callback cb),
+      setClock(clock_callback cb),
+      setRandomSeed(uint16_t seed),
+      renderBegin(uint16_t frameMs, uint16_t seed),
+      renderFrame(void),
+      renderEnd(void),
       setTransition(uint16_t t),
       setTransitionMode(bool t),
       calcGammaTable(float),
@@ -712,9 +764,9 @@ class WS2812FX {
       noise8_help(uint8_t),
       mapNoiseToLEDsUsingPalette(),
       blur1d( CRGB* leds, uint16_t numLeds, fract8 blur_amount),
-      blur2d( CRGB* leds, uint8_t width, uint8_t height, fract8 blur_amount),
-      blurRows( CRGB* leds, uint8_t width, uint8_t height, fract8 blur_amount),
-      blurColumns(CRGB* leds, uint8_t width, uint8_t height, fract8 blur_amount),
+      blur2d( CRGB* leds, uint16_t width, uint16_t height, fract8 blur_amount),
+      blurRows( CRGB* leds, uint16_t width, uint16_t height, fract8 blur_amount),
+      blurColumns(CRGB* leds, uint16_t width, uint16_t height, fract8 blur_amount),
       setPixels(CRGB* leds);
 
     bool
@@ -724,8 +776,10 @@ class WS2812FX {
       gammaCorrectCol = true,
       applyToAllSelected = true,
       setEffectConfig(uint8_t m, uint8_t s, uint8_t i, uint8_t f1, uint8_t f2, uint8_t f3, uint8_t p),
+      deserializeMap(uint8_t n = 0),
       // return true if the strip is being sent pixel updates
-      isUpdating(void);
+      isUpdating(void),
+      isRendering(void);
     uint8_t
       mainSegment = 0,
       rgbwMode = RGBW_MODE_DUAL,
@@ -742,6 +796,7 @@ class WS2812FX {
       getMaxSegments(void),
       //getFirstSelectedSegment(void),
       getMainSegmentId(void),
+      getLedmap(void),
       getColorOrder(void),
       gamma8(uint8_t),
       gamma8_cal(uint8_t, float),
@@ -774,6 +829,7 @@ class WS2812FX {
       gamma32(uint32_t),
       getLastShow(void),
       getPixelColor(uint16_t),
+      fxMillis(void),
       getColor(void);
 
     #ifndef ESP8266
@@ -957,6 +1013,7 @@ class WS2812FX {
     CRGBPalette16 targetPalette;
 
     uint16_t _length, _virtualSegmentLength;
+    uint16_t _segmentWidth = 0, _segmentHeight = 0;  // logical 2D size of the current segment
     uint16_t _rand16seed;
     uint8_t _brightness;
     uint16_t _usedSegmentData = 0;
@@ -973,6 +1030,12 @@ class WS2812FX {
     mode_ptr _mode[MODE_COUNT]; // SRAM footprint: 4 bytes per element
 
     show_callback _callback = nullptr;
+    clock_callback _clock = nullptr;
+    clock_callback _renderPrevClock = nullptr;  // clock to restore after rendering
+    bool _rendering = false;
+    uint16_t _renderFrame = 0, _renderFrameMs = 0;
+
+    uint16_t runEffect(void);
 
     // mode helper functions
     uint16_t
@@ -1000,12 +1063,14 @@ class WS2812FX {
     CRGB pacifica_one_layer(uint16_t i, CRGBPalette16& p, uint16_t cistart, uint16_t wavescale, uint8_t bri, uint16_t ioff);
 
     void
+      setupSegmentGeometry(void),
+      buildXYMap(void),
       blendPixelColor(uint16_t n, uint32_t color, uint8_t blend),
-      startTransition(uint8_t oldBri, uint32_t oldCol, uint16_t dur, uint8_t segn, uint8_t slot),
-      deserializeMap(void);
+      startTransition(uint8_t oldBri, uint32_t oldCol, uint16_t dur, uint8_t segn, uint8_t slot);
 
     uint16_t* customMappingTable = nullptr;
     uint16_t  customMappingSize  = 0;
+    uint8_t   _ledmap = 0;
 
     uint32_t _lastPaletteChange = 0;
     uint32_t _lastShow = 0;
@@ -1025,6 +1090,7 @@ class WS2812FX {
     friend class ColorTransition;
 
     uint16_t
+      mapXY(uint16_t x, uint16_t y),
       realPixelIndex(uint16_t i),
       transitionProgress(uint8_t tNr);
 };
@@ -26,11 +26,13 @@
 
 #include "FX.h"
 #include "palettes.h"
+#include "pixel_kernels.h"
 
 /*
   Custom per-LED mapping has moved!
 
-  Create a file "ledmap.json" using the edit page.
+  Create a file "ledmap.json" using the edit page. More maps can be stored as "ledmap1.json" to "ledmap9.json"
+  and selected with {"ledmap":n} in the JSON API, see deserializeMap() below.
 
   this is just an example (30 LEDs). It will first set all even, then all uneven LEDs.
   {"map":[
@@ -90,7 +92,7 @@ void WS2812FX::finalizeInit(uint16_t countPixels)
     }
   }
 
-  deserializeMap();
+  deserializeMap(_ledmap);
 
   uint16_t segStarts[MAX_NUM_SEGMENTS] = {0};
   uint16_t segStops [MAX_NUM_SEGMENTS] = {0};
@@ -133,7 +135,8 @@ void WS2812FX::finalizeInit(uint16_t countPixels)
 }
 
 void WS2812FX::service() {
-  uint32_t nowUp = millis(); // Be aware, millis() rolls over every 49 days
+  if (_rendering) return; //renderFrame() runs the effects
+  uint32_t nowUp = fxMillis(); // Be aware, millis() rolls over every 49 days
   now = nowUp + timebase;
   if (nowUp - _lastShow < MIN_SHOW_DELAY) return;
   bool doShow = false;
@@ -155,25 +158,14 @@ void WS2812FX::service() {
       uint16_t delay = FRAMETIME;
 
       if (!SEGMENT.getOption(SEG_OPTION_FREEZE)) { //only run effect function if not frozen
-        _virtualSegmentLength = SEGMENT.virtualLength();
-        _bri_t = SEGMENT.opacity; _colors_t[0] = SEGMENT.colors[0]; _colors_t[1] = SEGMENT.colors[1]; _colors_t[2] = SEGMENT.colors[2];
-        if (!IS_SEGMENT_ON) _bri_t = 0;
-        for (uint8_t t = 0; t < MAX_NUM_TRANSITIONS; t++) {
-          if ((transitions[t].segment & 0x3F) != i) continue;
-          uint8_t slot = transitions[t].segment >> 6;
-          if (slot == 0) _bri_t = transitions[t].currentBri();
-          _colors_t[slot] = transitions[t].currentColor(SEGMENT.colors[slot]);
-        }
-        for (uint8_t c = 0; c < 3; c++) _colors_t[c] = gamma32(_colors_t[c]);
-        handle_palette();
-        delay = (this->*_mode[SEGMENT.mode])(); //effect function
-        if (SEGMENT.mode != FX_MODE_HALLOWEEN_EYES) SEGENV.call++;
+        delay = runEffect();
       }
 
       SEGENV.next_time = nowUp + delay;
     }
   }
   _virtualSegmentLength = 0;
+  _segmentWidth = 0; _segmentHeight = 0;
   if(doShow) {
     yield();
     show();
@@ -181,6 +173,90 @@ void WS2812FX::service() {
   _triggered = false;
 }
 
+// runs the effect of the current segment once, returns the delay it asks for
+uint16_t WS2812FX::runEffect() {
+  _virtualSegmentLength = SEGMENT.virtualLength();
+  setupSegmentGeometry();
+  _bri_t = SEGMENT.opacity; _colors_t[0] = SEGMENT.colors[0]; _colors_t[1] = SEGMENT.colors[1]; _colors_t[2] = SEGMENT.colors[2];
+  if (!IS_SEGMENT_ON) _bri_t = 0;
+  for (uint8_t t = 0; t < MAX_NUM_TRANSITIONS; t++) {
+    if ((transitions[t].segment & 0x3F) != _segment_index) continue;
+    uint8_t slot = transitions[t].segment >> 6;
+    if (slot == 0) _bri_t = transitions[t].currentBri();
+    _colors_t[slot] = transitions[t].currentColor(SEGMENT.colors[slot]);
+  }
+  for (uint8_t c = 0; c < 3; c++) _colors_t[c] = gamma32(_colors_t[c]);
+  handle_palette();
+  uint16_t delay = (this->*_mode[SEGMENT.mode])(); //effect function
+  if (SEGMENT.mode != FX_MODE_HALLOWEEN_EYES) SEGENV.call++;
+  return delay;
+}
+
+// fixed clock of rendering
+static uint32_t renderTime = 0;
+static uint32_t renderClock() { return renderTime; }
+
+/*
+ * Renders frames of all active segments with a clock starting at 0 that advances frameMs per frame and
+ * a fixed random seed, so the pixels only depend on the segment settings (and the audio data for sound
+ * reactive effects). The segments start from a reset and a black strip, effects run when their delay
+ * has passed like in service(). Each renderFrame() renders the next frame, the caller reads the strip with
+ * busses.getPixelColor() in between, so a long render can be spread over several loop() iterations.
+ * Nothing is shown and service() pauses until renderEnd(), which resets the segments again.
+ */
+void WS2812FX::renderBegin(uint16_t frameMs, uint16_t seed) {
+  if (!_rendering) _renderPrevClock = _clock;
+  _rendering = true;
+  _renderFrame = 0;
+  _renderFrameMs = frameMs;
+  renderTime = 0;
+  setClock(renderClock);
+  setRandomSeed(seed);
+
+  for (uint8_t i = 0; i < MAX_NUM_SEGMENTS; i++) _segment_runtimes[i].reset();
+  for (uint16_t i = 0; i < _length; i++) busses.setPixelColor(i, BLACK);
+}
+
+void WS2812FX::renderFrame() {
+  if (!_rendering) return;
+  renderTime = (uint32_t)_renderFrame * _renderFrameMs;
+  now = renderTime;
+  for (uint8_t i = 0; i < MAX_NUM_SEGMENTS; i++) {
+    _segment_index = i;
+    SEGENV.resetIfRequired();
+    if (!SEGMENT.isActive() || SEGMENT.getOption(SEG_OPTION_FREEZE)) continue;
+    if (_renderFrame > 0 && renderTime < SEGENV.next_time) continue;
+    SEGENV.next_time = renderTime + runEffect();
+  }
+  _virtualSegmentLength = 0;
+  _segmentWidth = 0; _segmentHeight = 0;
+  _renderFrame++;
+}
+
+void WS2812FX::renderEnd() {
+  if (!_rendering) return;
+  for (uint8_t i = 0; i < MAX_NUM_SEGMENTS; i++) _segment_runtimes[i].reset();
+  setClock(_renderPrevClock);
+  _rendering = false;
+}
+
+bool WS2812FX::isRendering() {
+  return _rendering;
+}
+
+void WS2812FX::setClock(clock_callback cb) {
+  _clock = cb;
+}
+
+uint32_t WS2812FX::fxMillis() {
+  return _clock ? _clock() : millis();
+}
+
+// seeds random8()/random16() of FastLED, which all effects use
+void WS2812FX::setRandomSeed(uint16_t seed) {
+  random16_set_seed(seed);
+}
+
 void WS2812FX::setPixelColor(uint16_t n, uint32_t c) {
   uint8_t w = (c >> 24);
   uint8_t r = (c >> 16);
@@ -361,7 +437,7 @@ void WS2812FX::show(void) {
   // all of the data has been sent.
   // See https://github.com/Makuna/NeoPixelBus/wiki/ESP32-NeoMethods#neoesp32rmt-methods
   busses.show();
-  unsigned long now = millis();
+  unsigned long now = fxMillis();
   unsigned long diff = now - _lastShow;
   uint16_t fpsCurr = 200;
   if (diff > 0) fpsCurr = 1000 / diff;
@@ -382,7 +458,7 @@ bool WS2812FX::isUpdating() {
  * Only updates on show() or is set to 0 fps if last show is more than 2 secs ago, so accurary varies
  */
 uint16_t WS2812FX::getFps() {
-  if (millis() - _lastShow > 2000) return 0;
+  if (fxMillis() - _lastShow > 2000) return 0;
   return _cumulativeFps +1;
 }
 
@@ -491,7 +567,7 @@ void WS2812FX::setBrightness(uint8_t b) {
       _segments[i].setOption(SEG_OPTION_FREEZE, false);
     }
   }
-  if (SEGENV.next_time > millis() + 22 && millis() - _lastShow > MIN_SHOW_DELAY) show();//apply brightness change immediately if no refresh soon
+  if (SEGENV.next_time > fxMillis() + 22 && fxMillis() - _lastShow > MIN_SHOW_DELAY) show();//apply brightness change immediately if no refresh soon
 }
 
 uint8_t WS2812FX::getMode(void) {
@@ -653,6 +729,78 @@ void WS2812FX::setPixelSegment(uint8_t n)
   }
 }
 
+/*
+ * 2D geometry of the current segment: its own, or the global matrix settings if it has none.
+ * A matrix larger than the segment is cut down to the rows that fit.
+ * SEGWIDTH x SEGHEIGHT is the logical size after rotation/transpose.
+ */
+void WS2812FX::setupSegmentGeometry()
+{
+  uint16_t w = SEGMENT.width, h = SEGMENT.height;
+  uint8_t geo = SEGMENT.geometry, pw = SEGMENT.panelWidth, ph = SEGMENT.panelHeight;
+  if (!w || !h) {
+    #ifndef ESP8266
+    w = matrixWidth; h = matrixHeight;
+    geo = matrixSerpentine ? SEG_2D_SERPENTINE : 0;
+    #else
+    w = 0; h = 0; geo = 0;
+    #endif
+    pw = 0; ph = 0;
+  }
+  uint16_t len = SEGLEN;
+  if (w == 0 || w > len) { w = len; h = 1; }
+  if (h == 0 || (uint32_t)w * h > len) h = len / w;
+  if (!pw || !ph || w % pw || h % ph) { pw = 0; ph = 0; }  // panels have to tile the matrix
+
+  uint64_t key = w | ((uint32_t)h << 16) | ((uint64_t)geo << 32) | ((uint64_t)pw << 40) | ((uint64_t)ph << 48);
+  if (SEGENV.xyKey != key) {
+    SEGENV.freeXYMap();
+    SEGENV.xyKey = key;
+  }
+
+  bool swap = (((geo & SEG_2D_ROTATION) >> 2) & 1) ^ ((geo & SEG_2D_TRANSPOSE) ? 1 : 0);
+  _segmentWidth  = swap ? h : w;
+  _segmentHeight = swap ? w : h;
+}
+
+// segment pixel of logical x,y of the current segment, calculated from its geometry
+uint16_t WS2812FX::mapXY(uint16_t x, uint16_t y)
+{
+  uint64_t key = SEGENV.xyKey;
+  uint16_t w = key, h = key >> 16;
+  uint8_t geo = key >> 32, pw = key >> 40, ph = key >> 48;
+  if (!pw) { pw = w; ph = h; }
+
+  if (geo & SEG_2D_TRANSPOSE) { uint16_t t = x; x = y; y = t; }
+  uint16_t px, py;
+  switch ((geo & SEG_2D_ROTATION) >> 2) {
+    case 1:  px = w - 1 - y; py = x;         break;
+    case 2:  px = w - 1 - x; py = h - 1 - y; break;
+    case 3:  px = y;         py = h - 1 - x; break;
+    default: px = x;         py = y;         break;
+  }
+
+  uint16_t panel = (py / ph) * (w / pw) + px / pw;
+  uint16_t qx = px % pw, qy = py % ph;
+  if ((geo & SEG_2D_SERPENTINE) && (qy & 0x01)) qx = pw - 1 - qx;  // odd rows run backwards
+  return panel * pw * ph + qy * pw + qx;
+}
+
+// lookup table for XY(), so effects only pay for the geometry once
+void WS2812FX::buildXYMap()
+{
+  uint32_t n = (uint32_t)_segmentWidth * _segmentHeight;
+  if (!n) return;
+  if (!SEGENV.allocateXYMap(n)) {
+    SEGENV.xyNoMap = true;
+    return;
+  }
+  uint16_t* map = SEGENV.xyMap;
+  for (uint16_t y = 0; y < _segmentHeight; y++) {
+    for (uint16_t x = 0; x < _segmentWidth; x++) map[y * _segmentWidth + x] = mapXY(x, y);
+  }
+}
+
 void WS2812FX::setRange(uint16_t i, uint16_t i2, uint32_t col)
 {
   if (i2 >= i)
@@ -676,7 +824,7 @@ void WS2812FX::setTransition(uint16_t t)
 
 void WS2812FX::setTransitionMode(bool t)
 {
-  unsigned long waitMax = millis() + 20; //refresh after 20 ms if transition enabled
+  unsigned long waitMax = fxMillis() + 20; //refresh after 20 ms if transition enabled
   for (uint16_t i = 0; i < MAX_NUM_SEGMENTS; i++)
   {
     _segment_index = i;
@@ -693,6 +841,7 @@ uint32_t WS2812FX::color_blend(uint32_t color1, uint32_t color2, uint16_t blend,
   if(blend == 0)   return color1;
   uint16_t blendmax = b16 ? 0xFFFF : 0xFF;
   if(blend == blendmax) return color2;
+  if (!b16) return pixel_blend(color1, color2, blend);  // all channels at once
   uint8_t shift = b16 ? 16 : 8;
 
   uint32_t w1 = (color1 >> 24) & 0xFF;
@@ -734,26 +883,16 @@ void WS2812FX::blendPixelColor(uint16_t n, uint32_t color, uint8_t blend)
  * fade out function, higher rate = quicker fade
  */
 void WS2812FX::fade2black(uint8_t rate) {
-  uint32_t color;
-
   //rate = rate >> 1;
-  float mappedRate = (float) map(rate, 0, 255, 1, 100) ;
-
-  mappedRate = mappedRate / 100;
+  uint16_t mappedRate = map(rate, 0, 255, 1, 100) * 256 / 100;           // 1/256
+  uint16_t redRate = mappedRate * 105 / 100;                              // acount for the fact that leds stay red on much lower intensities
+  if (redRate > 256) redRate = 256;
 
   for(uint16_t i = 0; i < SEGLEN; i++) {
-    color = getPixelColor(i);
-    int w1 = (color >> 24) & 0xff;
-    int r1 = (color >> 16) & 0xff;
-    int g1 = (color >>  8) & 0xff;
-    int b1 =  color        & 0xff;
-
-    int w = w1 * mappedRate;
-    int r = r1 * (mappedRate * 1.05);      // acount for the fact that leds stay red on much lower intensities
-    int g = g1 * mappedRate;
-    int b = b1 * mappedRate;
-
-    setPixelColor(i, r, g, b, w);
+    uint32_t color = getPixelColor(i);
+    uint32_t faded = pixel_scale(color, mappedRate - 1);
+    uint32_t r = (((color >> 16) & 0xff) * redRate) >> 8;
+    setPixelColor(i, (faded & 0xFF00FFFF) | (r << 16));
   }
 }
 
@@ -762,33 +901,12 @@ void WS2812FX::fade2black(uint8_t rate) {
  */
 void WS2812FX::fade_out(uint8_t rate) {
   rate = (255-rate) >> 1;
-  float mappedRate = float(rate) +1.1;
-
+  uint16_t amount = 256 / (float(rate) +1.1);   // part of the distance to the target color per call, 1/256
   uint32_t color = SEGCOLOR(1); // target color
-  int w2 = (color >> 24) & 0xff;
-  int r2 = (color >> 16) & 0xff;
-  int g2 = (color >>  8) & 0xff;
-  int b2 =  color        & 0xff;
 
+  // moves at least 1 per channel (fixes rounding issues)
   for(uint16_t i = 0; i < SEGLEN; i++) {
-    color = getPixelColor(i);
-    int w1 = (color >> 24) & 0xff;
-    int r1 = (color >> 16) & 0xff;
-    int g1 = (color >>  8) & 0xff;
-    int b1 =  color        & 0xff;
-
-    int wdelta = (w2 - w1) / mappedRate;
-    int rdelta = (r2 - r1) / mappedRate;
-    int gdelta = (g2 - g1) / mappedRate;
-    int bdelta = (b2 - b1) / mappedRate;
-
-    // if fade isn't complete, make sure delta is at least 1 (fixes rounding issues)
-    wdelta += (w2 == w1) ? 0 : (w2 > w1) ? 1 : -1;
-    rdelta += (r2 == r1) ? 0 : (r2 > r1) ? 1 : -1;
-    gdelta += (g2 == g1) ? 0 : (g2 > g1) ? 1 : -1;
-    bdelta += (b2 == b1) ? 0 : (b2 > b1) ? 1 : -1;
-
-    setPixelColor(i, r1 + rdelta, g1 + gdelta, b1 + bdelta, w1 + wdelta);
+    setPixelColor(i, pixel_fade_toward(getPixelColor(i), color, amount));
   }
 }
 
@@ -799,24 +917,18 @@ void WS2812FX::blur(uint8_t blur_amount)
 {
   uint8_t keep = 255 - blur_amount;
   uint8_t seep = blur_amount >> 1;
-  CRGB carryover = CRGB::Black;
+  uint32_t carryover = 0;
+  uint32_t prev = 0;
   for(uint16_t i = 0; i < SEGLEN; i++)
   {
-    CRGB cur = col_to_crgb(getPixelColor(i));
-    CRGB part = cur;
-    part.nscale8(seep);
-    cur.nscale8(keep);
-    cur += carryover;
-    if(i > 0) {
-      uint32_t c = getPixelColor(i-1);
-      uint8_t r = (c >> 16 & 0xFF);
-      uint8_t g = (c >> 8  & 0xFF);
-      uint8_t b = (c       & 0xFF);
-      setPixelColor(i-1, qadd8(r, part.red), qadd8(g, part.green), qadd8(b, part.blue));
-    }
-    setPixelColor(i,cur.red, cur.green, cur.blue);
+    uint32_t cur = getPixelColor(i);
+    uint32_t part = pixel_scale(cur, seep);
+    cur = pixel_add(pixel_scale(cur, keep), carryover);
+    if(i > 0) setPixelColor(i-1, pixel_add(prev, part));
+    prev = cur;
     carryover = part;
   }
+  if (SEGLEN) setPixelColor(SEGLEN-1, prev);
 }
 
 uint16_t WS2812FX::triwave16(uint16_t in)
@@ -953,14 +1065,14 @@ void WS2812FX::handle_palette(void)
       {
         targetPalette = PartyColors_p; break; //fallback
       }
-      if (millis() - _lastPaletteChange > 1000 + ((uint32_t)(255-SEGMENT.intensity))*100)
+      if (fxMillis() - _lastPaletteChange > 1000 + ((uint32_t)(255-SEGMENT.intensity))*100)
       {
         targetPalette = CRGBPalette16(
                         CHSV(random8(), 255, random8(128, 255)),
                         CHSV(random8(), 255, random8(128, 255)),
                         CHSV(random8(), 192, random8(128, 255)),
                         CHSV(random8(), 255, random8(128, 255)));
-        _lastPaletteChange = millis();
+        _lastPaletteChange = fxMillis();
       } break;}
     case 2: {//primary color only
       CRGB prim = col_to_crgb(SEGCOLOR(0));
@@ -1044,29 +1156,108 @@ uint32_t WS2812FX::color_from_palette(uint16_t i, bool mapping, bool wrap, uint8
 }
 
 
-//load custom mapping table from JSON file
-void WS2812FX::deserializeMap(void) {
-  if (!WLED_FS.exists("/ledmap.json")) return;
-  DynamicJsonDocument doc(JSON_BUFFER_SIZE);  // full sized buffer for larger maps
-
-  DEBUG_PRINTLN(F("Reading LED map from /ledmap.json..."));
+//reads the "map" array of a ledmap JSON file into table without building a JSON document, returns the entries read
+static uint16_t readMapJson(File& f, uint16_t* table, uint16_t size) {
+  const char key[] = "\"map\"";
+  uint8_t buf[256];
+  uint16_t len = 0, pos = 0, count = 0;
+  uint8_t matched = 0;   //chars of key found so far
+  uint8_t state = 0;     //0: looking for key, 1: expecting ':', 2: expecting '[', 3: in the array
+  uint32_t value = 0;
+  bool digits = false, neg = false;
+
+  for (;;) {
+    if (pos >= len) {
+      len = f.read(buf, sizeof(buf));
+      pos = 0;
+      if (!len) return 0; //no complete array
+    }
+    char c = buf[pos++];
+    switch (state) {
+      case 0:
+        if (c == key[matched]) matched++;
+        else matched = (c == key[0]);
+        if (matched == sizeof(key) -1) { state = 1; matched = 0; }
+        break;
+      case 1:
+        if (c == ':') state = 2;
+        else if (!isspace(c)) state = 0; //"map" was a value, keep looking
+        break;
+      case 2:
+        if (c == '[') state = 3;
+        else if (!isspace(c)) return 0;  //not an array
+        break;
+      default:
+        if (c >= '0' && c <= '9') {
+          value = value * 10 + (c - '0');
+          digits = true;
+        } else if (c == '-' && !digits) {
+          neg = true;
+        } else if (c == ',' || c == ']') {
+          if (digits && count < size) table[count++] = (uint16_t)(neg ? -value : value);
+          if (c == ']') return count;
+          value = 0; digits = false; neg = false;
+        } else if (!isspace(c)) {
+          return 0;
+        }
+    }
+  }
+}
 
-  if (!readObjectFromFile("/ledmap.json", nullptr, &doc)) return; //if file does not exist just exit
+/*
+ * Loads the custom mapping table of map n from /ledmap.bin or /ledmap.json (n = 0) or /ledmap<n>.bin
+ * or /ledmap<n>.json. The binary map is "WMAP", a uint16 entry count and two reserved bytes, followed by
+ * the entries as little endian uint16 (tools/ledmap_bin.py converts a JSON map). Both are read straight
+ * into the table, which is never longer than the strip, so maps are limited by the LED count only.
+ * Without a map file the LEDs are not remapped. Returns false if map n could not be loaded.
+ */
+bool WS2812FX::deserializeMap(uint8_t n) {
+  char fileName[16];
+  if (n) sprintf_P(fileName, PSTR("/ledmap%d.bin"), n);
+  else   strcpy_P(fileName, PSTR("/ledmap.bin"));
+  bool binary = WLED_FS.exists(fileName);
+  if (!binary) strcpy_P(fileName + strlen(fileName) - 3, PSTR("json"));
 
   if (customMappingTable != nullptr) {
-    delete[] customMappingTable;
+    free(customMappingTable);
     customMappingTable = nullptr;
     customMappingSize = 0;
   }
+  _ledmap = n;
+
+  File f = WLED_FS.open(fileName, "r");
+  if (!f) return !n; //no ledmap.json is no mapping, a missing numbered map is an error
 
-  JsonArray map = doc[F("map")];
-  if (!map.isNull() && map.size()) {  // not an empty map
-    customMappingSize  = map.size();
-    customMappingTable = new uint16_t[customMappingSize];
-    for (uint16_t i=0; i<customMappingSize; i++) {
-      customMappingTable[i] = (uint16_t) map[i];
+  DEBUG_PRINT(F("Reading LED map from "));
+  DEBUG_PRINTLN(fileName);
+
+  uint16_t size = _length;
+  if (binary) {
+    uint8_t header[8];
+    if (f.read(header, sizeof(header)) != sizeof(header) || memcmp_P(header, PSTR("WMAP"), 4)) size = 0;
+    else size = min(size, (uint16_t)(header[4] | (header[5] << 8)));
+  }
+  if (size) customMappingTable = (uint16_t*) malloc(size * sizeof(uint16_t));
+  if (customMappingTable) {
+    if (binary) {
+      size_t bytes = f.read((uint8_t*)customMappingTable, size * sizeof(uint16_t));
+      customMappingSize = bytes / sizeof(uint16_t); //the ESP is little endian like the file
+    } else {
+      customMappingSize = readMapJson(f, customMappingTable, size);
     }
   }
+  f.close();
+
+  if (!customMappingSize && customMappingTable) {
+    free(customMappingTable);
+    customMappingTable = nullptr;
+  }
+  DEBUG_PRINTF("LED map %d: %d entries\n", n, customMappingSize);
+  return customMappingSize;
+}
+
+uint8_t WS2812FX::getLedmap(void) {
+  return _ledmap;
 }
 
 //gamma 2.8 lookup table used for color correction
@@ -5,8 +5,8 @@
 * NodeStruct from the ESP Easy project (https://github.com/letscontrolit/ESPEasy)
 \*********************************************************************************************/
 
-#include <map>
 #include <IPAddress.h>
+#include "wled_lock.h"
 
 #define NODE_TYPE_ID_UNDEFINED        0
 #define NODE_TYPE_ID_ESP8266         82
@@ -14,21 +14,142 @@
 
 /*********************************************************************************************\
 * NodeStruct
+* plain data so the node table can be kept as one sorted block and moved with memmove()
 \*********************************************************************************************/
 struct NodeStruct
 {
-  String    nodeName;
-  IPAddress ip;
+  uint32_t  ip;           // IPAddress as uint32_t, table key
+  uint32_t  build;
+  uint32_t  lastSeen;     // millis() of the last sysinfo packet from this node
+  uint8_t   mac[6];       // all zero if the sender does not include it
   uint8_t   unit;
-  uint8_t   age;
   uint8_t   nodeType;
-  uint32_t  build;
+  char      nodeName[33];
+};
+
+/*********************************************************************************************\
+* NodeList
+* Fixed capacity node table sorted by IP. Lookup is a binary search, the backing memory is
+* only allocated once the first node is seen and released again by clear().
+* Every insert, removal or change of a node increments the version, so clients only need to
+* refetch /json/nodes once "ndv" in /json/info changed.
+* The table is changed by the loop and the settings handlers and read by /json/nodes, hold getLock()
+* while using a pointer returned by get(), find() or add().
+\*********************************************************************************************/
+class NodeList
+{
+  public:
+  NodeList() {}
+
+  ~NodeList() {
+    clear();
+  }
+
+  inline uint16_t size()       { return _count; }
+  inline uint32_t getVersion() { return _version; }
+  inline void     modified()   { _version++; }
+  inline WledLock& getLock()   { return _lock; }
+
+  // i-th node in table order (0 <= i < size())
+  inline NodeStruct* get(uint16_t i) {
+    return (i < _count) ? &_nodes[i] : nullptr;
+  }
+
+  NodeStruct* find(uint32_t ip) {
+    bool found;
+    uint16_t pos = lowerBound(ip, found);
+    return found ? &_nodes[pos] : nullptr;
+  }
+
+  // returns the entry for ip, creating it if required. A node that re-appears with a known MAC
+  // under a new IP replaces its old entry instead of being listed twice.
+  NodeStruct* add(uint32_t ip, const uint8_t* mac = nullptr) {
+    WledLockGuard guard(_lock);
+    bool found;
+    uint16_t pos = lowerBound(ip, found);
+    if (found) return &_nodes[pos];
+
+    if (mac != nullptr && !isZeroMac(mac)) {
+      for (uint16_t i = 0; i < _count; i++) {
+        if (memcmp(_nodes[i].mac, mac, 6) == 0) {
+          remove(i);
+          pos = lowerBound(ip, found);
+          break;
+        }
+      }
+    }
+
+    if (_nodes == nullptr) {
+      _nodes = (NodeStruct*) malloc(sizeof(NodeStruct) * WLED_MAX_NODES);
+      if (_nodes == nullptr) return nullptr;
+    }
+    if (_count >= WLED_MAX_NODES) return nullptr;
+
+    memmove(&_nodes[pos+1], &_nodes[pos], sizeof(NodeStruct) * (_count - pos));
+    _count++;
+    NodeStruct* node = &_nodes[pos];
+    memset(node, 0, sizeof(NodeStruct));
+    node->ip = ip;
+    if (mac != nullptr) memcpy(node->mac, mac, 6);
+    _version++;
+    return node;
+  }
+
+  void remove(uint16_t i) {
+    WledLockGuard guard(_lock);
+    if (i >= _count) return;
+    _count--;
+    memmove(&_nodes[i], &_nodes[i+1], sizeof(NodeStruct) * (_count - i));
+    _version++;
+  }
+
+  // drop all nodes not heard from within ttl ms, returns number of removed nodes
+  uint16_t expire(uint32_t ttl) {
+    WledLockGuard guard(_lock);
+    uint32_t now = millis();
+    uint16_t removed = 0;
+    for (uint16_t i = 0; i < _count; i++) {
+      if (now - _nodes[i].lastSeen > ttl) removed++;
+      else if (removed) _nodes[i - removed] = _nodes[i];
+    }
+    if (removed) {
+      _count -= removed;
+      _version++;
+    }
+    return removed;
+  }
+
+  void clear() {
+    WledLockGuard guard(_lock);
+    if (_nodes == nullptr) return;
+    free(_nodes);
+    _nodes = nullptr;
+    _count = 0;
+    _version++;
+  }
+
+  private:
+  WledLock _lock;
+  NodeStruct* _nodes = nullptr;
+  uint16_t _count = 0;
+  uint32_t _version = 0;
+
+  static bool isZeroMac(const uint8_t* mac) {
+    for (uint8_t i = 0; i < 6; i++) if (mac[i]) return false;
+    return true;
+  }
 
-  NodeStruct() : age(0), nodeType(0), build(0)
-  {
-    for (uint8_t i = 0; i < 4; ++i) { ip[i] = 0; }
+  // first position whose ip is not less than ip
+  uint16_t lowerBound(uint32_t ip, bool& found) {
+    uint16_t lo = 0, hi = _count;
+    while (lo < hi) {
+      uint16_t mid = (lo + hi) >> 1;
+      if (_nodes[mid].ip < ip) lo = mid + 1;
+      else hi = mid;
+    }
+    found = (lo < _count && _nodes[lo].ip == ip);
+    return lo;
   }
 };
-typedef std::map<uint8_t, NodeStruct> NodesMap;
 
 #endif // WLED_NODESTRUCT_H
@@ -0,0 +1,270 @@
+#ifndef WLED_AUDIO_ANALYSIS_H
+#define WLED_AUDIO_ANALYSIS_H
+
+/*
+ * Hardware independent part of the sound reactive analysis.
+ * AudioSource delivers raw samples (I2S and analog microphones on the ESP32, WAV files on a host),
+ * AudioAnalyzer turns the last fftSize samples into an AudioFrame every hop samples and
+ * AudioVolume does the volume and AGC math of getSample() and agcAvg().
+ * Only depends on the C library, see tools/audio_analyze.cpp for running it on a host.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "audio_fft.h"
+#include "audio_bands.h"
+#include "audio_beat.h"
+#include "audio_frame.h"
+
+// Source of raw samples in the value range the firmware works with
+// (0-1023 for the analog input, 0-32767 for the rectified digital microphone)
+class AudioSource {
+  public:
+  virtual ~AudioSource() {}
+
+  // reads up to count samples into dst, blocking until at least one is available.
+  // Returns the number of samples read, 0 if the source is exhausted.
+  virtual uint16_t read(float* dst, uint16_t count) = 0;
+};
+
+// Time in ms, millis() on the ESP32. process() reads it once the newest sample is in.
+typedef uint32_t (*AudioClock)();
+
+// Settings of the analysis. On the ESP32 they are filled from the corresponding globals.
+struct AudioConfig {
+  uint8_t  squelch = 10;                        // soundSquelch
+  uint8_t  gain = 1;                            // sampleGain
+  uint8_t  targetAgc = 60;
+  uint8_t  bands = 0;                           // soundBands, 0 = off
+  uint16_t bandsMinFreq = 60;                   // soundBandsMinFreq
+  uint16_t bandsMaxFreq = 5120;                 // soundBandsMaxFreq
+};
+
+// Table of linearNoise results to be multiplied by soundSquelch in order to reduce squelch across fftResult bins.
+static const uint8_t linearNoise[16] = { 34, 28, 26, 25, 20, 12, 9, 6, 4, 4, 3, 2, 2, 2, 2, 2 };
+
+// Table of multiplication factors so that we can even out the frequency response.
+static const float fftResultPink[16] = {1.70,1.71,1.73,1.78,1.68,1.56,1.55,1.63,1.79,1.62,1.80,2.06,2.47,3.35,6.83,9.55};
+
+/*
+ * Andrew's mapping of 256 bins down to the 16 result bins with Sample Freq = 10240, samples = 512 and some overlap.
+ * Based on testing, the lowest/Start frequency is 60 Hz (with bin 3) and a highest/End frequency of 5120 Hz in bin 255.
+ * Now, Take the 60Hz and multiply by 1.320367784 to get the next frequency and so on until the end. Then detetermine the bins.
+ * End frequency = Start frequency * multiplier ^ 16
+ * Multiplier = (End frequency/ Start frequency) ^ 1/16
+ * Multiplier = 1.320367784
+ * Columns: first bin, last bin, divider
+ */
+#define AUDIO_REF_BIN_HZ 20.0f                  // bin width the table was made for
+static const uint8_t fftBands[16][3] = {
+  {  3,   4,  2},   // 60 - 100
+  {  4,   5,  2},   // 80 - 120
+  {  5,   7,  3},   // 100 - 160
+  {  7,   9,  3},   // 140 - 200
+  {  9,  12,  4},   // 180 - 260
+  { 12,  16,  5},   // 240 - 340
+  { 16,  21,  6},   // 320 - 440
+  { 21,  28,  8},   // 420 - 600
+  { 29,  37, 10},   // 580 - 760
+  { 37,  48, 12},   // 740 - 980
+  { 48,  64, 17},   // 960 - 1300
+  { 64,  84, 21},   // 1280 - 1700
+  { 84, 111, 28},   // 1680 - 2240
+  {111, 147, 37},   // 2220 - 2960
+  {147, 194, 48},   // 2940 - 3900
+  {194, 255, 62}    // 3880 - 5120
+};
+
+/*
+ * Volume and AGC as done by getSample() and agcAvg() once per loop on the newest raw sample.
+ */
+class AudioVolume {
+  public:
+  int   sample = 0;                             // 0-255
+  float sampleAvg = 0;                          // smoothed over the last 16 updates
+  int   sampleAgc = 0;                          // sample * multAgc
+  float micLev = 0;                             // leveller, the input is centered to this
+  float multAgc = 0;
+
+  // micIn: newest raw sample
+  void update(int micIn, const AudioConfig& cfg) {
+    micLev = ((micLev * 31) + micIn) / 32;      // Smooth it out over the last 32 samples for automatic centering
+    micIn -= micLev;                            // Let's center it to 0 now
+    micIn = abs(micIn);                         // And get the absolute value of each sample
+
+    // Using an exponential filter to smooth out the signal.
+    _expAdjF = (_weighting * micIn + (1.0 - _weighting) * _expAdjF);
+    _expAdjF = (_expAdjF <= cfg.squelch) ? 0 : _expAdjF;
+
+    int tmpSample = (int)_expAdjF;
+    int sampleAdj = tmpSample * cfg.gain / 40 + tmpSample / 16; // Adjust the gain.
+    sample = (sampleAdj > 255) ? 255 : sampleAdj;
+    sampleAvg = ((sampleAvg * 15) + sample) / 16;   // Smooth it out over the last 16 samples.
+  }
+
+  // A simple averaging multiplier to automatically adjust sound sensitivity.
+  void agc(const AudioConfig& cfg) {
+    multAgc = (sampleAvg < 1) ? cfg.targetAgc : cfg.targetAgc / sampleAvg;  // Make the multiplier so that sampleAvg * multiplier = setpoint
+    int tmpAgc = sample * multAgc;
+    if (tmpAgc > 255) tmpAgc = 0;
+    sampleAgc = tmpAgc;
+  }
+
+  private:
+  float _expAdjF = 0;
+  float _weighting = 0.2;                       // Exponential filter weighting. Will be adjustable in a future release.
+};
+
+/*
+ * Keeps the last fftSize samples in a ring buffer. Every process() reads hop new samples from the source
+ * and computes FFT, major peak, the 16 result bands, the configurable bands and the beat tracking.
+ */
+class AudioAnalyzer {
+  public:
+  AudioAnalyzer() {}
+
+  ~AudioAnalyzer() {
+    end();
+  }
+
+  // fftSize must be a power of 2, hop at most fftSize. Returns false if out of memory.
+  bool begin(uint16_t sampleRate, uint16_t fftSize = 512, uint16_t hop = 256) {
+    end();
+    if (hop == 0 || hop > fftSize) return false;
+    if (!_fft.begin(fftSize)) return false;
+    _ring = (float*) calloc(fftSize, sizeof(float));
+    _mag  = (float*) malloc(sizeof(float) * fftSize / 2);
+    if (!_ring || !_mag) {
+      end();
+      return false;
+    }
+    _sampleRate = sampleRate;
+    _size = fftSize;
+    _hop = hop;
+    _pos = 0;
+    _binHz = (float)sampleRate / fftSize;
+
+    // the 16 band table is made for 20 Hz bins, scale it to the actual bin width
+    for (uint8_t i = 0; i < 16; i++) {
+      uint16_t first = fftBands[i][0] * AUDIO_REF_BIN_HZ / _binHz + 0.5f;
+      uint16_t last  = fftBands[i][1] * AUDIO_REF_BIN_HZ / _binHz + 0.5f;
+      if (last >= fftSize / 2) last = fftSize / 2 - 1;
+      if (first > last) first = last;
+      _bandFirst[i] = first;
+      _bandLast[i]  = last;
+      _bandDiv[i]   = fftBands[i][2] * (float)(last - first + 1) / (fftBands[i][1] - fftBands[i][0] + 1);
+    }
+    memset(_avg, 0, sizeof(_avg));
+    _bandsN = 0; _bandsMin = 0; _bandsMax = 0;
+    _beat.begin(1000.0f * hop / sampleRate);
+    return true;
+  }
+
+  void end() {
+    _fft.end();
+    free(_ring); _ring = nullptr;
+    free(_mag);  _mag = nullptr;
+    _size = 0;
+  }
+
+  inline uint16_t fftSize() { return _size; }
+  inline uint16_t hopSize() { return _hop; }
+  inline float    binHz()   { return _binHz; }
+
+  // Reads the next hop from src and analyzes the last fftSize samples into frame, stamped with clock()
+  // after the read. frame->fftBin receives the first AUDIO_FRAME_BINS bins. Returns false if the source is exhausted.
+  bool process(AudioSource& src, AudioFrame* frame, const AudioConfig& cfg, AudioClock clock) {
+    if (!_ring) return false;
+    for (uint16_t got = 0; got < _hop; ) {
+      uint16_t want = _hop - got;
+      if (want > _size - _pos) want = _size - _pos;    // read up to the end of the ring
+      uint16_t n = src.read(&_ring[_pos], want);
+      if (n == 0) return false;
+      _pos = (_pos + n) & (_size - 1);
+      got += n;
+    }
+    frame->time = clock();                      // the read blocks for a hop, the frame is as old as its newest sample
+
+    _fft.compute(_ring, _mag, _pos);           // Hamming window, FFT and magnitudes over the last samples
+
+    //
+    // mag[3 .. 255] contain useful data, each a 20Hz interval (60Hz - 5120Hz).
+    // There could be interesting data at bins 0 to 2, but there are too many artifacts.
+    //
+    _fft.majorPeak(_mag, _sampleRate, &frame->majorPeak, &frame->magnitude); // let the effects know which freq was most dominant
+
+    uint16_t bins = _size / 2;
+    for (uint16_t i = 0; i < bins; i++) {
+      _mag[i] /= 16.0f;                         // Reduce magnitude. Want end result to be linear and ~4096 max.
+    }
+    uint16_t copy = (bins < AUDIO_FRAME_BINS) ? bins : AUDIO_FRAME_BINS;
+    memcpy(frame->fftBin, _mag, sizeof(float) * copy);
+    if (copy < AUDIO_FRAME_BINS) memset(&frame->fftBin[copy], 0, sizeof(float) * (AUDIO_FRAME_BINS - copy));
+
+    // This FFT post processing is a DIY endeavour. What we really need is someone with sound engineering expertise to do a great job here AND most importantly, that the animations look GREAT as a result.
+    postProcess(frame, cfg);
+    return true;
+  }
+
+  private:
+  AudioFFT   _fft;
+  AudioBands _bands;
+  AudioBeat  _beat;
+  float*   _ring = nullptr;                     // last _size samples, _pos is the oldest one
+  float*   _mag = nullptr;
+  uint16_t _size = 0, _hop = 0, _pos = 0;
+  uint16_t _sampleRate = 0;
+  float    _binHz = 0;
+  uint16_t _bandFirst[16], _bandLast[16];
+  float    _bandDiv[16];
+  float    _avg[16];                            // running average of the result bands
+  uint8_t  _bandsN = 0;
+  uint16_t _bandsMin = 0, _bandsMax = 0;
+
+  // (Re)build the band mapping if the configuration changed. The 16 band tables are the reference
+  // for the noise floor and frequency response corrections of the N bands.
+  void setupBands(const AudioConfig& cfg) {
+    if (_bandsN == cfg.bands && _bandsMin == cfg.bandsMinFreq && _bandsMax == cfg.bandsMaxFreq) return;
+    _bandsN = cfg.bands; _bandsMin = cfg.bandsMinFreq; _bandsMax = cfg.bandsMaxFreq;
+
+    if (!_bands.begin(_bandsN, _bandsMin, _bandsMax, _binHz, _size / 2)) return;   // off or invalid, size() is 0
+    float refHz[16];
+    for (uint8_t i = 0; i < 16; i++) refHz[i] = (fftBands[i][0] + fftBands[i][1]) * 0.5f * AUDIO_REF_BIN_HZ;
+    _bands.correct(refHz, fftResultPink, linearNoise, 16);
+  }
+
+  // Fold the FFT bins into the 16 result bands. Squelch, pink noise correction and gain are applied in the same pass.
+  void postProcess(AudioFrame* frame, const AudioConfig& cfg) {
+    float gain = cfg.gain / 40.0f + 1.0f / 16.0f;   // manual linear adjustment of gain using sampleGain
+    float squelch = cfg.squelch / 4.0f;
+
+    for (uint8_t i = 0; i < 16; i++) {
+      float sum = 0;
+      for (uint16_t b = _bandFirst[i]; b <= _bandLast[i]; b++) sum += _mag[b];
+      float v = sum / _bandDiv[i];
+
+      // noise supression using soundSquelch adjustment for different input types
+      if (v - squelch * linearNoise[i] <= 0) v = 0;
+      // adjustment for frequency curves and gain
+      v *= fftResultPink[i] * gain;
+
+      frame->fftResult[i] = (v > 254.0f) ? 254 : (int)v;
+      _avg[i] = (float)frame->fftResult[i]*.05 + (1-.05)*_avg[i];
+      frame->fftAvg[i] = _avg[i];
+    }
+
+    setupBands(cfg);
+    frame->numBands = _bands.size();
+    if (frame->numBands) _bands.compute(_mag, frame->bands, gain, squelch);
+
+    _beat.update(frame->fftResult, 16);
+    frame->beatBpm = _beat.bpm();
+    frame->beatPhase = _beat.phase();
+    frame->beatCount = _beat.count();
+  }
+};
+
+#endif // WLED_AUDIO_ANALYSIS_H
@@ -0,0 +1,111 @@
+#ifndef WLED_AUDIO_BANDS_H
+#define WLED_AUDIO_BANDS_H
+
+/*
+ * Maps the FFT bins to N logarithmically spaced bands between a lower and an upper frequency.
+ * Band edges, the partial weight of the bins at the edges and the per band corrections are
+ * computed once in begin(), so compute() is a single pass over the bins.
+ * Only depends on the C library, so the analysis can be run on a host as well.
+ */
+
+#include <stdint.h>
+#include <math.h>
+
+#define AUDIO_MIN_BANDS    8
+#define AUDIO_MAX_BANDS   64
+
+class AudioBands {
+  public:
+  AudioBands() {}
+
+  // n bands from fMin to fMax Hz, for bins that are binHz wide. bins is the number of usable bins.
+  // Returns false if the parameters are out of range.
+  bool begin(uint8_t n, float fMin, float fMax, float binHz, uint16_t bins) {
+    _n = 0;
+    if (n < AUDIO_MIN_BANDS || n > AUDIO_MAX_BANDS || binHz <= 0 || bins < 2) return false;
+    if (fMax > binHz * (bins - 1)) fMax = binHz * (bins - 1);
+    if (fMin < binHz) fMin = binHz;                    // bin 0 is DC
+    if (fMin >= fMax) return false;
+
+    float ratio = powf(fMax / fMin, 1.0f / n);
+    float lo = fMin / binHz;                           // edges in bins, bin k covers [k-0.5, k+0.5)
+    for (uint8_t i = 0; i < n; i++) {
+      float hi = lo * ratio;
+      Band& b = _bands[i];
+      float from = lo + 0.5f, to = hi + 0.5f;          // shift so that bin k covers [k, k+1)
+      b.first = (uint16_t)from;
+      b.last  = (uint16_t)to;
+      if (b.last >= bins) b.last = bins - 1;
+      if (b.first > b.last) b.first = b.last;
+      if (b.first == b.last) {
+        // narrower than a bin: all of it comes from one bin
+        b.wFirst = 1.0f;
+        b.wLast  = 0.0f;
+        b.scale  = 1.0f;
+      } else {
+        b.wFirst = (b.first + 1) - from;
+        b.wLast  = to - b.last;
+        b.scale  = 1.0f / (to - from);                 // average over the covered width
+      }
+      b.center = sqrtf(lo * hi) * binHz;
+      b.pink   = 1.0f;
+      b.noise  = 0.0f;
+      lo = hi;
+    }
+    _n = n;
+    return true;
+  }
+
+  inline uint8_t size() { return _n; }
+
+  inline float centerFreq(uint8_t i) { return (i < _n) ? _bands[i].center : 0.0f; }
+
+  // Per band pink noise (frequency response) and noise floor corrections, interpolated over log
+  // frequency from a reference table with count entries at increasing frequencies refHz.
+  void correct(const float* refHz, const float* refPink, const uint8_t* refNoise, uint8_t count) {
+    if (count == 0) return;
+    for (uint8_t i = 0; i < _n; i++) {
+      Band& b = _bands[i];
+      uint8_t r = 0;
+      while (r < count - 1 && refHz[r + 1] < b.center) r++;
+      if (r == count - 1 || b.center <= refHz[0]) {
+        uint8_t e = (b.center <= refHz[0]) ? 0 : count - 1;
+        b.pink  = refPink[e];
+        b.noise = refNoise[e];
+        continue;
+      }
+      float t = logf(b.center / refHz[r]) / logf(refHz[r + 1] / refHz[r]);
+      b.pink  = refPink[r]  + t * (refPink[r + 1]  - refPink[r]);
+      b.noise = refNoise[r] + t * (refNoise[r + 1] - refNoise[r]);
+    }
+  }
+
+  // bins to bands 0..254. Bands at or below squelch * noise floor are 0, the rest is corrected
+  // for the frequency response and multiplied by gain.
+  void compute(const float* bins, uint8_t* out, float gain, float squelch) {
+    for (uint8_t i = 0; i < _n; i++) {
+      const Band& b = _bands[i];
+      float sum = bins[b.first] * b.wFirst + bins[b.last] * b.wLast;
+      for (uint16_t k = b.first + 1; k < b.last; k++) sum += bins[k];
+      float v = sum * b.scale;
+      if (v - squelch * b.noise <= 0) v = 0;
+      v *= b.pink * gain;
+      out[i] = (v > 254.0f) ? 254 : (uint8_t)v;
+    }
+  }
+
+  private:
+  struct Band {
+    uint16_t first, last;                              // first and last bin contributing
+    float wFirst, wLast;                               // part of the first and last bin inside the band
+    float scale;                                       // 1 / band width in bins
+    float center;                                      // Hz
+    float pink;
+    float noise;
+  };
+
+  Band _bands[AUDIO_MAX_BANDS];
+  uint8_t _n = 0;
+};
+
+#endif // WLED_AUDIO_BANDS_H
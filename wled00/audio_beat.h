@@ -0,0 +1,190 @@
+#ifndef WLED_AUDIO_BEAT_H
+#define WLED_AUDIO_BEAT_H
+
+/*
+ * Beat and tempo tracking on the FFT result bands, called once per FFT frame.
+ * - onsets: spectral flux (sum of the band increases) above an adaptive threshold (running mean
+ *   plus a multiple of the mean deviation of the flux), with a holdoff of a fraction of the beat period
+ * - tempo: autocorrelation of the flux history over the lags of 60-180 BPM, weighted towards 120 BPM
+ *   to avoid locking to half or double tempo
+ * - phase: advanced every frame by the tempo and pulled towards onsets that are close to a predicted beat.
+ *   If the stronger onsets keep arriving half a beat off, the phase flips over to them.
+ * Only depends on the C library, so the analysis can be run on a host as well.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define AUDIO_BEAT_HISTORY   128                // flux history in frames, ~3 s at 40 frames/s
+#define AUDIO_BEAT_MIN_BPM    60
+#define AUDIO_BEAT_MAX_BPM   180
+
+class AudioBeat {
+  public:
+  AudioBeat() {}
+
+  // frameMs: time between two update() calls
+  void begin(float frameMs) {
+    _frameMs = frameMs;
+    reset();
+  }
+
+  void reset() {
+    memset(_hist, 0, sizeof(_hist));
+    memset(_prev, 0, sizeof(_prev));
+    _histPos = 0;
+    _frames = 0;
+    _mean = 0; _dev = 0;
+    _bpm = 0; _candidate = 0; _candidateHits = 0;
+    _phase = 0;
+    _onBeat = 0; _offBeat = 0;
+    _count = 0;
+    _sinceOnset = 0xFFFF;
+    _onset = false;
+  }
+
+  // bands: n band values (0-254) of the current frame. Returns true if a beat onset was detected.
+  bool update(const int* bands, uint8_t n) {
+    if (n > 16) n = 16;
+    float flux = 0;
+    for (uint8_t i = 0; i < n; i++) {
+      int d = bands[i] - _prev[i];
+      if (d > 0) flux += d;
+      _prev[i] = bands[i];
+    }
+
+    _hist[_histPos] = flux;
+    _histPos = (_histPos + 1) % AUDIO_BEAT_HISTORY;
+    _frames++;
+
+    // onset detection
+    float threshold = _mean + 2.0f * _dev + 40.0f;    // constant part keeps silence and noise quiet
+    float holdoff = (_bpm > 0) ? 0.4f * 60000.0f / _bpm : 100.0f;
+    _onset = (flux > threshold && _sinceOnset * _frameMs >= holdoff);
+    if (_sinceOnset < 0xFFFF) _sinceOnset++;
+    if (_onset) _sinceOnset = 0;
+    _mean += 0.05f * (flux - _mean);
+    _dev  += 0.05f * (fabsf(flux - _mean) - _dev);
+
+    if ((_frames & 7) == 0 && _frames >= AUDIO_BEAT_HISTORY) {
+      bool locked = (_bpm > 0);
+      estimateTempo();
+      if (!locked && _bpm > 0) {                  // just locked, start counting from the last onset
+        _phase = fmodf(_sinceOnset * _frameMs * _bpm / 60000.0f, 1.0f);
+        _onBeat = 0; _offBeat = 0;
+      }
+    }
+
+    // phase, 0 on the beat
+    if (_bpm > 0) {
+      _phase += _frameMs * _bpm / 60000.0f;
+      if (_phase >= 1.0f) {
+        _phase -= 1.0f;
+        _count++;
+      }
+      if (_onset) {
+        float err = (_phase > 0.5f) ? _phase - 1.0f : _phase;   // -0.5 .. 0.5, negative if the beat came early
+        _onBeat *= 0.9f; _offBeat *= 0.9f;
+        if (fabsf(err) < 0.25f) {
+          _onBeat += flux;
+          _phase -= 0.3f * err;
+        } else {
+          _offBeat += flux;
+          if (_offBeat > 1.5f * _onBeat + 1.0f) {   // we are counting the off-beats
+            float t = _onBeat; _onBeat = _offBeat; _offBeat = t;
+            _phase = 0;
+            _count++;
+          }
+        }
+        if (_phase < 0) _phase += 1.0f;
+        if (_phase >= 1.0f) { _phase -= 1.0f; _count++; }
+      }
+    } else if (_onset) {
+      _phase = 0;
+      _count++;
+    }
+    return _onset;
+  }
+
+  inline float    bpm()   { return _bpm; }      // 0 if no tempo found
+  inline float    phase() { return _phase; }    // 0..1, 0 on the beat
+  inline uint16_t count() { return _count; }    // beats so far, onsets if no tempo was found
+  inline bool     onset() { return _onset; }    // onset in the last update()
+
+  private:
+  float _hist[AUDIO_BEAT_HISTORY];
+  int   _prev[16];
+  uint16_t _histPos = 0;
+  uint32_t _frames = 0;
+  float _frameMs = 25.0f;
+  float _mean = 0, _dev = 0;
+  float _bpm = 0, _candidate = 0;
+  uint8_t _candidateHits = 0;
+  float _phase = 0;
+  float _onBeat = 0, _offBeat = 0;              // decaying sums of the onset strength near and away from the beat
+  uint16_t _count = 0;
+  uint16_t _sinceOnset = 0xFFFF;
+  bool _onset = false;
+
+  inline float hist(uint16_t age) {             // age 0 is the newest frame
+    return _hist[(_histPos + AUDIO_BEAT_HISTORY - 1 - age) % AUDIO_BEAT_HISTORY];
+  }
+
+  void estimateTempo() {
+    float mean = 0;
+    for (uint16_t i = 0; i < AUDIO_BEAT_HISTORY; i++) mean += _hist[i];
+    mean /= AUDIO_BEAT_HISTORY;
+
+    float r0 = 0;
+    for (uint16_t i = 0; i < AUDIO_BEAT_HISTORY; i++) r0 += (_hist[i] - mean) * (_hist[i] - mean);
+    if (r0 <= 0) { _bpm = 0; return; }
+
+    uint16_t minLag = 60000.0f / (AUDIO_BEAT_MAX_BPM * _frameMs);
+    uint16_t maxLag = 60000.0f / (AUDIO_BEAT_MIN_BPM * _frameMs) + 1;
+    if (maxLag > AUDIO_BEAT_HISTORY / 2) maxLag = AUDIO_BEAT_HISTORY / 2;
+    if (minLag < 2 || minLag + 2 > maxLag) return;
+
+    float r[AUDIO_BEAT_HISTORY / 2 + 2];
+    float best = 0, bestRaw = 0;
+    uint16_t bestLag = 0;
+    for (uint16_t lag = minLag - 1; lag <= maxLag + 1; lag++) {
+      float sum = 0;
+      for (uint16_t i = 0; i + lag < AUDIO_BEAT_HISTORY; i++) sum += (hist(i) - mean) * (hist(i + lag) - mean);
+      r[lag - minLag + 1] = sum / r0;
+    }
+    for (uint16_t lag = minLag; lag <= maxLag; lag++) {
+      float bpm = 60000.0f / (lag * _frameMs);
+      float o = log2f(bpm / 120.0f);
+      float w = r[lag - minLag + 1] * expf(-0.5f * o * o);
+      if (w > best) { best = w; bestRaw = r[lag - minLag + 1]; bestLag = lag; }
+    }
+    if (bestLag == 0 || bestRaw < 0.25f) {        // no periodicity
+      _bpm = 0;
+      _candidateHits = 0;
+      return;
+    }
+
+    // parabolic interpolation of the peak
+    float a = r[bestLag - minLag], b = r[bestLag - minLag + 1], c = r[bestLag - minLag + 2];
+    float denom = a - 2.0f * b + c;
+    float lag = bestLag + ((denom < 0) ? 0.5f * (a - c) / denom : 0.0f);
+    float bpm = 60000.0f / (lag * _frameMs);
+
+    if (_bpm > 0 && fabsf(bpm - _bpm) < 0.08f * _bpm) {
+      _bpm += 0.2f * (bpm - _bpm);                // same tempo, follow slowly
+      _candidateHits = 0;
+    } else if (_candidateHits && fabsf(bpm - _candidate) < 0.08f * _candidate) {
+      if (++_candidateHits >= 3) {                // a new tempo has to show up a few times in a row
+        _bpm = bpm;
+        _candidateHits = 0;
+      }
+    } else {
+      _candidate = bpm;
+      _candidateHits = 1;
+      if (_bpm == 0 && bestRaw > 0.4f) _bpm = bpm; // clear periodicity, lock right away
+    }
+  }
+};
+
+#endif // WLED_AUDIO_BEAT_H
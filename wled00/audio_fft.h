@@ -0,0 +1,148 @@
+#ifndef WLED_AUDIO_FFT_H
+#define WLED_AUDIO_FFT_H
+
+/*
+ * Single precision real FFT used by the sound reactive FFT task.
+ * N real samples are windowed and packed into N/2 complex values, transformed by an iterative
+ * radix-2 FFT and split into the N/2 bins of the real spectrum, so the work is about half of a
+ * complex FFT over N doubles. Window and twiddle factors are computed once in begin().
+ * Only depends on the C library, so the analysis can be run and measured on a host as well.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+class AudioFFT {
+  public:
+  AudioFFT() {}
+
+  ~AudioFFT() {
+    end();
+  }
+
+  // n must be a power of 2 (>= 8). Returns false if out of memory.
+  bool begin(uint16_t n) {
+    if (n < 8 || (n & (n - 1))) return false;
+    end();
+    _n = n;
+    uint16_t m = n >> 1;
+    _window = (float*) malloc(sizeof(float) * m);
+    _cos    = (float*) malloc(sizeof(float) * m);
+    _sin    = (float*) malloc(sizeof(float) * m);
+    _re     = (float*) malloc(sizeof(float) * m);
+    _im     = (float*) malloc(sizeof(float) * m);
+    if (!_window || !_cos || !_sin || !_re || !_im) {
+      end();
+      return false;
+    }
+    // Hamming window, symmetric so only the first half is stored
+    for (uint16_t i = 0; i < m; i++) {
+      _window[i] = 0.54f - 0.46f * cosf(2.0f * (float)M_PI * i / (n - 1));
+    }
+    // twiddles exp(-2*pi*i*k/n) for the N point split and the N/2 point complex FFT
+    for (uint16_t k = 0; k < m; k++) {
+      _cos[k] =  cosf(2.0f * (float)M_PI * k / n);
+      _sin[k] = -sinf(2.0f * (float)M_PI * k / n);
+    }
+    return true;
+  }
+
+  void end() {
+    free(_window); _window = nullptr;
+    free(_cos);    _cos = nullptr;
+    free(_sin);    _sin = nullptr;
+    free(_re);     _re = nullptr;
+    free(_im);     _im = nullptr;
+    _n = 0;
+  }
+
+  inline uint16_t size() { return _n; }
+
+  // windows n samples of in and writes the magnitudes of bins 0..n/2-1 to mag.
+  // in is read as a ring buffer of n samples with the oldest sample at index start.
+  void compute(const float* in, float* mag, uint16_t start = 0) {
+    uint16_t m = _n >> 1, mask = _n - 1;
+    for (uint16_t i = 0; i < m; i++) {
+      uint16_t a = 2*i, b = 2*i + 1;
+      _re[i] = in[(start + a) & mask] * windowAt(a);
+      _im[i] = in[(start + b) & mask] * windowAt(b);
+    }
+
+    transform(m);
+
+    // split the N/2 complex result into the spectrum of the N real samples
+    mag[0] = fabsf(_re[0] + _im[0]);
+    for (uint16_t k = 1; k < m; k++) {
+      float zr = _re[k],     zi = _im[k];
+      float cr = _re[m - k], ci = -_im[m - k];        // conj(Z[m-k])
+      float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+      float orr = 0.5f * (zi - ci), oi = -0.5f * (zr - cr); // (Z - conj) / 2i
+      float wr = _cos[k], wi = _sin[k];
+      float xr = er + orr * wr - oi * wi;
+      float xi = ei + orr * wi + oi * wr;
+      mag[k] = sqrtf(xr * xr + xi * xi);
+    }
+  }
+
+  // interpolated frequency and value of the largest local maximum, like arduinoFFT::MajorPeak()
+  void majorPeak(const float* mag, float sampleRate, float* freq, float* value) {
+    uint16_t m = _n >> 1;
+    float maxY = 0;
+    uint16_t idx = 1;
+    for (uint16_t i = 1; i < m - 1; i++) {
+      if (mag[i-1] < mag[i] && mag[i] > mag[i+1] && mag[i] > maxY) {
+        maxY = mag[i];
+        idx = i;
+      }
+    }
+    float denom = mag[idx-1] - 2.0f * mag[idx] + mag[idx+1];
+    float delta = (denom != 0.0f) ? 0.5f * (mag[idx-1] - mag[idx+1]) / denom : 0.0f;
+    *freq  = (idx + delta) * sampleRate / _n;
+    *value = fabsf(denom);
+  }
+
+  private:
+  uint16_t _n = 0;
+  float* _window = nullptr;
+  float* _cos = nullptr;
+  float* _sin = nullptr;
+  float* _re = nullptr;
+  float* _im = nullptr;
+
+  inline float windowAt(uint16_t i) {
+    uint16_t m = _n >> 1;
+    return (i < m) ? _window[i] : _window[_n - 1 - i];
+  }
+
+  // in-place iterative radix-2 FFT over _re/_im of length m
+  void transform(uint16_t m) {
+    // bit reversal permutation
+    for (uint16_t i = 1, j = 0; i < m; i++) {
+      uint16_t bit = m >> 1;
+      for (; j & bit; bit >>= 1) j ^= bit;
+      j ^= bit;
+      if (i < j) {
+        float t = _re[i]; _re[i] = _re[j]; _re[j] = t;
+        t = _im[i]; _im[i] = _im[j]; _im[j] = t;
+      }
+    }
+
+    for (uint16_t len = 2; len <= m; len <<= 1) {
+      uint16_t half = len >> 1;
+      uint16_t step = _n / len;                        // twiddle table is for N points
+      for (uint16_t i = 0; i < m; i += len) {
+        for (uint16_t j = 0; j < half; j++) {
+          float wr = _cos[j * step], wi = _sin[j * step];
+          uint16_t a = i + j, b = a + half;
+          float vr = _re[b] * wr - _im[b] * wi;
+          float vi = _re[b] * wi + _im[b] * wr;
+          _re[b] = _re[a] - vr; _im[b] = _im[a] - vi;
+          _re[a] += vr;         _im[a] += vi;
+        }
+      }
+    }
+  }
+};
+
+#endif // WLED_AUDIO_FFT_H
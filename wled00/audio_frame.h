@@ -0,0 +1,76 @@
+#ifndef WLED_AUDIO_FRAME_H
+#define WLED_AUDIO_FRAME_H
+
+/*
+ * Handoff of FFT results from the FFT task (core 0) to the render loop (core 1).
+ * The FFT task fills a complete AudioFrame and publishes it, the loop picks up the newest published
+ * frame. Nothing is ever read while it is being written, so bands, bins and peak always belong to
+ * the same FFT, and neither side blocks the other.
+ * Only depends on the C library, so the analysis can be run on a host as well.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "audio_bands.h"
+
+#define AUDIO_FRAME_BINS  256                   // samples/2
+
+struct AudioFrame {
+  uint32_t seq;                                 // increases by one with every published frame, 0 if nothing was published yet
+  uint32_t time;                                // millis() of the FFT
+  float    majorPeak;                           // Hz
+  float    magnitude;
+  int      fftResult[16];
+  float    fftAvg[16];
+  float    fftBin[AUDIO_FRAME_BINS];
+  uint8_t  numBands;                            // valid entries in bands[], 0 if band mapping is off
+  uint8_t  bands[AUDIO_MAX_BANDS];
+  float    beatBpm;                             // detected tempo, 0 if none
+  float    beatPhase;                           // 0..1, 0 on the beat
+  uint16_t beatCount;                           // increases with every beat
+};
+
+/*
+ * Triple buffer with a single writer and a single reader.
+ * The writer owns one slot, the reader owns one slot and the third one holds the newest published
+ * frame. publish() and acquire() swap their slot with the third one in a single atomic exchange,
+ * a flag in the exchanged index tells the reader whether the frame in there is new.
+ */
+class AudioFrameBuffer {
+  public:
+  AudioFrameBuffer() {
+    memset(_frames, 0, sizeof(_frames));
+  }
+
+  // slot the writer may fill. Contents are left over from an older frame.
+  inline AudioFrame* writeFrame() { return &_frames[_back]; }
+
+  // make the write slot the newest frame and get a new write slot
+  void publish() {
+    _frames[_back].seq = ++_seq;
+    _back = __atomic_exchange_n(&_middle, _back | FRESH, __ATOMIC_ACQ_REL) & INDEX;
+  }
+
+  // switch the read slot to the newest frame. Returns false (and keeps the current frame) if
+  // nothing was published since the last call.
+  bool acquire() {
+    if (!(__atomic_load_n(&_middle, __ATOMIC_ACQUIRE) & FRESH)) return false;
+    _front = __atomic_exchange_n(&_middle, _front, __ATOMIC_ACQ_REL) & INDEX;
+    return true;
+  }
+
+  // frame returned by the last acquire()
+  inline const AudioFrame* readFrame() { return &_frames[_front]; }
+
+  private:
+  static const uint32_t INDEX = 0x03;
+  static const uint32_t FRESH = 0x04;
+
+  AudioFrame _frames[3];
+  uint32_t _back = 0;                           // writer only
+  uint32_t _middle = 1;                         // shared
+  uint32_t _front = 2;                          // reader only
+  uint32_t _seq = 0;                            // writer only
+};
+
+#endif // WLED_AUDIO_FRAME_H
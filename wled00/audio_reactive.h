@@ -10,13 +10,19 @@
 //
 // sample     sampleAvg     sampleAgc       samplePeak    myVals[]
 //
-// fftBin[]   fftResult[]   FFT_MajorPeak   FFT_Magnitude
+// fftBin[]   fftResult[]   FFT_MajorPeak   FFT_Magnitude   fftAvg[]   fftBandResult[]
+//
+// beatBpm    beatPhase     beatCount
 //
 // Otherwise, the animations may asynchronously read interim values of these variables.
+// The FFT task never writes the FFT variables directly. It publishes complete AudioFrames which the
+// loop copies into them in updateAudioFrame(), so the effects only ever see values of one FFT.
+// audioFrameSeq changes whenever new audio data arrived (local FFT or UDP sync).
 //
 
 #include "wled.h"
 #include <driver/i2s.h>
+#include "audio_analysis.h"
 
 // ALL AUDIO INPUT PINS DEFINED IN wled.h AND CONFIGURABLE VIA UI
 
@@ -38,7 +44,7 @@
 // #define FFT_SAMPLING_LOG
 
 const i2s_port_t I2S_PORT = I2S_NUM_0;
-const int BLOCK_SIZE = 64;
+const int BLOCK_SIZE = 64;                      // samples per I2S DMA buffer and per i2s_read()
 
 const int SAMPLE_RATE = 10240;                  // Base sample rate in Hz
 
@@ -50,7 +56,11 @@ TaskHandle_t FFT_Task;
   #define LED_BUILTIN 3
 #endif
 
-#define UDP_SYNC_HEADER "00001"
+#define UDP_SYNC_HEADER    "00001"
+#define UDP_SYNC_HEADER_V2 "00002"
+
+#define AUDIO_SYNC_V2_SIZE      76              // size of a version 2 packet without extended bins
+#define AUDIO_SYNC_MAX_AGE     200              // ms, packets delayed more than this (relative to the fastest seen) are dropped
 
 uint8_t maxVol = 10;                            // Reasonable value for constant volume for 'peak detector', as it won't always trigger
 uint8_t binNum;                                 // Used to select the bin for FFT based beat detection.
@@ -61,50 +71,80 @@ bool udpSamplePeak = 0;                         // Boolean flag for peak. Set at
 int delayMs = 10;                               // I don't want to sample too often and overload WLED
 int micIn;                                      // Current sample starts with negative values and large values, which is why it's 16 bit signed
 int sample;                                     // Current sample. Must only be updated ONCE!!!
-int tmpSample;                                  // An interim sample variable used for calculatioins.
-int sampleAdj;                                  // Gain adjusted sample value
 int sampleAgc;                                  // Our AGC sample
 uint16_t micData;                               // Analog input for FFT
 uint16_t micDataSm;                             // Smoothed mic data, as it's a bit twitchy
 long timeOfPeak = 0;
 long lastTime = 0;
-float micLev = 0;                               // Used to convert returned value to have '0' as minimum. A leveller
-float multAgc;                                  // sample * multAgc = sampleAgc. Our multiplier
 float sampleAvg = 0;                            // Smoothed Average
 double beat = 0;                                // beat Detection
 
-float expAdjF;                                  // Used for exponential filter.
-float weighting = 0.2;                          // Exponential filter weighting. Will be adjustable in a future release.
+AudioVolume volume;                             // volume and AGC state of getSample() and agcAvg()
+
+// Analysis settings from the globals
+AudioConfig audioConfig() {
+  AudioConfig cfg;
+  cfg.squelch = soundSquelch;
+  cfg.gain = sampleGain;
+  cfg.targetAgc = targetAgc;
+  cfg.bands = soundBands;
+  cfg.bandsMinFreq = soundBandsMinFreq;
+  cfg.bandsMaxFreq = soundBandsMaxFreq;
+  return cfg;
+}
+
+// time stamp of an FFT frame, taken once its samples are in
+uint32_t audioClock() {
+  return millis();
+}
 
 
 // FFT Variables
 const uint16_t samples = 512;                   // This value MUST ALWAYS be a power of 2
+#ifndef FFT_HOP_SIZE
+  #define FFT_HOP_SIZE 256                      // new samples per FFT. Half of samples gives 50% overlapping windows and twice the FFT rate
+#endif
 unsigned int sampling_period_us;
 unsigned long microseconds;
 
 double FFT_MajorPeak = 0;
 double FFT_Magnitude = 0;
 uint16_t mAvg = 0;
+unsigned long fftTime = 0;                      // millis() when the last FFT result was published
 
-// These are the input and output vectors.  Input vectors receive computed results from FFT.
-double vReal[samples];
-double vImag[samples];
-double fftBin[samples];
+// Audio sync state
+uint16_t audioSyncSeq = 0;                      // sequence number of the next transmitted packet
+uint16_t audioSyncLastSeq = 0;                  // last received sequence number
+bool     audioSyncSeqValid = false;             // audioSyncLastSeq holds a received value
+uint32_t audioSyncLost = 0;                     // number of packets missing in the received sequence
+int32_t  audioSyncOffset = 0;                   // smallest (receive time - sender timestamp) seen, i.e. the network + clock offset
+uint16_t audioSyncDelay = 0;                    // how much later than the fastest packet the current packet arrived (ms)
+
+// Output magnitudes. Only the first samples/2 bins of a real FFT are meaningful.
+float fftBin[samples/2];
+
+static_assert(AUDIO_FRAME_BINS == samples/2, "AudioFrame must hold all FFT bins");
+AudioFrameBuffer audioFrames;                   // FFT task -> loop
+uint32_t audioFrameSeq = 0;                     // changes whenever the audio variables were updated
 
 // Try and normalize fftBin values to a max of 4096, so that 4096/16 = 256.
 // Oh, and bins 0,1,2 are no good, so we'll zero them out.
-double fftCalc[16];
 int fftResult[16];                              // Our calculated result table, which we feed to the animations.
-double fftResultMax[16];                        // A table used for testing to determine how our post-processing is working.
 float fftAvg[16];
 
-// Table of linearNoise results to be multiplied by soundSquelch in order to reduce squelch across fftResult bins.
-int linearNoise[16] = { 34, 28, 26, 25, 20, 12, 9, 6, 4, 4, 3, 2, 2, 2, 2, 2 };
+// Configurable number of logarithmic bands (soundBands, soundBandsMinFreq, soundBandsMaxFreq), in addition to fftResult[]
+uint8_t fftBandResult[AUDIO_MAX_BANDS];
+uint8_t fftBandCount = 0;                       // valid entries in fftBandResult[], 0 if not available (off or audio sync receive)
 
-// Table of multiplication factors so that we can even out the frequency response.
-double fftResultPink[16] = {1.70,1.71,1.73,1.78,1.68,1.56,1.55,1.63,1.79,1.62,1.80,2.06,2.47,3.35,6.83,9.55};
+// Beat tracking, see audio_beat.h
+float beatBpm = 0;                              // detected tempo, 0 if there is none
+uint8_t beatPhase = 0;                          // position in the current beat, 0 on the beat. Advanced every loop.
+uint16_t beatCount = 0;                         // increases with every beat (every onset if there is no tempo)
+float beatFramePhase = 0;                       // phase at beatFrameTime
+unsigned long beatFrameTime = 0;
 
 
+// Version 1 packet, kept to talk to older nodes. Its layout depends on the compiler's struct packing.
 struct audioSyncPacket {
   char header[6] = UDP_SYNC_HEADER;
   uint8_t myVals[32];     //  32 Bytes
@@ -117,6 +157,35 @@ struct audioSyncPacket {
   double FFT_MajorPeak;   //  08 Bytes
 };
 
+/*
+ * Version 2 packet. All multi-byte fields are little endian and written byte by byte, so the layout
+ * does not depend on compiler struct packing or the architecture of sender and receiver.
+ *  0: 6 byte header "00002"
+ *  6: 1 byte flags (bit 0: samplePeak, bit 1: extended FFT bins follow)
+ *  7: 1 byte reserved
+ *  8: 2 byte sequence number
+ * 10: 4 byte sender timestamp (millis() of the FFT the values belong to)
+ * 14: 1 byte sampleAgc
+ * 15: 1 byte sample
+ * 16: 2 byte sampleAvg (8.8 fixed point)
+ * 18: 32 byte myVals
+ * 50: 16 byte fftResult
+ * 66: 4 byte FFT_Magnitude (24.8 fixed point)
+ * 70: 2 byte FFT_MajorPeak in Hz (13.3 fixed point)
+ * 72: 2 byte beatBpm (8.8 fixed point, 0 = no tempo)
+ * 74: 1 byte beatPhase at the sender timestamp
+ * 75: 1 byte beatCount (low byte)
+ * 76: 1 byte number of extended bins N (only if flags bit 1)
+ * 77: N byte fftBin[0..N-1]/16
+ */
+#define AUDIO_SYNC_FLAG_PEAK    0x01
+#define AUDIO_SYNC_FLAG_BINS    0x02
+
+static inline void audioSyncPut16(uint8_t* p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static inline void audioSyncPut32(uint8_t* p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+static inline uint16_t audioSyncGet16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+static inline uint32_t audioSyncGet32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+
 double mapf(double x, double in_min, double in_max, double out_min, double out_max);
 
 bool isValidUdpSyncVersion(char header[6]) {
@@ -146,28 +215,9 @@ void getSample() {
     DEBUGSR_PRINT("\t\t"); DEBUGSR_PRINT(micIn);
 /*-------END DEBUG-------*/
   #endif
-  micLev = ((micLev * 31) + micIn) / 32;          // Smooth it out over the last 32 samples for automatic centering
-  micIn -= micLev;                                // Let's center it to 0 now
-  micIn = abs(micIn);                             // And get the absolute value of each sample
-/*---------DEBUG---------*/
-  DEBUGSR_PRINT("\t\t"); DEBUGSR_PRINT(micIn);
-/*-------END DEBUG-------*/
-
-// Using an exponential filter to smooth out the signal. We'll add controls for this in a future release.
-  expAdjF = (weighting * micIn + (1.0-weighting) * expAdjF);
-  expAdjF = (expAdjF <= soundSquelch) ? 0: expAdjF;
-
-  tmpSample = (int)expAdjF;
-
-/*---------DEBUG---------*/
-  DEBUGSR_PRINT("\t\t"); DEBUGSR_PRINT(sample);
-/*-------END DEBUG-------*/
-
-  sampleAdj = tmpSample * sampleGain / 40 + tmpSample / 16; // Adjust the gain.
-  sampleAdj = min(sampleAdj, 255);
-  sample = sampleAdj;                             // ONLY update sample ONCE!!!!
-
-  sampleAvg = ((sampleAvg * 15) + sample) / 16;   // Smooth it out over the last 16 samples.
+  volume.update(micIn, audioConfig());            // centering, exponential filter, squelch and gain
+  sample = volume.sample;                         // ONLY update sample ONCE!!!!
+  sampleAvg = volume.sampleAvg;
 
 /*---------DEBUG---------*/
   DEBUGSR_PRINT("\t"); DEBUGSR_PRINT(sample);
@@ -198,10 +248,8 @@ void getSample() {
  */
 void agcAvg() {
 
-  multAgc = (sampleAvg < 1) ? targetAgc : targetAgc / sampleAvg;  // Make the multiplier so that sampleAvg * multiplier = setpoint
-  int tmpAgc = sample * multAgc;
-  if (tmpAgc > 255) tmpAgc = 0;
-  sampleAgc = tmpAgc;                             // ONLY update sampleAgc ONCE because it's used elsewhere asynchronously!!!!
+  volume.agc(audioConfig());
+  sampleAgc = volume.sampleAgc;                   // ONLY update sampleAgc ONCE because it's used elsewhere asynchronously!!!!
   userVar0 = sampleAvg * 4;
   if (userVar0 > 255) userVar0 = 255;
 } // agcAvg()
@@ -212,19 +260,7 @@ void agcAvg() {
 // Begin FFT Code //
 ////////////////////
 
-#include "arduinoFFT.h"
-
-void transmitAudioData() {
-  if (!udpSyncConnected) return;
-  extern uint8_t myVals[];
-  extern int sampleAgc;
-  extern int sample;
-  extern float sampleAvg;
-  extern bool udpSamplePeak;
-  extern int fftResult[];
-  extern double FFT_Magnitude;
-  extern double FFT_MajorPeak;
-
+void transmitAudioDataV1() {
   audioSyncPacket transmitData;
 
   for (int i = 0; i < 32; i++) {
@@ -247,147 +283,244 @@ void transmitAudioData() {
   fftUdp.beginMulticastPacket();
   fftUdp.write(reinterpret_cast<uint8_t *>(&transmitData), sizeof(transmitData));
   fftUdp.endPacket();
-  return;
+} // transmitAudioDataV1()
+
+void transmitAudioData() {
+  if (!udpSyncConnected) return;
+  if (audioSyncVersion < 2) {
+    transmitAudioDataV1();
+    return;
+  }
+
+  uint8_t nBins = min((int)audioSyncExtBins, (int)samples/2);
+  uint8_t buf[AUDIO_SYNC_V2_SIZE + 1 + 255];
+  uint16_t len = AUDIO_SYNC_V2_SIZE;
+
+  memset(buf, 0, AUDIO_SYNC_V2_SIZE);
+  memcpy(buf, UDP_SYNC_HEADER_V2, 6);
+  buf[6] = (udpSamplePeak ? AUDIO_SYNC_FLAG_PEAK : 0) | (nBins ? AUDIO_SYNC_FLAG_BINS : 0);
+  udpSamplePeak = 0;                              // Reset udpSamplePeak after we've transmitted it
+  audioSyncPut16(buf +  8, audioSyncSeq++);
+  audioSyncPut32(buf + 10, fftTime);
+  buf[14] = constrain(sampleAgc, 0, 255);
+  buf[15] = constrain(sample, 0, 255);
+  audioSyncPut16(buf + 16, (uint16_t)constrain(sampleAvg * 256.0f, 0.0f, 65535.0f));
+  memcpy(buf + 18, myVals, 32);
+  for (int i = 0; i < 16; i++) {
+    buf[50 + i] = (uint8_t)constrain(fftResult[i], 0, 254);
+  }
+  audioSyncPut32(buf + 66, (uint32_t)constrain(FFT_Magnitude * 256.0, 0.0, 4294967295.0));
+  audioSyncPut16(buf + 70, (uint16_t)constrain(FFT_MajorPeak * 8.0, 0.0, 65535.0));
+  audioSyncPut16(buf + 72, (uint16_t)constrain(beatBpm * 256.0f, 0.0f, 65535.0f));
+  buf[74] = beatFramePhase * 256.0f;
+  buf[75] = beatCount;
+
+  if (nBins) {
+    buf[len++] = nBins;
+    for (int i = 0; i < nBins; i++) {
+      buf[len++] = (uint8_t)constrain(fftBin[i] / 16.0, 0.0, 255.0);
+    }
+  }
+
+  fftUdp.beginMulticastPacket();
+  fftUdp.write(buf, len);
+  fftUdp.endPacket();
 } // transmitAudioData()
 
 
+void receiveAudioDataV1(const uint8_t* fftBuff, int packetSize) {
+  audioSyncPacket receivedPacket;
+  if (packetSize < (int)sizeof(receivedPacket)) return;
+  memcpy(&receivedPacket, fftBuff, sizeof(receivedPacket));
 
+  for (int i = 0; i < 32; i++ ){
+    myVals[i] = receivedPacket.myVals[i];
+  }
+  sampleAgc = receivedPacket.sampleAgc;
+  sample = receivedPacket.sample;
+  sampleAvg = receivedPacket.sampleAvg;
+
+  // Only change samplePeak IF it's currently false.
+  // If it's true already, then the animation still needs to respond.
+  if (!samplePeak) {
+    samplePeak = receivedPacket.samplePeak;
+    if (samplePeak) timeOfPeak = millis();
+  }
+  //These values are only available on the ESP32
+  for (int i = 0; i < 16; i++) {
+    fftResult[i] = receivedPacket.fftResult[i];
+  }
 
-// Create FFT object
-arduinoFFT FFT = arduinoFFT( vReal, vImag, samples, SAMPLE_RATE );
+  FFT_Magnitude = receivedPacket.FFT_Magnitude;
+  FFT_MajorPeak = receivedPacket.FFT_MajorPeak;
+  fftBandCount = 0;                               // not part of the sync packet, effects fall back to fftResult[]
+  beatBpm = 0;                                    // same for the beat tracking
+  audioFrameSeq++;
+} // receiveAudioDataV1()
+
+void receiveAudioDataV2(const uint8_t* buf, int packetSize) {
+  if (packetSize < AUDIO_SYNC_V2_SIZE) return;
+
+  // sequence: drop duplicates and reordered packets, count gaps as loss
+  uint16_t seq = audioSyncGet16(buf + 8);
+  bool first = !audioSyncSeqValid;
+  if (!first) {
+    int16_t diff = (int16_t)(seq - audioSyncLastSeq);
+    if (diff <= 0 && diff > -100) return;       // old or duplicate packet (a large jump back means the sender restarted)
+    if (diff > 1) audioSyncLost += diff - 1;
+  }
+  audioSyncLastSeq = seq;
+  audioSyncSeqValid = true;
+
+  // latency: clocks are not synced, so track the smallest receive - send difference seen (slowly
+  // forgetting it) and treat anything above it as delay of this packet
+  int32_t offset = (int32_t)(millis() - audioSyncGet32(buf + 10));
+  if (first || offset < audioSyncOffset || offset - audioSyncOffset > 1000) audioSyncOffset = offset; // (re)sync, e.g. sender restarted
+  else if ((seq & 0x3F) == 0) audioSyncOffset++;                                                       // clocks drift, slowly forget
+  audioSyncDelay = offset - audioSyncOffset;
+  if (audioSyncDelay > AUDIO_SYNC_MAX_AGE) return; // stale, a newer packet is already on its way
+
+  memcpy(myVals, buf + 18, 32);
+  sampleAgc = buf[14];
+  sample = buf[15];
+  sampleAvg = audioSyncGet16(buf + 16) / 256.0f;
+
+  // Only change samplePeak IF it's currently false.
+  // If it's true already, then the animation still needs to respond.
+  if (!samplePeak && (buf[6] & AUDIO_SYNC_FLAG_PEAK)) {
+    samplePeak = 1;
+    timeOfPeak = millis() - audioSyncDelay;       // let the peak expire as if it had been detected locally
+  }
+  for (int i = 0; i < 16; i++) {
+    fftResult[i] = buf[50 + i];
+  }
+  FFT_Magnitude = audioSyncGet32(buf + 66) / 256.0;
+  FFT_MajorPeak = audioSyncGet16(buf + 70) / 8.0;
+
+  static uint8_t lastBeat = 0;
+  beatCount += (uint8_t)(buf[75] - lastBeat);     // the sender counts in 8 bit
+  lastBeat = buf[75];
+  beatBpm = audioSyncGet16(buf + 72) / 256.0f;
+  beatFramePhase = buf[74] / 256.0f;
+  beatFrameTime = millis() - audioSyncDelay;
+
+  if ((buf[6] & AUDIO_SYNC_FLAG_BINS) && packetSize > AUDIO_SYNC_V2_SIZE) {
+    int nBins = min((int)buf[AUDIO_SYNC_V2_SIZE], packetSize - AUDIO_SYNC_V2_SIZE - 1);
+    nBins = min(nBins, (int)samples/2);
+    for (int i = 0; i < nBins; i++) {
+      fftBin[i] = buf[AUDIO_SYNC_V2_SIZE + 1 + i] * 16.0;
+    }
+  }
+  fftBandCount = 0;                               // not part of the sync packet, effects fall back to fftResult[]
+  audioFrameSeq++;
+  DEBUGSR_PRINTF("Audio sync seq %u delay %ums lost %u\n", seq, audioSyncDelay, audioSyncLost);
+} // receiveAudioDataV2()
 
-double fftAdd( int from, int to) {
-  int i = from;
-  double result = 0;
-  while ( i <= to) {
-    result += fftBin[i++];
+void receiveAudioData() {
+  if (!udpSyncConnected) return;
+  int packetSize = fftUdp.parsePacket();
+  if (packetSize < 6 || packetSize > AUDIO_SYNC_V2_SIZE + 1 + 255) return;
+  uint8_t fftBuff[packetSize];
+  fftUdp.read(fftBuff, packetSize);
+
+  // VERIFY THAT THIS IS A COMPATIBLE PACKET
+  if (isValidUdpSyncVersion((char*)fftBuff)) {
+    receiveAudioDataV1(fftBuff, packetSize);
+  } else if (strncmp((char*)fftBuff, UDP_SYNC_HEADER_V2, 6) == 0) {
+    receiveAudioDataV2(fftBuff, packetSize);
   }
-  return result;
-}
+} // receiveAudioData()
 
-// FFT main code
-void FFTcode( void * parameter) {
-  //DEBUG_PRINT("FFT running on core: "); DEBUG_PRINTLN(xPortGetCoreID());
-  //double beatSample = 0;  // COMMENTED OUT - UNUSED VARIABLE COMPILER WARNINGS
-  //double envelope = 0;    // COMMENTED OUT - UNUSED VARIABLE COMPILER WARNINGS
 
-  for(;;) {
-    delay(1);           // DO NOT DELETE THIS LINE! It is needed to give the IDLE(0) task enough time and to keep the watchdog happy.
-                        // taskYIELD(), yield(), vTaskDelay() and esp_task_wdt_feed() didn't seem to work.
 
-    // Only run the FFT computing code if we're not in Receive mode
-    if (audioSyncEnabled & (1 << 1))
-      continue;
+AudioAnalyzer analyzer;                         // only used by the FFT task
 
+// Analog microphone, timed analogRead() at SAMPLE_RATE
+class AnalogAudioSource : public AudioSource {
+  public:
+  uint16_t read(float* dst, uint16_t count) override {
     microseconds = micros();
-    //extern double volume;   // COMMENTED OUT - UNUSED VARIABLE COMPILER WARNINGS
-
-    for(int i=0; i<samples; i++) {
-      if (digitalMic == false) {
-        micData = analogRead(audioPin);           // Analog Read
-      } else {
-        int32_t digitalSample = 0;
-        // TODO: I2S_POP_SAMLE DEPRECATED, FIND ALTERNATE SOLUTION
-        int bytes_read = i2s_pop_sample(I2S_PORT, (char *)&digitalSample, portMAX_DELAY); // no timeout
-        if (bytes_read > 0) {
-          micData = abs(digitalSample >> 16);
-        }
-      }
-      micDataSm = ((micData * 3) + micData)/4;    // We'll be passing smoothed micData to the volume routines as the A/D is a bit twitchy.
-      vReal[i] = micData;                         // Store Mic Data in an array
-      vImag[i] = 0;
-
-      // MIC DATA DEBUGGING
-      // DEBUGSR_PRINT("micData: ");
-      // DEBUGSR_PRINT(micData);
-      // DEBUGSR_PRINT("\tmicDataSm: ");
-      // DEBUGSR_PRINT("\t");
-      // DEBUGSR_PRINT(micDataSm);
-      // DEBUGSR_PRINT("\n");
-
-      if (digitalMic == false) { while(micros() - microseconds < sampling_period_us){/*empty loop*/} }
+    for (uint16_t i = 0; i < count; i++) {
+      micData = analogRead(audioPin);           // Analog Read
+      micDataSm = ((micData * 3) + micData)/4;  // We'll be passing smoothed micData to the volume routines as the A/D is a bit twitchy.
+      dst[i] = micData;
 
+      while(micros() - microseconds < sampling_period_us){/*empty loop*/}
       microseconds += sampling_period_us;
     }
+    return count;
+  }
+};
 
-    FFT.Windowing( FFT_WIN_TYP_HAMMING, FFT_FORWARD );      // Weigh data
-    FFT.Compute( FFT_FORWARD );                             // Compute FFT
-    FFT.ComplexToMagnitude();                               // Compute magnitudes
-
-    //
-    // vReal[3 .. 255] contain useful data, each a 20Hz interval (60Hz - 5120Hz).
-    // There could be interesting data at bins 0 to 2, but there are too many artifacts.
-    //
-    FFT.MajorPeak(&FFT_MajorPeak, &FFT_Magnitude);          // let the effects know which freq was most dominant
-
-    for (int i = 0; i < samples; i++) {                     // Values for bins 0 and 1 are WAY too large. Might as well start at 3.
-      double t = 0.0;
-      t = abs(vReal[i]);
-      t = t / 16.0;                                         // Reduce magnitude. Want end result to be linear and ~4096 max.
-      fftBin[i] = t;
-    } // for()
-
-
-/* This FFT post processing is a DIY endeavour. What we really need is someone with sound engineering expertise to do a great job here AND most importantly, that the animations look GREAT as a result.
- *
- *
- * Andrew's updated mapping of 256 bins down to the 16 result bins with Sample Freq = 10240, samples = 512 and some overlap.
- * Based on testing, the lowest/Start frequency is 60 Hz (with bin 3) and a highest/End frequency of 5120 Hz in bin 255.
- * Now, Take the 60Hz and multiply by 1.320367784 to get the next frequency and so on until the end. Then detetermine the bins.
- * End frequency = Start frequency * multiplier ^ 16
- * Multiplier = (End frequency/ Start frequency) ^ 1/16
- * Multiplier = 1.320367784
- */
-
-//                                               Range
-      fftCalc[0] = (fftAdd(3,4)) /2;        // 60 - 100
-      fftCalc[1] = (fftAdd(4,5)) /2;        // 80 - 120
-      fftCalc[2] = (fftAdd(5,7)) /3;        // 100 - 160
-      fftCalc[3] = (fftAdd(7,9)) /3;        // 140 - 200
-      fftCalc[4] = (fftAdd(9,12)) /4;       // 180 - 260
-      fftCalc[5] = (fftAdd(12,16)) /5;      // 240 - 340
-      fftCalc[6] = (fftAdd(16,21)) /6;      // 320 - 440
-      fftCalc[7] = (fftAdd(21,28)) /8;      // 420 - 600
-      fftCalc[8] = (fftAdd(29,37)) /10;     // 580 - 760
-      fftCalc[9] = (fftAdd(37,48)) /12;     // 740 - 980
-      fftCalc[10] = (fftAdd(48,64)) /17;    // 960 - 1300
-      fftCalc[11] = (fftAdd(64,84)) /21;    // 1280 - 1700
-      fftCalc[12] = (fftAdd(84,111)) /28;   // 1680 - 2240
-      fftCalc[13] = (fftAdd(111,147)) /37;  // 2220 - 2960
-      fftCalc[14] = (fftAdd(147,194)) /48;  // 2940 - 3900
-      fftCalc[15] = (fftAdd(194, 255)) /62; // 3880 - 5120
-
-
-//   Noise supression of fftCalc bins using soundSquelch adjustment for different input types.
-    for (int i=0; i < 16; i++) {
-        fftCalc[i] = fftCalc[i]-(float)soundSquelch*(float)linearNoise[i]/4.0 <= 0? 0 : fftCalc[i];
+// I2S microphone, block reads. The DMA buffers keep sampling while the FFT is computed.
+class I2SAudioSource : public AudioSource {
+  public:
+  uint16_t read(float* dst, uint16_t count) override {
+    int32_t block[BLOCK_SIZE];
+    size_t bytes_read = 0;
+    if (count > BLOCK_SIZE) count = BLOCK_SIZE;
+    i2s_read(I2S_PORT, (void *)block, count * sizeof(int32_t), &bytes_read, portMAX_DELAY); // no timeout
+    uint16_t n = bytes_read / sizeof(int32_t);
+    for (uint16_t i = 0; i < n; i++) {
+      micData = abs(block[i] >> 16);
+      dst[i] = micData;
     }
+    if (n > 0) micDataSm = ((micData * 3) + micData)/4;
+    return n;
+  }
+};
 
-// Adjustment for frequency curves.
-  for (int i=0; i < 16; i++) {
-    fftCalc[i] = fftCalc[i] * fftResultPink[i];
+// Make the newest published FFT frame visible to the effects. Called from the loop only.
+void updateAudioFrame() {
+  if (!audioFrames.acquire()) return;
+  const AudioFrame* frame = audioFrames.readFrame();
+  memcpy(fftBin, frame->fftBin, sizeof(fftBin));
+  memcpy(fftResult, frame->fftResult, sizeof(fftResult));
+  memcpy(fftAvg, frame->fftAvg, sizeof(fftAvg));
+  memcpy(fftBandResult, frame->bands, frame->numBands);
+  fftBandCount = frame->numBands;
+  FFT_MajorPeak = frame->majorPeak;
+  FFT_Magnitude = frame->magnitude;
+  fftTime = frame->time;
+  beatBpm = frame->beatBpm;
+  beatFramePhase = frame->beatPhase;
+  beatFrameTime = frame->time;
+  beatCount = frame->beatCount;
+  audioFrameSeq++;
+}
+
+// Advance beatPhase between audio frames. Called from the loop only.
+void updateBeatPhase() {
+  if (beatBpm <= 0) {
+    beatPhase = 0;
+    return;
   }
+  float phase = beatFramePhase + (millis() - beatFrameTime) * beatBpm / 60000.0f;
+  beatPhase = (uint8_t)((phase - floorf(phase)) * 256.0f);
+}
 
-// Manual linear adjustment of gain using sampleGain adjustment for different input types.
-    for (int i=0; i < 16; i++) {
-        fftCalc[i] = fftCalc[i] * sampleGain / 40 + fftCalc[i]/16.0;
-    }
+// FFT main code
+void FFTcode( void * parameter) {
+  //DEBUG_PRINT("FFT running on core: "); DEBUG_PRINTLN(xPortGetCoreID());
 
+  if (!analyzer.begin(SAMPLE_RATE, samples, FFT_HOP_SIZE)) {
+    DEBUGSR_PRINTLN(F("FFT: no memory"));
+    vTaskDelete(NULL);
+    return;
+  }
+  AnalogAudioSource analogSource;
+  I2SAudioSource i2sSource;
 
-// Now, let's dump it all into fftResult. Need to do this, otherwise other routines might grab fftResult values prematurely.
-    for (int i=0; i < 16; i++) {
-        // fftResult[i] = (int)fftCalc[i];
-        fftResult[i] = constrain((int)fftCalc[i],0,254);
-        fftAvg[i] = (float)fftResult[i]*.05 + (1-.05)*fftAvg[i];
-    }
+  for(;;) {
+    delay(1);           // DO NOT DELETE THIS LINE! It is needed to give the IDLE(0) task enough time and to keep the watchdog happy.
+                        // taskYIELD(), yield(), vTaskDelay() and esp_task_wdt_feed() didn't seem to work.
 
+    // Only run the FFT computing code if we're not in Receive mode
+    if (audioSyncEnabled & (1 << 1))
+      continue;
 
-// Looking for fftResultMax for each bin using Pink Noise
-//      for (int i=0; i<16; i++) {
-//          fftResultMax[i] = ((fftResultMax[i] * 63.0) + fftResult[i]) / 64.0;
-//         Serial.print(fftResultMax[i]*fftResultPink[i]); Serial.print("\t");
-//        }
-//      Serial.println(" ");
+    AudioSource& source = digitalMic ? (AudioSource&)i2sSource : (AudioSource&)analogSource;
+    if (analyzer.process(source, audioFrames.writeFrame(), audioConfig(), audioClock)) audioFrames.publish();
 
   } // for(;;)
 } // FFTcode()
@@ -410,12 +543,12 @@ void logAudio() {
 #ifdef MIC_SAMPLING_LOG
   //------------ Oscilloscope output ---------------------------
   Serial.print(targetAgc); Serial.print(" ");
-  Serial.print(multAgc); Serial.print(" ");
+  Serial.print(volume.multAgc); Serial.print(" ");
   Serial.print(sampleAgc); Serial.print(" ");
 
   Serial.print(sample); Serial.print(" ");
   Serial.print(sampleAvg); Serial.print(" ");
-  Serial.print(micLev); Serial.print(" ");
+  Serial.print(volume.micLev); Serial.print(" ");
   Serial.print(samplePeak); Serial.print(" ");    //samplePeak = 0;
   Serial.print(micIn); Serial.print(" ");
   Serial.print(100); Serial.print(" ");
@@ -0,0 +1,142 @@
+#include "wled.h"
+
+/*
+ * Compact binary state API (UDP port and WebSocket binary frames)
+ *
+ * A message is BIN_API_MAGIC followed by any number of commands, an opcode byte and its fixed size
+ * arguments. Segment commands fill the same SegmentValues the JSON API does and apply them with
+ * applySegments(), segment 255 means all selected segments. The state is updated and notifications
+ * are sent once per message, so a scene of many commands costs one colorUpdated().
+ *
+ *  BIN_BRI      bri                                 master brightness, 0 turns off
+ *  BIN_ON       on                                  0 off, 1 on, 2 toggle
+ *  BIN_TT       tt (uint16)                         transition for this message, in 100 ms units
+ *  BIN_PRESET   id                                  apply preset
+ *  BIN_SEG_BRI  seg bri                             segment opacity, 0 turns the segment off
+ *  BIN_SEG_COL  seg slot r g b w                    color slot 0-2
+ *  BIN_SEG_FX   seg fx sx ix
+ *  BIN_SEG_PAL  seg pal
+ *  BIN_SEG      seg mask (uint16) values...         bulk update, values of the BIN_SV_ bits in mask, in bit order
+ *
+ * Multi-byte values are little endian.
+ */
+
+//bytes of arguments per opcode, 0 = variable or unknown
+static uint8_t binArgLength(uint8_t op) {
+  switch (op) {
+    case BIN_BRI:
+    case BIN_ON:
+    case BIN_PRESET:  return 1;
+    case BIN_TT:
+    case BIN_SEG_BRI:
+    case BIN_SEG_PAL: return 2;
+    case BIN_SEG_FX:  return 4;
+    case BIN_SEG_COL: return 6;
+  }
+  return 0;
+}
+
+//bytes of the values of a BIN_SEG mask
+static uint8_t binSegLength(uint16_t mask) {
+  uint8_t len = 0;
+  if (mask & BIN_SV_ON)  len++;
+  if (mask & BIN_SV_BRI) len++;
+  for (uint8_t i = 0; i < 3; i++) if (mask & (BIN_SV_COL << i)) len += 4;
+  if (mask & BIN_SV_FX)  len++;
+  if (mask & BIN_SV_SX)  len++;
+  if (mask & BIN_SV_IX)  len++;
+  if (mask & BIN_SV_PAL) len++;
+  if (mask & BIN_SV_SEL) len++;
+  if (mask & BIN_SV_BOUNDS) len += 4;
+  return len;
+}
+
+static void parseBinSeg(const uint8_t* d, uint16_t mask, SegmentValues& v) {
+  if (mask & BIN_SV_ON)  { v.options |= (*d++ ? 1 : 0) << SEG_OPTION_ON; v.set |= SV_ON; }
+  if (mask & BIN_SV_BRI) { v.bri = *d++; v.set |= SV_BRI; }
+  for (uint8_t i = 0; i < 3; i++) {
+    if (!(mask & (BIN_SV_COL << i))) continue;
+    memcpy(v.col[i], d, 4); d += 4;
+    v.set |= SV_COL << i;
+  }
+  if (mask & BIN_SV_FX)  { v.fx  = *d++; v.set |= SV_FX; }
+  if (mask & BIN_SV_SX)  { v.sx  = *d++; v.set |= SV_SX; }
+  if (mask & BIN_SV_IX)  { v.ix  = *d++; v.set |= SV_IX; }
+  if (mask & BIN_SV_PAL) { v.pal = *d++; v.set |= SV_PAL; }
+  if (mask & BIN_SV_SEL) { v.options |= (*d++ ? 1 : 0) << SEG_OPTION_SELECTED; v.set |= SV_SEL; }
+  if (mask & BIN_SV_BOUNDS) {
+    v.start = d[0] | (d[1] << 8);
+    v.stop  = d[2] | (d[3] << 8);
+    v.set |= SV_START | SV_STOP;
+  }
+}
+
+//applies a binary API message, returns false if it isn't one or is malformed (commands before the error are applied)
+bool handleBinApi(const uint8_t* data, size_t len, byte callMode) {
+  if (len < 2 || data[0] != BIN_API_MAGIC) return false;
+  strip.applyToAllSelected = false;
+
+  bool ok = true;
+  bool changed = false;
+  size_t i = 1;
+  while (i < len) {
+    uint8_t op = data[i++];
+    uint8_t argLen = binArgLength(op);
+    uint16_t mask = 0;
+    if (op == BIN_SEG && i +3 <= len) {
+      mask = data[i+1] | (data[i+2] << 8);
+      argLen = 3 + binSegLength(mask);
+    }
+    if (!argLen || i + argLen > len) { ok = false; break; }
+    const uint8_t* a = data + i;
+    i += argLen;
+
+    SegmentValues v;
+    memset(&v, 0, sizeof(v));
+    switch (op) {
+      case BIN_BRI:
+        bri = a[0];
+        break;
+      case BIN_ON:
+        if (a[0] == 2 || !a[0] != !bri) toggleOnOff();
+        break;
+      case BIN_TT:
+        transitionDelayTemp = (a[0] | (a[1] << 8)) * 100;
+        jsonTransitionOnce = true;
+        strip.setTransition(transitionDelayTemp);
+        break;
+      case BIN_PRESET:
+        unloadPlaylist(); //stop playlist if preset changed manually
+        applyPreset(a[0], callMode);
+        continue; //the preset notifies
+      case BIN_SEG_BRI:
+        v.bri = a[1]; v.set = SV_BRI;
+        applySegments(v, a[0]);
+        break;
+      case BIN_SEG_COL:
+        if (a[1] > 2) break;
+        memcpy(v.col[a[1]], a + 2, 4); v.set = SV_COL << a[1];
+        applySegments(v, a[0]);
+        break;
+      case BIN_SEG_FX:
+        v.fx = a[1]; v.sx = a[2]; v.ix = a[3]; v.set = SV_FX | SV_SX | SV_IX;
+        applySegments(v, a[0]);
+        break;
+      case BIN_SEG_PAL:
+        v.pal = a[1]; v.set = SV_PAL;
+        applySegments(v, a[0]);
+        break;
+      case BIN_SEG:
+        parseBinSeg(a + 3, mask, v);
+        applySegments(v, a[0]);
+        break;
+    }
+    changed = true;
+  }
+
+  if (changed) {
+    interfaceUpdateCallMode = CALL_MODE_WS_SEND;
+    colorUpdated(callMode);
+  }
+  return ok;
+}
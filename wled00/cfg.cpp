@@ -299,6 +299,10 @@ bool deserializeConfig(JsonObject doc, bool fromFS) {
   JsonObject if_nodes = interfaces["nodes"];
   CJSON(nodeListEnabled, if_nodes[F("list")]);
   CJSON(nodeBroadcastEnabled, if_nodes[F("bcast")]);
+  CJSON(nodeUnicastRefresh, if_nodes[F("ucast")]);
+  CJSON(nodeListTtl, if_nodes[F("ttl")]);
+  if (nodeListTtl < 30) nodeListTtl = 30;
+  if (!nodeListEnabled) Nodes.clear();
 
   JsonObject if_live = interfaces["live"];
   CJSON(receiveDirect, if_live["en"]);
@@ -344,6 +348,10 @@ bool deserializeConfig(JsonObject doc, bool fromFS) {
 
   getStringFromJson(mqttDeviceTopic, if_mqtt[F("topics")][F("device")], 33); // "wled/test"
   getStringFromJson(mqttGroupTopic, if_mqtt[F("topics")][F("group")], 33); // ""
+  JsonObject if_mqtt_pub = if_mqtt[F("pub")];
+  CJSON(mqttPublishInterval, if_mqtt_pub[F("int")]);
+  CJSON(mqttPublishXml, if_mqtt_pub[F("xml")]);
+  CJSON(mqttPublishJson, if_mqtt_pub[F("json")]);
 #endif
 
 #ifndef WLED_DISABLE_HUESYNC
@@ -462,16 +470,22 @@ bool deserializeConfig(JsonObject doc, bool fromFS) {
   CJSON(effectFFT1, snd_fft[F("f1")]);
   CJSON(effectFFT2, snd_fft[F("f2")]);
   CJSON(effectFFT3, snd_fft[F("f3")]);
+  CJSON(soundBands, snd_fft[F("bands")]);
+  if (soundBands) soundBands = constrain(soundBands, 8, 64);
+  CJSON(soundBandsMinFreq, snd_fft[F("fmin")]);
+  CJSON(soundBandsMaxFreq, snd_fft[F("fmax")]);
 
   JsonObject snd_sync = sound[F("sync")];     // Sound Reactive audio sync
   CJSON(audioSyncPort, snd_sync[F("port")]);  // 11988
   CJSON(audioSyncEnabled, snd_sync[F("en")]);
+  CJSON(audioSyncVersion, snd_sync[F("ver")]);
+  CJSON(audioSyncExtBins, snd_sync[F("bins")]);
 
   DEBUG_PRINTLN(F("Starting usermod config."));
   JsonObject usermods_settings = doc["um"];
   if (!usermods_settings.isNull()) {
     bool allComplete = usermods.readFromConfig(usermods_settings);
-    if (!allComplete && fromFS) serializeConfig();
+    if (!allComplete && fromFS) serializeConfig(CFG_UM);
   }
 
   if (fromFS) return false;
@@ -480,6 +494,9 @@ bool deserializeConfig(JsonObject doc, bool fromFS) {
 }
 
 void deserializeConfigFromFS() {
+  //power loss after the old cfg.json was removed
+  if (!WLED_FS.exists("/cfg.json") && WLED_FS.exists("/cfg.tmp")) WLED_FS.rename("/cfg.tmp", "/cfg.json");
+
   bool success = deserializeConfigSec();
   if (!success) { //if file does not exist, try reading from EEPROM
     deEEPSettings();
@@ -499,26 +516,19 @@ void deserializeConfigFromFS() {
   deserializeConfig(doc.as<JsonObject>(), true);
 }
 
-void serializeConfig() {
-  serializeConfigSec();
-
-  DEBUG_PRINTLN(F("Writing settings to /cfg.json..."));
-
-  DynamicJsonDocument doc(JSON_BUFFER_SIZE);
-
-  JsonArray rev = doc.createNestedArray("rev");
-  rev.add(1); //major settings revision
-  rev.add(0); //minor settings revision
-
-  doc[F("vid")] = VERSION;
+/*
+ * cfg.json is written section by section: each top level object is built in a small JSON document and
+ * streamed to the file on its own, so no document holds the whole configuration. Sections not in the
+ * sections mask of serializeConfig() are copied unchanged from the current cfg.json.
+ */
 
-  JsonObject id = doc.createNestedObject("id");
+static void serializeConfigId(JsonObject id) {
   id[F("mdns")] = cmDNS;
   id[F("name")] = serverDescription;
   id[F("inv")] = alexaInvocationName;
+}
 
-  JsonObject nw = doc.createNestedObject("nw");
-
+static void serializeConfigNw(JsonObject nw) {
   JsonArray nw_ins = nw.createNestedArray("ins");
 
   JsonObject nw_ins_0 = nw_ins.createNestedObject();
@@ -534,8 +544,9 @@ void serializeConfig() {
     nw_ins_0_gw.add(staticGateway[i]);
     nw_ins_0_sn.add(staticSubnet[i]);
   }
+}
 
-  JsonObject ap = doc.createNestedObject("ap");
+static void serializeConfigAp(JsonObject ap) {
   ap[F("ssid")] = apSSID;
   ap[F("pskl")] = strlen(apPass);
   ap[F("chan")] = apChannel;
@@ -547,18 +558,20 @@ void serializeConfig() {
   ap_ip.add(3);
   ap_ip.add(2);
   ap_ip.add(1);
+}
 
-  JsonObject wifi = doc.createNestedObject("wifi");
+static void serializeConfigWifi(JsonObject wifi) {
   wifi[F("sleep")] = !noWifiSleep;
   //wifi[F("phy")] = 1;
+}
 
-  #ifdef WLED_USE_ETHERNET
-  JsonObject ethernet = doc.createNestedObject("eth");
+#ifdef WLED_USE_ETHERNET
+static void serializeConfigEth(JsonObject ethernet) {
   ethernet["type"] = ethernetType;
-  #endif
-
-  JsonObject hw = doc.createNestedObject("hw");
+}
+#endif
 
+static void serializeConfigHw(JsonObject hw) {
   JsonObject hw_led = hw.createNestedObject("led");
   hw_led[F("total")] = ledCount;
   hw_led[F("maxpwr")] = strip.ablMilliampsMax;
@@ -630,8 +643,9 @@ void serializeConfig() {
   hw_dmic_pins[F("i2ssd")] = i2ssdPin;
   hw_dmic_pins[F("i2sws")] = i2swsPin;
   hw_dmic_pins[F("i2sck")] = i2sckPin;
+}
 
-  JsonObject light = doc.createNestedObject(F("light"));
+static void serializeConfigLight(JsonObject light) {
   light[F("scale-bri")] = briMultiplier;
   light[F("pal-mode")] = strip.paletteBlend;
 
@@ -649,14 +663,15 @@ void serializeConfig() {
   light_nl["dur"] = nightlightDelayMinsDefault;
   light_nl[F("tbri")] = nightlightTargetBri;
   light_nl["macro"] = macroNl;
+}
 
-  JsonObject def = doc.createNestedObject("def");
+static void serializeConfigDef(JsonObject def) {
   def[F("ps")] = bootPreset;
   def["on"] = turnOnAtBoot;
   def["bri"] = briS;
+}
 
-  JsonObject interfaces = doc.createNestedObject("if");
-
+static void serializeConfigIf(JsonObject interfaces) {
   JsonObject if_sync = interfaces.createNestedObject("sync");
   if_sync[F("port0")] = udpPort;
   if_sync[F("port1")] = udpPort2;
@@ -677,6 +692,8 @@ void serializeConfig() {
   JsonObject if_nodes = interfaces.createNestedObject("nodes");
   if_nodes[F("list")] = nodeListEnabled;
   if_nodes[F("bcast")] = nodeBroadcastEnabled;
+  if_nodes[F("ucast")] = nodeUnicastRefresh;
+  if_nodes[F("ttl")] = nodeListTtl;
 
   JsonObject if_live = interfaces.createNestedObject("live");
   if_live["en"] = receiveDirect;
@@ -719,6 +736,11 @@ void serializeConfig() {
   JsonObject if_mqtt_topics = if_mqtt.createNestedObject(F("topics"));
   if_mqtt_topics[F("device")] = mqttDeviceTopic;
   if_mqtt_topics[F("group")] = mqttGroupTopic;
+
+  JsonObject if_mqtt_pub = if_mqtt.createNestedObject(F("pub"));
+  if_mqtt_pub[F("int")] = mqttPublishInterval;
+  if_mqtt_pub[F("xml")] = mqttPublishXml;
+  if_mqtt_pub[F("json")] = mqttPublishJson;
 #endif
 
 #ifndef WLED_DISABLE_HUESYNC
@@ -746,8 +768,9 @@ void serializeConfig() {
   if_ntp[F("ampm")] = useAMPM;
   if_ntp[F("ln")] = longitude;
   if_ntp[F("lt")] = latitude;
+}
 
-  JsonObject ol = doc.createNestedObject("ol");
+static void serializeConfigOl(JsonObject ol) {
   ol[F("clock")] = overlayDefault;
   ol[F("cntdwn")] = countdownMode;
 
@@ -756,9 +779,9 @@ void serializeConfig() {
   ol[F("o12pix")] = analogClock12pixel;
   ol[F("o5m")] = analogClock5MinuteMarks;
   ol[F("osec")] = analogClockSecondsTrail;
+}
 
-  JsonObject timers = doc.createNestedObject(F("timers"));
-
+static void serializeConfigTimers(JsonObject timers) {
   JsonObject cntdwn = timers.createNestedObject(F("cntdwn"));
   JsonArray goal = cntdwn.createNestedArray(F("goal"));
   goal.add(countdownYear); goal.add(countdownMonth); goal.add(countdownDay);
@@ -776,15 +799,17 @@ void serializeConfig() {
     timers_ins0["macro"] = timerMacro[i];
     timers_ins0[F("dow")] = timerWeekday[i] >> 1;
   }
+}
 
-  JsonObject ota = doc.createNestedObject("ota");
+static void serializeConfigOta(JsonObject ota) {
   ota[F("lock")] = otaLock;
   ota[F("lock-wifi")] = wifiLock;
   ota[F("pskl")] = strlen(otaPass);
   ota[F("aota")] = aOtaEnabled;
+}
 
-  #ifdef WLED_ENABLE_DMX
-  JsonObject dmx = doc.createNestedObject("dmx");
+#ifdef WLED_ENABLE_DMX
+static void serializeConfigDmx(JsonObject dmx) {
   dmx[F("chan")] = DMXChannels;
   dmx[F("gap")] = DMXGap;
   dmx[F("start")] = DMXStart;
@@ -793,11 +818,11 @@ void serializeConfig() {
   JsonArray dmx_fixmap = dmx.createNestedArray(F("fixmap"));
   for (byte i = 0; i < 15; i++)
     dmx_fixmap.add(DMXFixtureMap[i]);
-  #endif
-
-  // Begin Sound Reactive specific settings - 1st attempt
-  JsonObject sound = doc.createNestedObject("snd");
+}
+#endif
 
+// Begin Sound Reactive specific settings - 1st attempt
+static void serializeConfigSnd(JsonObject sound) {
   JsonObject snd_cfg = sound.createNestedObject("cfg");   // Sound Reactive Configuration
   snd_cfg[F("sq")] = soundSquelch;
   snd_cfg[F("gn")] = sampleGain;
@@ -806,17 +831,180 @@ void serializeConfig() {
   snd_fft[F("f1")] = effectFFT1;
   snd_fft[F("f2")] = effectFFT2;
   snd_fft[F("f3")] = effectFFT3;
+  snd_fft[F("bands")] = soundBands;
+  snd_fft[F("fmin")] = soundBandsMinFreq;
+  snd_fft[F("fmax")] = soundBandsMaxFreq;
 
   JsonObject snd_sync = sound.createNestedObject("sync"); // Sound Reactive audio sync
   snd_sync[F("port")] = audioSyncPort;  // 11988
   snd_sync[F("en")] = audioSyncEnabled;
+  snd_sync[F("ver")] = audioSyncVersion;
+  snd_sync[F("bins")] = audioSyncExtBins;
+}
 
-  JsonObject usermods_settings = doc.createNestedObject("um");
+static void serializeConfigUm(JsonObject usermods_settings) {
   usermods.addToConfig(usermods_settings);
+}
+
+typedef struct ConfigSection {
+  const char* key;
+  uint16_t group;                      // CFG_ bit the section belongs to
+  void (*serialize)(JsonObject);
+} ConfigSection;
+
+// in file order
+static const ConfigSection configSections[] = {
+  {"id",     CFG_ID,    serializeConfigId},
+  {"nw",     CFG_NW,    serializeConfigNw},
+  {"ap",     CFG_NW,    serializeConfigAp},
+  {"wifi",   CFG_NW,    serializeConfigWifi},
+  #ifdef WLED_USE_ETHERNET
+  {"eth",    CFG_NW,    serializeConfigEth},
+  #endif
+  {"hw",     CFG_HW,    serializeConfigHw},
+  {"light",  CFG_LIGHT, serializeConfigLight},
+  {"def",    CFG_LIGHT, serializeConfigDef},
+  {"if",     CFG_IF,    serializeConfigIf},
+  {"ol",     CFG_TIME,  serializeConfigOl},
+  {"timers", CFG_TIME,  serializeConfigTimers},
+  {"ota",    CFG_OTA,   serializeConfigOta},
+  #ifdef WLED_ENABLE_DMX
+  {"dmx",    CFG_DMX,   serializeConfigDmx},
+  #endif
+  {"snd",    CFG_SND,   serializeConfigSnd},
+  {"um",     CFG_UM,    serializeConfigUm}
+};
+#define CFG_SECTION_COUNT (sizeof(configSections) / sizeof(ConfigSection))
+
+//returns the CFG_ bits of the sections present in a (partial) configuration, e.g. one posted to /json/cfg
+uint16_t getConfigSections(JsonObject doc) {
+  uint16_t sections = 0;
+  for (uint8_t s = 0; s < CFG_SECTION_COUNT; s++) {
+    if (doc.containsKey(configSections[s].key)) sections |= configSections[s].group;
+  }
+  return sections;
+}
+
+//finds where the value of each section starts and ends in the current cfg.json, end is 0 if not found
+static void findConfigSections(File& f, uint32_t* start, uint32_t* end) {
+  uint8_t buf[128];
+  char key[8];
+  uint8_t keyLen = 0, depth = 0;
+  int8_t current = -1;                 // section whose value is being read
+  uint32_t pos = 0, valueStart = 0;
+  bool inString = false, escape = false, inKey = false, expectKey = false;
+
+  size_t len;
+  while ((len = f.read(buf, sizeof(buf)))) {
+    for (size_t i = 0; i < len; i++, pos++) {
+      char c = buf[i];
+      if (inString) {
+        if (escape) escape = false;
+        else if (c == '\\') escape = true;
+        else if (c == '"') inString = false;
+        else if (inKey && keyLen < sizeof(key) -1) key[keyLen++] = c;
+        continue;
+      }
+      switch (c) {
+        case '"':
+          inString = true;
+          inKey = (depth == 1 && expectKey);
+          keyLen = 0;
+          break;
+        case ':':
+          if (depth != 1) break;
+          key[keyLen] = 0;
+          current = -1;
+          for (uint8_t s = 0; s < CFG_SECTION_COUNT; s++) {
+            if (!strcmp(key, configSections[s].key)) current = s;
+          }
+          valueStart = pos +1;
+          expectKey = false;
+          break;
+        case '{': case '[':
+          if (++depth == 1) expectKey = true;
+          break;
+        case '}': case ']':
+          if (depth-- != 1) break;
+          //fall through - end of the last section
+        case ',':
+          if (depth > 1) break;
+          if (current >= 0) { start[current] = valueStart; end[current] = pos; }
+          current = -1;
+          expectKey = true;
+          break;
+      }
+    }
+  }
+}
+
+//writes the sections of the CFG_ bits in sections and copies the others from the current cfg.json
+static void writeConfig(uint16_t sections) {
+  unsigned long writeStart = millis();
+  if (sections & (CFG_NW | CFG_IF | CFG_OTA)) serializeConfigSec();
+
+  DEBUG_PRINTF("Writing settings to /cfg.json (sections %04X)...\n", sections);
+
+  uint32_t spanStart[CFG_SECTION_COUNT] = {0};
+  uint32_t spanEnd[CFG_SECTION_COUNT] = {0};
+  File old = WLED_FS.open("/cfg.json", "r");
+  if (old && sections != CFG_ALL) findConfigSections(old, spanStart, spanEnd);
 
-  File f = WLED_FS.open("/cfg.json", "w");
-  if (f) serializeJson(doc, f);
+  File f = WLED_FS.open("/cfg.tmp", "w");
+  if (!f) {
+    if (old) old.close();
+    return;
+  }
+  bool ok = f.print(F("{\"rev\":[1,0],\"vid\":")) && f.print(VERSION); //major and minor settings revision
+
+  for (uint8_t s = 0; s < CFG_SECTION_COUNT && ok; s++) {
+    const ConfigSection& sec = configSections[s];
+    ok = f.print(F(",\"")) && f.print(sec.key) && f.print(F("\":"));
+    if (!(sections & sec.group) && spanEnd[s] > spanStart[s]) {
+      uint8_t buf[128];
+      old.seek(spanStart[s]);
+      for (uint32_t left = spanEnd[s] - spanStart[s]; left && ok; ) {
+        size_t len = old.read(buf, min(left, (uint32_t)sizeof(buf)));
+        ok = len && f.write(buf, len) == len;
+        left -= len;
+      }
+      continue;
+    }
+    //start small and grow for large sections (usermods), the whole configuration never is in RAM
+    for (size_t docSize = 1024; ; ) {
+      DynamicJsonDocument doc(docSize);
+      sec.serialize(doc.to<JsonObject>());
+      if (doc.overflowed() && docSize < JSON_BUFFER_SIZE) {
+        docSize = min(docSize * 2, (size_t)JSON_BUFFER_SIZE);
+        continue;
+      }
+      ok = ok && serializeJson(doc, f);
+      break;
+    }
+  }
+  ok = ok && f.print('}');
+  uint32_t size = f.size();
   f.close();
+  if (old) old.close();
+
+  if (!ok) {
+    WLED_FS.remove("/cfg.tmp");
+    errorFlag = ERR_FS_GENERAL;
+    return;
+  }
+  WLED_FS.remove("/cfg.json");
+  WLED_FS.rename("/cfg.tmp", "/cfg.json");
+  countWrite("/cfg.json", size);
+
+  cfgWriteTime = millis() - writeStart;
+  if (cfgWriteTime > cfgWriteTimeMax) cfgWriteTimeMax = cfgWriteTime;
+  cfgWrites++;
+  DEBUG_PRINTF("Settings written in %u ms\n", cfgWriteTime);
+}
+
+//saves the settings once they stopped changing, see writeback.cpp
+void serializeConfig(uint16_t sections) {
+  queueWrite(writeConfig, sections);
 }
 
 //settings in /wsec.json, not accessible via webserver, for passwords and tokens
@@ -897,6 +1085,6 @@ void serializeConfigSec() {
   ota[F("aota")] = aOtaEnabled;
 
   File f = WLED_FS.open("/wsec.json", "w");
-  if (f) serializeJson(doc, f);
+  if (f) countWrite("/wsec.json", serializeJson(doc, f));
   f.close();
 }
@@ -79,6 +79,29 @@
 #define CALL_MODE_ALEXA         10
 #define CALL_MODE_WS_SEND       11     //special call mode, not for notifier, updates websocket only
 
+//Binary API (bin_api.cpp)
+#define BIN_API_MAGIC          0xB1     //first byte of a binary API message
+#define BIN_BRI                0x01
+#define BIN_ON                 0x02
+#define BIN_TT                 0x03
+#define BIN_PRESET             0x04
+#define BIN_SEG_BRI            0x10
+#define BIN_SEG_COL            0x11
+#define BIN_SEG_FX             0x12
+#define BIN_SEG_PAL            0x13
+#define BIN_SEG                0x20
+
+//values in a BIN_SEG command
+#define BIN_SV_ON              0x0001
+#define BIN_SV_BRI             0x0002
+#define BIN_SV_COL             0x0004   //3 bits, one per color slot
+#define BIN_SV_FX              0x0020
+#define BIN_SV_SX              0x0040
+#define BIN_SV_IX              0x0080
+#define BIN_SV_PAL             0x0100
+#define BIN_SV_SEL             0x0200
+#define BIN_SV_BOUNDS          0x0400   //start and stop, uint16
+
 //RGB to RGBW conversion mode
 #define RGBW_MODE_MANUAL_ONLY     0            //No automatic white channel calculation. Manual white channel slider
 #define RGBW_MODE_AUTO_BRIGHTER   1            //New algorithm. Adds as much white as the darkest RGBW channel
@@ -285,12 +308,80 @@
   #define JSON_BUFFER_SIZE 20480
 #endif
 
-// Maximum size of node map (list of other WLED instances)
+// JSON API requests holding a JSON_BUFFER_SIZE buffer at the same time, more get 503 (wled_server.cpp)
+#ifdef ESP8266
+  #define JSON_POOL_SIZE     1    // parse buffers, freed after use
+  #define JSON_MAX_REQUESTS  2
+#else
+  #define JSON_POOL_SIZE     2    // parse buffers, kept for reuse
+  #define JSON_MAX_REQUESTS  4
+#endif
+#define JSON_HEAP_RESERVE    4096 // heap left free after allocating a JSON buffer
+#define JSON_POOL_IDLE       10000 // ms until unused parse buffers are freed (ESP32)
+
+// RAM for the presets of the active playlist, kept compiled so playlist steps don't read presets.json
+#ifndef PLAYLIST_COMPILED_SIZE
+  #ifdef ESP8266
+    #define PLAYLIST_COMPILED_SIZE 4096
+  #else
+    #define PLAYLIST_COMPILED_SIZE 16384
+  #endif
+#endif
+
+// cfg.json sections for serializeConfig(), sections not given are copied from the file
+#define CFG_ID    0x0001 // "id"
+#define CFG_NW    0x0002 // "nw", "ap", "wifi", "eth"
+#define CFG_HW    0x0004 // "hw"
+#define CFG_LIGHT 0x0008 // "light", "def"
+#define CFG_IF    0x0010 // "if"
+#define CFG_TIME  0x0020 // "ol", "timers"
+#define CFG_OTA   0x0040 // "ota"
+#define CFG_DMX   0x0080 // "dmx"
+#define CFG_SND   0x0100 // "snd"
+#define CFG_UM    0x0200 // "um"
+#define CFG_ALL   0xFFFF
+
+// deferred FS writes (writeback.cpp)
+#define WRITEBACK_SLOTS       8     // different writes that can be queued
+#define WRITEBACK_STATS       10    // files with write statistics in /json/info
+#define WRITEBACK_DELAY       1000  // ms without a change before a queued write runs
+#define WRITEBACK_MAX_DELAY   10000 // ms a write may be put off by repeated changes
+
+// reproducible rendering into /render.bin (led.cpp)
+#define RENDER_MAX_FRAMES     600
+#define RENDER_SLICE_MS       20    // ms of rendering per loop(), the rest of the frames follow in the next ones
+
+// cached content hashes for the ETags of static files (file.cpp)
 #ifdef ESP8266
-  #define WLED_MAX_NODES 15
+  #define FILE_TAG_SLOTS     16   // least recently used is replaced
 #else
-  #define WLED_MAX_NODES 150
+  #define FILE_TAG_SLOTS     32
 #endif
+#define FILE_TAG_READ_SIZE   65536 // files up to this size are hashed before the response, larger ones while sent
+
+// segment changes that can be staged by batched JSON state requests (json.cpp)
+#define WLED_MAX_BATCH_SEGMENTS 32
+#define WLED_MAX_BATCH_GLOBALS  8  // staged batches with on/bri/transition/tt/mainseg
+
+// stageState() results
+#define BATCH_STAGED     0
+#define BATCH_INVALID    1 // can't be batched, nothing staged
+#define BATCH_BUSY       2 // the staged batches are full or there is no memory, nothing staged
+
+// number of LED maps that can be selected, /ledmap.json and /ledmap1.json to /ledmap9.json
+#define WLED_MAX_LEDMAPS 10
+
+// Maximum size of node table (list of other WLED instances)
+#ifndef WLED_MAX_NODES
+  #ifdef ESP8266
+    #define WLED_MAX_NODES 15
+  #else
+    #define WLED_MAX_NODES 256
+  #endif
+#endif
+
+#define NODE_REFRESH_INTERVAL  2000  // ms between node table expiry runs
+#define NODE_REFRESH_BATCH        8  // max. unicast refresh requests sent per run
 
 //this is merely a default now and can be changed at runtime
 #ifndef LEDPIN
@@ -3,6 +3,7 @@
 #include <Arduino.h>
 #include "src/dependencies/espalexa/EspalexaDevice.h"
 #include "src/dependencies/e131/ESPAsyncE131.h"
+#include "const.h"
 
 /*
  * All globally accessible functions are declared here
@@ -19,6 +20,9 @@ void onAlexaChange(EspalexaDevice* dev);
 //void FFTcode(void * parameter);
 //void getSample();
 
+//bin_api.cpp
+bool handleBinApi(const uint8_t* data, size_t len, byte callMode = CALL_MODE_DIRECT_CHANGE);
+
 //blynk.cpp
 void initBlynk(const char* auth, const char* host, uint16_t port);
 void handleBlynk();
@@ -34,7 +38,8 @@ void handleIO();
 bool deserializeConfig(JsonObject doc, bool fromFS = false);
 void deserializeConfigFromFS();
 bool deserializeConfigSec();
-void serializeConfig();
+uint16_t getConfigSections(JsonObject doc);
+void serializeConfig(uint16_t sections = CFG_ALL);
 void serializeConfigSec();
 
 template<typename DestType>
@@ -82,6 +87,8 @@ void handleDMX();
 void handleE131Packet(e131_packet_t* p, IPAddress clientIP, byte protocol);
 
 //file.cpp
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len);
+void fileChanged(const char* path = nullptr);
 bool handleFileRead(AsyncWebServerRequest*, String path);
 bool writeObjectToFileUsingId(const char* file, uint16_t id, JsonDocument* content);
 bool writeObjectToFile(const char* file, const char* key, JsonDocument* content);
@@ -124,8 +131,55 @@ void handleIR();
 #include "src/dependencies/json/AsyncJson-v6.h"
 #include "FX.h"
 
+//values of one segment in a JSON state, a bit in set for every value that is present
+typedef struct SegmentValues {
+  uint32_t set;
+  uint16_t start, stop, len;
+  int32_t  offset;
+  uint8_t  grp, spc, bri;
+  uint8_t  options;                  //SEG_OPTION_ON, _SELECTED, _REVERSED and _MIRROR values
+  uint8_t  col[3][4];                //RGBW
+  uint16_t width, height;
+  uint8_t  geometry, panelWidth, panelHeight;
+  uint8_t  fx, sx, ix, f1x, f2x, f3x, pal;
+} SegmentValues;
+
+#define SV_START      0x00000001
+#define SV_STOP       0x00000002
+#define SV_LEN        0x00000004
+#define SV_GRP        0x00000008
+#define SV_SPC        0x00000010
+#define SV_OFFSET     0x00000020
+#define SV_BRI        0x00000040
+#define SV_ON         0x00000080
+#define SV_SEL        0x00000100
+#define SV_REV        0x00000200
+#define SV_MI         0x00000400
+#define SV_COL        0x00000800   //3 bits, one per color slot
+#define SV_COL_ZERO   0x00004000   //3 bits, slot given as 0 (black without transition)
+#define SV_MX         0x00020000
+#define SV_MX_W       0x00040000
+#define SV_MX_H       0x00080000
+#define SV_MX_SP      0x00100000
+#define SV_MX_TR      0x00200000
+#define SV_MX_ROT     0x00400000
+#define SV_MX_PW      0x00800000
+#define SV_MX_PH      0x01000000
+#define SV_FX         0x02000000
+#define SV_SX         0x04000000
+#define SV_IX         0x08000000
+#define SV_F1X        0x10000000
+#define SV_F2X        0x20000000
+#define SV_F3X        0x40000000
+#define SV_PAL        0x80000000
+
+bool parseSegment(JsonObject elem, SegmentValues& v);
+void applySegment(const SegmentValues& v, byte id, byte presetId = 0);
+void applySegments(const SegmentValues& v, byte id, byte presetId = 0);
 void deserializeSegment(JsonObject elem, byte it, byte presetId = 0);
 bool deserializeState(JsonObject root, byte callMode = CALL_MODE_DIRECT_CHANGE, byte presetId = 0);
+byte stageState(JsonObject root, byte callMode = CALL_MODE_DIRECT_CHANGE);
+void handleBatch();
 void serializeSegment(JsonObject& root, WS2812FX::Segment& seg, byte id, bool forPreset = false, bool segmentBounds = true);
 void serializeState(JsonObject root, bool forPreset = false, bool includeBri = true, bool segmentBounds = true);
 void serializeInfo(JsonObject root);
@@ -143,6 +197,7 @@ void colorUpdated(int callMode);
 void updateInterfaces(uint8_t callMode);
 void handleTransitions();
 void handleNightlight();
+void handleRender();
 byte scaledBri(byte in);
 
 //lx_parser.cpp
@@ -183,8 +238,15 @@ void _drawOverlayCronixie();
 void shufflePlaylist();
 void unloadPlaylist();
 int16_t loadPlaylist(JsonObject playlistObject, byte presetId = 0);
+void playlistPresetChanged(byte index);
 void handlePlaylist();
 
+//preset_store.cpp
+void initPresetStore();
+bool readPreset(byte index, JsonDocument* dest);
+bool writePreset(byte index, JsonDocument* content);
+void handlePresetStore();
+
 //presets.cpp
 bool applyPreset(byte index, byte callMode = CALL_MODE_DIRECT_CHANGE);
 void savePreset(byte index, bool persist = true, const char* pname = nullptr, JsonObject saveobj = JsonObject());
@@ -204,7 +266,7 @@ void realtimeLock(uint32_t timeoutMs, byte md = REALTIME_MODE_GENERIC);
 void handleNotifications();
 void setRealtimePixel(uint16_t i, byte r, byte g, byte b, byte w);
 void refreshNodeList();
-void sendSysInfoUDP();
+void sendSysInfoUDP(IPAddress dest = IPAddress(0, 0, 0, 0));
 
 //um_manager.cpp
 class Usermod {
@@ -274,6 +336,20 @@ void serveMessage(AsyncWebServerRequest* request, uint16_t code, const String& h
 String settingsProcessor(const String& var);
 String dmxProcessor(const String& var);
 void serveSettings(AsyncWebServerRequest* request, bool post = false);
+bool admitRequest(AsyncWebServerRequest* request);
+DynamicJsonDocument* acquireJsonBuffer(AsyncWebServerRequest* request = nullptr);
+void releaseJsonBuffer(DynamicJsonDocument* doc);
+void handleJsonPool();
+void serializeRequestStats(JsonObject root);
+
+//writeback.cpp
+typedef void (*WriteBackFn)(uint16_t arg);
+bool writeSlack();
+void queueWrite(WriteBackFn write, uint16_t arg = 0);
+void countWrite(const char* file, uint32_t bytes);
+void flushWrites(bool write = true);
+void handleWriteBack();
+void serializeWriteStats(JsonObject fs);
 
 //ws.cpp
 void handleWs();
@@ -30,6 +30,21 @@
 uint16_t knownLargestSpace = UINT16_MAX;
 
 File f;
+static char fPath[33]; //file f was opened for writing
+
+/*
+ * Index of /presets.json: offset of the value of every root level "<id>": key, so reading a preset is a
+ * seek instead of a search through the file. Built by the first read and rebuilt if the file size or the
+ * key at an offset does not match (file exported by the preset store, uploaded or edited).
+ * Only reads use it, the preset store never writes /presets.json with writeObjectToFile().
+ */
+#define PRESET_INDEX_SIZE 251                  // preset ids 0-250
+static uint32_t* presetIndex = nullptr;        // 0 = not in file
+static uint32_t presetIndexFileSize = UINT32_MAX; // file size the index is valid for
+
+static bool isPresetFile(const char* file) {
+  return !strcmp(file, "/presets.json");
+}
 
 //wrapper to find out how long closing takes
 void closeFile() {
@@ -40,6 +55,7 @@ void closeFile() {
   f.close();
   DEBUGFS_PRINTF("took %d ms\n", millis() - s);
   doCloseFile = false;
+  fileChanged(fPath);
 }
 
 //find() that reads and buffers data from file stream in 256-byte blocks.
@@ -160,6 +176,75 @@ bool bufferedFindObjectEnd() {
   return false;
 }
 
+//scans the open file for root level "<id>": keys, skipping strings and nested objects
+static bool buildPresetIndex() {
+  #ifdef WLED_DEBUG_FS
+    DEBUGFS_PRINTLN(F("Build preset index"));
+    uint32_t s = millis();
+  #endif
+  if (!presetIndex) presetIndex = (uint32_t*)malloc(PRESET_INDEX_SIZE * sizeof(uint32_t));
+  if (!presetIndex) return false;
+  memset(presetIndex, 0, PRESET_INDEX_SIZE * sizeof(uint32_t));
+
+  uint8_t depth = 0;
+  bool inString = false, escaped = false, keyDigits = false;
+  int16_t id = 0, keyId = -1;                  //id of the key string that just ended
+  byte buf[FS_BUFSIZE];
+  f.seek(0);
+  uint32_t pos = 0;
+  while (pos < f.size()) {
+    uint16_t bufsize = f.read(buf, FS_BUFSIZE);
+    if (!bufsize) break;
+    for (uint16_t i = 0; i < bufsize; i++, pos++) {
+      char c = buf[i];
+      if (inString) {
+        if (escaped) escaped = false;
+        else if (c == '\\') escaped = true;
+        else if (c == '"') {
+          inString = false;
+          if (depth == 1 && keyDigits) { keyId = id; continue; }
+        } else if (c >= '0' && c <= '9' && id < PRESET_INDEX_SIZE) id = id * 10 + (c - '0');
+        else keyDigits = false;
+      } else if (c == '"') {
+        inString = true; id = 0; keyDigits = true;
+      } else if (c == ':' && keyId >= 0 && keyId < PRESET_INDEX_SIZE) {
+        presetIndex[keyId] = pos + 1;
+      } else if (c == '{' || c == '[') depth++;
+      else if ((c == '}' || c == ']') && depth) depth--;
+      keyId = -1;
+    }
+  }
+  presetIndexFileSize = f.size();
+  DEBUGFS_PRINTF("Indexed, took %d ms\n", millis() - s);
+  return true;
+}
+
+//checks that the key ends right before pos
+static bool keyAt(const char* key, uint32_t pos) {
+  char buf[10];
+  uint8_t keyLen = strlen(key);
+  if (pos < keyLen || keyLen > sizeof(buf)) return false;
+  f.seek(pos - keyLen);
+  if (f.read((uint8_t*)buf, keyLen) != keyLen) return false;
+  return !memcmp(buf, key, keyLen);
+}
+
+//bufferedFind() for the key of a preset using the index
+static bool indexedFind(const char* key) {
+  uint16_t id = atoi(key + 1);
+  if (id >= PRESET_INDEX_SIZE) return bufferedFind(key);
+  for (uint8_t attempt = 0; attempt < 2; attempt++) {
+    if ((attempt || presetIndexFileSize != f.size()) && !buildPresetIndex()) return bufferedFind(key);
+    uint32_t pos = presetIndex[id];
+    if (!pos) return false;
+    if (keyAt(key, pos)) {
+      f.seek(pos);
+      return true;
+    }
+  }
+  return false;
+}
+
 //fills n bytes from current file pos with ' ' characters
 void writeSpace(uint16_t l)
 {
@@ -277,7 +362,11 @@ bool writeObjectToFile(const char* file, const char* key, JsonDocument* content)
     DEBUGFS_PRINTLN(F("Failed to open!"));
     return false;
   }
-  
+  strlcpy(fPath, file, sizeof(fPath));
+  countWrite(file, content->isNull() ? 0 : measureJson(*content));
+
+  if (isPresetFile(file)) presetIndexFileSize = UINT32_MAX; //rebuilt by the next read
+
   if (!bufferedFind(key)) //key does not exist in file
   {
     return appendObjectToFile(key, content, s);
@@ -342,7 +431,8 @@ bool readObjectFromFile(const char* file, const char* key, JsonDocument* dest)
   f = WLED_FS.open(file, "r");
   if (!f) return false;
 
-  if (key != nullptr && !bufferedFind(key)) //key does not exist in file
+  bool found = (key == nullptr) || (isPresetFile(file) ? indexedFind(key) : bufferedFind(key));
+  if (!found) //key does not exist in file
   {
     f.close();
     dest->clear();
@@ -379,33 +469,198 @@ String getContentType(AsyncWebServerRequest* request, String filename){
   if(request->hasArg("download")) return "application/octet-stream";
   else if(filename.endsWith(".htm")) return "text/html";
   else if(filename.endsWith(".html")) return "text/html";
-//  else if(filename.endsWith(".css")) return "text/css";
-//  else if(filename.endsWith(".js")) return "application/javascript";
+  else if(filename.endsWith(".css")) return "text/css";
+  else if(filename.endsWith(".js")) return "application/javascript";
   else if(filename.endsWith(".json")) return "application/json";
   else if(filename.endsWith(".png")) return "image/png";
-//  else if(filename.endsWith(".gif")) return "image/gif";
+  else if(filename.endsWith(".gif")) return "image/gif";
   else if(filename.endsWith(".jpg")) return "image/jpeg";
   else if(filename.endsWith(".ico")) return "image/x-icon";
-//  else if(filename.endsWith(".xml")) return "text/xml";
+  else if(filename.endsWith(".svg")) return "image/svg+xml";
+  else if(filename.endsWith(".xml")) return "text/xml";
 //  else if(filename.endsWith(".pdf")) return "application/x-pdf";
 //  else if(filename.endsWith(".zip")) return "application/x-zip";
-//  else if(filename.endsWith(".gz")) return "application/x-gzip";
+  else if(filename.endsWith(".gz")) return "application/x-gzip";
   return "text/plain";
 }
 
+/*
+ * Static files are served with a strong ETag, the CRC32 of the bytes sent, so browsers revalidate
+ * with If-None-Match and get a 304 instead of the file. CRCs are cached per path and size for the
+ * FILE_TAG_SLOTS most recently requested files. On a miss, files up to FILE_TAG_READ_SIZE are read
+ * once for the CRC before the response, so the first response has an ETag too. Of larger files the
+ * CRC is taken from the chunks as they are sent, their first full response goes out without one.
+ * A write (countWrite(), closeFile()) drops the cached tag of that file only, /edit drops all as the
+ * path is in the request body. A CRC taken while any file was written is not cached.
+ * If "<path>.gz" exists it is sent with Content-Encoding: gzip to clients that accept it.
+ * Single byte ranges are honored. Files are streamed in chunks the size of the TCP send window.
+ */
+
+typedef struct FileTag {
+  char path[32];                     // "" = free slot
+  uint32_t size;
+  uint32_t crc;
+  uint32_t used;                     // fileTagUses at the last hit, the lowest is replaced
+} FileTag;
+
+static FileTag fileTags[FILE_TAG_SLOTS];
+static uint32_t fileTagUses = 0;
+static uint16_t fileChanges = 0;     // writes so far, a CRC taken across one is not cached
+static WledLock fileTagLock;         // written by the loop, read by the web server
+
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    for (uint8_t b = 0; b < 8; b++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+//a file was written, its cached ETag is stale. nullptr if the path is not known
+void fileChanged(const char* path) {
+  WledLockGuard guard(fileTagLock);
+  fileChanges++;
+  for (uint8_t i = 0; i < FILE_TAG_SLOTS; i++) {
+    if (!path || !strcmp(fileTags[i].path, path)) fileTags[i].path[0] = 0;
+  }
+}
+
+//cached CRC of the file, false if there is none. changes is needed to cache a new one
+static bool getFileTag(const String& path, uint32_t size, uint32_t* crc, uint16_t* changes) {
+  WledLockGuard guard(fileTagLock);
+  *changes = fileChanges;
+  for (uint8_t i = 0; i < FILE_TAG_SLOTS; i++) {
+    FileTag& t = fileTags[i];
+    if (t.path[0] && t.size == size && !strcmp(t.path, path.c_str())) {
+      *crc = t.crc;
+      t.used = ++fileTagUses;
+      return true;
+    }
+  }
+  return false;
+}
+
+//false if a file was written since getFileTag(), the CRC may be of a half written file then
+static bool setFileTag(const String& path, uint32_t size, uint32_t crc, uint16_t changes) {
+  WledLockGuard guard(fileTagLock);
+  if (changes != fileChanges) return false;
+  if (path.length() >= sizeof(fileTags[0].path)) return true; //too long to cache
+  uint8_t slot = 0;
+  for (uint8_t i = 0; i < FILE_TAG_SLOTS; i++) {
+    if (!fileTags[i].path[0]) { slot = i; break; }
+    if (fileTags[i].used < fileTags[slot].used) slot = i;
+  }
+  FileTag& t = fileTags[slot];
+  strcpy(t.path, path.c_str());
+  t.size = size;
+  t.crc = crc;
+  t.used = ++fileTagUses;
+  return true;
+}
+
+static uint32_t fileCrc(File& file) {
+  uint8_t buf[256];
+  uint32_t crc = 0;
+  size_t len;
+  while ((len = file.read(buf, sizeof(buf)))) crc = crc32Update(crc, buf, len);
+  file.seek(0);
+  return crc;
+}
+
+//parses "bytes=first-last", "bytes=first-" and "bytes=-suffix". Returns false if unsatisfiable
+static bool parseRange(const String& range, uint32_t size, uint32_t* first, uint32_t* last) {
+  if (!range.startsWith(F("bytes=")) || range.indexOf(',') >= 0) return true; //multiple ranges: send all
+  int dash = range.indexOf('-');
+  if (dash < 6) return true;
+  String from = range.substring(6, dash);
+  String to = range.substring(dash +1);
+  if (from.length()) {
+    *first = from.toInt();
+    *last = to.length() ? min((uint32_t)to.toInt(), size -1) : size -1;
+  } else {
+    uint32_t suffix = to.toInt();
+    if (!suffix) return false;
+    *first = suffix < size ? size - suffix : 0;
+    *last = size -1;
+  }
+  return size && *first <= *last;
+}
+
 bool handleFileRead(AsyncWebServerRequest* request, String path){
   DEBUG_PRINTLN("FileRead: " + path);
   if(path.endsWith("/")) path += "index.htm";
   if(path.indexOf("sec") > -1) return false;
   String contentType = getContentType(request, path);
-  /*String pathWithGz = path + ".gz";
-  if(WLED_FS.exists(pathWithGz)){
-    request->send(WLED_FS, pathWithGz, contentType);
-    return true;
-  }*/
-  if(WLED_FS.exists(path)) {
-    request->send(WLED_FS, path, contentType);
+
+  String pathWithGz = path + ".gz";
+  bool hasGz = WLED_FS.exists(pathWithGz);
+  bool hasPlain = hasGz ? WLED_FS.exists(path) : false;
+  AsyncWebHeader* encodings = request->getHeader(F("Accept-Encoding"));
+  bool gz = hasGz && (!hasPlain || (encodings && encodings->value().indexOf(F("gzip")) >= 0));
+  if (gz) path = pathWithGz;
+  else if (!hasPlain && !WLED_FS.exists(path)) return false;
+
+  File file = WLED_FS.open(path, "r");
+  if (!file || file.isDirectory()) return false;
+  uint32_t size = file.size();
+
+  uint32_t crc = 0;
+  uint16_t changes = 0;
+  bool tagged = getFileTag(path, size, &crc, &changes);
+  if (!tagged && size <= FILE_TAG_READ_SIZE) {
+    crc = fileCrc(file);
+    tagged = setFileTag(path, size, crc, changes);
+  }
+  char etag[11];
+  sprintf_P(etag, PSTR("\"%08x\""), (unsigned)crc);
+
+  AsyncWebHeader* header = request->getHeader(F("If-None-Match"));
+  if (tagged && header && header->value().indexOf(etag) >= 0) {
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader(F("ETag"), etag);
+    request->send(response);
     return true;
   }
-  return false;
+
+  uint32_t first = 0, last = size ? size -1 : 0;
+  bool partial = false;
+  header = request->getHeader(F("Range"));
+  if (header && request->method() == HTTP_GET) {
+    if (!parseRange(header->value(), size, &first, &last)) {
+      AsyncWebServerResponse *response = request->beginResponse(416);
+      response->addHeader(F("Content-Range"), "bytes */" + String(size));
+      request->send(response);
+      return true;
+    }
+    partial = first > 0 || last < size -1;
+  }
+  uint32_t length = size ? last - first +1 : 0;
+  bool takeCrc = !tagged && !partial && size > FILE_TAG_READ_SIZE;
+
+  AsyncWebServerResponse *response = request->beginResponse(contentType, length,
+    [file, first, length, path, changes, takeCrc, crc](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+      if (index >= length) return 0;
+      if (file.position() != first + index) file.seek(first + index);
+      size_t len = file.read(buffer, min(maxLen, (size_t)(length - index)));
+      if (takeCrc) {
+        crc = crc32Update(crc, buffer, len);
+        if (index + len >= length) {
+          setFileTag(path, length, crc, changes);
+          takeCrc = false;
+        }
+      }
+      return len;
+    });
+  if (partial) {
+    response->setCode(206);
+    response->addHeader(F("Content-Range"), "bytes " + String(first) + "-" + String(last) + "/" + String(size));
+  }
+  if (gz) response->addHeader(F("Content-Encoding"), "gzip");
+  if (hasGz && hasPlain) response->addHeader(F("Vary"), "Accept-Encoding");
+  response->addHeader(F("Accept-Ranges"), "bytes");
+  response->addHeader(F("Cache-Control"), "no-cache");
+  if (tagged) response->addHeader(F("ETag"), etag);
+  request->send(response);
+  return true;
 }
@@ -0,0 +1,99 @@
+#ifndef WLED_FX_JULIA_H
+#define WLED_FX_JULIA_H
+
+/*
+ * Iteration of the animated Julia set of mode_2DJulia() in FX.cpp, in float and in 3.13 fixed point
+ * (WLED_FX_FIXED_POINT). Both call pixel(i, j, iter) for every pixel of a w x h segment, iter is
+ * maxIterations for points inside the set.
+ * Only depends on the C library, so tools/fx_fixed_bench.cpp compares the two variants the firmware runs.
+ */
+
+#include <stdint.h>
+#include <math.h>
+
+struct JuliaView {
+  float reAl, imAg;                 // the constant c
+  float xmin, xmax, ymin, ymax;     // area of the complex plane shown
+  int maxIterations;
+};
+
+// view for the frame time ms, intensity and center/zoom (xymag 0.01-1.0) of the effect
+static inline JuliaView juliaView(uint32_t ms, uint8_t intensity, float xcen, float ycen, float xymag) {
+  JuliaView v;
+  v.reAl = -0.94299;                // PixelBlaze example
+  v.imAg = 0.3162;
+  v.reAl += sin((float)ms/305.)/20.;
+  v.imAg += sin((float)ms/405.)/20.;
+
+  // Whole set should be within -1.2,1.2 to -.8 to 1.
+  v.xmin = fminf(fmaxf(xcen - xymag, -1.2f), 1.2f);
+  v.xmax = fminf(fmaxf(xcen + xymag, -1.2f), 1.2f);
+  v.ymin = fminf(fmaxf(ycen - xymag, -0.8f), 1.0f);
+  v.ymax = fminf(fmaxf(ycen + xymag, -0.8f), 1.0f);
+
+  v.maxIterations = intensity/2;    // How many iterations per pixel before we give up.
+  return v;
+}
+
+template <typename Pixel>
+static inline void juliaFloat(const JuliaView& v, int w, int h, Pixel pixel) {
+  float maxCalc = 16.0;             // How big is each calculation allowed to be before we give up.
+  float dx = (v.xmax - v.xmin) / w; // Scale the delta x and y values to our matrix size.
+  float dy = (v.ymax - v.ymin) / h;
+
+  float y = v.ymin;
+  for (int j = 0; j < h; j++) {
+    float x = v.xmin;
+    for (int i = 0; i < w; i++) {
+      // Now we test, as we iterate z = z^2 + c does z tend towards infinity?
+      float a = x;
+      float b = y;
+      int iter = 0;
+      while (iter < v.maxIterations) {
+        float aa = a * a;
+        float bb = b * b;
+        if (aa + bb > maxCalc) break;   // |z|^2 = a^2+b^2 saves the square root. Bail
+        b = 2*a*b + v.imAg;             // z -> z^2+c where z=a+ib c=(x,y)
+        a = aa - bb + v.reAl;
+        iter++;
+      }
+      pixel(i, j, iter);
+      x += dx;
+    }
+    y += dy;
+  }
+}
+
+// 3.13 fixed point. a and b are at most 4 when they get squared (otherwise a^2+b^2 > maxCalc anyway),
+// so all products fit into 32 bit.
+template <typename Pixel>
+static inline void juliaFixed(const JuliaView& v, int w, int h, Pixel pixel) {
+  const int32_t one = 1 << 13;
+  const int32_t maxCalc = 16 * one;
+  int32_t re = v.reAl * one;
+  int32_t im = v.imAg * one;
+  int32_t x0 = v.xmin * one, y0 = v.ymin * one;
+  int32_t xRange = (v.xmax - v.xmin) * one, yRange = (v.ymax - v.ymin) * one;
+
+  for (int j = 0; j < h; j++) {
+    int32_t y = y0 + yRange * j / h;
+    for (int i = 0; i < w; i++) {
+      int32_t x = x0 + xRange * i / w;
+      int32_t a = x;
+      int32_t b = y;
+      int iter = 0;
+      while (iter < v.maxIterations) {
+        if (a > 4*one || a < -4*one || b > 4*one || b < -4*one) break;  // Bail
+        int32_t aa = (a * a) >> 13;
+        int32_t bb = (b * b) >> 13;
+        if (aa + bb > maxCalc) break;   // Bail
+        b = ((a * b) >> 12) + im;       // 2*a*b
+        a = aa - bb + re;
+        iter++;
+      }
+      pixel(i, j, iter);
+    }
+  }
+}
+
+#endif // WLED_FX_JULIA_H
@@ -6,46 +6,27 @@
  * JSON API (De)serialization
  */
 
-void deserializeSegment(JsonObject elem, byte it, byte presetId)
+//reads the segment values of elem, returns false if elem also sets individual LEDs or Loxone colors
+bool parseSegment(JsonObject elem, SegmentValues& v)
 {
-  byte id = elem["id"] | it;
-  if (id >= strip.getMaxSegments()) return;
-
-  WS2812FX::Segment& seg = strip.getSegment(id);
-  //WS2812FX::Segment prev;
-  //prev = seg; //make a backup so we can tell if something changed
+  memset(&v, 0, sizeof(v));
 
-  uint16_t start = elem[F("start")] | seg.start;
+  if (elem[F("start")].is<uint16_t>()) { v.start = elem[F("start")]; v.set |= SV_START; }
   int stop = elem["stop"] | -1;
-
-  if (stop < 0) {
-    uint16_t len = elem[F("len")];
-    stop = (len > 0) ? start + len : seg.stop;
-  }
-  uint16_t grp = elem[F("grp")] | seg.grouping;
-  uint16_t spc = elem[F("spc")] | seg.spacing;
-  strip.setSegment(id, start, stop, grp, spc);
-
-  uint16_t len = 1;
-  if (stop > start) len = stop - start;
-  int offset = elem[F("of")] | INT32_MAX;
-  if (offset != INT32_MAX) {
-    int offsetAbs = abs(offset);
-    if (offsetAbs > len - 1) offsetAbs %= len;
-    if (offset < 0) offsetAbs = len - offsetAbs;
-    seg.offset = offsetAbs;
-  }
-  if (stop > start && seg.offset > len -1) seg.offset = len -1;
+  if (stop >= 0) { v.stop = stop; v.set |= SV_STOP; }
+  v.len = elem[F("len")];
+  if (v.len > 0) v.set |= SV_LEN;
+  if (elem[F("grp")].is<uint8_t>()) { v.grp = elem[F("grp")]; v.set |= SV_GRP; }
+  if (elem[F("spc")].is<uint8_t>()) { v.spc = elem[F("spc")]; v.set |= SV_SPC; }
+  if (elem[F("of")].is<int>())      { v.offset = elem[F("of")]; v.set |= SV_OFFSET; }
 
   int segbri = elem["bri"] | -1;
-  if (segbri == 0) {
-    seg.setOption(SEG_OPTION_ON, 0, id);
-  } else if (segbri > 0) {
-    seg.setOpacity(segbri, id);
-    seg.setOption(SEG_OPTION_ON, 1, id);
-  }
+  if (segbri >= 0) { v.bri = min(segbri, 255); v.set |= SV_BRI; }
 
-  seg.setOption(SEG_OPTION_ON, elem["on"] | seg.getOption(SEG_OPTION_ON), id);
+  if (elem["on"].is<bool>())     { v.options |= elem["on"].as<bool>()     << SEG_OPTION_ON;       v.set |= SV_ON; }
+  if (elem[F("sel")].is<bool>()) { v.options |= elem[F("sel")].as<bool>() << SEG_OPTION_SELECTED; v.set |= SV_SEL; }
+  if (elem["rev"].is<bool>())    { v.options |= elem["rev"].as<bool>()    << SEG_OPTION_REVERSED; v.set |= SV_REV; }
+  if (elem[F("mi")].is<bool>())  { v.options |= elem[F("mi")].as<bool>()  << SEG_OPTION_MIRROR;   v.set |= SV_MI; }
 
   JsonArray colarr = elem["col"];
   if (!colarr.isNull())
@@ -61,7 +42,7 @@ void deserializeSegment(JsonObject elem, byte it, byte presetId)
         if (hexCol == nullptr) { //Kelvin color temperature (or invalid), e.g 2400
           int kelvin = colarr[i] | -1;
           if (kelvin <  0) continue;
-          if (kelvin == 0) seg.setColor(i, 0, id);
+          if (kelvin == 0) v.set |= SV_COL_ZERO << i;
           if (kelvin >  0) colorKtoRGB(kelvin, brgbw);
           colValid = true;
         } else { //HEX string, e.g. "FFAA00"
@@ -73,64 +54,178 @@ void deserializeSegment(JsonObject elem, byte it, byte presetId)
         if (sz == 0) continue; //do nothing on empty array
 
         byte cp = copyArray(colX, rgbw, 4);
-        if (cp == 1 && rgbw[0] == 0)
-          seg.setColor(i, 0, id);
+        if (cp == 1 && rgbw[0] == 0) v.set |= SV_COL_ZERO << i;
         colValid = true;
       }
 
       if (!colValid) continue;
-      if (id == strip.getMainSegmentId() && i < 2) //temporary, to make transition work on main segment
-      {
-        if (i == 0) {col[0] = rgbw[0]; col[1] = rgbw[1]; col[2] = rgbw[2]; col[3] = rgbw[3];}
-        if (i == 1) {colSec[0] = rgbw[0]; colSec[1] = rgbw[1]; colSec[2] = rgbw[2]; colSec[3] = rgbw[3];}
-      } else { //normal case, apply directly to segment
-        seg.setColor(i, ((rgbw[3] << 24) | ((rgbw[0]&0xFF) << 16) | ((rgbw[1]&0xFF) << 8) | ((rgbw[2]&0xFF))), id);
-        if (seg.mode == FX_MODE_STATIC) strip.trigger(); //instant refresh
-      }
+      for (uint8_t c = 0; c < 4; c++) v.col[i][c] = rgbw[c];
+      v.set |= SV_COL << i;
     }
   }
 
-  // lx parser
-  #ifdef WLED_ENABLE_LOXONE
-  int lx = elem[F("lx")] | -1;
-  if (lx > 0) {
-    parseLxJson(lx, id, false);
+  JsonObject mx = elem[F("mx")];
+  if (!mx.isNull()) {
+    v.set |= SV_MX;
+    if (mx["w"].is<uint16_t>()) { v.width  = mx["w"]; v.set |= SV_MX_W; }
+    if (mx["h"].is<uint16_t>()) { v.height = mx["h"]; v.set |= SV_MX_H; }
+    if (!mx[F("sp")].isNull())  { v.geometry |= mx[F("sp")] ? SEG_2D_SERPENTINE : 0; v.set |= SV_MX_SP; }
+    if (!mx[F("tr")].isNull())  { v.geometry |= mx[F("tr")] ? SEG_2D_TRANSPOSE : 0;  v.set |= SV_MX_TR; }
+    if (!mx[F("rot")].isNull()) { v.geometry |= (((mx[F("rot")] | 0) / 90) & 0x03) << 2; v.set |= SV_MX_ROT; }
+    if (mx[F("pw")].is<uint8_t>()) { v.panelWidth  = mx[F("pw")]; v.set |= SV_MX_PW; }
+    if (mx[F("ph")].is<uint8_t>()) { v.panelHeight = mx[F("ph")]; v.set |= SV_MX_PH; }
   }
-  int ly = elem[F("ly")] | -1;
-  if (ly > 0) {
-    parseLxJson(ly, id, true);
+
+  if (elem["fx"].is<uint8_t>())     { v.fx  = elem["fx"];     v.set |= SV_FX; }
+  if (elem[F("sx")].is<uint8_t>())  { v.sx  = elem[F("sx")];  v.set |= SV_SX; }
+  if (elem[F("ix")].is<uint8_t>())  { v.ix  = elem[F("ix")];  v.set |= SV_IX; }
+  if (elem[F("f1x")].is<uint8_t>()) { v.f1x = elem[F("f1x")]; v.set |= SV_F1X; }
+  if (elem[F("f2x")].is<uint8_t>()) { v.f2x = elem[F("f2x")]; v.set |= SV_F2X; }
+  if (elem[F("f3x")].is<uint8_t>()) { v.f3x = elem[F("f3x")]; v.set |= SV_F3X; }
+  if (elem["pal"].is<uint8_t>())    { v.pal = elem["pal"];    v.set |= SV_PAL; }
+
+  return elem[F("i")].isNull() && elem[F("lx")].isNull() && elem[F("ly")].isNull();
+}
+
+void applySegment(const SegmentValues& v, byte id, byte presetId)
+{
+  if (id >= strip.getMaxSegments()) return;
+
+  WS2812FX::Segment& seg = strip.getSegment(id);
+
+  uint16_t start = (v.set & SV_START) ? v.start : seg.start;
+  int stop = seg.stop;
+  if (v.set & SV_STOP) stop = v.stop;
+  else if (v.set & SV_LEN) stop = start + v.len;
+  uint16_t grp = (v.set & SV_GRP) ? v.grp : seg.grouping;
+  uint16_t spc = (v.set & SV_SPC) ? v.spc : seg.spacing;
+  strip.setSegment(id, start, stop, grp, spc);
+
+  uint16_t len = 1;
+  if (stop > start) len = stop - start;
+  if (v.set & SV_OFFSET) {
+    int offsetAbs = abs(v.offset);
+    if (offsetAbs > len - 1) offsetAbs %= len;
+    if (v.offset < 0) offsetAbs = len - offsetAbs;
+    seg.offset = offsetAbs;
+  }
+  if (stop > start && seg.offset > len -1) seg.offset = len -1;
+
+  if (v.set & SV_BRI) {
+    if (v.bri == 0) {
+      seg.setOption(SEG_OPTION_ON, 0, id);
+    } else {
+      seg.setOpacity(v.bri, id);
+      seg.setOption(SEG_OPTION_ON, 1, id);
+    }
+  }
+
+  if (v.set & SV_ON) seg.setOption(SEG_OPTION_ON, v.options & (1 << SEG_OPTION_ON), id);
+
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    if (v.set & (SV_COL_ZERO << i)) seg.setColor(i, 0, id);
+    if (!(v.set & (SV_COL << i))) continue;
+    const uint8_t* rgbw = v.col[i];
+    if (id == strip.getMainSegmentId() && i < 2) //temporary, to make transition work on main segment
+    {
+      memcpy(i == 0 ? col : colSec, rgbw, 4);
+    } else { //normal case, apply directly to segment
+      seg.setColor(i, (((uint32_t)rgbw[3] << 24) | ((uint32_t)rgbw[0] << 16) | ((uint32_t)rgbw[1] << 8) | rgbw[2]), id);
+      if (seg.mode == FX_MODE_STATIC) strip.trigger(); //instant refresh
+    }
   }
-  #endif
 
-  //if (pal != seg.palette && pal < strip.getPaletteCount()) strip.setPalette(pal);
-  seg.setOption(SEG_OPTION_SELECTED, elem[F("sel")] | seg.getOption(SEG_OPTION_SELECTED));
-  seg.setOption(SEG_OPTION_REVERSED, elem["rev"] | seg.getOption(SEG_OPTION_REVERSED));
-  seg.setOption(SEG_OPTION_MIRROR  , elem[F("mi")]  | seg.getOption(SEG_OPTION_MIRROR  ));
+  if (v.set & SV_SEL) seg.setOption(SEG_OPTION_SELECTED, v.options & (1 << SEG_OPTION_SELECTED));
+  if (v.set & SV_REV) seg.setOption(SEG_OPTION_REVERSED, v.options & (1 << SEG_OPTION_REVERSED));
+  if (v.set & SV_MI)  seg.setOption(SEG_OPTION_MIRROR,   v.options & (1 << SEG_OPTION_MIRROR));
+
+  // 2D geometry, {"w":0} goes back to the global matrix settings
+  if (v.set & SV_MX) {
+    if (v.set & SV_MX_W) seg.width  = v.width;
+    if (v.set & SV_MX_H) seg.height = v.height;
+    uint8_t geo = seg.geometry;
+    if (v.set & SV_MX_SP)  geo = (geo & ~SEG_2D_SERPENTINE) | (v.geometry & SEG_2D_SERPENTINE);
+    if (v.set & SV_MX_TR)  geo = (geo & ~SEG_2D_TRANSPOSE)  | (v.geometry & SEG_2D_TRANSPOSE);
+    if (v.set & SV_MX_ROT) geo = (geo & ~SEG_2D_ROTATION)   | (v.geometry & SEG_2D_ROTATION);
+    seg.geometry = geo;
+    if (v.set & SV_MX_PW) seg.panelWidth  = v.panelWidth;
+    if (v.set & SV_MX_PH) seg.panelHeight = v.panelHeight;
+    if (!seg.width || !seg.height) {
+      seg.width = 0; seg.height = 0; seg.geometry = 0; seg.panelWidth = 0; seg.panelHeight = 0;
+    }
+  }
 
   //temporary, strip object gets updated via colorUpdated()
   if (id == strip.getMainSegmentId()) {
     byte effectPrev = effectCurrent;
-    effectCurrent = elem["fx"] | effectCurrent;
+    if (v.set & SV_FX) effectCurrent = v.fx;
     if (!presetId && effectCurrent != effectPrev) unloadPlaylist(); //stop playlist if active and FX changed manually
-    effectSpeed = elem[F("sx")] | effectSpeed;
-    effectIntensity = elem[F("ix")] | effectIntensity;
-    effectFFT1 = elem[F("f1x")] | effectFFT1;
-    effectFFT2 = elem[F("f2x")] | effectFFT2;
-    effectFFT3 = elem[F("f3x")] | effectFFT3;
-    effectPalette = elem["pal"] | effectPalette;
+    if (v.set & SV_SX)  effectSpeed = v.sx;
+    if (v.set & SV_IX)  effectIntensity = v.ix;
+    if (v.set & SV_F1X) effectFFT1 = v.f1x;
+    if (v.set & SV_F2X) effectFFT2 = v.f2x;
+    if (v.set & SV_F3X) effectFFT3 = v.f3x;
+    if (v.set & SV_PAL) effectPalette = v.pal;
   } else { //permanent
-    byte fx = elem["fx"] | seg.mode;
-    if (fx != seg.mode && fx < strip.getModeCount()) {
-      strip.setMode(id, fx);
+    if ((v.set & SV_FX) && v.fx != seg.mode && v.fx < strip.getModeCount()) {
+      strip.setMode(id, v.fx);
       if (!presetId) unloadPlaylist(); //stop playlist if active and FX changed manually
     }
-    seg.speed = elem[F("sx")] | seg.speed;
-    seg.intensity = elem[F("ix")] | seg.intensity;
-    seg.fft1 = elem[F("f1x")] | seg.fft1;
-    seg.fft2 = elem[F("f2x")] | seg.fft2;
-    seg.fft3 = elem[F("f3x")] | seg.fft3;
-    seg.palette = elem["pal"] | seg.palette;
+    if (v.set & SV_SX)  seg.speed = v.sx;
+    if (v.set & SV_IX)  seg.intensity = v.ix;
+    if (v.set & SV_F1X) seg.fft1 = v.f1x;
+    if (v.set & SV_F2X) seg.fft2 = v.f2x;
+    if (v.set & SV_F3X) seg.fft3 = v.f3x;
+    if (v.set & SV_PAL) seg.palette = v.pal;
+  }
+}
+
+//id 255: all selected segments, or the first active one if none is selected (like "seg":{})
+void applySegments(const SegmentValues& v, byte id, byte presetId)
+{
+  if (id != 255) {
+    applySegment(v, id, presetId);
+    return;
+  }
+  bool didSet = false;
+  byte lowestActive = 99;
+  for (byte s = 0; s < strip.getMaxSegments(); s++) {
+    WS2812FX::Segment& sg = strip.getSegment(s);
+    if (!sg.isActive()) continue;
+    if (lowestActive == 99) lowestActive = s;
+    if (sg.isSelected()) {
+      applySegment(v, s, presetId);
+      didSet = true;
+    }
   }
+  if (!didSet && lowestActive < strip.getMaxSegments()) applySegment(v, lowestActive, presetId);
+}
+
+void deserializeSegment(JsonObject elem, byte it, byte presetId)
+{
+  byte id = elem["id"] | it;
+  if (id >= strip.getMaxSegments()) return;
+
+  WS2812FX::Segment& seg = strip.getSegment(id);
+  //WS2812FX::Segment prev;
+  //prev = seg; //make a backup so we can tell if something changed
+
+  SegmentValues v;
+  parseSegment(elem, v);
+  applySegment(v, id, presetId);
+
+  // lx parser
+  #ifdef WLED_ENABLE_LOXONE
+  int lx = elem[F("lx")] | -1;
+  if (lx > 0) {
+    parseLxJson(lx, id, false);
+  }
+  int ly = elem[F("ly")] | -1;
+  if (ly > 0) {
+    parseLxJson(ly, id, true);
+  }
+  #endif
 
   JsonArray iarr = elem[F("i")]; //set individual LEDs
   if (!iarr.isNull()) {
@@ -186,6 +281,8 @@ void deserializeSegment(JsonObject elem, byte it, byte presetId)
 
 bool deserializeState(JsonObject root, byte callMode, byte presetId)
 {
+  if (root[F("tx")] && !presetId && stageState(root, callMode) != BATCH_INVALID) return false; //applied later (or busy and dropped), nothing to respond yet
+
   strip.applyToAllSelected = false;
   bool stateResponse = root[F("v")] | false;
 
@@ -238,6 +335,9 @@ bool deserializeState(JsonObject root, byte callMode, byte presetId)
 
   doReboot = root[F("rb")] | doReboot;
 
+  int ledmap = root[F("ledmap")] | -1;
+  if (ledmap >= 0 && ledmap < WLED_MAX_LEDMAPS) loadLedmap = ledmap;
+
   realtimeOverride = root[F("lor")] | realtimeOverride;
   if (realtimeOverride > 2) realtimeOverride = REALTIME_OVERRIDE_ALWAYS;
 
@@ -285,6 +385,15 @@ bool deserializeState(JsonObject root, byte callMode, byte presetId)
     }
   }
 
+  JsonObject rnd = root[F("render")];
+  if (!rnd.isNull()) {
+    renderFrameMs = rnd[F("dt")] | FRAMETIME;
+    renderSeed    = rnd[F("seed")] | 1;
+    renderId      = rnd["id"] | 0;
+    int frames    = rnd["n"] | 0;
+    renderFrames  = constrain(frames, 0, RENDER_MAX_FRAMES); //set last, the loop starts rendering once it is set
+  }
+
   #ifndef WLED_DISABLE_CRONIXIE
     if (root["nx"].is<const char*>()) {
       strncpy(cronixieDisplay, root["nx"], 6);
@@ -330,6 +439,166 @@ bool deserializeState(JsonObject root, byte callMode, byte presetId)
   return stateResponse;
 }
 
+/*
+ * Batched state changes ("tx":true in a state, or POST /json/batch)
+ *
+ * deserializeState() changes segments one after the other from whatever task received the request,
+ * so the strip can show a frame with half of a scene applied. A batch is only parsed when it arrives:
+ * the values are staged and the loop applies all of them between two frames, followed by a single
+ * colorUpdated(). Batches staged before the loop got to them are applied in order, each with its own
+ * globals: two toggles cancel out, and a mainseg is only applied after the segments staged before it.
+ * Only on, bri, transition, tt, mainseg and seg (without i, lx or ly) can be batched. A "tx" state with
+ * anything else is applied right away, /json/batch answers it with 400.
+ * batchLock is held while staging and while the loop takes the staged batches out, which it then applies
+ * without the lock, so staging continues into new ones. Once WLED_MAX_BATCH_SEGMENTS segment changes or
+ * WLED_MAX_BATCH_GLOBALS batches with globals wait for the loop, or there is no memory for them, batching
+ * is busy: HTTP gets 503 with Retry-After, other transports drop it like a WebSocket message without a
+ * parse buffer.
+ */
+
+#define BATCH_BRI        0x01
+#define BATCH_ON         0x02
+#define BATCH_TRANSITION 0x04
+#define BATCH_TT         0x08
+#define BATCH_MAINSEG    0x10
+
+typedef struct BatchSegment {
+  SegmentValues v;
+  byte id;                           //255 = selected segments
+} BatchSegment;
+
+typedef struct BatchGlobals {
+  uint8_t first;                     //index of the first segment change staged after these globals
+  uint8_t set;
+  byte bri, on, mainSeg;             //on 2 = toggle
+  uint16_t transition, tt;
+  byte callMode;
+} BatchGlobals;
+
+typedef struct Batch {
+  BatchSegment* segs;
+  uint8_t count;
+  uint8_t steps;                     //used entries of globals, batches without any share the previous one
+  bool ready;
+  BatchGlobals globals[WLED_MAX_BATCH_GLOBALS];
+} Batch;
+
+static Batch staged = {};
+static WledLock batchLock;
+
+static bool stageSegment(JsonObject elem, byte id) {
+  BatchSegment& b = staged.segs[staged.count];
+  if (!parseSegment(elem, b.v)) return false;
+  b.id = id;
+  staged.count++;
+  return true;
+}
+
+//stages the state in root, returns BATCH_STAGED, BATCH_INVALID if it can't be batched or BATCH_BUSY (nothing is staged then)
+byte stageState(JsonObject root, byte callMode)
+{
+  for (JsonPair kv : root) {
+    const char* k = kv.key().c_str();
+    if (strcmp_P(k, PSTR("on")) && strcmp_P(k, PSTR("bri")) && strcmp_P(k, PSTR("transition")) && strcmp_P(k, PSTR("tt"))
+      && strcmp_P(k, PSTR("mainseg")) && strcmp_P(k, PSTR("seg")) && strcmp_P(k, PSTR("tx")) && strcmp_P(k, PSTR("v"))) return BATCH_INVALID;
+  }
+  JsonVariant segVar = root["seg"];
+  uint16_t segs = segVar.is<JsonObject>() ? 1 : segVar.as<JsonArray>().size();
+  if (segs > WLED_MAX_BATCH_SEGMENTS) return BATCH_INVALID;
+
+  BatchGlobals g = {};
+  if (root["bri"].is<uint8_t>()) { g.bri = root["bri"]; g.set |= BATCH_BRI; }
+  if (root["on"].is<bool>()) { g.on = root["on"].as<bool>(); g.set |= BATCH_ON; }
+  else if (root["on"].is<const char*>() && root["on"].as<const char*>()[0] == 't') { g.on = 2; g.set |= BATCH_ON; }
+  if (root[F("transition")].is<uint16_t>()) { g.transition = root[F("transition")]; g.set |= BATCH_TRANSITION; }
+  if (root[F("tt")].is<uint16_t>())  { g.tt = root[F("tt")]; g.set |= BATCH_TT; }
+  if (root[F("mainseg")].is<uint8_t>()) { g.mainSeg = root[F("mainseg")]; g.set |= BATCH_MAINSEG; }
+  g.callMode = callMode;
+
+  WledLockGuard guard(batchLock);
+  if (staged.count + segs > WLED_MAX_BATCH_SEGMENTS) return BATCH_BUSY;
+  bool newStep = g.set || !staged.steps;
+  if (newStep && staged.steps >= WLED_MAX_BATCH_GLOBALS) return BATCH_BUSY;
+  if (!staged.segs && !(staged.segs = (BatchSegment*)malloc(WLED_MAX_BATCH_SEGMENTS * sizeof(BatchSegment)))) return BATCH_BUSY;
+
+  uint8_t prevCount = staged.count;
+  bool ok = true;
+  if (segVar.is<JsonObject>()) {
+    int id = segVar["id"] | -1;
+    ok = stageSegment(segVar, id < 0 ? 255 : id);
+  } else {
+    byte it = 0;
+    for (JsonObject elem : segVar.as<JsonArray>()) {
+      ok = ok && stageSegment(elem, elem["id"] | it);
+      it++;
+    }
+  }
+  if (!ok) {
+    staged.count = prevCount;
+    return BATCH_INVALID;
+  }
+
+  if (newStep) {
+    g.first = prevCount;
+    staged.globals[staged.steps++] = g;
+  } else {
+    staged.globals[staged.steps -1].callMode = callMode;
+  }
+  staged.ready = true;
+  return BATCH_STAGED;
+}
+
+static void applyBatchGlobals(const BatchGlobals& g)
+{
+  if (g.set & BATCH_TRANSITION) {
+    transitionDelay = g.transition * 100;
+    transitionDelayTemp = transitionDelay;
+  }
+  if (g.set & BATCH_TT) {
+    transitionDelayTemp = g.tt * 100;
+    jsonTransitionOnce = true;
+  }
+  strip.setTransition(transitionDelayTemp);
+
+  if (g.set & BATCH_BRI) bri = g.bri;
+  if ((g.set & BATCH_ON) && (g.on == 2 || !g.on != !bri)) toggleOnOff();
+
+  if (g.set & BATCH_MAINSEG) {
+    byte prevMain = strip.getMainSegmentId();
+    strip.mainSegment = g.mainSeg;
+    if (strip.getMainSegmentId() != prevMain) setValuesFromMainSeg();
+  }
+}
+
+//applies the staged batches, called from the loop so no frame is rendered in between
+void handleBatch()
+{
+  if (!staged.ready) return;
+  Batch b;
+  {
+    WledLockGuard guard(batchLock);
+    b = staged;
+    memset(&staged, 0, sizeof(staged)); //the next batch stages into a new buffer
+  }
+
+  strip.applyToAllSelected = false;
+  uint8_t step = 0;
+  for (uint8_t i = 0; i <= b.count; i++) {
+    while (step < b.steps && b.globals[step].first == i) applyBatchGlobals(b.globals[step++]);
+    if (i == b.count) break;
+    byte id = b.segs[i].id;
+    applySegments(b.segs[i].v, id);
+    for (byte s = 0; s < strip.getMaxSegments(); s++) { //return to regular effect, as deserializeSegment() does
+      WS2812FX::Segment& sg = strip.getSegment(s);
+      if (id == 255 ? sg.isSelected() : s == id) sg.setOption(SEG_OPTION_FREEZE, false);
+    }
+  }
+  free(b.segs);
+
+  interfaceUpdateCallMode = CALL_MODE_WS_SEND;
+  colorUpdated(b.globals[b.steps -1].callMode);
+}
+
 void serializeSegment(JsonObject& root, WS2812FX::Segment& seg, byte id, bool forPreset, bool segmentBounds)
 {
 	root["id"] = id;
@@ -341,6 +610,18 @@ void serializeSegment(JsonObject& root, WS2812FX::Segment& seg, byte id, bool fo
   root[F("grp")] = seg.grouping;
   root[F("spc")] = seg.spacing;
   root[F("of")] = seg.offset;
+  if (seg.width && seg.height) {
+    JsonObject mx = root.createNestedObject(F("mx"));
+    mx["w"] = seg.width;
+    mx["h"] = seg.height;
+    mx[F("sp")]  = (bool)(seg.geometry & SEG_2D_SERPENTINE);
+    mx[F("tr")]  = (bool)(seg.geometry & SEG_2D_TRANSPOSE);
+    mx[F("rot")] = ((seg.geometry & SEG_2D_ROTATION) >> 2) * 90;
+    if (seg.panelWidth && seg.panelHeight) {
+      mx[F("pw")] = seg.panelWidth;
+      mx[F("ph")] = seg.panelHeight;
+    }
+  }
   root["on"] = seg.getOption(SEG_OPTION_ON);
   byte segbri = seg.opacity;
   root["bri"] = (segbri) ? segbri : 255;
@@ -393,6 +674,7 @@ void serializeState(JsonObject root, bool forPreset, bool includeBri, bool segme
 
     root[F("ps")] = currentPreset;
     root[F("pl")] = currentPlaylist;
+    root[F("ledmap")] = strip.getLedmap();
 
     usermods.addToJsonState(root);
 
@@ -512,8 +794,16 @@ void serializeInfo(JsonObject root)
   fs_info["u"] = fsBytesUsed / 1000;
   fs_info["t"] = fsBytesTotal / 1000;
   fs_info[F("pmt")] = presetsModifiedTime;
+  JsonObject cfg_info = fs_info.createNestedObject(F("cfg"));
+  cfg_info["n"] = cfgWrites;
+  cfg_info["ms"] = cfgWriteTime;
+  cfg_info[F("max")] = cfgWriteTimeMax;
+  serializeWriteStats(fs_info);
+
+  serializeRequestStats(root);
 
   root[F("ndc")] = nodeListEnabled ? (int)Nodes.size() : -1;
+  root[F("ndv")] = Nodes.getVersion();
 
   #ifdef ARDUINO_ARCH_ESP32
   #ifdef WLED_DEBUG
@@ -730,21 +1020,45 @@ void serializePalettes(JsonObject root, AsyncWebServerRequest* request)
   }
 }
 
-void serializeNodes(JsonObject root)
+void serializeNodes(JsonObject root, AsyncWebServerRequest* request)
 {
+  #ifdef ESP8266
+  int itemPerPage = 15;
+  #else
+  int itemPerPage = 50;
+  #endif
+
+  WledLockGuard guard(Nodes.getLock()); //the loop expires and adds nodes
+  int count = Nodes.size();
+  int start = 0, end = count;
+
+  //only paginate if requested, the UI expects the full list
+  if (request->hasParam("page")) {
+    int page = request->getParam("page")->value().toInt();
+    int maxPage = (count > 0) ? (count -1) / itemPerPage : 0;
+    if (page > maxPage) page = maxPage;
+    if (page < 0) page = 0;
+    start = itemPerPage * page;
+    end = start + itemPerPage;
+    if (end > count) end = count;
+    root[F("m")] = maxPage;
+  }
+  root[F("cnt")] = count;
+  root[F("ver")] = Nodes.getVersion();
+
   JsonArray nodes = root.createNestedArray("nodes");
+  uint32_t now = millis();
 
-  for (NodesMap::iterator it = Nodes.begin(); it != Nodes.end(); ++it)
+  for (int i = start; i < end; i++)
   {
-    if (it->second.ip[0] != 0)
-    {
-      JsonObject node = nodes.createNestedObject();
-      node[F("name")] = it->second.nodeName;
-      node["type"]    = it->second.nodeType;
-      node["ip"]      = it->second.ip.toString();
-      node[F("age")]  = it->second.age;
-      node[F("vid")]  = it->second.build;
-    }
+    NodeStruct* n = Nodes.get(i);
+    if (!n) break;
+    JsonObject node = nodes.createNestedObject();
+    node[F("name")] = n->nodeName;
+    node["type"]    = n->nodeType;
+    node["ip"]      = IPAddress(n->ip).toString();
+    node[F("age")]  = (now - n->lastSeen) / 30000; //in 30s units, as before
+    node[F("vid")]  = n->build;
   }
 }
 
@@ -777,6 +1091,7 @@ void serveJson(AsyncWebServerRequest* request)
     return;
   }
 
+  if (!admitRequest(request)) return;
   AsyncJsonResponse* response = new AsyncJsonResponse(JSON_BUFFER_SIZE);
   JsonObject doc = response->getRoot();
 
@@ -787,7 +1102,7 @@ void serveJson(AsyncWebServerRequest* request)
     case 2: //info
       serializeInfo(doc); break;
     case 4: //node list
-      serializeNodes(doc); break;
+      serializeNodes(doc, request); break;
     case 5: //palettes
       serializePalettes(doc, request); break;
     default: //all
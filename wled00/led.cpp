@@ -311,3 +311,102 @@ uint32_t get_millisecond_timer()
 {
   return strip.now;
 }
+
+/*
+ * Reproducible rendering for regression checks of the effects (tools/fx_render.py)
+ * File format, little endian: "WFRM", version (1), bytes per pixel (4), pixels (16 bit), frames (16 bit),
+ * frame time in ms (16 bit), seed (16 bit), id (32 bit), then all pixels of every frame as 32 bit WRGB.
+ */
+static File renderFile;
+static uint16_t renderTotal = 0, renderDone = 0; //frames of the running render
+
+static bool writeRenderFrame()
+{
+  uint16_t len = busses.getTotalLength();
+  for (uint16_t i = 0; i < len; i++) {
+    uint32_t c = busses.getPixelColor(i);
+    if (renderFile.write((const uint8_t*)&c, 4) != 4) return false;
+  }
+  return true;
+}
+
+static bool writeRenderHeader(uint16_t len, uint16_t frames)
+{
+  uint8_t header[18] = {'W','F','R','M', 1, 4};
+  memcpy(header +  6, &len, 2);
+  memcpy(header +  8, &frames, 2);
+  memcpy(header + 10, &renderFrameMs, 2);
+  memcpy(header + 12, &renderSeed, 2);
+  memcpy(header + 14, &renderId, 4);
+  return renderFile.write(header, sizeof(header)) == sizeof(header);
+}
+
+//moves the finished file in place
+static void finishRender()
+{
+  uint32_t size = renderFile.size();
+  renderFile.close();
+  WLED_FS.rename("/render.tmp", "/render.bin");
+  countWrite("/render.bin", size);
+}
+
+//a /render.bin with 0 frames tells the client the render was refused or failed
+static void refuseRender(byte error)
+{
+  errorFlag = error;
+  if (renderFile) renderFile.close();
+  WLED_FS.remove("/render.tmp");
+  renderFile = WLED_FS.open("/render.bin", "w");
+  if (!renderFile) return; //the client times out
+  writeRenderHeader(busses.getTotalLength(), 0);
+  renderFile.close();
+  countWrite("/render.bin", 18);
+}
+
+/*
+ * Renders the frames requested by the JSON API into /render.bin. Up to 600 frames of all pixels take
+ * megabytes, so the output size is checked against the free space first, and the frames are rendered
+ * and written RENDER_SLICE_MS at a time per loop(), which keeps the watchdog, network and web server going.
+ * The LEDs keep their last frame meanwhile.
+ */
+void handleRender()
+{
+  if (renderFrames && !strip.isRendering()) {
+    uint16_t frames = renderFrames;
+    renderFrames = 0;
+
+    WLED_FS.remove("/render.tmp");
+    WLED_FS.remove("/render.bin");
+    uint16_t len = busses.getTotalLength();
+    uint32_t size = 18 + (uint32_t)frames * len * 4;
+    updateFSInfo();
+    if (size + 9000 > fsBytesTotal - fsBytesUsed) { //same margin as appending presets
+      DEBUG_PRINTF("Render of %u frames (%u bytes) does not fit\n", frames, size);
+      refuseRender(ERR_FS_QUOTA);
+      return;
+    }
+
+    renderFile = WLED_FS.open("/render.tmp", "w");
+    if (!renderFile || !writeRenderHeader(len, frames)) {
+      refuseRender(ERR_FS_GENERAL);
+      return;
+    }
+
+    renderTotal = frames;
+    renderDone = 0;
+    strip.renderBegin(renderFrameMs, renderSeed);
+  }
+  if (!strip.isRendering()) return;
+
+  uint32_t start = millis();
+  bool ok = true;
+  do {
+    strip.renderFrame();
+    ok = writeRenderFrame();
+  } while (ok && ++renderDone < renderTotal && millis() - start < RENDER_SLICE_MS);
+  if (ok && renderDone < renderTotal) return; //next slice in the next loop()
+
+  strip.renderEnd();
+  if (ok) finishRender();
+  else refuseRender(ERR_FS_QUOTA); //FS full after all
+}
@@ -7,6 +7,33 @@
 #ifdef WLED_ENABLE_MQTT
 #define MQTT_KEEP_ALIVE_TIME 60    // contact the MQTT broker every 60 seconds
 
+//last published payload per topic (FNV-1a hash), so unchanged values are not sent again
+static uint32_t mqttLastBri    = UINT32_MAX;
+static uint32_t mqttLastCol    = UINT32_MAX;
+static uint32_t mqttLastXml    = 0;
+static uint32_t mqttLastState  = 0;
+static uint32_t mqttLastSeg[MAX_NUM_SEGMENTS] = {0};
+static bool     mqttStatusSent = false;
+static unsigned long lastMqttPublish = 0;
+
+static uint32_t mqttHash(const char* s)
+{
+  uint32_t h = 2166136261UL;
+  while (*s) { h ^= (uint8_t)*s++; h *= 16777619UL; }
+  return h;
+}
+
+//forget what was published so the next publishMqtt() sends every topic
+static void resetMqttPublishCache()
+{
+  mqttLastBri = UINT32_MAX;
+  mqttLastCol = UINT32_MAX;
+  mqttLastXml = 0;
+  mqttLastState = 0;
+  memset(mqttLastSeg, 0, sizeof(mqttLastSeg));
+  mqttStatusSent = false;
+}
+
 void parseMQTTBriPayload(char* payload)
 {
   if      (strstr(payload, "ON") || strstr(payload, "on") || strstr(payload, "true")) {bri = briLast; colorUpdated(1);}
@@ -47,6 +74,7 @@ void onMqttConnect(bool sessionPresent)
 
   usermods.onMqttConnect(sessionPresent);
 
+  resetMqttPublishCache();
   doPublishMqtt = true;
   DEBUG_PRINTLN(F("MQTT ready"));
 }
@@ -91,11 +119,14 @@ void onMqttMessage(char* topic, char* payload, AsyncMqttClientMessageProperties
     colorUpdated(CALL_MODE_DIRECT_CHANGE);
   } else if (strcmp_P(topic, PSTR("/api")) == 0) {
     if (payload[0] == '{') { //JSON API
-      DynamicJsonDocument doc(JSON_BUFFER_SIZE);
-      deserializeJson(doc, payloadStr);
-      fileDoc = &doc;
-      deserializeState(doc.as<JsonObject>());
-      fileDoc = nullptr;
+      DynamicJsonDocument* doc = acquireJsonBuffer();
+      if (doc) {
+        deserializeJson(*doc, payloadStr);
+        fileDoc = doc;
+        deserializeState(doc->as<JsonObject>());
+        fileDoc = nullptr;
+        releaseJsonBuffer(doc);
+      }
     } else { //HTTP API
       String apireq = "win&";
       apireq += (char*)payloadStr;
@@ -112,34 +143,114 @@ void onMqttMessage(char* topic, char* payload, AsyncMqttClientMessageProperties
 }
 
 
+//publish the compact JSON state: global values to <device>/state, each active segment to <device>/seg/<id>
+static void publishMqttJsonState()
+{
+  char subuf[48];
+  char payload[384];
+  DynamicJsonDocument doc(1024);
+
+  JsonObject root = doc.to<JsonObject>();
+  root["on"]  = (bri > 0);
+  root["bri"] = briLast;
+  root[F("ps")] = currentPreset;
+  root[F("pl")] = currentPlaylist;
+  root[F("mainseg")] = strip.getMainSegmentId();
+  serializeJson(doc, payload, sizeof(payload));
+  uint32_t h = mqttHash(payload);
+  if (h != mqttLastState) {
+    mqttLastState = h;
+    strcpy(subuf, mqttDeviceTopic);
+    strcat_P(subuf, PSTR("/state"));
+    mqtt->publish(subuf, 0, true, payload);
+  }
+
+  for (byte s = 0; s < strip.getMaxSegments(); s++)
+  {
+    WS2812FX::Segment& sg = strip.getSegment(s);
+    if (!sg.isActive()) {
+      if (mqttLastSeg[s] != 0) { //segment was removed, clear its retained message
+        mqttLastSeg[s] = 0;
+        sprintf_P(subuf, PSTR("%s/seg/%u"), mqttDeviceTopic, s);
+        mqtt->publish(subuf, 0, true, "");
+      }
+      continue;
+    }
+    doc.clear();
+    JsonObject seg = doc.to<JsonObject>();
+    serializeSegment(seg, sg, s);
+    size_t len = measureJson(doc);
+    char* segPayload = payload;
+    if (len >= sizeof(payload) && !doc.overflowed()) segPayload = (char*) malloc(len +1); //large 2D segments
+    if (segPayload && !doc.overflowed()) {
+      serializeJson(doc, segPayload, len +1);
+    } else { //subscribers see why the state is missing
+      segPayload = payload;
+      strcpy_P(payload, PSTR("{\"error\":\"size\"}"));
+    }
+    h = mqttHash(segPayload);
+    if (h != mqttLastSeg[s]) {
+      mqttLastSeg[s] = h;
+      sprintf_P(subuf, PSTR("%s/seg/%u"), mqttDeviceTopic, s);
+      mqtt->publish(subuf, 0, true, segPayload);
+    }
+    if (segPayload != payload) free(segPayload);
+  }
+}
+
+
 void publishMqtt()
 {
+  if (!WLED_MQTT_CONNECTED) {
+    doPublishMqtt = false;
+    return;
+  }
+  //coalesce changes: keep the request pending until the minimum interval has passed
+  if (millis() - lastMqttPublish < mqttPublishInterval) return;
   doPublishMqtt = false;
-  if (!WLED_MQTT_CONNECTED) return;
+  lastMqttPublish = millis();
   DEBUG_PRINTLN(F("Publish MQTT"));
 
   char s[10];
   char subuf[38];
 
-  sprintf_P(s, PSTR("%u"), bri);
-  strcpy(subuf, mqttDeviceTopic);
-  strcat_P(subuf, PSTR("/g"));
-  mqtt->publish(subuf, 0, true, s);
-
-  sprintf_P(s, PSTR("#%06X"), (col[3] << 24) | (col[0] << 16) | (col[1] << 8) | (col[2]));
-  strcpy(subuf, mqttDeviceTopic);
-  strcat_P(subuf, PSTR("/c"));
-  mqtt->publish(subuf, 0, true, s);
-
-  strcpy(subuf, mqttDeviceTopic);
-  strcat_P(subuf, PSTR("/status"));
-  mqtt->publish(subuf, 0, true, "online");
-
-  char apires[1024];
-  XML_response(nullptr, apires);
-  strcpy(subuf, mqttDeviceTopic);
-  strcat_P(subuf, PSTR("/v"));
-  mqtt->publish(subuf, 0, false, apires);
+  if (bri != mqttLastBri) {
+    mqttLastBri = bri;
+    sprintf_P(s, PSTR("%u"), bri);
+    strcpy(subuf, mqttDeviceTopic);
+    strcat_P(subuf, PSTR("/g"));
+    mqtt->publish(subuf, 0, true, s);
+  }
+
+  uint32_t c = (col[3] << 24) | (col[0] << 16) | (col[1] << 8) | (col[2]);
+  if (c != mqttLastCol) {
+    mqttLastCol = c;
+    sprintf_P(s, PSTR("#%06X"), c);
+    strcpy(subuf, mqttDeviceTopic);
+    strcat_P(subuf, PSTR("/c"));
+    mqtt->publish(subuf, 0, true, s);
+  }
+
+  if (!mqttStatusSent) { //retained, once per connection is enough
+    mqttStatusSent = true;
+    strcpy(subuf, mqttDeviceTopic);
+    strcat_P(subuf, PSTR("/status"));
+    mqtt->publish(subuf, 0, true, "online");
+  }
+
+  if (mqttPublishXml) {
+    char apires[1024];
+    XML_response(nullptr, apires);
+    uint32_t h = mqttHash(apires);
+    if (h != mqttLastXml) {
+      mqttLastXml = h;
+      strcpy(subuf, mqttDeviceTopic);
+      strcat_P(subuf, PSTR("/v"));
+      mqtt->publish(subuf, 0, false, apires);
+    }
+  }
+
+  if (mqttPublishJson) publishMqttJsonState();
 }
 
 
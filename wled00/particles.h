@@ -0,0 +1,176 @@
+#ifndef WLED_PARTICLES_H
+#define WLED_PARTICLES_H
+
+/*
+ * Particle storage and physics for the particle style effects (Popcorn, Drip, Fireworks 1D,
+ * Starburst, Bouncing Balls, Ripple).
+ * The particles live in the segment data as one array per property (structure of arrays), so the
+ * update pass runs through a few dense arrays instead of jumping over structs, and particles that
+ * die are replaced by the last one, so the live particles always are 0..count()-1.
+ * Positions and velocities are 16.16 fixed point in pixels and pixels per step, no float math.
+ * Only depends on the C library, so the engine can be benchmarked on a host as well
+ * (tools/particle_bench.cpp).
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define PS_ONE           65536        // 1.0 in 16.16 fixed point
+
+// update() flags
+#define PS_KILL_BELOW    0x01         // particles dying below 0 (x in 1D, y in 2D)
+#define PS_KILL_OUTSIDE  0x02         // particles dying outside of 0..width (and 0..height in 2D)
+#define PS_FLOOR_STOP    0x04         // particles stop at 0 (x in 1D, y in 2D)
+#define PS_FLOOR_BOUNCE  0x08         // particles bounce back at 0 (x in 1D, y in 2D), keeping bounce/256 of their speed
+
+class ParticleSystem {
+  public:
+  // bytes of segment data needed for n particles and extra bytes of effect data
+  static uint32_t dataSize(uint16_t n, bool is2D = false, uint16_t extra = 0) {
+    return align4(sizeof(Header) + (uint32_t)n * bytesPerParticle(is2D)) + extra;
+  }
+
+  // Sets up the arrays in data, which must have dataSize(n, is2D, extra) bytes. The particles
+  // already in data are kept unless clear is set, so this is called every frame on the segment data.
+  void begin(uint8_t* data, uint16_t n, bool is2D = false, uint16_t extra = 0, bool clear = false) {
+    _h = reinterpret_cast<Header*>(data);
+    if (clear || _h->capacity != n || _h->is2D != is2D) {
+      memset(data, 0, dataSize(n, is2D, extra));
+      _h->capacity = n;
+      _h->is2D = is2D;
+    }
+    uint8_t* p = data + sizeof(Header);
+    x  = reinterpret_cast<int32_t*>(p);  p += n * sizeof(int32_t);
+    vx = reinterpret_cast<int32_t*>(p);  p += n * sizeof(int32_t);
+    if (is2D) {
+      y  = reinterpret_cast<int32_t*>(p);  p += n * sizeof(int32_t);
+      vy = reinterpret_cast<int32_t*>(p);  p += n * sizeof(int32_t);
+    } else {
+      y = nullptr; vy = nullptr;
+    }
+    age   = reinterpret_cast<uint16_t*>(p); p += n * sizeof(uint16_t);
+    life  = reinterpret_cast<uint16_t*>(p); p += n * sizeof(uint16_t);
+    value = reinterpret_cast<uint16_t*>(p); p += n * sizeof(uint16_t);
+    tag   = p;                              p += n;
+    this->extra = data + align4(p - data);
+  }
+
+  inline uint16_t count()    { return _h->count; }
+  inline uint16_t capacity() { return _h->capacity; }
+  inline bool     full()     { return _h->count >= _h->capacity; }
+  inline void     clear()    { _h->count = 0; }
+
+  // new particle, returns its index or -1 if all are in use. life: steps until it dies, 0 = forever.
+  int16_t spawn(int32_t px, int32_t pvx, uint16_t plife = 0, uint16_t pvalue = 0, uint8_t ptag = 0) {
+    if (full()) return -1;
+    uint16_t i = _h->count++;
+    x[i] = px; vx[i] = pvx;
+    if (y) { y[i] = 0; vy[i] = 0; }
+    age[i] = 0; life[i] = plife; value[i] = pvalue; tag[i] = ptag;
+    return i;
+  }
+
+  int16_t spawn2D(int32_t px, int32_t py, int32_t pvx, int32_t pvy, uint16_t plife = 0, uint16_t pvalue = 0, uint8_t ptag = 0) {
+    int16_t i = spawn(px, pvx, plife, pvalue, ptag);
+    if (i >= 0 && y) { y[i] = py; vy[i] = pvy; }
+    return i;
+  }
+
+  // removes particle i, the last particle takes its index
+  void kill(uint16_t i) {
+    uint16_t last = --_h->count;
+    if (i == last) return;
+    x[i] = x[last]; vx[i] = vx[last];
+    if (y) { y[i] = y[last]; vy[i] = vy[last]; }
+    age[i] = age[last]; life[i] = life[last]; value[i] = value[last]; tag[i] = tag[last];
+  }
+
+  // moves particle i by one step (step = PS_ONE) or a fraction/multiple of it, without aging.
+  // Exact for constant gravity (x += v*t + g*t*t/2), so a particle launched with sqrt(2*g*h) peaks at h.
+  inline void move(uint16_t i, int32_t step = PS_ONE) {
+    if (step == PS_ONE) {
+      x[i] += vx[i] + (gravityX >> 1);
+      vx[i] += gravityX;
+      if (y) { y[i] += vy[i] + (gravityY >> 1); vy[i] += gravityY; }
+    } else {
+      int32_t gx = mul(gravityX, step);
+      x[i] += mul(vx[i] + (gx >> 1), step);
+      vx[i] += gx;
+      if (y) {
+        int32_t gy = mul(gravityY, step);
+        y[i] += mul(vy[i] + (gy >> 1), step);
+        vy[i] += gy;
+      }
+    }
+  }
+
+  // physics and aging of all particles, then applies the flags
+  void update(int32_t step = PS_ONE) {
+    int32_t d = (step == PS_ONE) ? drag : mul(drag, step);
+    int32_t* floorPos = y ? y : x;
+    int32_t* floorVel = y ? vy : vx;
+    for (uint16_t i = 0; i < _h->count; ) {
+      if (age[i] < 0xFFFF) age[i]++;
+      if (life[i] && age[i] >= life[i]) { kill(i); continue; }
+
+      move(i, step);
+      if (d) {
+        vx[i] -= mul(vx[i], d);
+        if (y) vy[i] -= mul(vy[i], d);
+      }
+
+      if (floorPos[i] < 0) {
+        if (flags & PS_KILL_BELOW) { kill(i); continue; }
+        if (flags & PS_FLOOR_BOUNCE) {
+          floorPos[i] = -((floorPos[i] >> 8) * bounce);
+          floorVel[i] = -((floorVel[i] >> 8) * bounce);
+        } else if (flags & PS_FLOOR_STOP) {
+          floorPos[i] = 0;
+        }
+      }
+      if ((flags & PS_KILL_OUTSIDE) && (x[i] < 0 || x[i] >= width || (y && (y[i] < 0 || y[i] >= height)))) {
+        kill(i);
+        continue;
+      }
+      i++;
+    }
+  }
+
+  // integer pixel of a position
+  static inline int16_t pixel(int32_t pos) { return pos >> 16; }
+
+  // settings for update(), not stored in the segment data
+  int32_t gravityX = 0, gravityY = 0;   // added to the velocity every step
+  int32_t drag = 0;                     // part of the velocity lost every step, 16.16
+  uint8_t bounce = 128;                 // 1/256 of the velocity kept by PS_FLOOR_BOUNCE
+  uint8_t flags = 0;
+  int32_t width = 0, height = 0;        // for PS_KILL_OUTSIDE, 16.16
+
+  // particle properties, valid for 0..count()-1
+  int32_t  *x = nullptr, *vx = nullptr; // 16.16 pixels, pixels per step
+  int32_t  *y = nullptr, *vy = nullptr; // 2D only
+  uint16_t *age = nullptr;              // steps since spawn
+  uint16_t *life = nullptr;             // steps to live, 0 = forever
+  uint16_t *value = nullptr;            // for the effect, e.g. brightness or heat
+  uint8_t  *tag = nullptr;              // for the effect, e.g. color index or group
+  uint8_t  *extra = nullptr;            // extra bytes of effect data, 32 bit aligned
+
+  private:
+  struct Header {
+    uint16_t count;
+    uint16_t capacity;
+    uint8_t  is2D;
+    uint8_t  reserved[3];               // keeps the arrays 32 bit aligned
+  };
+  Header* _h = nullptr;
+
+  static inline uint16_t bytesPerParticle(bool is2D) {
+    return (is2D ? 4 : 2) * sizeof(int32_t) + 3 * sizeof(uint16_t) + sizeof(uint8_t);
+  }
+
+  static inline uint32_t align4(uint32_t n) { return (n + 3) & ~3u; }
+
+  static inline int32_t mul(int32_t a, int32_t b) { return ((int64_t)a * b) >> 16; }
+};
+
+#endif // WLED_PARTICLES_H
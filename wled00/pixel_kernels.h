@@ -0,0 +1,161 @@
+#ifndef WLED_PIXEL_KERNELS_H
+#define WLED_PIXEL_KERNELS_H
+
+/*
+ * Fade, blend, add and blur on packed WRGB colors (0xWWRRGGBB, as used by setPixelColor()).
+ * All four channels are processed at once in a 32 bit word: the R/B and W/G channels are
+ * split into two words with a 16 bit lane per channel, so a single multiply scales two
+ * channels without them spilling into each other (SWAR). The buffer versions process two
+ * pixels per 64 bit word on hosts with 64 bit registers.
+ * Only depends on the C library, so the kernels can be benchmarked on a host as well
+ * (tools/pixel_bench.cpp).
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+// two pixels per word on 64 bit targets, unless PIXEL_KERNELS_NARROW is defined
+#if !defined(PIXEL_KERNELS_WIDE) && !defined(PIXEL_KERNELS_NARROW) && (UINTPTR_MAX > 0xFFFFFFFFu)
+  #define PIXEL_KERNELS_WIDE
+#endif
+
+namespace pixel_swar {
+  // 0x00FF00FF..., one byte in the low half of every 16 bit lane
+  template <typename T> inline T lanes() { return (T)(~(T)0) / 0xFFFF * 0xFF; }
+  // 0x00010001..., bit 0 of every 16 bit lane
+  template <typename T> inline T ones()  { return (T)(~(T)0) / 0xFFFF; }
+
+  // c * (scale + 1) >> 8 per channel (nscale8() of FastLED)
+  template <typename T> inline T scale(T c, uint8_t scale) {
+    const T M = lanes<T>();
+    uint32_t s = scale + 1;
+    T rb = (((c & M) * s) >> 8) & M;
+    T wg = ((c >> 8) & M) * s & ~M;
+    return rb | wg;
+  }
+
+  // (c1 * (255 - blend) + c2 * blend) >> 8 per channel (color_blend() with 8 bit blend)
+  template <typename T> inline T blend(T c1, T c2, uint8_t blend) {
+    const T M = lanes<T>();
+    uint32_t b = blend, ib = 255 - blend;
+    T rb = (((c1 & M) * ib + (c2 & M) * b) >> 8) & M;
+    T wg = (((c1 >> 8) & M) * ib + ((c2 >> 8) & M) * b) & ~M;
+    return rb | wg;
+  }
+
+  // a + b per channel, saturating at 255
+  template <typename T> inline T add(T a, T b) {
+    const T M = lanes<T>(), L = ones<T>();
+    T rb = (a & M) + (b & M);
+    T wg = ((a >> 8) & M) + ((b >> 8) & M);
+    rb |= ((rb >> 8) & L) * 0xFF;                 // overflow into bit 8 of a lane saturates it
+    wg |= ((wg >> 8) & L) * 0xFF;
+    return (rb & M) | ((wg & M) << 8);
+  }
+
+  // a - b per channel, clamped at 0
+  template <typename T> inline T sub(T a, T b) {
+    const T M = lanes<T>(), L = ones<T>();
+    T rb = ((a & M) | (L << 8)) - (b & M);        // bit 8 of a lane survives if there was no borrow
+    T wg = (((a >> 8) & M) | (L << 8)) - ((b >> 8) & M);
+    rb &= ((rb >> 8) & L) * 0xFF;
+    wg &= ((wg >> 8) & L) * 0xFF;
+    return rb | (wg << 8);
+  }
+
+  // (x * amount + 255) >> 8 per channel, at least 1 for channels that are not 0 if amount > 0
+  template <typename T> inline T scaleUp(T x, uint16_t amount) {
+    const T M = lanes<T>();
+    T rb = (((x & M) * amount + M) >> 8) & M;
+    T wg = (((x >> 8) & M) * amount + M) & ~M;
+    return rb | wg;
+  }
+
+  // moves c by amount/256 of the distance towards target, at least one step per channel
+  template <typename T> inline T fadeToward(T c, T target, uint16_t amount) {
+    T up   = sub<T>(target, c);
+    T down = sub<T>(c, target);                   // per channel only one of the two is not 0
+    return c + scaleUp<T>(up, amount) - scaleUp<T>(down, amount);
+  }
+}
+
+inline uint32_t pixel_scale(uint32_t c, uint8_t scale)                          { return pixel_swar::scale<uint32_t>(c, scale); }
+inline uint32_t pixel_blend(uint32_t c1, uint32_t c2, uint8_t blend)            { return pixel_swar::blend<uint32_t>(c1, c2, blend); }
+inline uint32_t pixel_add(uint32_t a, uint32_t b)                               { return pixel_swar::add<uint32_t>(a, b); }
+inline uint32_t pixel_fade_toward(uint32_t c, uint32_t target, uint16_t amount) { return pixel_swar::fadeToward<uint32_t>(c, target, amount); }
+
+/*
+ * Buffer versions. Buffers hold n packed colors and need no particular alignment.
+ */
+
+#ifdef PIXEL_KERNELS_WIDE
+  #define PIXEL_KERNELS_LOOP(n, px, OP)                                   \
+    uint16_t i = 0;                                                       \
+    for (; i + 1 < n; i += 2) {                                           \
+      uint64_t c; memcpy(&c, px + i, 8);                                  \
+      c = OP(uint64_t, c); memcpy(px + i, &c, 8);                         \
+    }                                                                     \
+    for (; i < n; i++) px[i] = OP(uint32_t, px[i]);
+#else
+  #define PIXEL_KERNELS_LOOP(n, px, OP)                                   \
+    for (uint16_t i = 0; i < n; i++) px[i] = OP(uint32_t, px[i]);
+#endif
+
+// scale all channels by (scale + 1) / 256
+inline void pixels_scale(uint32_t* px, uint16_t n, uint8_t scale) {
+  #define PIXEL_OP(T, c) pixel_swar::scale<T>(c, scale)
+  PIXEL_KERNELS_LOOP(n, px, PIXEL_OP)
+  #undef PIXEL_OP
+}
+
+// blend all pixels with color
+inline void pixels_blend(uint32_t* px, uint16_t n, uint32_t color, uint8_t blend) {
+  const uint64_t color2 = ((uint64_t)color << 32) | color;
+  #define PIXEL_OP(T, c) pixel_swar::blend<T>(c, (T)color2, blend)
+  PIXEL_KERNELS_LOOP(n, px, PIXEL_OP)
+  #undef PIXEL_OP
+}
+
+// add color to all pixels, saturating
+inline void pixels_add(uint32_t* px, uint16_t n, uint32_t color) {
+  const uint64_t color2 = ((uint64_t)color << 32) | color;
+  #define PIXEL_OP(T, c) pixel_swar::add<T>(c, (T)color2)
+  PIXEL_KERNELS_LOOP(n, px, PIXEL_OP)
+  #undef PIXEL_OP
+}
+
+// move all pixels amount/256 of the way towards target (amount 1-256)
+inline void pixels_fade_toward(uint32_t* px, uint16_t n, uint32_t target, uint16_t amount) {
+  const uint64_t target2 = ((uint64_t)target << 32) | target;
+  #define PIXEL_OP(T, c) pixel_swar::fadeToward<T>(c, (T)target2, amount)
+  PIXEL_KERNELS_LOOP(n, px, PIXEL_OP)
+  #undef PIXEL_OP
+}
+
+#undef PIXEL_KERNELS_LOOP
+
+// blur of n pixels that are stride apart, same as blur1d() of FastLED: every pixel keeps
+// 255 - blur_amount and gives blur_amount / 2 to each neighbor
+inline void pixels_blur(uint32_t* px, uint16_t n, uint8_t blur_amount, uint16_t stride = 1) {
+  uint8_t keep = 255 - blur_amount;
+  uint8_t seep = blur_amount >> 1;
+  uint32_t carryover = 0;
+  uint32_t* prev = nullptr;
+  for (uint16_t i = 0; i < n; i++, px += stride) {
+    uint32_t cur = *px;
+    uint32_t part = pixel_scale(cur, seep);
+    cur = pixel_add(pixel_scale(cur, keep), carryover);
+    if (prev) *prev = pixel_add(*prev, part);
+    *px = cur;
+    prev = px;
+    carryover = part;
+  }
+}
+
+// blur of a width x height buffer stored row by row, rows first then columns
+inline void pixels_blur2d(uint32_t* px, uint16_t width, uint16_t height, uint8_t blur_amount) {
+  for (uint16_t y = 0; y < height; y++) pixels_blur(px + (uint32_t)y * width, width, blur_amount);
+  for (uint16_t x = 0; x < width; x++)  pixels_blur(px + x, height, blur_amount, width);
+}
+
+#endif // WLED_PIXEL_KERNELS_H
@@ -2,12 +2,42 @@
 
 /*
  * Handles playlists, timed sequences of presets
+ *
+ * The presets of a loaded playlist are read one per loop and compiled into SegmentValues in RAM
+ * (up to PLAYLIST_COMPILED_SIZE bytes), so a playlist step does not need to read the preset
+ * and parse it into a JSON_BUFFER_SIZE document. Presets with more than on/bri/mainseg and a
+ * segment array (e.g. "win", "nl", nested playlists) are applied from the file as before.
  */
 
+#define PL_PRESET_PENDING  0 //not read yet
+#define PL_PRESET_COMPILED 1 //applied from RAM
+#define PL_PRESET_FILE     2 //applied with applyPreset()
+
+#define CP_BRI     0x01
+#define CP_ON      0x02
+#define CP_MAINSEG 0x04
+
+typedef struct CompiledSegment {
+  uint8_t id;
+  SegmentValues v;
+} CompiledSegment;
+
+typedef struct CompiledPreset {
+  CompiledSegment* seg;  //segCount segments, following this struct
+  uint16_t size;         //bytes allocated
+  uint8_t  segCount;
+  uint8_t  set;          //CP_* bits of the values present
+  uint8_t  bri;
+  bool     on;
+  uint8_t  mainseg;
+} CompiledPreset;
+
 typedef struct PlaylistEntry {
   uint8_t preset; //ID of the preset to apply
+  uint8_t state;  //PL_PRESET_* where the preset is applied from
   uint16_t dur;   //Duration of the entry (in tenths of seconds)
   uint16_t tr;    //Duration of the transition TO this entry (in tenths of seconds)
+  CompiledPreset* compiled; //shared by all entries of the same preset
 } ple;
 
 byte           playlistRepeat = 1;        //how many times to repeat the playlist (0 = infinitely)
@@ -18,6 +48,12 @@ PlaylistEntry *playlistEntries = nullptr;
 byte           playlistLen;               //number of playlist entries
 int8_t         playlistIndex = -1;
 uint16_t       playlistEntryDur = 0;      //duration of the current entry in tenths of seconds
+uint16_t       playlistCompiledSize = 0;  //bytes used by compiled presets
+
+//presets saved or deleted since the last loop, one bit per ID. Set from the web server task, the
+//compiled presets are only freed in handlePlaylist() as the loop may be applying or compiling them.
+static uint32_t    changedPresets[8];
+static WledLock    changedLock;
 
 //values we need to keep about the parent playlist while inside sub-playlist
 //int8_t         parentPlaylistIndex = -1;
@@ -42,8 +78,125 @@ void shufflePlaylist() {
 }
 
 
+//frees the compiled preset of entry i and of all later entries sharing it
+static void freeCompiledPreset(byte i) {
+  CompiledPreset* cp = playlistEntries[i].compiled;
+  if (cp == nullptr) return;
+  for (byte j = i; j < playlistLen; j++) {
+    if (playlistEntries[j].compiled != cp) continue;
+    playlistEntries[j].compiled = nullptr;
+    playlistEntries[j].state = PL_PRESET_PENDING;
+  }
+  playlistCompiledSize -= cp->size;
+  free(cp);
+}
+
+
+//compiles the preset of entry i for all entries using it, or marks it to be applied with applyPreset()
+static void compilePreset(byte i) {
+  byte preset = playlistEntries[i].preset;
+  CompiledPreset* cp = nullptr;
+
+  DynamicJsonDocument doc(JSON_BUFFER_SIZE);
+  if (readPreset(preset, &doc)) {
+    JsonObject root = doc.as<JsonObject>();
+    if (root["ps"] == preset) root.remove("ps");
+
+    bool compilable = root["seg"].is<JsonArray>() && (root["on"].isNull() || root["on"].is<bool>());
+    for (JsonPair kv : root) {
+      const char* key = kv.key().c_str();
+      if (strcmp(key, "n") && strcmp(key, "ql") && strcmp(key, "on") && strcmp(key, "bri") && strcmp(key, "seg")
+          && strcmp_P(key, PSTR("transition")) && strcmp_P(key, PSTR("mainseg"))) compilable = false; //transition is ignored in playlists
+    }
+
+    JsonArray segs = root["seg"];
+    uint16_t size = sizeof(CompiledPreset) + segs.size() * sizeof(CompiledSegment);
+    if (compilable && segs.size() <= strip.getMaxSegments() && playlistCompiledSize + size <= PLAYLIST_COMPILED_SIZE) {
+      cp = (CompiledPreset*) malloc(size);
+    }
+    if (cp != nullptr) {
+      cp->seg = (CompiledSegment*) (cp + 1);
+      cp->size = size;
+      cp->segCount = 0;
+      cp->set = 0;
+      if (root["bri"].is<uint8_t>())     { cp->bri = root["bri"];         cp->set |= CP_BRI; }
+      if (root["on"].is<bool>())         { cp->on = root["on"];           cp->set |= CP_ON; }
+      if (root[F("mainseg")].is<uint8_t>()) { cp->mainseg = root[F("mainseg")]; cp->set |= CP_MAINSEG; }
+      byte it = 0;
+      for (JsonObject elem : segs) {
+        CompiledSegment& cs = cp->seg[cp->segCount++];
+        cs.id = elem["id"] | it;
+        if (!parseSegment(elem, cs.v)) { free(cp); cp = nullptr; break; }
+        it++;
+      }
+    }
+  }
+
+  if (cp != nullptr) playlistCompiledSize += cp->size;
+  for (byte j = 0; j < playlistLen; j++) {
+    if (playlistEntries[j].preset != preset) continue;
+    playlistEntries[j].compiled = cp;
+    playlistEntries[j].state = cp ? PL_PRESET_COMPILED : PL_PRESET_FILE;
+  }
+  DEBUG_PRINTF("Playlist preset %d %s.\n", preset, cp ? "compiled" : "applied from storage");
+}
+
+
+//same as deserializeState() and applyPreset() do for a preset of a running playlist
+static void applyCompiledPreset(byte preset, const CompiledPreset* cp) {
+  strip.applyToAllSelected = false;
+  if (cp->set & CP_BRI) bri = cp->bri;
+  bool on = (cp->set & CP_ON) ? cp->on : (bri > 0);
+  if (!on != !bri) toggleOnOff();
+  strip.setTransition(transitionDelayTemp);
+
+  if (cp->set & CP_MAINSEG) {
+    byte prevMain = strip.getMainSegmentId();
+    strip.mainSegment = cp->mainseg;
+    if (strip.getMainSegmentId() != prevMain) setValuesFromMainSeg();
+  }
+
+  for (byte s = 0; s < cp->segCount; s++) {
+    const CompiledSegment& cs = cp->seg[s];
+    if (cs.id >= strip.getMaxSegments()) continue;
+    applySegment(cs.v, cs.id, preset);
+    strip.getSegment(cs.id).setOption(SEG_OPTION_FREEZE, false);
+  }
+
+  interfaceUpdateCallMode = CALL_MODE_WS_SEND;
+  colorUpdated(CALL_MODE_DIRECT_CHANGE);
+  errorFlag = ERR_NONE;
+  currentPreset = preset;
+}
+
+
+//a preset was saved or deleted, compile it again before its next use
+void playlistPresetChanged(byte index) {
+  WledLockGuard guard(changedLock);
+  changedPresets[index >> 5] |= 1UL << (index & 31);
+}
+
+
+static void freeChangedPresets() {
+  uint32_t changed[8];
+  {
+    WledLockGuard guard(changedLock);
+    memcpy(changed, changedPresets, sizeof(changed));
+    memset(changedPresets, 0, sizeof(changedPresets));
+  }
+  if (playlistEntries == nullptr) return;
+  for (byte i = 0; i < playlistLen; i++) {
+    byte preset = playlistEntries[i].preset;
+    if (!(changed[preset >> 5] & (1UL << (preset & 31)))) continue;
+    freeCompiledPreset(i);
+    playlistEntries[i].state = PL_PRESET_PENDING;
+  }
+}
+
+
 void unloadPlaylist() {
   if (playlistEntries != nullptr) {
+    for (byte i = 0; i < playlistLen; i++) freeCompiledPreset(i);
     delete[] playlistEntries;
     playlistEntries = nullptr;
   }
@@ -68,6 +221,8 @@ int16_t loadPlaylist(JsonObject playlistObj, byte presetId) {
   for (int ps : presets) {
     if (it >= playlistLen) break;
     playlistEntries[it].preset = ps;
+    playlistEntries[it].state = PL_PRESET_PENDING;
+    playlistEntries[it].compiled = nullptr;
     it++;
   }
 
@@ -118,6 +273,7 @@ int16_t loadPlaylist(JsonObject playlistObj, byte presetId) {
 
 
 void handlePlaylist() {
+  freeChangedPresets();
   if (currentPlaylist < 0 || playlistEntries == nullptr) return;
 
   if (millis() - presetCycledTime > (100*playlistEntryDur)) {
@@ -138,9 +294,18 @@ void handlePlaylist() {
       if (playlistOptions & PL_OPTION_SHUFFLE) shufflePlaylist(); // shuffle playlist and start over
     }
 
+    PlaylistEntry& entry = playlistEntries[playlistIndex];
     jsonTransitionOnce = true;
-    transitionDelayTemp = playlistEntries[playlistIndex].tr * 100;
-    playlistEntryDur = playlistEntries[playlistIndex].dur;
-    applyPreset(playlistEntries[playlistIndex].preset);
+    transitionDelayTemp = entry.tr * 100;
+    playlistEntryDur = entry.dur;
+    if (entry.state == PL_PRESET_COMPILED) applyCompiledPreset(entry.preset, entry.compiled);
+    else applyPreset(entry.preset);
+  } else {
+    //compile one preset per loop while waiting for the next step
+    for (byte i = 0; i < playlistLen; i++) {
+      if (playlistEntries[i].state != PL_PRESET_PENDING) continue;
+      compilePreset(i);
+      break;
+    }
   }
 }
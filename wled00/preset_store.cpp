@@ -0,0 +1,454 @@
+#include "wled.h"
+
+/*
+ * Crash safe preset storage
+ *
+ * Presets are kept in /presets.log, a file that is only ever appended to:
+ *   "WPS1", then per record: 'P', id, payload length (16 bit), CRC32 of id, length and payload, payload
+ * The payload is the preset as JSON, or empty if the preset was deleted. The latest record of an id
+ * is the preset, an index in RAM keeps its offset. A power loss during a write at most leaves an
+ * incomplete record at the end of the file, which fails its CRC and is dropped with everything after
+ * it on the next boot, so the worst case is losing the preset that was being saved.
+ * Saving a preset does not append right away but queues the append (see writeback.cpp), so saving the
+ * same preset repeatedly (e.g. the auto save usermod) ends in one record. Until then the preset is read
+ * from RAM.
+ *
+ * Replaced records are removed by compaction in the background, one record per loop: the records
+ * in use are copied to /presets.tmp, which replaces the log once complete.
+ *
+ * /presets.json stays a plain JSON file for the UI and for backups. It is exported from the log after
+ * every change, one preset per loop into /presets.json.tmp, which replaces it once complete. Record 0
+ * holds the size of the last export, a /presets.json of another size was uploaded or edited and is
+ * imported into the log.
+ *
+ * Presets are read and saved by the async web server too, which runs concurrently with the loop on ESP32.
+ * storeLock is held for every access to the log, the index and the pending preset. Each background step
+ * handles one record, so a preset read from the other task waits at most that long.
+ */
+
+#define STORE_LOG       "/presets.log"
+#define STORE_LOG_TMP   "/presets.tmp"
+#define STORE_JSON      "/presets.json"
+#define STORE_JSON_TMP  "/presets.json.tmp"
+#define STORE_MAGIC     "WPS1"
+#define STORE_RECORD    'P'
+#define STORE_IDS       251   //preset ids 1-250, 0 is the size of the last export
+
+#define STORE_BUFSIZE   256
+
+#define STORE_IDLE      0
+#define STORE_COMPACT   1
+#define STORE_EXPORT    2
+
+#define STORE_EXPORT_DELAY   500 //ms without writes before exporting
+#define STORE_CHECK_INTERVAL 2000 //ms between checks for an uploaded /presets.json
+#define STORE_COMPACT_MIN    4096 //bytes of replaced records before compacting
+
+typedef struct StoreRecord {
+  uint8_t  magic;
+  uint8_t  id;
+  uint16_t len;
+  uint32_t crc;
+} StoreRecord;
+
+static uint32_t* storeIndex = nullptr;    //offset of the latest record of every id, 0 = none
+static uint16_t* storeLen = nullptr;      //payload length of these records
+static uint32_t* compactIndex = nullptr;  //storeIndex of the new log during compaction
+static uint32_t  storeSize = 0;           //bytes of valid records in the log (incl. header)
+static uint32_t  exportedSize = 0;        //size of /presets.json when it was last exported or imported
+static bool      storeDirty = false;      //changed since the last export
+static unsigned long storeLastWrite = 0;
+static unsigned long storeLastCheck = 0;
+static byte      storeTask = STORE_IDLE;
+static uint32_t  taskPos = 0;             //compaction: offset in the log, export: next id
+static uint32_t  taskSize = 0;            //compaction: bytes written to the new log
+static File      taskFile;
+static WledLock  storeLock;
+static uint8_t*  pendingPayload = nullptr;  //preset saved but not appended yet
+static uint16_t  pendingLen = 0;
+static byte      pendingId = 0;             //0 = none
+
+static uint32_t recordCrc(uint8_t id, uint16_t len, const uint8_t* payload) {
+  uint32_t crc = crc32Update(0, &id, 1);
+  crc = crc32Update(crc, (const uint8_t*)&len, sizeof(len));
+  return crc32Update(crc, payload, len);
+}
+
+//reads and checks the record at pos, payload must have room for maxLen bytes (or be a nullptr)
+static bool readRecord(File& file, uint32_t pos, StoreRecord& r, uint8_t* payload = nullptr, uint16_t maxLen = 0) {
+  if (!file.seek(pos) || file.read((uint8_t*)&r, sizeof(r)) != sizeof(r)) return false;
+  if (r.magic != STORE_RECORD || r.id >= STORE_IDS || pos + sizeof(r) + r.len > file.size()) return false;
+
+  uint32_t crc = crc32Update(0, &r.id, 1);
+  crc = crc32Update(crc, (const uint8_t*)&r.len, sizeof(r.len));
+  if (payload) {
+    if (r.len > maxLen || file.read(payload, r.len) != r.len) return false;
+    crc = crc32Update(crc, payload, r.len);
+  } else {
+    uint8_t buf[STORE_BUFSIZE];
+    for (uint16_t done = 0; done < r.len; ) {
+      uint16_t block = min(r.len - done, STORE_BUFSIZE);
+      if (file.read(buf, block) != block) return false;
+      crc = crc32Update(crc, buf, block);
+      done += block;
+    }
+  }
+  return crc == r.crc;
+}
+
+static bool appendRecord(File& file, uint8_t id, const uint8_t* payload, uint16_t len) {
+  StoreRecord r = {STORE_RECORD, id, len, recordCrc(id, len, payload)};
+  if (file.write((const uint8_t*)&r, sizeof(r)) != sizeof(r)) return false;
+  return !len || file.write(payload, len) == len;
+}
+
+//record of id at pos is the latest, len 0 deletes the preset
+static void indexRecord(uint8_t id, uint32_t pos, uint16_t len) {
+  storeIndex[id] = (len || !id) ? pos : 0;
+  storeLen[id] = len;
+}
+
+//bytes of the records in use
+static uint32_t liveSize() {
+  uint32_t live = sizeof(STORE_MAGIC) -1;
+  for (uint16_t id = 0; id < STORE_IDS; id++) if (storeIndex[id]) live += sizeof(StoreRecord) + storeLen[id];
+  return live;
+}
+
+//size of /presets.json exported from the log
+static uint32_t exportSize() {
+  uint32_t size = 8; //{"0":{}}
+  for (uint16_t id = 1; id < STORE_IDS; id++) {
+    if (storeIndex[id]) size += storeLen[id] + ((id < 10) ? 5 : (id < 100) ? 6 : 7); //,"<id>":
+  }
+  return size;
+}
+
+//replaces file with the complete tmp
+static bool replaceFile(const char* file, const char* tmp) {
+  WLED_FS.remove(file);
+  return WLED_FS.rename(tmp, file);
+}
+
+//builds the index from the log, returns false if there is no log. Sets torn if the log ends in an incomplete record.
+static bool scanLog(bool& torn) {
+  File log = WLED_FS.open(STORE_LOG, "r");
+  if (!log) return false;
+  char magic[4];
+  if (log.read((uint8_t*)magic, 4) != 4 || memcmp(magic, STORE_MAGIC, 4)) {
+    log.close();
+    return false;
+  }
+
+  memset(storeIndex, 0, STORE_IDS * sizeof(uint32_t));
+  memset(storeLen, 0, STORE_IDS * sizeof(uint16_t));
+  uint32_t pos = 4, lastChange = 0;
+  StoreRecord r;
+  while (pos < log.size() && readRecord(log, pos, r)) {
+    indexRecord(r.id, pos, r.len);
+    if (r.id) lastChange = pos;
+    pos += sizeof(r) + r.len;
+  }
+  storeSize = pos;
+  torn = (pos < log.size());
+
+  exportedSize = 0;
+  if (storeIndex[0] && storeLen[0] == sizeof(exportedSize)) {
+    if (!readRecord(log, storeIndex[0], r, (uint8_t*)&exportedSize, sizeof(exportedSize))) exportedSize = 0;
+  }
+  if (lastChange > storeIndex[0]) storeDirty = true; //written after the last export, e.g. power loss before it
+  log.close();
+  DEBUGFS_PRINTF("Preset log %d bytes, %d in use%s\n", storeSize, liveSize(), torn ? ", torn" : "");
+  return true;
+}
+
+//appends the size of the export to the log
+static void writeExportSize(uint32_t size) {
+  File log = WLED_FS.open(STORE_LOG, "a");
+  if (!log) return;
+  if (log.size() == storeSize && appendRecord(log, 0, (const uint8_t*)&size, sizeof(size))) {
+    indexRecord(0, storeSize, sizeof(size));
+    storeSize += sizeof(StoreRecord) + sizeof(size);
+    exportedSize = size;
+  }
+  log.close();
+}
+
+//new /presets.json, the UI reloads it when presetsModifiedTime changes
+static void presetsChanged() {
+  unsigned long now = toki.second(); //unix time
+  presetsModifiedTime = (now != presetsModifiedTime) ? now : now +1;
+  if (!interfaceUpdateCallMode) interfaceUpdateCallMode = CALL_MODE_WS_SEND;
+}
+
+//replaces the log with the presets of /presets.json
+static void importPresets() {
+  DEBUGFS_PRINTLN(F("Import presets.json"));
+  File json = WLED_FS.open(STORE_JSON, "r");
+  uint32_t jsonSize = json ? json.size() : 0;
+  if (json) json.close();
+
+  File tmp = WLED_FS.open(STORE_LOG_TMP, "w");
+  if (!tmp) {
+    errorFlag = ERR_FS_GENERAL;
+    return;
+  }
+  tmp.print(F(STORE_MAGIC));
+  bool ok = true;
+  if (jsonSize) {
+    DynamicJsonDocument doc(JSON_BUFFER_SIZE);
+    for (uint16_t id = 1; id < STORE_IDS && ok; id++) {
+      if (!readObjectFromFileUsingId(STORE_JSON, id, &doc) || doc.isNull()) continue;
+      uint16_t len = measureJson(doc);
+      uint8_t* payload = (uint8_t*) malloc(len +1);
+      if (!payload) { ok = false; break; }
+      serializeJson(doc, (char*)payload, len +1);
+      ok = appendRecord(tmp, id, payload, len);
+      free(payload);
+    }
+  }
+  ok = ok && appendRecord(tmp, 0, (const uint8_t*)&jsonSize, sizeof(jsonSize));
+  tmp.close();
+
+  bool torn = false;
+  if (!ok || !replaceFile(STORE_LOG, STORE_LOG_TMP) || !scanLog(torn)) {
+    WLED_FS.remove(STORE_LOG_TMP);
+    errorFlag = ERR_FS_GENERAL;
+    return;
+  }
+  for (uint16_t id = 1; id < STORE_IDS; id++) playlistPresetChanged(id);
+  storeDirty = (exportSize() != exportedSize); //rewrite an edited file in the exported format
+  storeLastWrite = millis();
+  presetsChanged();
+}
+
+//copies one record to the new log per call, replaces the log when done
+static void compactStep() {
+  if (!taskFile) {
+    DEBUGFS_PRINTLN(F("Compact preset log"));
+    if (!compactIndex) compactIndex = (uint32_t*) malloc(STORE_IDS * sizeof(uint32_t));
+    taskFile = WLED_FS.open(STORE_LOG_TMP, "w");
+    if (!compactIndex || !taskFile) { storeTask = STORE_IDLE; return; }
+    memset(compactIndex, 0, STORE_IDS * sizeof(uint32_t));
+    taskFile.print(F(STORE_MAGIC));
+    taskPos = taskSize = 4;
+    return;
+  }
+
+  if (taskPos < storeSize) {
+    File log = WLED_FS.open(STORE_LOG, "r");
+    StoreRecord r;
+    uint8_t* payload = nullptr;
+    bool ok = log && log.seek(taskPos) && log.read((uint8_t*)&r, sizeof(r)) == sizeof(r);
+    if (ok) {
+      payload = (uint8_t*) malloc(r.len ? r.len : 1);
+      ok = payload && readRecord(log, taskPos, r, payload, r.len);
+    }
+    if (log) log.close();
+    if (ok) {
+      //the latest record of its id, or the deletion of a preset already copied
+      bool keep = (storeIndex[r.id] == taskPos) || (!r.len && !storeIndex[r.id] && compactIndex[r.id]);
+      if (keep) {
+        ok = appendRecord(taskFile, r.id, payload, r.len);
+        compactIndex[r.id] = r.len || !r.id ? taskSize : 0;
+        taskSize += sizeof(r) + r.len;
+      }
+      taskPos += sizeof(r) + r.len;
+    }
+    free(payload);
+    if (!ok) { //leave the log as it is
+      taskFile.close();
+      WLED_FS.remove(STORE_LOG_TMP);
+      storeTask = STORE_IDLE;
+      errorFlag = ERR_FS_GENERAL;
+    }
+    return;
+  }
+
+  taskFile.close();
+  storeTask = STORE_IDLE;
+  if (!replaceFile(STORE_LOG, STORE_LOG_TMP)) {
+    errorFlag = ERR_FS_GENERAL;
+    return;
+  }
+  memcpy(storeIndex, compactIndex, STORE_IDS * sizeof(uint32_t));
+  storeSize = taskSize;
+  countWrite(STORE_LOG, taskSize);
+  free(compactIndex);
+  compactIndex = nullptr;
+  DEBUGFS_PRINTF("Compacted to %d bytes\n", storeSize);
+}
+
+//writes one preset to the export per call, replaces /presets.json when done
+static void exportStep() {
+  if (!taskFile) {
+    DEBUGFS_PRINTLN(F("Export presets.json"));
+    taskFile = WLED_FS.open(STORE_JSON_TMP, "w");
+    if (!taskFile) { storeTask = STORE_IDLE; return; }
+    taskFile.print(F("{\"0\":{}"));
+    taskPos = 1;
+    storeDirty = false; //writes from now on need another export
+    return;
+  }
+
+  while (taskPos < STORE_IDS && !storeIndex[taskPos]) taskPos++;
+  if (taskPos < STORE_IDS) {
+    File log = WLED_FS.open(STORE_LOG, "r");
+    StoreRecord r;
+    uint16_t len = storeLen[taskPos];
+    uint8_t* payload = (uint8_t*) malloc(len ? len : 1);
+    bool ok = log && payload && readRecord(log, storeIndex[taskPos], r, payload, len) && r.id == taskPos;
+    if (log) log.close();
+    if (ok) {
+      taskFile.printf(",\"%u\":", taskPos);
+      ok = taskFile.write(payload, r.len) == r.len;
+    }
+    free(payload);
+    taskPos++;
+    if (!ok) {
+      taskFile.close();
+      WLED_FS.remove(STORE_JSON_TMP);
+      storeTask = STORE_IDLE;
+      storeDirty = true;
+      errorFlag = ERR_FS_GENERAL;
+    }
+    return;
+  }
+
+  taskFile.print('}');
+  uint32_t size = taskFile.size();
+  taskFile.close();
+  storeTask = STORE_IDLE;
+  if (!replaceFile(STORE_JSON, STORE_JSON_TMP)) {
+    storeDirty = true;
+    errorFlag = ERR_FS_GENERAL;
+    return;
+  }
+  countWrite(STORE_JSON, size);
+  writeExportSize(size);
+  presetsChanged();
+  DEBUGFS_PRINTF("Exported %d bytes\n", size);
+}
+
+void initPresetStore() {
+  storeIndex = (uint32_t*) malloc(STORE_IDS * sizeof(uint32_t));
+  storeLen = (uint16_t*) malloc(STORE_IDS * sizeof(uint16_t));
+  if (!storeIndex || !storeLen) {
+    free(storeIndex); free(storeLen);
+    storeIndex = nullptr; storeLen = nullptr;
+    return;
+  }
+
+  //a compaction that was complete but not renamed yet, else an incomplete one
+  if (!WLED_FS.exists(STORE_LOG) && WLED_FS.exists(STORE_LOG_TMP)) WLED_FS.rename(STORE_LOG_TMP, STORE_LOG);
+  WLED_FS.remove(STORE_LOG_TMP);
+  WLED_FS.remove(STORE_JSON_TMP);
+
+  bool torn = false;
+  if (!scanLog(torn)) {
+    importPresets(); //first boot with the preset log
+    return;
+  }
+  if (torn) { //drop the incomplete record before anything is appended after it
+    storeTask = STORE_COMPACT;
+    while (storeTask == STORE_COMPACT) compactStep();
+  }
+}
+
+bool readPreset(byte index, JsonDocument* dest) {
+  dest->clear();
+  if (!storeIndex || !index || index >= STORE_IDS) return false;
+  WledLockGuard guard(storeLock);
+  if (index == pendingId) return pendingLen && !deserializeJson(*dest, (const char*)pendingPayload, pendingLen);
+  if (!storeIndex[index]) return false;
+
+  uint16_t len = storeLen[index];
+  uint8_t* payload = (uint8_t*) malloc(len);
+  if (!payload) return false;
+  File log = WLED_FS.open(STORE_LOG, "r");
+  StoreRecord r;
+  bool ok = log && readRecord(log, storeIndex[index], r, payload, len) && r.id == index;
+  if (log) log.close();
+  if (ok) ok = !deserializeJson(*dest, (const char*)payload, r.len); //const, so the document copies the strings
+  free(payload);
+  return ok;
+}
+
+//appends the pending preset to the log
+static void appendPending(uint16_t) {
+  WledLockGuard guard(storeLock);
+  byte index = pendingId;
+  uint8_t* payload = pendingPayload;
+  uint16_t len = pendingLen;
+  pendingId = 0;
+  pendingPayload = nullptr;
+  if (!index) return;
+
+  File log = WLED_FS.open(STORE_LOG, "a");
+  bool ok = log && log.size() == storeSize && appendRecord(log, index, payload, len);
+  if (log) log.close();
+  if (ok) {
+    indexRecord(index, storeSize, len);
+    storeSize += sizeof(StoreRecord) + len;
+    storeDirty = true;
+    storeLastWrite = millis();
+    countWrite(STORE_LOG, sizeof(StoreRecord) + len);
+  } else {
+    storeTask = STORE_COMPACT; //drops anything after the last valid record
+    errorFlag = ERR_FS_GENERAL;
+  }
+  free(payload);
+}
+
+//saves the preset, or deletes it if content is null
+bool writePreset(byte index, JsonDocument* content) {
+  if (!storeIndex || !index || index >= STORE_IDS) return false;
+  uint16_t len = content->isNull() ? 0 : measureJson(*content);
+  uint8_t* payload = (uint8_t*) malloc(len +1);
+  if (!payload) return false;
+  if (len) serializeJson(*content, (char*)payload, len +1);
+
+  {
+    WledLockGuard guard(storeLock);
+    if (!len && !storeIndex[index] && index != pendingId) { //nothing to delete
+      free(payload);
+      return true;
+    }
+    updateFSInfo();
+    if (fsBytesUsed + liveSize() + len + 4096 > fsBytesTotal) { //keep room to compact
+      free(payload);
+      errorFlag = ERR_FS_QUOTA;
+      return false;
+    }
+    if (pendingId && pendingId != index) appendPending(0); //another preset is waiting, write it first
+    free(pendingPayload);
+    pendingPayload = payload;
+    pendingLen = len;
+    pendingId = index;
+  }
+  queueWrite(appendPending);
+  return true;
+}
+
+//compaction, export and the check for an uploaded /presets.json, one step per loop when the LEDs have time
+void handlePresetStore() {
+  if (!storeIndex || !writeSlack()) return;
+  WledLockGuard guard(storeLock);
+
+  if (storeTask == STORE_COMPACT) { compactStep(); return; }
+  if (storeTask == STORE_EXPORT)  { exportStep();  return; }
+
+  if (millis() - storeLastCheck > STORE_CHECK_INTERVAL || (storeDirty && millis() - storeLastWrite > STORE_EXPORT_DELAY)) {
+    storeLastCheck = millis();
+    if (storeSize > 2 * liveSize() + STORE_COMPACT_MIN) {
+      storeTask = STORE_COMPACT;
+      return;
+    }
+    File json = WLED_FS.open(STORE_JSON, "r");
+    uint32_t size = json ? json.size() : 0;
+    if (json) json.close();
+    if (size && size != exportedSize) { importPresets(); return; } //uploaded or edited
+    if (!size) storeDirty = true;
+  }
+  if (storeDirty && millis() - storeLastWrite > STORE_EXPORT_DELAY) storeTask = STORE_EXPORT;
+}
@@ -8,7 +8,7 @@ bool applyPreset(byte index, byte callMode)
 {
   if (index == 0) return false;
   if (fileDoc) {
-    errorFlag = readObjectFromFileUsingId("/presets.json", index, fileDoc) ? ERR_NONE : ERR_FS_PLOAD;
+    errorFlag = readPreset(index, fileDoc) ? ERR_NONE : ERR_FS_PLOAD;
     JsonObject fdo = fileDoc->as<JsonObject>();
     if (fdo["ps"] == index) fdo.remove("ps"); //remove load request for same presets to prevent recursive crash
     #ifdef WLED_DEBUG_FS
@@ -18,7 +18,7 @@ bool applyPreset(byte index, byte callMode)
   } else {
     DEBUGFS_PRINTLN(F("Make read buf"));
     DynamicJsonDocument fDoc(JSON_BUFFER_SIZE);
-    errorFlag = readObjectFromFileUsingId("/presets.json", index, &fDoc) ? ERR_NONE : ERR_FS_PLOAD;
+    errorFlag = readPreset(index, &fDoc) ? ERR_NONE : ERR_FS_PLOAD;
     JsonObject fdo = fDoc.as<JsonObject>();
     if (fdo["ps"] == index) fdo.remove("ps");
     #ifdef WLED_DEBUG_FS
@@ -50,7 +50,7 @@ void savePreset(byte index, bool persist, const char* pname, JsonObject saveobj)
     serializeState(sObj, true);
     currentPreset = index;
 
-    writeObjectToFileUsingId("/presets.json", index, &lDoc);
+    writePreset(index, &lDoc);
   } else { //from JSON API
     DEBUGFS_PRINTLN(F("Reuse recv buffer"));
     sObj.remove(F("psave"));
@@ -67,15 +67,15 @@ void savePreset(byte index, bool persist, const char* pname, JsonObject saveobj)
     sObj.remove(F("error"));
     sObj.remove(F("time"));
 
-    writeObjectToFileUsingId("/presets.json", index, fileDoc);
+    writePreset(index, fileDoc);
   }
-  presetsModifiedTime = toki.second(); //unix time
+  playlistPresetChanged(index); //presetsModifiedTime is updated once /presets.json is exported
   updateFSInfo();
 }
 
 void deletePreset(byte index) {
   StaticJsonDocument<24> empty;
-  writeObjectToFileUsingId("/presets.json", index, &empty);
-  presetsModifiedTime = toki.second(); //unix time
+  writePreset(index, &empty);
+  playlistPresetChanged(index); //presetsModifiedTime is updated once /presets.json is exported
   updateFSInfo();
 }
\ No newline at end of file
@@ -389,6 +389,7 @@ void handleSettingsSet(AsyncWebServerRequest *request, byte subPage)
     if (request->hasArg(F("RS"))) //complete factory reset
     {
       WLED_FS.format();
+      flushWrites(false); //nothing queued may recreate the settings
       clearEEPROM();
       serveMessage(request, 200, F("All Settings erased."), F("Connect to WLED-AP to setup again"),255);
       doReboot = true;
@@ -573,7 +574,11 @@ void handleSettingsSet(AsyncWebServerRequest *request, byte subPage)
     }
   }
 
-  if (subPage != 2 && (subPage != 6 || !doReboot)) serializeConfig(); //do not save if factory reset or LED settings (which are saved after LED re-init)
+  //settings sections written by each page, the others are copied from cfg.json
+  const uint16_t pageSections[] = {CFG_ALL, CFG_ID | CFG_NW, CFG_HW | CFG_LIGHT, CFG_ID, CFG_ID | CFG_HW | CFG_IF | CFG_SND,
+                                   CFG_HW | CFG_LIGHT | CFG_IF | CFG_TIME, CFG_OTA, CFG_DMX, CFG_UM, CFG_HW | CFG_SND};
+  uint16_t sections = (subPage < sizeof(pageSections) / sizeof(pageSections[0])) ? pageSections[subPage] : CFG_ALL;
+  if (subPage != 2 && (subPage != 6 || !doReboot)) serializeConfig(sections); //do not save if factory reset or LED settings (which are saved after LED re-init)
   if (subPage == 4) alexaInit();
 }
 
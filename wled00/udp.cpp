@@ -180,34 +180,39 @@ void handleNotifications()
   if (isSupp) len = notifier2Udp.read(udpIn, packetSize);
   else        len =  notifierUdp.read(udpIn, packetSize);
 
+  // WLED nodes info request, answer directly to the asking node
+  if (isSupp && len >= 2 && udpIn[0] == 255 && udpIn[1] == 2) {
+    if (nodeBroadcastEnabled) sendSysInfoUDP(notifier2Udp.remoteIP());
+    return;
+  }
+
   // WLED nodes info notifications
   if (isSupp && udpIn[0] == 255 && udpIn[1] == 1 && len >= 40) {
     if (!nodeListEnabled || notifier2Udp.remoteIP() == Network.localIP()) return;
 
-    uint8_t unit = udpIn[39];
-    NodesMap::iterator it = Nodes.find(unit);
-    if (it == Nodes.end() && Nodes.size() < WLED_MAX_NODES) { // Create a new element when not present
-      Nodes[unit].age = 0;
-      it = Nodes.find(unit);
-    }
-
-    if (it != Nodes.end()) {
-      for (byte x = 0; x < 4; x++) {
-        it->second.ip[x] = udpIn[x + 2];
-      }
-      it->second.age = 0; // reset 'age counter'
-      char tmpNodeName[33] = { 0 };
-      memcpy(&tmpNodeName[0], reinterpret_cast<byte *>(&udpIn[6]), 32);
-      tmpNodeName[32]     = 0;
-      it->second.nodeName = tmpNodeName;
-      it->second.nodeName.trim();
-      it->second.nodeType = udpIn[38];
-      uint32_t build = 0;
-      if (len >= 44)
-        for (byte i=0; i<sizeof(uint32_t); i++)
-          build |= udpIn[40+i]<<(8*i);
-      it->second.build = build;
+    IPAddress ip(udpIn[2], udpIn[3], udpIn[4], udpIn[5]);
+    WledLockGuard guard(Nodes.getLock()); //the settings page may clear the table
+    NodeStruct* node = Nodes.add(uint32_t(ip), (len >= 50) ? &udpIn[44] : nullptr);
+    if (node == nullptr) return; // table full
+
+    node->lastSeen = millis();
+    char tmpNodeName[33] = { 0 };
+    memcpy(&tmpNodeName[0], reinterpret_cast<byte *>(&udpIn[6]), 32);
+    String name = tmpNodeName;
+    name.trim();
+    uint32_t build = 0;
+    if (len >= 44)
+      for (byte i=0; i<sizeof(uint32_t); i++)
+        build |= udpIn[40+i]<<(8*i);
+
+    if (strcmp(node->nodeName, name.c_str()) != 0 || node->nodeType != udpIn[38] || node->build != build) {
+      strlcpy(node->nodeName, name.c_str(), sizeof(node->nodeName));
+      node->nodeType = udpIn[38];
+      node->build = build;
+      Nodes.modified();
     }
+    node->unit = udpIn[39];
+    if (len >= 50) memcpy(node->mac, &udpIn[44], 6);
     return;
   }
 
@@ -404,6 +409,10 @@ void handleNotifications()
   }
 
   // API over UDP
+  if (udpIn[0] == BIN_API_MAGIC) {
+    handleBinApi(udpIn, packetSize);
+    return;
+  }
   udpIn[packetSize] = '\0';
 
   if (udpIn[0] >= 'A' && udpIn[0] <= 'Z') { //HTTP API
@@ -434,31 +443,42 @@ void setRealtimePixel(uint16_t i, byte r, byte g, byte b, byte w)
 }
 
 /*********************************************************************************************\
-   Refresh aging for remote units, drop if too old...
+   Expire remote units not heard from within the TTL, optionally ask stale ones directly
 \*********************************************************************************************/
 void refreshNodeList()
 {
-  for (NodesMap::iterator it = Nodes.begin(); it != Nodes.end();) {
-    bool mustRemove = true;
-
-    if (it->second.ip[0] != 0) {
-      if (it->second.age < 10) {
-        it->second.age++;
-        mustRemove = false;
-        ++it;
-      }
-    }
-
-    if (mustRemove) {
-      it = Nodes.erase(it);
-    }
+  uint32_t ttl = nodeListTtl * 1000UL;
+  Nodes.expire(ttl);
+
+  if (!nodeUnicastRefresh || !udp2Connected) return;
+
+  // nodes that have been silent for half their TTL get a unicast info request,
+  // a few per run so a large table does not stall the loop
+  static uint16_t cursor = 0;
+  uint16_t sent = 0;
+  uint32_t now = millis();
+  for (uint16_t n = 0; n < Nodes.size() && sent < NODE_REFRESH_BATCH; n++) {
+    Nodes.getLock().lock();
+    if (cursor >= Nodes.size()) cursor = 0;
+    NodeStruct* node = Nodes.get(cursor++);
+    bool stale = node && now - node->lastSeen >= ttl/2;
+    uint32_t nodeIp = node ? node->ip : 0;
+    Nodes.getLock().unlock();
+    if (!stale) continue;
+
+    uint8_t data[2] = {255, 2};
+    notifier2Udp.beginPacket(IPAddress(nodeIp), udpPort2);
+    notifier2Udp.write(data, sizeof(data));
+    notifier2Udp.endPacket();
+    sent++;
   }
 }
 
 /*********************************************************************************************\
    Broadcast system info to other nodes. (to update node lists)
+   If a destination is given, the info is sent to that node only (answer to an info request)
 \*********************************************************************************************/
-void sendSysInfoUDP()
+void sendSysInfoUDP(IPAddress dest)
 {
   if (!udp2Connected) return;
 
@@ -472,10 +492,11 @@ void sendSysInfoUDP()
   // 38: 1 byte node type id
   // 39: 1 byte node id
   // 40: 4 byte version ID
-  // 44 bytes total
+  // 44: 6 byte MAC address (used to deduplicate nodes that changed IP)
+  // 50 bytes total
 
   // send my info to the world...
-  uint8_t data[44] = {0};
+  uint8_t data[50] = {0};
   data[0] = 255;
   data[1] = 1;
   
@@ -496,8 +517,10 @@ void sendSysInfoUDP()
   for (byte i=0; i<sizeof(uint32_t); i++)
     data[40+i] = (build>>(8*i)) & 0xFF;
 
-  IPAddress broadcastIP(255, 255, 255, 255);
-  notifier2Udp.beginPacket(broadcastIP, udpPort2);
+  WiFi.macAddress(data + 44);
+
+  if (dest[0] == 0) dest = IPAddress(255, 255, 255, 255);
+  notifier2Udp.beginPacket(dest, udpPort2);
   notifier2Udp.write(data, sizeof(data));
   notifier2Udp.endPacket();
 }
@@ -55,13 +55,14 @@ void userSetup() {
 // Test to see if we have a digital microphone installed or not.
 float mean = 0.0;
 int32_t samples[BLOCK_SIZE];
-// TODO: I2S_READ_BYTES DEPRECATED, FIND ALTERNATE SOLUTION
-int num_bytes_read = i2s_read_bytes(I2S_PORT,
-                                    (char *)samples,
-                                    BLOCK_SIZE,     // the doc says bytes, but its elements.
-                                    portMAX_DELAY); // no timeout
-
-int samples_read = num_bytes_read / 8;
+size_t num_bytes_read = 0;
+i2s_read(I2S_PORT,
+         (void *)samples,
+         sizeof(samples),
+         &num_bytes_read,
+         portMAX_DELAY);    // no timeout
+
+int samples_read = num_bytes_read / sizeof(int32_t);
 if (samples_read > 0) {
   for (int i = 0; i < samples_read; ++i) {
     mean += samples[i];
@@ -100,6 +101,7 @@ void userLoop() {
 
   if (!(audioSyncEnabled & (1 << 1))) { // Only run the sampling code IF we're not in Receive mode
     lastTime = millis();
+    updateAudioFrame();                 // Pick up the newest FFT results
     getSample();                        // Sample the microphone
     agcAvg();                           // Calculated the PI adjusted value as sampleAvg
     myVals[millis()%32] = sampleAgc;
@@ -117,49 +119,9 @@ void userLoop() {
   // Begin UDP Microphone Sync
   if (audioSyncEnabled & (1 << 1)) {    // Only run the audio listener code if we're in Receive mode
     if (millis()-lastTime > delayMs) {
-      if (udpSyncConnected) {
-        //Serial.println("Checking for UDP Microphone Packet");
-        int packetSize = fftUdp.parsePacket();
-        if (packetSize) {
-          // Serial.println("Received UDP Sync Packet");
-          uint8_t fftBuff[packetSize];
-          fftUdp.read(fftBuff, packetSize);
-          audioSyncPacket receivedPacket;
-          memcpy(&receivedPacket, fftBuff, packetSize);
-          for (int i = 0; i < 32; i++ ){
-            myVals[i] = receivedPacket.myVals[i];
-          }
-          sampleAgc = receivedPacket.sampleAgc;
-          sample = receivedPacket.sample;
-          sampleAvg = receivedPacket.sampleAvg;
-          // VERIFY THAT THIS IS A COMPATIBLE PACKET
-          char packetHeader[6];
-          memcpy(&receivedPacket, packetHeader, 6);
-          if (!(isValidUdpSyncVersion(packetHeader))) {
-            memcpy(&receivedPacket, fftBuff, packetSize);
-            for (int i = 0; i < 32; i++ ){
-              myVals[i] = receivedPacket.myVals[i];
-            }
-            sampleAgc = receivedPacket.sampleAgc;
-            sample = receivedPacket.sample;
-            sampleAvg = receivedPacket.sampleAvg;
-
-            // Only change samplePeak IF it's currently false.
-            // If it's true already, then the animation still needs to respond.
-            if (!samplePeak) {
-              samplePeak = receivedPacket.samplePeak;
-            }
-            //These values are only available on the ESP32
-            for (int i = 0; i < 16; i++) {
-              fftResult[i] = receivedPacket.fftResult[i];
-            }
-
-            FFT_Magnitude = receivedPacket.FFT_Magnitude;
-            FFT_MajorPeak = receivedPacket.FFT_MajorPeak;
-            //Serial.println("Finished parsing UDP Sync Packet");
-          }
-        }
-      }
+      receiveAudioData();
     }
   }
+
+  updateBeatPhase();
 } // userLoop()
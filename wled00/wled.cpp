@@ -29,6 +29,7 @@ void WLED::reset()
   }
   setAllLeds();
   DEBUG_PRINTLN(F("MODULE RESET"));
+  flushWrites();
   ESP.restart();
 }
 
@@ -136,11 +137,17 @@ void WLED::loop()
 
   if (doReboot)
     reset();
+  if (loadLedmap >= 0) {
+    strip.deserializeMap(loadLedmap);
+    loadLedmap = -1;
+  }
   if (doCloseFile) {
     closeFile();
     yield();
   }
 
+  handleBatch();
+
   if (!realtimeMode || realtimeOverride)  // block stuff if WARLS/Adalight is enabled
   {
     if (apActive)
@@ -151,6 +158,7 @@ void WLED::loop()
 #endif
     handleNightlight();
     handlePlaylist();
+    handleRender();
     yield();
 
     handleHue();
@@ -165,6 +173,9 @@ void WLED::loop()
       delay(1); //required to make sure ESP enters modem sleep (see #1184)
 #endif
   }
+  handleWriteBack(); //right after a frame was shown
+  handlePresetStore();
+  handleJsonPool();
   yield();
 #ifdef ESP8266
   MDNS.update();
@@ -179,12 +190,16 @@ void WLED::loop()
     lastMqttReconnectAttempt = millis();
     initMqtt();
     yield();
-    // refresh WLED nodes list
-    refreshNodeList();
     if (nodeBroadcastEnabled) sendSysInfoUDP();
     yield();
   }
 
+  // expire and refresh WLED nodes list
+  if (nodeListEnabled && millis() - lastNodeListRefresh > NODE_REFRESH_INTERVAL) {
+    lastNodeListRefresh = millis();
+    refreshNodeList();
+  }
+
   //LED settings have been saved, re-init busses
   //This code block causes severe FPS drop on ESP32 with the original "if (busConfigs[0] != nullptr)" conditional. Investigate!
   if (doInitBusses) {
@@ -210,7 +225,7 @@ void WLED::loop()
     }
     strip.finalizeInit(ledCount);
     yield();
-    serializeConfig();
+    serializeConfig(CFG_HW | CFG_LIGHT); //the LED settings page also sets brightness, transition and nightlight defaults
   }
 
   yield();
@@ -303,7 +318,10 @@ void WLED::setup()
   if (!fsinit) {
     DEBUGFS_PRINTLN(F("FS failed!"));
     errorFlag = ERR_FS_BEGIN;
-  } else deEEP();
+  } else {
+    deEEP();
+    initPresetStore();
+  }
   updateFSInfo();
 
   DEBUG_PRINTLN(F("Reading config"));
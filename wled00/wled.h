@@ -304,6 +304,9 @@ WLED_GLOBAL byte briS     _INIT(128);                     // default brightness
 
 WLED_GLOBAL byte soundSquelch   _INIT(10);          // default squelch value for volume reactive routines
 WLED_GLOBAL byte sampleGain     _INIT(1);           // default sample gain
+WLED_GLOBAL byte soundBands     _INIT(0);           // number of logarithmic bands in fftBandResult[] (8-64, 0 = off, effects use the 16 fftResult[] bands)
+WLED_GLOBAL uint16_t soundBandsMinFreq _INIT(60);   // Hz, lower edge of the first band
+WLED_GLOBAL uint16_t soundBandsMaxFreq _INIT(5120); // Hz, upper edge of the last band
 WLED_GLOBAL uint16_t noiseFloor _INIT(100);         // default squelch value for FFT reactive routines
 WLED_GLOBAL bool digitalMic     _INIT(false);       // do we have a digital microphone or not
 
@@ -320,9 +323,11 @@ WLED_GLOBAL char serverDescription[33] _INIT("WLED-SoundReactive");  // Name of
 WLED_GLOBAL bool syncToggleReceive     _INIT(false);   // UIs which only have a single button for sync should toggle send+receive if this is true, only send otherwise
 
 // Sync CONFIG
-WLED_GLOBAL NodesMap Nodes;
+WLED_GLOBAL NodeList Nodes;
 WLED_GLOBAL bool nodeListEnabled _INIT(false);
 WLED_GLOBAL bool nodeBroadcastEnabled _INIT(false);
+WLED_GLOBAL bool nodeUnicastRefresh _INIT(false);   // ask known nodes directly for their info before they expire
+WLED_GLOBAL uint16_t nodeListTtl _INIT(300);        // seconds after which a silent node is dropped from the list
 
 WLED_GLOBAL byte buttonType[WLED_MAX_BUTTONS]  _INIT({BTN_TYPE_PUSH});
 WLED_GLOBAL byte irEnabled      _INIT(0);     // Infrared receiver
@@ -377,6 +382,9 @@ WLED_GLOBAL char mqttUser[41] _INIT("");                   // optional: username
 WLED_GLOBAL char mqttPass[65] _INIT("");                   // optional: password for MQTT auth
 WLED_GLOBAL char mqttClientID[41] _INIT("");               // override the client ID
 WLED_GLOBAL uint16_t mqttPort _INIT(1883);
+WLED_GLOBAL uint16_t mqttPublishInterval _INIT(250);   // minimum ms between two state publishes, changes in between are coalesced
+WLED_GLOBAL bool mqttPublishXml _INIT(true);           // publish the XML API response to <device>/v
+WLED_GLOBAL bool mqttPublishJson _INIT(false);         // publish compact JSON state to <device>/state and <device>/seg/<id>
 
 #ifndef WLED_DISABLE_HUESYNC
 WLED_GLOBAL bool huePollingEnabled _INIT(false);           // poll hue bridge for light state
@@ -505,9 +513,12 @@ WLED_GLOBAL bool effectChanged _INIT(false);
 //  0th bit - transmit enabled/disabled. 1st bit - receive enabled/disabled
 WLED_GLOBAL byte audioSyncEnabled _INIT(0);
 WLED_GLOBAL uint16_t audioSyncPort _INIT(11988);
+WLED_GLOBAL byte audioSyncVersion _INIT(1);         // packet version to transmit, 2 only once all receivers run firmware that reads it
+WLED_GLOBAL byte audioSyncExtBins _INIT(0);         // number of raw FFT bins appended to version 2 packets (0 = none)
 
 // network
 WLED_GLOBAL bool udpConnected _INIT(false), udp2Connected _INIT(false), udpRgbConnected _INIT(false), udpSyncConnected _INIT(false);
+WLED_GLOBAL unsigned long lastNodeListRefresh _INIT(0);
 
 // ui style
 WLED_GLOBAL bool showWelcomePage _INIT(false);
@@ -597,18 +608,28 @@ WLED_GLOBAL uint16_t olen _INIT(0);
 WLED_GLOBAL size_t fsBytesUsed _INIT(0);
 WLED_GLOBAL size_t fsBytesTotal _INIT(0);
 WLED_GLOBAL unsigned long presetsModifiedTime _INIT(0L);
+WLED_GLOBAL uint16_t cfgWrites _INIT(0);        // cfg.json writes since boot
+WLED_GLOBAL uint16_t cfgWriteTime _INIT(0);     // ms the last cfg.json write took
+WLED_GLOBAL uint16_t cfgWriteTimeMax _INIT(0);
 WLED_GLOBAL JsonDocument* fileDoc;
 WLED_GLOBAL bool doCloseFile _INIT(false);
 
 // presets
 WLED_GLOBAL int16_t currentPreset _INIT(-1);
 
+// reproducible rendering of the current segments into /render.bin (tools/fx_render.py)
+WLED_GLOBAL uint16_t renderFrames _INIT(0);    // requested by the JSON API, rendered by the loop
+WLED_GLOBAL uint16_t renderFrameMs _INIT(FRAMETIME);
+WLED_GLOBAL uint16_t renderSeed _INIT(1);
+WLED_GLOBAL uint32_t renderId _INIT(0);        // written to the file header, tells the requests apart
+
 WLED_GLOBAL byte errorFlag _INIT(0);
 
 WLED_GLOBAL String messageHead, messageSub;
 WLED_GLOBAL byte optionType;
 
 WLED_GLOBAL bool doReboot _INIT(false);        // flag to initiate reboot from async handlers
+WLED_GLOBAL int8_t loadLedmap _INIT(-1);       // LED map to load in the loop, set by async handlers
 WLED_GLOBAL bool doPublishMqtt _INIT(false);
 
 // server library objects
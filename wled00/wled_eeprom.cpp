@@ -400,7 +400,7 @@ void applyMacro(byte index) {
 
 // De-EEPROM routine, upgrade from previous versions to v0.11
 void deEEP() {
-  if (WLED_FS.exists("/presets.json")) return;
+  if (WLED_FS.exists("/presets.json") || WLED_FS.exists("/presets.log")) return;
 
   DEBUG_PRINTLN(F("Preset file not found, attempting to load from EEPROM"));
   DEBUGFS_PRINTLN(F("Allocating saving buffer for dEEP"));
@@ -0,0 +1,43 @@
+#ifndef WLED_LOCK_H
+#define WLED_LOCK_H
+
+/*
+ * Lock for data shared by the loop and the async TCP task (web server, websockets, MQTT),
+ * which run concurrently on ESP32. The same task may take it again while holding it.
+ * On ESP8266 async callbacks only run between loop() iterations, so there is nothing to lock.
+ * Hold it for copies and pointer swaps, not for file writes or while waiting for the other task.
+ */
+
+#ifdef ARDUINO_ARCH_ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#endif
+
+class WledLock
+{
+  public:
+  #ifdef ARDUINO_ARCH_ESP32
+  WledLock() { _mutex = xSemaphoreCreateRecursiveMutex(); }
+  inline void lock()    { xSemaphoreTakeRecursive(_mutex, portMAX_DELAY); }
+  inline void unlock()  { xSemaphoreGiveRecursive(_mutex); }
+
+  private:
+  SemaphoreHandle_t _mutex;
+  #else
+  inline void lock()    {}
+  inline void unlock()  {}
+  #endif
+};
+
+//holds the lock until the end of the scope
+class WledLockGuard
+{
+  public:
+  WledLockGuard(WledLock& lock) : _lock(lock) { _lock.lock(); }
+  ~WledLockGuard() { _lock.unlock(); }
+
+  private:
+  WledLock& _lock;
+};
+
+#endif // WLED_LOCK_H
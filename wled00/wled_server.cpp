@@ -32,6 +32,132 @@ bool captivePortal(AsyncWebServerRequest *request)
   return false;
 }
 
+#ifdef WLED_ENABLE_FS_EDITOR
+//never handles a request, only sees uploads and deletes going to the FS editor so cached file ETags get invalidated
+class FileChangeHandler : public AsyncWebHandler {
+  public:
+    bool canHandle(AsyncWebServerRequest *request) override {
+      if (request->method() == HTTP_GET || !request->url().startsWith(F("/edit"))) return false;
+      fileChanged(); //the path is in the request body, drop all
+      request->onDisconnect([](){ fileChanged(); }); //again once the upload is written
+      return false;
+    }
+};
+#endif
+
+/*
+ * Admission control for JSON API requests
+ *
+ * Every request that parses or builds a JSON_BUFFER_SIZE document is counted while it holds the memory:
+ * a pooled parse buffer (POST /json, WebSocket, MQTT) until the state is applied, a /json response until
+ * it was sent. Past JSON_MAX_REQUESTS, or when the heap can't take another buffer, HTTP requests get a
+ * 503 with Retry-After instead of an allocation that could fail. Requests are counted in the async TCP
+ * task only. On ESP32 a parse buffer is kept for the next request (a WebSocket client sends one per
+ * change), and handleJsonPool() frees it from the loop after JSON_POOL_IDLE ms without use.
+ */
+
+static DynamicJsonDocument* jsonPool[JSON_POOL_SIZE] = {nullptr};
+static bool jsonPoolUsed[JSON_POOL_SIZE] = {false};
+static unsigned long jsonPoolLastUse = 0;
+static WledLock jsonPoolLock;
+static volatile uint8_t jsonRequests = 0;
+static uint8_t jsonRequestsMax = 0;
+static uint16_t jsonRejected = 0;
+
+//a request that allocates a buffer would get 503 now
+static bool jsonBusy(bool allocates = true) {
+  return jsonRequests >= JSON_MAX_REQUESTS || (allocates && ESP.getFreeHeap() < JSON_BUFFER_SIZE + JSON_HEAP_RESERVE);
+}
+
+static bool admitJson(bool allocates) {
+  if (jsonBusy(allocates)) {
+    jsonRejected++;
+    return false;
+  }
+  jsonRequests++;
+  if (jsonRequests > jsonRequestsMax) jsonRequestsMax = jsonRequests;
+  return true;
+}
+
+static void sendBusy(AsyncWebServerRequest* request) {
+  if (!request) return;
+  AsyncWebServerResponse *response = request->beginResponse(503, "application/json", F("{\"error\":\"busy\"}"));
+  response->addHeader(F("Retry-After"), F("1"));
+  request->send(response);
+}
+
+//counts the request until it is disconnected, or answers it with 503
+bool admitRequest(AsyncWebServerRequest* request) {
+  if (!admitJson(true)) {
+    sendBusy(request);
+    return false;
+  }
+  request->onDisconnect([](){ if (jsonRequests) jsonRequests--; });
+  return true;
+}
+
+//returns an empty JSON_BUFFER_SIZE document from the pool, or nullptr after answering request with 503
+DynamicJsonDocument* acquireJsonBuffer(AsyncWebServerRequest* request) {
+  WledLockGuard guard(jsonPoolLock);
+  int8_t slot = -1; //an unused allocated buffer needs no heap, an unallocated slot only if there is none
+  for (uint8_t i = 0; i < JSON_POOL_SIZE; i++) {
+    if (jsonPoolUsed[i]) continue;
+    if (jsonPool[i]) { slot = i; break; }
+    if (slot < 0) slot = i;
+  }
+  if (slot >= 0 && admitJson(!jsonPool[slot])) {
+    if (!jsonPool[slot]) jsonPool[slot] = new DynamicJsonDocument(JSON_BUFFER_SIZE);
+    if (jsonPool[slot]->capacity()) {
+      jsonPoolUsed[slot] = true;
+      return jsonPool[slot];
+    }
+    delete jsonPool[slot]; //allocation failed
+    jsonPool[slot] = nullptr;
+    jsonRequests--;
+    jsonRejected++;
+  }
+  sendBusy(request);
+  return nullptr;
+}
+
+void releaseJsonBuffer(DynamicJsonDocument* doc) {
+  WledLockGuard guard(jsonPoolLock);
+  for (uint8_t i = 0; i < JSON_POOL_SIZE; i++) {
+    if (jsonPool[i] != doc) continue;
+    #ifdef ESP8266
+    delete jsonPool[i]; //not enough heap to keep it
+    jsonPool[i] = nullptr;
+    #else
+    doc->clear();
+    jsonPoolLastUse = millis();
+    #endif
+    jsonPoolUsed[i] = false;
+    if (jsonRequests) jsonRequests--;
+    return;
+  }
+}
+
+//frees the parse buffers once they were not used for a while
+void handleJsonPool() {
+  #ifndef ESP8266
+  if (millis() - jsonPoolLastUse < JSON_POOL_IDLE) return;
+  WledLockGuard guard(jsonPoolLock);
+  for (uint8_t i = 0; i < JSON_POOL_SIZE; i++) {
+    if (!jsonPool[i] || jsonPoolUsed[i]) continue;
+    delete jsonPool[i];
+    jsonPool[i] = nullptr;
+  }
+  jsonPoolLastUse = millis(); //look again after another JSON_POOL_IDLE
+  #endif
+}
+
+void serializeRequestStats(JsonObject root) {
+  JsonObject req = root.createNestedObject(F("req"));
+  req["n"] = jsonRequests;
+  req[F("max")] = jsonRequestsMax;
+  req[F("rej")] = jsonRejected;
+}
+
 void initServer()
 {
   //CORS compatiblity
@@ -85,28 +211,45 @@ void initServer()
   AsyncCallbackJsonWebHandler* handler = new AsyncCallbackJsonWebHandler("/json", [](AsyncWebServerRequest *request) {
     bool verboseResponse = false;
     bool isConfig = false;
-    { //scope JsonDocument so it releases its buffer
-      DynamicJsonDocument jsonBuffer(JSON_BUFFER_SIZE);
-      DeserializationError error = deserializeJson(jsonBuffer, (uint8_t*)(request->_tempObject));
-      JsonObject root = jsonBuffer.as<JsonObject>();
+    byte staged = BATCH_INVALID;
+    uint16_t sections = 0;
+    {
+      DynamicJsonDocument* jsonBuffer = acquireJsonBuffer(request);
+      if (!jsonBuffer) return;
+      DeserializationError error = deserializeJson(*jsonBuffer, (uint8_t*)(request->_tempObject));
+      JsonObject root = jsonBuffer->as<JsonObject>();
       if (error || root.isNull()) {
+        releaseJsonBuffer(jsonBuffer);
         request->send(400, "application/json", F("{\"error\":9}")); return;
       }
       const String& url = request->url();
       isConfig = url.indexOf("cfg") > -1;
-      if (!isConfig) {
-        fileDoc = &jsonBuffer;
+      bool batch = url.indexOf(F("batch")) > 0;
+      if (!isConfig && (batch || root[F("tx")])) staged = stageState(root);
+      if (staged == BATCH_BUSY || (batch && staged == BATCH_INVALID)) {
+        releaseJsonBuffer(jsonBuffer);
+        if (staged == BATCH_BUSY) sendBusy(request);
+        else request->send(400, "application/json", F("{\"error\":\"batch\"}"));
+        return;
+      }
+      if (staged == BATCH_STAGED) {
+        //applied all at once by the loop, nothing to respond with yet
+      } else if (!isConfig) { //a "tx" state that can't be batched is applied right away
+        fileDoc = jsonBuffer;
         verboseResponse = deserializeState(root);
         fileDoc = nullptr;
       } else {
         verboseResponse = deserializeConfig(root); //use verboseResponse to determine whether cfg change should be saved immediately
+        sections = getConfigSections(root);
       }
+      releaseJsonBuffer(jsonBuffer);
     }
     if (verboseResponse) {
       if (!isConfig) {
-        serveJson(request); return; //if JSON contains "v"
+        //the state is applied, a 503 would make the client send it again, so answer without it
+        if (!jsonBusy()) { serveJson(request); return; } //if JSON contains "v"
       } else {
-        serializeConfig(); //Save new settings to FS
+        serializeConfig(sections); //Save new settings to FS
       }
     }
     request->send(200, "application/json", F("{\"success\":true}"));
@@ -140,6 +283,7 @@ void initServer()
   //if OTA is allowed
   if (!otaLock){
     #ifdef WLED_ENABLE_FS_EDITOR
+     server.addHandler(new FileChangeHandler());
      #ifdef ARDUINO_ARCH_ESP32
       server.addHandler(new SPIFFSEditor(WLED_FS));//http_username,http_password));
      #else
@@ -0,0 +1,137 @@
+#include "wled.h"
+
+/*
+ * Deferred filesystem writes
+ *
+ * Settings and presets are not written when they change but queued here: a write is a callback that
+ * writes the file from what is in RAM when it runs. Queueing the same callback again before it ran
+ * only moves it back (and ORs its argument), so a burst of changes ends in a single write. Writes run
+ * in the loop once nothing was queued for WRITEBACK_DELAY ms, and only right after a frame was shown
+ * or while the LEDs are idle, so the milliseconds a flash write blocks don't delay a frame. A write
+ * that was put off for WRITEBACK_MAX_DELAY ms runs regardless.
+ *
+ * Every file write is counted per file for /json/info, see serializeWriteStats().
+ *
+ * Writes are queued by the async web server too (settings, presets), concurrently with the loop on
+ * ESP32. writeLock covers the queue and the stats; a write is taken out of the queue under it and run
+ * after releasing it, so the callback may queue again.
+ */
+
+typedef struct WriteBackEntry {
+  WriteBackFn write;                 // nullptr = free
+  uint16_t arg;
+  unsigned long first;               // millis() when queued
+  unsigned long last;                // millis() when queued again
+} WriteBackEntry;
+
+typedef struct WriteStats {
+  char file[16];
+  uint16_t writes;
+  uint32_t bytes;
+} WriteStats;
+
+static WriteBackEntry writeQueue[WRITEBACK_SLOTS];
+static WriteStats writeStats[WRITEBACK_STATS];
+static uint16_t writesCoalesced = 0;
+static WledLock writeLock;
+
+static WriteStats* getWriteStats(const char* file) {
+  for (uint8_t i = 0; i < WRITEBACK_STATS; i++) {
+    if (!writeStats[i].file[0]) {
+      strlcpy(writeStats[i].file, file, sizeof(writeStats[i].file));
+      return &writeStats[i];
+    }
+    if (!strncmp(writeStats[i].file, file, sizeof(writeStats[i].file) -1)) return &writeStats[i];
+  }
+  return nullptr;
+}
+
+//the LEDs have time for a write: a frame was just shown, or none was shown for a while (static or off)
+bool writeSlack() {
+  uint32_t sinceShow = strip.fxMillis() - strip.getLastShow();
+  return sinceShow < 2 || sinceShow > 2 * FRAMETIME;
+}
+
+void queueWrite(WriteBackFn write, uint16_t arg) {
+  {
+    WledLockGuard guard(writeLock);
+    WriteBackEntry* slot = nullptr;
+    for (uint8_t i = 0; i < WRITEBACK_SLOTS; i++) {
+      WriteBackEntry& e = writeQueue[i];
+      if (e.write == write) {
+        e.arg |= arg;
+        e.last = millis();
+        writesCoalesced++;
+        return;
+      }
+      if (!e.write && !slot) slot = &e;
+    }
+    if (slot) {
+      slot->write = write;
+      slot->arg = arg;
+      slot->first = slot->last = millis();
+      return;
+    }
+  }
+  write(arg); //queue full, write now
+}
+
+void countWrite(const char* file, uint32_t bytes) {
+  fileChanged(file);
+  WledLockGuard guard(writeLock);
+  WriteStats* s = getWriteStats(file);
+  if (!s) return;
+  s->writes++;
+  s->bytes += bytes;
+}
+
+//runs all queued writes, or drops them (factory reset)
+void flushWrites(bool write) {
+  for (uint8_t i = 0; i < WRITEBACK_SLOTS; i++) {
+    WriteBackEntry& e = writeQueue[i];
+    writeLock.lock();
+    WriteBackFn fn = e.write;
+    uint16_t arg = e.arg;
+    e.write = nullptr;
+    writeLock.unlock();
+    if (fn && write) fn(arg);
+  }
+}
+
+//one due write per loop
+void handleWriteBack() {
+  unsigned long now = millis();
+  bool slack = writeSlack();
+  WriteBackFn fn = nullptr;
+  uint16_t arg = 0;
+  writeLock.lock();
+  for (uint8_t i = 0; i < WRITEBACK_SLOTS; i++) {
+    WriteBackEntry& e = writeQueue[i];
+    if (!e.write) continue;
+    bool overdue = now - e.first > WRITEBACK_MAX_DELAY;
+    if (!overdue && (now - e.last < WRITEBACK_DELAY || !slack)) continue;
+
+    fn = e.write;
+    arg = e.arg;
+    e.write = nullptr;
+    break;
+  }
+  writeLock.unlock();
+  if (!fn) return;
+  fn(arg);
+  DEBUGFS_PRINTF("Write-back took %d ms\n", millis() - now);
+}
+
+void serializeWriteStats(JsonObject fs) {
+  JsonObject wr = fs.createNestedObject(F("wr"));
+  WledLockGuard guard(writeLock);
+  uint8_t queued = 0;
+  for (uint8_t i = 0; i < WRITEBACK_SLOTS; i++) if (writeQueue[i].write) queued++;
+  wr[F("q")] = queued;
+  wr[F("coal")] = writesCoalesced;
+  for (uint8_t i = 0; i < WRITEBACK_STATS && writeStats[i].file[0]; i++) {
+    JsonArray file = wr.createNestedArray(writeStats[i].file); //writes, bytes
+    file.add(writeStats[i].writes);
+    file.add(writeStats[i].bytes);
+  }
+}
@@ -27,11 +27,15 @@ void wsEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventTyp
       if(info->opcode == WS_TEXT)
       {
         bool verboseResponse = false;
-        { //scope JsonDocument so it releases its buffer
-          DynamicJsonDocument jsonBuffer(JSON_BUFFER_SIZE);
-          DeserializationError error = deserializeJson(jsonBuffer, data, len);
-          JsonObject root = jsonBuffer.as<JsonObject>();
-          if (error || root.isNull()) return;
+        {
+          DynamicJsonDocument* jsonBuffer = acquireJsonBuffer(); //busy: dropped, the UI sends its full state with the next change
+          if (!jsonBuffer) return;
+          DeserializationError error = deserializeJson(*jsonBuffer, data, len);
+          JsonObject root = jsonBuffer->as<JsonObject>();
+          if (error || root.isNull()) {
+            releaseJsonBuffer(jsonBuffer);
+            return;
+          }
 
           if (root["v"] && root.size() == 1) {
             //if the received value is just "{"v":true}", send only to this client
@@ -40,7 +44,7 @@ void wsEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventTyp
           {
             wsLiveClientId = root["lv"] ? client->id() : 0;
           } else {
-            fileDoc = &jsonBuffer;
+            fileDoc = jsonBuffer;
             verboseResponse = deserializeState(root);
             fileDoc = nullptr;
             if (!interfaceUpdateCallMode) {
@@ -48,9 +52,12 @@ void wsEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventTyp
               if (millis() - lastInterfaceUpdate > 1700) verboseResponse = false;
             }
           }
+          releaseJsonBuffer(jsonBuffer);
         }
         //update if it takes longer than 300ms until next "broadcast"
         if (verboseResponse && (millis() - lastInterfaceUpdate < 1700 || !interfaceUpdateCallMode)) sendDataWs(client);
+      } else if(info->opcode == WS_BINARY) {
+        handleBinApi(data, len);
       }
     } else {
       //message is comprised of multiple frames or the frame is split into multiple packets